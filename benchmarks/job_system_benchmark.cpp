@@ -0,0 +1,148 @@
+// Scaling benchmark for JobSystem, running the frame's per-instance work (interpolating the angles and computing the
+// bounds, chunked like record_frame() does) and a graph of small dependent jobs, on 1 to N threads.
+//
+// There is no build target for this, compile it alongside the helpers, with optimisations, e.g. (on one line)
+//     g++ -O2 -std=c++17 -pthread -I. -I<glm include dir> -I<imgui include dir> benchmarks/job_system_benchmark.cpp
+//         helpers/JobSystem.cpp helpers/BatchTransform.cpp helpers/CpuProfiler.cpp helpers/imgui/ImGuiReadouts.cpp
+//         <imgui sources> -o job_system_benchmark
+// and run it with an optional object count (default 1000000) and most threads (default the hardware threads).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../helpers/BatchTransform.h"
+#include "../helpers/JobSystem.h"
+
+// The number of times each variant is run, the best time is reported
+const int REPEATS = 20;
+// The same chunk size as main.cpp's INSTANCE_CHUNK_SIZE
+const size_t CHUNK_SIZE = 16384;
+// The graph is this many layers of this many jobs, each layer depending on the whole layer before it
+const int GRAPH_LAYERS = 64;
+const int GRAPH_WIDTH = 32;
+// How many iterations of busy work each of the graph's jobs does, a few microseconds' worth
+const int GRAPH_JOB_WORK = 2000;
+
+template<typename F>
+static double best_time_ms(F&& function) {
+    double best = 1e30;
+    for (int i = 0; i < REPEATS; i++) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+// Some work the compiler can't remove, standing in for a small job
+static float busy_work(int iterations, float seed) {
+    float value = seed;
+    for (int i = 0; i < iterations; i++) {
+        value = std::sin(value) + 1.0f;
+    }
+    return value;
+}
+
+// Run the graph: each layer is a job that splits into its jobs as children, so it only finishes once they all have, and
+// only starts once the layer before it has finished
+static void run_graph(JobSystem& jobs, std::atomic<float>& sink) {
+    JobCounter done;
+    // A job can't see its own handle, so each layer looks it up here to make its jobs its children
+    JobHandle layers[GRAPH_LAYERS];
+    for (int layer = 0; layer < GRAPH_LAYERS; layer++) {
+        layers[layer] = jobs.create([&jobs, &sink, &layers, layer] {
+            for (int i = 0; i < GRAPH_WIDTH; i++) {
+                jobs.submit(jobs.create([&sink, layer, i] {
+                    float value = busy_work(GRAPH_JOB_WORK, (float) (layer * GRAPH_WIDTH + i));
+                    float expected = sink.load(std::memory_order_relaxed);
+                    while (!sink.compare_exchange_weak(expected, expected + value, std::memory_order_relaxed)) {
+                    }
+                }, nullptr, layers[layer]));
+            }
+        }, &done);
+        if (layer > 0) {
+            jobs.add_dependency(layers[layer], layers[layer - 1]);
+        }
+    }
+    // Only submitted once they are all created, as a layer's job reads the handles
+    for (JobHandle layer : layers) {
+        jobs.submit(layer);
+    }
+    jobs.wait(done);
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    int max_threads = argc > 2 ? std::atoi(argv[2]) : (int) std::max(1u, std::thread::hardware_concurrency());
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> angle_distribution(0.0f, 2.0f * (float) M_PI);
+    TransformBatch batch;
+    batch.resize(count);
+    std::vector<float> previous_x(count);
+    std::vector<float> previous_y(count);
+    std::vector<float> current_x(count);
+    std::vector<float> current_y(count);
+    for (size_t i = 0; i < count; i++) {
+        previous_x[i] = angle_distribution(random);
+        previous_y[i] = angle_distribution(random);
+        current_x[i] = previous_x[i] + 0.01f;
+        current_y[i] = previous_y[i] + 0.01f;
+        batch.scale[i] = 0.001f;
+        batch.position_x[i] = (float) (i % 1000) * 0.002f - 1.0f;
+        batch.position_y[i] = (float) (i / 1000) * 0.002f - 1.0f;
+    }
+    BoundsBatch bounds;
+    bounds.resize(count);
+    size_t chunk_count = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    std::cout << "Objects: " << count << " in " << chunk_count << " chunks, graph of " << GRAPH_LAYERS << " x "
+              << GRAPH_WIDTH << " jobs" << std::endl;
+    std::cout << "threads   frame ms  speedup  efficiency   graph ms  speedup  efficiency  stolen" << std::endl;
+
+    double frame_baseline = 0.0;
+    double graph_baseline = 0.0;
+    std::atomic<float> sink{0.0f};
+    for (int threads = 1; threads <= max_threads; threads++) {
+        // The thread waiting for the jobs is one of them
+        JobSystem jobs;
+        jobs.start(threads - 1);
+
+        double frame_ms = best_time_ms([&] {
+            jobs.parallel_for(chunk_count, [&](size_t chunk) {
+                size_t begin = chunk * CHUNK_SIZE;
+                size_t end = std::min(count, begin + CHUNK_SIZE);
+                BatchTransform::interpolate_angles(previous_x.data() + begin, current_x.data() + begin, 0.5f,
+                                                   batch.angle_x.data() + begin, end - begin);
+                BatchTransform::interpolate_angles(previous_y.data() + begin, current_y.data() + begin, 0.5f,
+                                                   batch.angle_y.data() + begin, end - begin);
+                BatchTransform::write_bounds(batch, bounds, begin, end);
+            }, 1);
+        });
+        JobSystemStats before = jobs.get_stats();
+        double graph_ms = best_time_ms([&] { run_graph(jobs, sink); });
+        JobSystemStats after = jobs.get_stats();
+
+        if (threads == 1) {
+            frame_baseline = frame_ms;
+            graph_baseline = graph_ms;
+        }
+        double frame_speedup = frame_baseline / frame_ms;
+        double graph_speedup = graph_baseline / graph_ms;
+        std::cout << std::fixed << std::setprecision(3) << std::setw(7) << threads
+                  << std::setw(11) << frame_ms << std::setw(8) << frame_speedup << "x" << std::setw(11) << 100.0 * frame_speedup / threads << "%"
+                  << std::setw(11) << graph_ms << std::setw(8) << graph_speedup << "x" << std::setw(11) << 100.0 * graph_speedup / threads << "%"
+                  << std::setw(8) << (after.jobs_stolen - before.jobs_stolen) / REPEATS << std::endl;
+    }
+    // Printed so that the graph's work can't be optimised away
+    std::cout << "Checksum: " << sink.load() << std::endl;
+}
@@ -0,0 +1,131 @@
+// Microbenchmark comparing BatchTransform against the per-object glm code that draw() used to run.
+//
+// There is no build target for this, compile it alongside the helper, with optimisations, e.g.
+//     g++ -O2 -std=c++17 -I. -I<glm include dir> benchmarks/transform_benchmark.cpp helpers/BatchTransform.cpp -o transform_benchmark
+// and run it with an optional object count (default 100000).
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../helpers/BatchTransform.h"
+
+// The number of times each variant is run, the best time is reported
+const int REPEATS = 50;
+
+// The original code from draw(), applied to each object in turn
+static void glm_per_object(std::vector<glm::vec3>& angles, const std::vector<glm::vec3>& speeds, const TransformBatch& batch,
+                           float delta, glm::vec3 rotation_speed, InstanceTransform* out) {
+    for (size_t i = 0; i < angles.size(); i++) {
+        glm::vec3& rotation_angles = angles[i];
+        rotation_angles += delta * rotation_speed * speeds[i];
+        rotation_angles = glm::mod(rotation_angles, 2.0f * (float) M_PI);
+
+        auto x_angle = rotation_angles.x;
+        glm::mat3 x_rotation = glm::mat3(
+                {1.0f, 0.0f, 0.0f},
+                {0.0f, std::cos(x_angle), std::sin(x_angle)},
+                {0.0f, -std::sin(x_angle), std::cos(x_angle)}
+        );
+        auto y_angle = rotation_angles.y;
+        glm::mat3 y_rotation = glm::mat3(
+                {std::cos(y_angle), 0.0, -std::sin(y_angle)},
+                {0.0f, 1.0f, 0.0f},
+                {std::sin(y_angle), 0.0, std::cos(y_angle)}
+        );
+        glm::mat3 shrink_x = glm::mat3(
+                {0.25f, 0.0f, 0.0f},
+                {0.0f, 1.0f, 0.0f},
+                {0.0f, 0.0f, 1.0f}
+        );
+        glm::mat3 combined_matrix = y_rotation * x_rotation * shrink_x * batch.scale[i];
+
+        // glm is column major, so transpose into the rows the instance buffer expects
+        glm::vec3 position{batch.position_x[i], batch.position_y[i], batch.position_z[i]};
+        for (int row = 0; row < 3; row++) {
+            out[i].rows[row] = {combined_matrix[0][row], combined_matrix[1][row], combined_matrix[2][row], position[row]};
+        }
+    }
+}
+
+template<typename F>
+static double best_time_ms(F&& function) {
+    double best = 1e30;
+    for (int i = 0; i < REPEATS; i++) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    const float delta = 1.0f / 60.0f;
+    const glm::vec3 rotation_speed{1.0f};
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> angle_distribution(0.0f, 2.0f * (float) M_PI);
+    std::uniform_real_distribution<float> speed_distribution(0.5f, 1.5f);
+
+    TransformBatch batch;
+    batch.resize(count);
+    std::vector<glm::vec3> angles(count);
+    std::vector<glm::vec3> speeds(count);
+    for (size_t i = 0; i < count; i++) {
+        batch.angle_x[i] = angles[i].x = angle_distribution(random);
+        batch.angle_y[i] = angles[i].y = angle_distribution(random);
+        batch.speed_x[i] = speeds[i].x = speed_distribution(random);
+        batch.speed_y[i] = speeds[i].y = speed_distribution(random);
+        batch.scale[i] = 0.5f;
+        batch.position_x[i] = (float) i;
+    }
+
+    std::vector<InstanceTransform> reference(count);
+    std::vector<InstanceTransform> output(count);
+
+    // Check that every path agrees with glm after one step, before timing anything
+    glm_per_object(angles, speeds, batch, delta, rotation_speed, reference.data());
+    TransformBatch initial = batch;
+    float worst_error = 0.0f;
+    for (auto path : {BatchTransform::Path::Scalar, BatchTransform::Path::SSE2, BatchTransform::Path::AVX2}) {
+        if (!BatchTransform::set_path(path)) {
+            continue;
+        }
+        batch = initial;
+        BatchTransform::advance(batch, delta, rotation_speed);
+        BatchTransform::write_transforms(batch, output.data());
+        for (size_t i = 0; i < count; i++) {
+            for (int row = 0; row < 3; row++) {
+                for (int column = 0; column < 4; column++) {
+                    worst_error = std::max(worst_error, std::abs(output[i].rows[row][column] - reference[i].rows[row][column]));
+                }
+            }
+        }
+    }
+    std::cout << "Objects: " << count << ", max abs error vs glm: " << worst_error << std::endl;
+
+    auto glm_time = best_time_ms([&] {
+        glm_per_object(angles, speeds, batch, delta, rotation_speed, output.data());
+    });
+    std::cout << "glm per object: " << glm_time << " ms (" << 1e6 * glm_time / (double) count << " ns/object)" << std::endl;
+
+    for (auto path : {BatchTransform::Path::Scalar, BatchTransform::Path::SSE2, BatchTransform::Path::AVX2}) {
+        if (!BatchTransform::set_path(path)) {
+            std::cout << BatchTransform::get_path_name(path) << ": not supported" << std::endl;
+            continue;
+        }
+        auto time = best_time_ms([&] {
+            BatchTransform::advance(batch, delta, rotation_speed);
+            BatchTransform::write_transforms(batch, output.data());
+        });
+        std::cout << BatchTransform::get_path_name(path) << ": " << time << " ms (" << 1e6 * time / (double) count
+                  << " ns/object, " << glm_time / time << "x)" << std::endl;
+    }
+}
@@ -0,0 +1,135 @@
+// Microbenchmark for converting vertices from the float layout to the compact ones, which first checks that the packed
+// attributes decode back to what was packed, within their precision.
+//
+// There is no build target for this, compile it with optimisations, e.g.
+//     g++ -O2 -std=c++17 -I. -I<glm include dir> -I<glad include dir> benchmarks/vertex_format_benchmark.cpp -o vertex_format_benchmark
+// and run it with an optional vertex count (default 1000000). It exits with a failure if a check fails.
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../helpers/VertexFormat.h"
+
+// The number of times each conversion is run, the best time is reported
+const int REPEATS = 20;
+
+template<typename F>
+static double best_time_ms(F&& function) {
+    double best = 1e30;
+    for (int repeat = 0; repeat < REPEATS; repeat++) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+// How GL before 4.2 decodes a 10 bit signed normalised integer, which the shaders get on a GL 4.1 context
+static float decode_snorm10_gl41(uint32_t packed, int component) {
+    auto value = (int32_t) (packed << (22 - 10 * component)) >> 22;
+    return (2.0f * (float) value + 1.0f) / 1023.0f;
+}
+
+// Pack every normal and decode it again, the way GL 4.2+ and GL 4.1 do, returning whether every component is within
+// half a step of the unit normal
+static bool check_normals(const std::vector<glm::vec3>& normals) {
+    float worst_error = 0.0f;
+    float worst_error_gl41 = 0.0f;
+    for (glm::vec3 normal : normals) {
+        glm::vec3 unit = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f);
+        uint32_t packed = pack_normal(normal);
+        glm::vec3 decoded = unpack_normal(packed);
+        for (int component = 0; component < 3; component++) {
+            worst_error = std::max(worst_error, std::abs(decoded[component] - unit[component]));
+            worst_error_gl41 = std::max(worst_error_gl41, std::abs(decode_snorm10_gl41(packed, component) - unit[component]));
+        }
+        // The unused bits must be 0, GL reads them as the 4th component
+        if (packed >> 30 != 0) {
+            std::cout << "Normal packed with its top 2 bits set" << std::endl;
+            return false;
+        }
+    }
+
+    // Half a step of rounding, plus a little for the float arithmetic
+    const float tolerance = 0.5f / 511.0f + 1e-6f;
+    // (2c + 1) / 1023 differs from c / 511 by up to 2/1023, at c = -511
+    const float tolerance_gl41 = tolerance + 2.0f / 1023.0f;
+    std::cout << "Normals: " << normals.size() << ", max abs error " << worst_error << " (tolerance " << tolerance
+              << "), decoded as GL 4.1 does " << worst_error_gl41 << " (tolerance " << tolerance_gl41 << ")" << std::endl;
+    return worst_error <= tolerance && worst_error_gl41 <= tolerance_gl41;
+}
+
+// Pack every vertex as a CompactVertex and decode the position again, returning whether it's within half precision
+static bool check_positions(const std::vector<Vertex>& vertices) {
+    float worst_error = 0.0f;
+    for (const Vertex& vertex : vertices) {
+        CompactVertex compact = CompactVertex::from(vertex);
+        glm::vec3 decoded = unpack_position(compact.position);
+        for (int component = 0; component < 3; component++) {
+            worst_error = std::max(worst_error, std::abs(decoded[component] - vertex.position[component]));
+        }
+    }
+    // The positions are within [-1, 1], where half floats have 11 bits of precision
+    const float tolerance = 0.0005f;
+    std::cout << "Positions: " << vertices.size() << ", max abs error " << worst_error << " (tolerance " << tolerance << ")" << std::endl;
+    return worst_error <= tolerance;
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::mt19937 random{42};
+    std::uniform_real_distribution<float> unit_distribution{-1.0f, 1.0f};
+    std::uniform_real_distribution<float> colour_distribution{0.0f, 1.0f};
+    std::vector<Vertex> vertices(count);
+    std::vector<glm::vec3> normals(count);
+    for (size_t i = 0; i < count; i++) {
+        vertices[i].position = {unit_distribution(random), unit_distribution(random), unit_distribution(random)};
+        vertices[i].colour = {colour_distribution(random), colour_distribution(random), colour_distribution(random)};
+        // Not normalised, pack_normal() does that
+        normals[i] = {unit_distribution(random), unit_distribution(random), unit_distribution(random)};
+    }
+
+    // The edge cases: the axes, where a component is exactly 1 or -1, and a degenerate normal
+    std::vector<glm::vec3> normals_to_check = normals;
+    for (glm::vec3 axis : {glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1)}) {
+        normals_to_check.push_back(axis);
+        normals_to_check.push_back(-axis);
+    }
+    normals_to_check.emplace_back(0.0f);
+
+    bool passed = check_normals(normals_to_check);
+    passed = check_positions(vertices) && passed;
+    if (!passed) {
+        std::cout << "Round trip check failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<CompactVertex> compact(count);
+    auto compact_time = best_time_ms([&] {
+        for (size_t i = 0; i < count; i++) {
+            compact[i] = CompactVertex::from(vertices[i]);
+        }
+    });
+    std::cout << "CompactVertex: " << compact_time << " ms (" << 1e6 * compact_time / (double) count << " ns/vertex), "
+              << sizeof(Vertex) << " -> " << sizeof(CompactVertex) << " bytes" << std::endl;
+
+    std::vector<CompactLitVertex> compact_lit(count);
+    auto compact_lit_time = best_time_ms([&] {
+        for (size_t i = 0; i < count; i++) {
+            compact_lit[i] = CompactLitVertex::from(vertices[i], normals[i]);
+        }
+    });
+    std::cout << "CompactLitVertex: " << compact_lit_time << " ms (" << 1e6 * compact_lit_time / (double) count
+              << " ns/vertex), " << sizeof(Vertex) + sizeof(glm::vec3) << " -> " << sizeof(CompactLitVertex) << " bytes"
+              << std::endl;
+    return EXIT_SUCCESS;
+}
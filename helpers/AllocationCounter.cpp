@@ -0,0 +1,147 @@
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Constant initialised, so they are usable by allocations made before main(), and from any thread
+static std::atomic<uint64_t> total_allocations{0};
+static std::atomic<uint64_t> total_frees{0};
+static std::atomic<uint64_t> total_bytes{0};
+static thread_local AllocationCounts thread_counts;
+
+static void count_allocation(size_t size) {
+    total_allocations.fetch_add(1, std::memory_order_relaxed);
+    total_bytes.fetch_add(size, std::memory_order_relaxed);
+    thread_counts.allocations++;
+    thread_counts.bytes += size;
+}
+
+static void count_free(void* pointer) {
+    if (pointer) {
+        total_frees.fetch_add(1, std::memory_order_relaxed);
+        thread_counts.frees++;
+    }
+}
+
+// What the standard's operator new does: retry after calling the new handler, if there is one, until it succeeds
+static void* allocate_or_throw(size_t size, size_t alignment) {
+    // Zero sized allocations still have to return distinct pointers
+    size = std::max<size_t>(size, 1);
+    while (true) {
+        void* pointer = nullptr;
+        if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            pointer = std::malloc(size);
+        } else {
+#if defined(_WIN32)
+            pointer = _aligned_malloc(size, alignment);
+#else
+            if (posix_memalign(&pointer, alignment, size) != 0) {
+                pointer = nullptr;
+            }
+#endif
+        }
+        if (pointer) {
+            count_allocation(size);
+            return pointer;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+static void* allocate_or_null(size_t size, size_t alignment) noexcept {
+    try {
+        return allocate_or_throw(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+static void free_allocation(void* pointer, size_t alignment) noexcept {
+    count_free(pointer);
+#if defined(_WIN32)
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        _aligned_free(pointer);
+        return;
+    }
+#else
+    (void) alignment;
+#endif
+    std::free(pointer);
+}
+
+// Every replaceable form, the sized and nothrow ones included, as the library's own would bypass the counts
+void* operator new(size_t size) { return allocate_or_throw(size, 0); }
+void* operator new[](size_t size) { return allocate_or_throw(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate_or_null(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate_or_null(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocate_or_throw(size, (size_t) alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocate_or_throw(size, (size_t) alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate_or_null(size, (size_t) alignment);
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate_or_null(size, (size_t) alignment);
+}
+
+void operator delete(void* pointer) noexcept { free_allocation(pointer, 0); }
+void operator delete[](void* pointer) noexcept { free_allocation(pointer, 0); }
+void operator delete(void* pointer, size_t) noexcept { free_allocation(pointer, 0); }
+void operator delete[](void* pointer, size_t) noexcept { free_allocation(pointer, 0); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { free_allocation(pointer, 0); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { free_allocation(pointer, 0); }
+void operator delete(void* pointer, std::align_val_t alignment) noexcept { free_allocation(pointer, (size_t) alignment); }
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept { free_allocation(pointer, (size_t) alignment); }
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept { free_allocation(pointer, (size_t) alignment); }
+void operator delete[](void* pointer, size_t, std::align_val_t alignment) noexcept { free_allocation(pointer, (size_t) alignment); }
+void operator delete(void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    free_allocation(pointer, (size_t) alignment);
+}
+void operator delete[](void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    free_allocation(pointer, (size_t) alignment);
+}
+
+AllocationCounts AllocationCounter::get_counts() {
+    return {total_allocations.load(std::memory_order_relaxed), total_frees.load(std::memory_order_relaxed),
+            total_bytes.load(std::memory_order_relaxed)};
+}
+
+AllocationCounts AllocationCounter::get_thread_counts() {
+    return thread_counts;
+}
+
+void* AllocationCounter::allocate(size_t size, void*) {
+    void* pointer = std::malloc(size);
+    if (pointer) {
+        count_allocation(size);
+    }
+    return pointer;
+}
+
+void AllocationCounter::deallocate(void* pointer, void*) {
+    count_free(pointer);
+    std::free(pointer);
+}
+
+void FrameAllocationTracker::end_frame() {
+    AllocationCounts counts = AllocationCounter::get_counts();
+    uint64_t thread_allocations = AllocationCounter::get_thread_counts().allocations;
+    last_frame = {counts.allocations - frame_start.allocations, counts.frees - frame_start.frees,
+                  counts.bytes - frame_start.bytes};
+    last_frame_thread_allocations = thread_allocations - frame_start_thread_allocations;
+    frame_start = counts;
+    frame_start_thread_allocations = thread_allocations;
+
+    history[next] = last_frame.allocations;
+    next = (next + 1) % HISTORY_SIZE;
+    frames_without_allocations = last_frame.allocations == 0 ? frames_without_allocations + 1 : 0;
+}
+
+uint64_t FrameAllocationTracker::get_peak_allocations() const {
+    return *std::max_element(history, history + HISTORY_SIZE);
+}
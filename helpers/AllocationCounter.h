@@ -0,0 +1,57 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/// Running totals of heap allocations
+struct AllocationCounts {
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0;
+};
+
+/// Counts every heap allocation made through operator new, which AllocationCounter.cpp replaces (so linking it in is
+/// all it takes), as well as those made through allocate()/deallocate() by libraries that take their own allocator,
+/// such as ImGUI. malloc() itself isn't counted.
+///
+/// The counts are relaxed atomics, so they cost a few uncontended increments per allocation.
+class AllocationCounter {
+public:
+    /// The counts of every thread since the program started
+    static AllocationCounts get_counts();
+    /// The counts of the calling thread since it started
+    static AllocationCounts get_thread_counts();
+
+    /// Counted malloc() and free(), in the form ImGui::SetAllocatorFunctions() takes
+    static void* allocate(size_t size, void* user_data);
+    static void deallocate(void* pointer, void* user_data);
+};
+
+/// Turns the running counts into the allocations made during each frame, by every thread and by the one calling
+/// end_frame(), which should be called once a frame on the same thread.
+class FrameAllocationTracker {
+public:
+    /// The number of frames get_peak_allocations() is over
+    static const int HISTORY_SIZE = 120;
+
+    void end_frame();
+
+    [[nodiscard]] const AllocationCounts& get_last_frame() const { return last_frame; }
+    [[nodiscard]] uint64_t get_last_frame_thread_allocations() const { return last_frame_thread_allocations; }
+    /// The most allocations made in one of the last HISTORY_SIZE frames
+    [[nodiscard]] uint64_t get_peak_allocations() const;
+    /// How many frames in a row have made no allocations at all
+    [[nodiscard]] uint64_t get_frames_without_allocations() const { return frames_without_allocations; }
+
+private:
+    AllocationCounts frame_start;
+    uint64_t frame_start_thread_allocations = 0;
+    AllocationCounts last_frame;
+    uint64_t last_frame_thread_allocations = 0;
+    uint64_t history[HISTORY_SIZE]{};
+    int next = 0;
+    uint64_t frames_without_allocations = 0;
+};
+
+#endif //ALLOCATION_COUNTER_H
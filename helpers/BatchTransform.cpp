@@ -0,0 +1,447 @@
+#include "BatchTransform.h"
+
+#include <cmath>
+#include <cstdint>
+
+// The SIMD paths are only built for x86-64, where SSE2 is always available. Other architectures
+// (e.g. Apple Silicon) use the scalar path.
+#if defined(__x86_64__) || defined(_M_X64)
+#define BATCH_TRANSFORM_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang need to be told that a function may use AVX2 and FMA instructions, since we don't compile the
+// whole program for them. MSVC lets any function use them.
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define TARGET_AVX2
+#endif
+
+static const float TWO_PI = 6.28318530717958647692f;
+// The same constant shrink of the x axis that draw() has always applied, in model space
+static const float SHRINK_X = 0.25f;
+
+void TransformBatch::resize(size_t count) {
+    for (auto* array : {&angle_x, &angle_y, &speed_x, &speed_y, &scale, &position_x, &position_y, &position_z}) {
+        array->resize(count, 0.0f);
+    }
+}
+
+void BoundsBatch::resize(size_t count) {
+    for (auto* array : {&centre_x, &centre_y, &centre_z, &extent_x, &extent_y, &extent_z}) {
+        array->resize(count, 0.0f);
+    }
+}
+
+// Scalar versions, used as the fallback and for the tail of the arrays that doesn't fill a whole SIMD register
+
+static void advance_scalar(float* angles, const float* speeds, size_t begin, size_t end, float step) {
+    for (size_t i = begin; i < end; i++) {
+        angles[i] = glm::mod(angles[i] + step * speeds[i], TWO_PI);
+    }
+}
+
+static void write_transforms_scalar(const TransformBatch& batch, InstanceTransform* out, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        float cos_x = std::cos(batch.angle_x[i]);
+        float sin_x = std::sin(batch.angle_x[i]);
+        float cos_y = std::cos(batch.angle_y[i]);
+        float sin_y = std::sin(batch.angle_y[i]);
+        float scale = batch.scale[i];
+
+        // The rows of y_rotation * x_rotation * shrink_x * scale, with the translation in w
+        out[i].rows[0] = {SHRINK_X * scale * cos_y, scale * sin_y * sin_x, scale * sin_y * cos_x, batch.position_x[i]};
+        out[i].rows[1] = {0.0f, scale * cos_x, -scale * sin_x, batch.position_y[i]};
+        out[i].rows[2] = {-SHRINK_X * scale * sin_y, scale * cos_y * sin_x, scale * cos_y * cos_x, batch.position_z[i]};
+    }
+}
+
+// The extent of a transformed box along each axis is the sum of the absolute values of that row of the matrix (times
+// the box's own extent), see write_transforms_scalar() for the rows
+static void write_bounds_scalar(const TransformBatch& batch, BoundsBatch& bounds, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        float cos_x = std::abs(std::cos(batch.angle_x[i]));
+        float sin_x = std::abs(std::sin(batch.angle_x[i]));
+        float cos_y = std::abs(std::cos(batch.angle_y[i]));
+        float sin_y = std::abs(std::sin(batch.angle_y[i]));
+        float half_scale = 0.5f * batch.scale[i];
+
+        bounds.centre_x[i] = batch.position_x[i];
+        bounds.centre_y[i] = batch.position_y[i];
+        bounds.centre_z[i] = batch.position_z[i];
+        bounds.extent_x[i] = half_scale * (SHRINK_X * cos_y + sin_y * (sin_x + cos_x));
+        bounds.extent_y[i] = half_scale * (cos_x + sin_x);
+        bounds.extent_z[i] = half_scale * (SHRINK_X * sin_y + cos_y * (sin_x + cos_x));
+    }
+}
+
+#ifdef BATCH_TRANSFORM_X86
+
+// Constants for the sincos approximation, from Cephes' sinf/cosf. The angle is reduced to [-pi/4, pi/4] by
+// subtracting a multiple of pi/2, which is split into 3 parts so that the subtraction stays exact (Cody-Waite).
+static const float TWO_OVER_PI = 0.636619772367581343076f;
+static const float PI_OVER_2_PART_1 = 1.5703125f;
+static const float PI_OVER_2_PART_2 = 4.837512969970703125e-4f;
+static const float PI_OVER_2_PART_3 = 7.54978995489188216e-8f;
+static const float SIN_COEFFICIENT_1 = -1.6666654611e-1f;
+static const float SIN_COEFFICIENT_2 = 8.3321608736e-3f;
+static const float SIN_COEFFICIENT_3 = -1.9515295891e-4f;
+static const float COS_COEFFICIENT_1 = 4.166664568298827e-2f;
+static const float COS_COEFFICIENT_2 = -1.388731625493765e-3f;
+static const float COS_COEFFICIENT_3 = 2.443315711809948e-5f;
+
+// Transpose one row component-wise for 4 objects (each argument holds one component of 4 objects) into the
+// row of each object, and store them. Streaming stores avoid reading the destination into the cache, which
+// matters when writing to a mapped GL buffer, but need 16 byte alignment.
+template<bool Stream>
+static inline void store_row_sse(InstanceTransform* out, int row, __m128 x, __m128 y, __m128 z, __m128 w) {
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    if (Stream) {
+        _mm_stream_ps(&out[0].rows[row].x, x);
+        _mm_stream_ps(&out[1].rows[row].x, y);
+        _mm_stream_ps(&out[2].rows[row].x, z);
+        _mm_stream_ps(&out[3].rows[row].x, w);
+    } else {
+        _mm_storeu_ps(&out[0].rows[row].x, x);
+        _mm_storeu_ps(&out[1].rows[row].x, y);
+        _mm_storeu_ps(&out[2].rows[row].x, z);
+        _mm_storeu_ps(&out[3].rows[row].x, w);
+    }
+}
+
+template<bool Stream>
+static inline void store_transforms_sse(InstanceTransform* out, __m128 cos_x, __m128 sin_x, __m128 cos_y, __m128 sin_y,
+                                        __m128 scale, __m128 position_x, __m128 position_y, __m128 position_z) {
+    __m128 shrunk_scale = _mm_mul_ps(scale, _mm_set1_ps(SHRINK_X));
+    __m128 scaled_cos_x = _mm_mul_ps(scale, cos_x);
+    __m128 scaled_sin_x = _mm_mul_ps(scale, sin_x);
+
+    store_row_sse<Stream>(out, 0, _mm_mul_ps(shrunk_scale, cos_y), _mm_mul_ps(sin_y, scaled_sin_x),
+                          _mm_mul_ps(sin_y, scaled_cos_x), position_x);
+    store_row_sse<Stream>(out, 1, _mm_setzero_ps(), scaled_cos_x, _mm_sub_ps(_mm_setzero_ps(), scaled_sin_x), position_y);
+    store_row_sse<Stream>(out, 2, _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(shrunk_scale, sin_y)), _mm_mul_ps(cos_y, scaled_sin_x),
+                          _mm_mul_ps(cos_y, scaled_cos_x), position_z);
+}
+
+// SSE2 has no floor instruction, so truncate and correct the negative values that were rounded up
+static inline __m128 floor_sse2(__m128 x) {
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+}
+
+// Compute the sine and cosine of 4 angles in [0, 2pi)
+static inline void sincos_sse2(__m128 x, __m128* sin_out, __m128* cos_out) {
+    __m128i quadrant = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI)), _mm_set1_ps(0.5f)));
+    __m128 quadrant_f = _mm_cvtepi32_ps(quadrant);
+
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(quadrant_f, _mm_set1_ps(PI_OVER_2_PART_1)));
+    r = _mm_sub_ps(r, _mm_mul_ps(quadrant_f, _mm_set1_ps(PI_OVER_2_PART_2)));
+    r = _mm_sub_ps(r, _mm_mul_ps(quadrant_f, _mm_set1_ps(PI_OVER_2_PART_3)));
+    __m128 z = _mm_mul_ps(r, r);
+
+    __m128 sin_r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_COEFFICIENT_3), z), _mm_set1_ps(SIN_COEFFICIENT_2));
+    sin_r = _mm_add_ps(_mm_mul_ps(sin_r, z), _mm_set1_ps(SIN_COEFFICIENT_1));
+    sin_r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sin_r, z), r), r);
+
+    __m128 cos_r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_COEFFICIENT_3), z), _mm_set1_ps(COS_COEFFICIENT_2));
+    cos_r = _mm_add_ps(_mm_mul_ps(cos_r, z), _mm_set1_ps(COS_COEFFICIENT_1));
+    cos_r = _mm_mul_ps(_mm_mul_ps(cos_r, z), z);
+    cos_r = _mm_add_ps(_mm_sub_ps(cos_r, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+    // In odd quadrants sin and cos swap, then the sign of sin flips in quadrants 2 and 3, and cos in 1 and 2
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+    __m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+    __m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+
+    __m128 sin_value = _mm_or_ps(_mm_and_ps(swap, cos_r), _mm_andnot_ps(swap, sin_r));
+    __m128 cos_value = _mm_or_ps(_mm_and_ps(swap, sin_r), _mm_andnot_ps(swap, cos_r));
+    *sin_out = _mm_xor_ps(sin_value, sin_sign);
+    *cos_out = _mm_xor_ps(cos_value, cos_sign);
+}
+
+static size_t advance_sse2(float* angles, const float* speeds, size_t count, float step) {
+    __m128 step_v = _mm_set1_ps(step);
+    __m128 two_pi = _mm_set1_ps(TWO_PI);
+    __m128 inverse_two_pi = _mm_set1_ps(1.0f / TWO_PI);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 angle = _mm_add_ps(_mm_loadu_ps(angles + i), _mm_mul_ps(step_v, _mm_loadu_ps(speeds + i)));
+        angle = _mm_sub_ps(angle, _mm_mul_ps(two_pi, floor_sse2(_mm_mul_ps(angle, inverse_two_pi))));
+        _mm_storeu_ps(angles + i, angle);
+    }
+    return i;
+}
+
+template<bool Stream>
+static size_t write_transforms_sse2(const TransformBatch& batch, InstanceTransform* out) {
+    size_t count = batch.size();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 sin_x, cos_x, sin_y, cos_y;
+        sincos_sse2(_mm_loadu_ps(&batch.angle_x[i]), &sin_x, &cos_x);
+        sincos_sse2(_mm_loadu_ps(&batch.angle_y[i]), &sin_y, &cos_y);
+        store_transforms_sse<Stream>(out + i, cos_x, sin_x, cos_y, sin_y, _mm_loadu_ps(&batch.scale[i]),
+                                     _mm_loadu_ps(&batch.position_x[i]), _mm_loadu_ps(&batch.position_y[i]),
+                                     _mm_loadu_ps(&batch.position_z[i]));
+    }
+    return i;
+}
+
+static inline __m128 abs_sse(__m128 x) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+static size_t write_bounds_sse2(const TransformBatch& batch, BoundsBatch& bounds, size_t begin, size_t end) {
+    __m128 shrink_x = _mm_set1_ps(SHRINK_X);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 sin_x, cos_x, sin_y, cos_y;
+        sincos_sse2(_mm_loadu_ps(&batch.angle_x[i]), &sin_x, &cos_x);
+        sincos_sse2(_mm_loadu_ps(&batch.angle_y[i]), &sin_y, &cos_y);
+        sin_x = abs_sse(sin_x);
+        cos_x = abs_sse(cos_x);
+        sin_y = abs_sse(sin_y);
+        cos_y = abs_sse(cos_y);
+        __m128 half_scale = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_loadu_ps(&batch.scale[i]));
+        __m128 sum_x = _mm_add_ps(sin_x, cos_x);
+
+        _mm_storeu_ps(&bounds.centre_x[i], _mm_loadu_ps(&batch.position_x[i]));
+        _mm_storeu_ps(&bounds.centre_y[i], _mm_loadu_ps(&batch.position_y[i]));
+        _mm_storeu_ps(&bounds.centre_z[i], _mm_loadu_ps(&batch.position_z[i]));
+        _mm_storeu_ps(&bounds.extent_x[i], _mm_mul_ps(half_scale, _mm_add_ps(_mm_mul_ps(shrink_x, cos_y), _mm_mul_ps(sin_y, sum_x))));
+        _mm_storeu_ps(&bounds.extent_y[i], _mm_mul_ps(half_scale, sum_x));
+        _mm_storeu_ps(&bounds.extent_z[i], _mm_mul_ps(half_scale, _mm_add_ps(_mm_mul_ps(shrink_x, sin_y), _mm_mul_ps(cos_y, sum_x))));
+    }
+    return i;
+}
+
+// The AVX2 versions do 8 objects at a time, and use FMA for the polynomials
+
+TARGET_AVX2 static inline void sincos_avx2(__m256 x, __m256* sin_out, __m256* cos_out) {
+    __m256i quadrant = _mm256_cvttps_epi32(_mm256_fmadd_ps(x, _mm256_set1_ps(TWO_OVER_PI), _mm256_set1_ps(0.5f)));
+    __m256 quadrant_f = _mm256_cvtepi32_ps(quadrant);
+
+    __m256 r = _mm256_fnmadd_ps(quadrant_f, _mm256_set1_ps(PI_OVER_2_PART_1), x);
+    r = _mm256_fnmadd_ps(quadrant_f, _mm256_set1_ps(PI_OVER_2_PART_2), r);
+    r = _mm256_fnmadd_ps(quadrant_f, _mm256_set1_ps(PI_OVER_2_PART_3), r);
+    __m256 z = _mm256_mul_ps(r, r);
+
+    __m256 sin_r = _mm256_fmadd_ps(_mm256_set1_ps(SIN_COEFFICIENT_3), z, _mm256_set1_ps(SIN_COEFFICIENT_2));
+    sin_r = _mm256_fmadd_ps(sin_r, z, _mm256_set1_ps(SIN_COEFFICIENT_1));
+    sin_r = _mm256_fmadd_ps(_mm256_mul_ps(sin_r, z), r, r);
+
+    __m256 cos_r = _mm256_fmadd_ps(_mm256_set1_ps(COS_COEFFICIENT_3), z, _mm256_set1_ps(COS_COEFFICIENT_2));
+    cos_r = _mm256_fmadd_ps(cos_r, z, _mm256_set1_ps(COS_COEFFICIENT_1));
+    cos_r = _mm256_mul_ps(_mm256_mul_ps(cos_r, z), z);
+    cos_r = _mm256_add_ps(_mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), cos_r), _mm256_set1_ps(1.0f));
+
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+    __m256 sin_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30));
+    __m256 cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+
+    *sin_out = _mm256_xor_ps(_mm256_blendv_ps(sin_r, cos_r, swap), sin_sign);
+    *cos_out = _mm256_xor_ps(_mm256_blendv_ps(cos_r, sin_r, swap), cos_sign);
+}
+
+TARGET_AVX2 static size_t advance_avx2(float* angles, const float* speeds, size_t count, float step) {
+    __m256 step_v = _mm256_set1_ps(step);
+    __m256 two_pi = _mm256_set1_ps(TWO_PI);
+    __m256 inverse_two_pi = _mm256_set1_ps(1.0f / TWO_PI);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 angle = _mm256_fmadd_ps(step_v, _mm256_loadu_ps(speeds + i), _mm256_loadu_ps(angles + i));
+        angle = _mm256_fnmadd_ps(two_pi, _mm256_floor_ps(_mm256_mul_ps(angle, inverse_two_pi)), angle);
+        _mm256_storeu_ps(angles + i, angle);
+    }
+    return i;
+}
+
+template<bool Stream>
+TARGET_AVX2 static size_t write_transforms_avx2(const TransformBatch& batch, InstanceTransform* out) {
+    size_t count = batch.size();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 sin_x, cos_x, sin_y, cos_y;
+        sincos_avx2(_mm256_loadu_ps(&batch.angle_x[i]), &sin_x, &cos_x);
+        sincos_avx2(_mm256_loadu_ps(&batch.angle_y[i]), &sin_y, &cos_y);
+        __m256 scale = _mm256_loadu_ps(&batch.scale[i]);
+        __m256 position_x = _mm256_loadu_ps(&batch.position_x[i]);
+        __m256 position_y = _mm256_loadu_ps(&batch.position_y[i]);
+        __m256 position_z = _mm256_loadu_ps(&batch.position_z[i]);
+
+        // The stores are a transpose to AoS either way, so reuse the 4 wide version on each half
+        store_transforms_sse<Stream>(out + i, _mm256_castps256_ps128(cos_x), _mm256_castps256_ps128(sin_x),
+                                     _mm256_castps256_ps128(cos_y), _mm256_castps256_ps128(sin_y),
+                                     _mm256_castps256_ps128(scale), _mm256_castps256_ps128(position_x),
+                                     _mm256_castps256_ps128(position_y), _mm256_castps256_ps128(position_z));
+        store_transforms_sse<Stream>(out + i + 4, _mm256_extractf128_ps(cos_x, 1), _mm256_extractf128_ps(sin_x, 1),
+                                     _mm256_extractf128_ps(cos_y, 1), _mm256_extractf128_ps(sin_y, 1),
+                                     _mm256_extractf128_ps(scale, 1), _mm256_extractf128_ps(position_x, 1),
+                                     _mm256_extractf128_ps(position_y, 1), _mm256_extractf128_ps(position_z, 1));
+    }
+    return i;
+}
+
+TARGET_AVX2 static inline __m256 abs_avx(__m256 x) {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+}
+
+TARGET_AVX2 static size_t write_bounds_avx2(const TransformBatch& batch, BoundsBatch& bounds, size_t begin, size_t end) {
+    __m256 shrink_x = _mm256_set1_ps(SHRINK_X);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 sin_x, cos_x, sin_y, cos_y;
+        sincos_avx2(_mm256_loadu_ps(&batch.angle_x[i]), &sin_x, &cos_x);
+        sincos_avx2(_mm256_loadu_ps(&batch.angle_y[i]), &sin_y, &cos_y);
+        sin_x = abs_avx(sin_x);
+        cos_x = abs_avx(cos_x);
+        sin_y = abs_avx(sin_y);
+        cos_y = abs_avx(cos_y);
+        __m256 half_scale = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_loadu_ps(&batch.scale[i]));
+        __m256 sum_x = _mm256_add_ps(sin_x, cos_x);
+
+        // Unlike the transforms, the bounds are stored as arrays, so there's no transpose and no need to split
+        _mm256_storeu_ps(&bounds.centre_x[i], _mm256_loadu_ps(&batch.position_x[i]));
+        _mm256_storeu_ps(&bounds.centre_y[i], _mm256_loadu_ps(&batch.position_y[i]));
+        _mm256_storeu_ps(&bounds.centre_z[i], _mm256_loadu_ps(&batch.position_z[i]));
+        _mm256_storeu_ps(&bounds.extent_x[i], _mm256_mul_ps(half_scale, _mm256_fmadd_ps(shrink_x, cos_y, _mm256_mul_ps(sin_y, sum_x))));
+        _mm256_storeu_ps(&bounds.extent_y[i], _mm256_mul_ps(half_scale, sum_x));
+        _mm256_storeu_ps(&bounds.extent_z[i], _mm256_mul_ps(half_scale, _mm256_fmadd_ps(shrink_x, sin_y, _mm256_mul_ps(cos_y, sum_x))));
+    }
+    return i;
+}
+
+static bool cpu_supports_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool fma = info[2] & (1 << 12);
+    bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    bool avx2 = info[1] & (1 << 5);
+    return avx2 && fma && os_saves_ymm;
+#else
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#endif // BATCH_TRANSFORM_X86
+
+bool BatchTransform::is_supported(Path path) {
+    switch (path) {
+        case Path::Scalar:
+            return true;
+#ifdef BATCH_TRANSFORM_X86
+        case Path::SSE2:
+            return true;
+        case Path::AVX2: {
+            static const bool supported = cpu_supports_avx2();
+            return supported;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+static BatchTransform::Path detect_path() {
+    if (BatchTransform::is_supported(BatchTransform::Path::AVX2)) {
+        return BatchTransform::Path::AVX2;
+    }
+    if (BatchTransform::is_supported(BatchTransform::Path::SSE2)) {
+        return BatchTransform::Path::SSE2;
+    }
+    return BatchTransform::Path::Scalar;
+}
+
+static BatchTransform::Path current_path = detect_path();
+
+BatchTransform::Path BatchTransform::get_path() {
+    return current_path;
+}
+
+bool BatchTransform::set_path(Path path) {
+    if (!is_supported(path)) {
+        return false;
+    }
+    current_path = path;
+    return true;
+}
+
+const char* BatchTransform::get_path_name(Path path) {
+    switch (path) {
+        case Path::Scalar:
+            return "Scalar";
+        case Path::SSE2:
+            return "SSE2";
+        case Path::AVX2:
+            return "AVX2";
+    }
+    return "Unknown";
+}
+
+void BatchTransform::advance(TransformBatch& batch, float delta, glm::vec3 global_speed) {
+    size_t count = batch.size();
+    float step_x = delta * global_speed.x;
+    float step_y = delta * global_speed.y;
+
+    size_t done = 0;
+#ifdef BATCH_TRANSFORM_X86
+    if (current_path == Path::AVX2) {
+        done = advance_avx2(batch.angle_x.data(), batch.speed_x.data(), count, step_x);
+        advance_avx2(batch.angle_y.data(), batch.speed_y.data(), count, step_y);
+    } else if (current_path == Path::SSE2) {
+        done = advance_sse2(batch.angle_x.data(), batch.speed_x.data(), count, step_x);
+        advance_sse2(batch.angle_y.data(), batch.speed_y.data(), count, step_y);
+    }
+#endif
+    advance_scalar(batch.angle_x.data(), batch.speed_x.data(), done, count, step_x);
+    advance_scalar(batch.angle_y.data(), batch.speed_y.data(), done, count, step_y);
+}
+
+void BatchTransform::interpolate_angles(const float* previous, const float* current, float alpha, float* out, size_t count) {
+    // Written without branches, so that the compiler vectorises it for whatever the baseline instruction set is
+    const float PI = 0.5f * TWO_PI;
+    for (size_t i = 0; i < count; i++) {
+        float difference = current[i] - previous[i];
+        difference -= difference > PI ? TWO_PI : 0.0f;
+        difference += difference < -PI ? TWO_PI : 0.0f;
+        float angle = previous[i] + alpha * difference;
+        angle -= angle >= TWO_PI ? TWO_PI : 0.0f;
+        angle += angle < 0.0f ? TWO_PI : 0.0f;
+        out[i] = angle;
+    }
+}
+
+void BatchTransform::write_transforms(const TransformBatch& batch, InstanceTransform* out) {
+    size_t done = 0;
+#ifdef BATCH_TRANSFORM_X86
+    bool aligned = ((uintptr_t) out & 15) == 0;
+    if (current_path == Path::AVX2) {
+        done = aligned ? write_transforms_avx2<true>(batch, out) : write_transforms_avx2<false>(batch, out);
+    } else if (current_path == Path::SSE2) {
+        done = aligned ? write_transforms_sse2<true>(batch, out) : write_transforms_sse2<false>(batch, out);
+    }
+    if (aligned && done > 0) {
+        // Make the streaming stores visible before the buffer is unmapped
+        _mm_sfence();
+    }
+#endif
+    write_transforms_scalar(batch, out, done, batch.size());
+}
+
+void BatchTransform::write_bounds(const TransformBatch& batch, BoundsBatch& bounds, size_t begin, size_t end) {
+    size_t done = begin;
+#ifdef BATCH_TRANSFORM_X86
+    if (current_path == Path::AVX2) {
+        done = write_bounds_avx2(batch, bounds, begin, end);
+    } else if (current_path == Path::SSE2) {
+        done = write_bounds_sse2(batch, bounds, begin, end);
+    }
+#endif
+    write_bounds_scalar(batch, bounds, done, end);
+}
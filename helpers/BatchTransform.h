@@ -0,0 +1,81 @@
+#ifndef BATCH_TRANSFORM_H
+#define BATCH_TRANSFORM_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+/// The animation state of a batch of objects, stored as a structure of arrays so that the kernels
+/// in BatchTransform can process several objects per instruction.
+struct TransformBatch {
+    /// Rotation angles about the x and y axes, kept wrapped to [0, 2pi)
+    std::vector<float> angle_x;
+    std::vector<float> angle_y;
+    /// Per-object rotation speeds, multiplied by the batch wide speed passed to BatchTransform::advance
+    std::vector<float> speed_x;
+    std::vector<float> speed_y;
+    /// Uniform scale and translation of each object
+    std::vector<float> scale;
+    std::vector<float> position_x;
+    std::vector<float> position_y;
+    std::vector<float> position_z;
+
+    /// Resize all the arrays, keeping the existing objects. New objects are zero initialised.
+    void resize(size_t count);
+    [[nodiscard]] size_t size() const { return angle_x.size(); }
+};
+
+/// Axis aligned bounding boxes of a batch of objects, as a structure of arrays so that they can be tested 4 at a time.
+/// Each box is its centre plus and minus its extent (half its size) along each axis.
+struct BoundsBatch {
+    std::vector<float> centre_x;
+    std::vector<float> centre_y;
+    std::vector<float> centre_z;
+    std::vector<float> extent_x;
+    std::vector<float> extent_y;
+    std::vector<float> extent_z;
+
+    void resize(size_t count);
+    [[nodiscard]] size_t size() const { return centre_x.size(); }
+};
+
+/// Batched, vectorised versions of the per-object animation and matrix building that draw() used to do with glm,
+/// with SSE2 and AVX2 (+FMA) kernels and a scalar fallback, picked at runtime based on what the CPU supports.
+class BatchTransform {
+public:
+    enum class Path {
+        Scalar,
+        SSE2,
+        AVX2,
+    };
+
+    /// The path used by advance() and write_transforms(), the fastest one the CPU supports unless overridden.
+    static Path get_path();
+    /// Override the path, e.g. for benchmarking. Returns false (and changes nothing) if the CPU doesn't support it.
+    static bool set_path(Path path);
+    static bool is_supported(Path path);
+    static const char* get_path_name(Path path);
+
+    /// Advance every object's angles by delta * speed * global_speed, wrapping them back to [0, 2pi)
+    /// like glm::mod(angles, 2pi). The z component of global_speed is unused, as there is no z rotation.
+    static void advance(TransformBatch& batch, float delta, glm::vec3 global_speed);
+
+    /// Interpolate angles between two states of a batch, out = previous + alpha * (current - previous), taking the
+    /// shortest way round so that angles which wrapped past 2pi between the states don't spin back the long way.
+    /// The results are in [0, 2pi), out can be the same as previous or current.
+    static void interpolate_angles(const float* previous, const float* current, float alpha, float* out, size_t count);
+
+    /// Build each object's transform, y_rotation * x_rotation * shrink_x scaled and translated, and write them
+    /// packed into out, which can be (and is intended to be) a mapped GL buffer as the writes are sequential
+    /// and bypass the cache when possible.
+    static void write_transforms(const TransformBatch& batch, InstanceTransform* out);
+
+    /// Write the bounds of objects begin to end, the boxes around their models' [-0.5, 0.5] cube once transformed as
+    /// write_transforms() would. bounds must be at least as big as batch. Taking a range lets threads split a batch.
+    static void write_bounds(const TransformBatch& batch, BoundsBatch& bounds, size_t begin, size_t end);
+};
+
+#endif //BATCH_TRANSFORM_H
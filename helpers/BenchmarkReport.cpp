@@ -0,0 +1,389 @@
+#include "BenchmarkReport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Just enough of a JSON document model to read back what write() writes
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    // The member with the key, or null if there isn't one or this isn't an object
+    [[nodiscard]] const JsonValue* find(const std::string& key) const {
+        for (const auto& member : object) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Nesting deeper than this is rejected rather than recursed into, a report is only 3 levels deep
+static const int MAX_JSON_DEPTH = 32;
+
+static void skip_whitespace(const std::string& text, size_t& pos) {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+        pos++;
+    }
+}
+
+static bool parse_string(const std::string& text, size_t& pos, std::string& string) {
+    if (pos >= text.size() || text[pos] != '"') {
+        return false;
+    }
+    pos++;
+    string.clear();
+    while (pos < text.size() && text[pos] != '"') {
+        char c = text[pos++];
+        if (c != '\\') {
+            string += c;
+            continue;
+        }
+        if (pos >= text.size()) {
+            return false;
+        }
+        char escape = text[pos++];
+        switch (escape) {
+            case 'b': string += '\b'; break;
+            case 'f': string += '\f'; break;
+            case 'n': string += '\n'; break;
+            case 'r': string += '\r'; break;
+            case 't': string += '\t'; break;
+            case 'u': {
+                // Only ASCII is ever escaped by write(), anything else is replaced rather than encoded as UTF-8
+                if (pos + 4 > text.size()) {
+                    return false;
+                }
+                long code = std::strtol(text.substr(pos, 4).c_str(), nullptr, 16);
+                string += code < 0x80 ? (char) code : '?';
+                pos += 4;
+                break;
+            }
+            default: string += escape; break;
+        }
+    }
+    if (pos >= text.size()) {
+        return false;
+    }
+    pos++;
+    return true;
+}
+
+static bool parse_value(const std::string& text, size_t& pos, JsonValue& value, int depth) {
+    skip_whitespace(text, pos);
+    if (pos >= text.size() || depth > MAX_JSON_DEPTH) {
+        return false;
+    }
+
+    char c = text[pos];
+    if (c == '{' || c == '[') {
+        bool is_object = c == '{';
+        char close = is_object ? '}' : ']';
+        value.type = is_object ? JsonValue::Type::Object : JsonValue::Type::Array;
+        pos++;
+        skip_whitespace(text, pos);
+        if (pos < text.size() && text[pos] == close) {
+            pos++;
+            return true;
+        }
+        while (true) {
+            JsonValue element;
+            if (is_object) {
+                std::string key;
+                skip_whitespace(text, pos);
+                if (!parse_string(text, pos, key)) {
+                    return false;
+                }
+                skip_whitespace(text, pos);
+                if (pos >= text.size() || text[pos] != ':') {
+                    return false;
+                }
+                pos++;
+                if (!parse_value(text, pos, element, depth + 1)) {
+                    return false;
+                }
+                value.object.emplace_back(std::move(key), std::move(element));
+            } else {
+                if (!parse_value(text, pos, element, depth + 1)) {
+                    return false;
+                }
+                value.array.push_back(std::move(element));
+            }
+
+            skip_whitespace(text, pos);
+            if (pos >= text.size()) {
+                return false;
+            }
+            if (text[pos] == close) {
+                pos++;
+                return true;
+            }
+            if (text[pos] != ',') {
+                return false;
+            }
+            pos++;
+        }
+    }
+    if (c == '"') {
+        value.type = JsonValue::Type::String;
+        return parse_string(text, pos, value.string);
+    }
+    if (text.compare(pos, 4, "true") == 0 || text.compare(pos, 5, "false") == 0) {
+        value.type = JsonValue::Type::Bool;
+        value.boolean = c == 't';
+        pos += value.boolean ? 4 : 5;
+        return true;
+    }
+    if (text.compare(pos, 4, "null") == 0) {
+        pos += 4;
+        return true;
+    }
+
+    const char* start = text.c_str() + pos;
+    char* end;
+    value.type = JsonValue::Type::Number;
+    value.number = std::strtod(start, &end);
+    if (end == start) {
+        return false;
+    }
+    pos += end - start;
+    return true;
+}
+
+static double get_number(const JsonValue& object, const char* key) {
+    const JsonValue* member = object.find(key);
+    return member && member->type == JsonValue::Type::Number ? member->number : 0.0;
+}
+
+static std::string get_string(const JsonValue& object, const char* key) {
+    const JsonValue* member = object.find(key);
+    return member && member->type == JsonValue::Type::String ? member->string : std::string();
+}
+
+static std::string escape_json(const std::string& string) {
+    std::string escaped;
+    for (char c : string) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char) c < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", (unsigned) c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+bool BenchmarkReport::write(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open " << path << " to write the benchmark results" << std::endl;
+        return false;
+    }
+
+    // One line per result, so that the results diff nicely when a baseline is updated
+    file << std::fixed << std::setprecision(4);
+    file << "{\n";
+    file << "  \"renderer\": \"" << escape_json(renderer) << "\",\n";
+    file << "  \"gl_version\": \"" << escape_json(gl_version) << "\",\n";
+    file << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& result = results[i];
+        file << (i == 0 ? "\n" : ",\n");
+        file << "    {\"name\": \"" << escape_json(result.name) << "\", \"instances\": " << result.instances
+             << ", \"subdivisions\": " << result.subdivisions << ", \"vertices\": " << result.vertices
+             << ", \"triangles\": " << result.triangles << ", \"ui\": " << (result.ui ? "true" : "false")
+             << ", \"frames\": " << result.frames
+             << ", \"cpu_p50_ms\": " << result.cpu_p50_ms << ", \"cpu_p95_ms\": " << result.cpu_p95_ms
+             << ", \"cpu_p99_ms\": " << result.cpu_p99_ms << ", \"cpu_max_ms\": " << result.cpu_max_ms
+             << ", \"wall_ms_per_frame\": " << result.wall_ms_per_frame
+             << ", \"gpu_avg_ms\": " << result.gpu_avg_ms << ", \"gpu_p99_ms\": " << result.gpu_p99_ms
+             << ", \"peak_rss_mb\": " << result.peak_rss_mb
+             << ", \"allocations_per_frame\": " << result.allocations_per_frame << "}";
+    }
+    file << "\n  ]\n}\n";
+
+    if (!file) {
+        std::cerr << "Failed to write the benchmark results to " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool BenchmarkReport::read(const std::string& path) {
+    *this = BenchmarkReport{};
+
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open benchmark results " << path << std::endl;
+        return false;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string text = contents.str();
+
+    JsonValue root;
+    size_t pos = 0;
+    const JsonValue* results_array = nullptr;
+    if (parse_value(text, pos, root, 0) && root.type == JsonValue::Type::Object) {
+        results_array = root.find("results");
+    }
+    if (!results_array || results_array->type != JsonValue::Type::Array) {
+        std::cerr << "Failed to parse benchmark results " << path << std::endl;
+        return false;
+    }
+
+    renderer = get_string(root, "renderer");
+    gl_version = get_string(root, "gl_version");
+    for (const JsonValue& object : results_array->array) {
+        BenchmarkResult result;
+        result.name = get_string(object, "name");
+        result.instances = (int) get_number(object, "instances");
+        result.subdivisions = (int) get_number(object, "subdivisions");
+        result.vertices = (size_t) get_number(object, "vertices");
+        result.triangles = (size_t) get_number(object, "triangles");
+        const JsonValue* ui = object.find("ui");
+        result.ui = ui && ui->type == JsonValue::Type::Bool && ui->boolean;
+        result.frames = (int) get_number(object, "frames");
+        result.cpu_p50_ms = get_number(object, "cpu_p50_ms");
+        result.cpu_p95_ms = get_number(object, "cpu_p95_ms");
+        result.cpu_p99_ms = get_number(object, "cpu_p99_ms");
+        result.cpu_max_ms = get_number(object, "cpu_max_ms");
+        result.wall_ms_per_frame = get_number(object, "wall_ms_per_frame");
+        result.gpu_avg_ms = get_number(object, "gpu_avg_ms");
+        result.gpu_p99_ms = get_number(object, "gpu_p99_ms");
+        result.peak_rss_mb = get_number(object, "peak_rss_mb");
+        result.allocations_per_frame = get_number(object, "allocations_per_frame");
+        results.push_back(std::move(result));
+    }
+    return true;
+}
+
+int BenchmarkReport::compare(const BenchmarkReport& baseline, const BenchmarkThresholds& thresholds) const {
+    if (baseline.renderer != renderer) {
+        std::cout << "Warning: the baseline was measured on " << baseline.renderer << ", not " << renderer
+                  << ", so the comparison may not mean much" << std::endl;
+    }
+
+    std::vector<std::string> regressions;
+    std::cout << std::fixed << std::setprecision(3);
+    for (const BenchmarkResult& result : results) {
+        auto base = std::find_if(baseline.results.begin(), baseline.results.end(),
+                                 [&](const BenchmarkResult& other) { return other.name == result.name; });
+        if (base == baseline.results.end()) {
+            std::cout << result.name << ": not in the baseline" << std::endl;
+            continue;
+        }
+
+        std::cout << result.name << ":";
+        // Print the change of a metric, and note it as a regression if it got worse by more than both thresholds. A
+        // zero on either side means the metric wasn't measured (no timer queries), so it is only printed.
+        auto check = [&](const char* metric, double before, double after, const char* unit, double percent,
+                         double minimum, bool gated) {
+            double change = before > 0.0 ? 100.0 * (after - before) / before : 0.0;
+            std::cout << " " << metric << " " << before << " -> " << after << " " << unit << " ("
+                      << std::showpos << std::setprecision(1) << change << std::noshowpos << std::setprecision(3) << "%)";
+            if (gated && before > 0.0 && after > 0.0 && change > percent && after - before > minimum) {
+                std::ostringstream regression;
+                regression << std::fixed << std::setprecision(3) << result.name << ": " << metric << " " << before
+                           << " -> " << after << " " << unit << ", " << std::setprecision(1) << change
+                           << "% worse, the threshold is " << percent << "%";
+                regressions.push_back(regression.str());
+            }
+        };
+        check("cpu p50", base->cpu_p50_ms, result.cpu_p50_ms, "ms", thresholds.cpu_percent, thresholds.min_ms, true);
+        check("cpu p95", base->cpu_p95_ms, result.cpu_p95_ms, "ms", thresholds.cpu_percent, thresholds.min_ms, true);
+        check("cpu p99", base->cpu_p99_ms, result.cpu_p99_ms, "ms", thresholds.cpu_percent, thresholds.min_ms, false);
+        check("gpu avg", base->gpu_avg_ms, result.gpu_avg_ms, "ms", thresholds.gpu_percent, thresholds.min_ms, true);
+        check("peak rss", base->peak_rss_mb, result.peak_rss_mb, "MB", thresholds.rss_percent, thresholds.min_rss_mb, true);
+        check("allocations", base->allocations_per_frame, result.allocations_per_frame, "per frame", 0.0, 0.0, false);
+        std::cout << std::endl;
+    }
+    for (const BenchmarkResult& base : baseline.results) {
+        auto found = std::find_if(results.begin(), results.end(),
+                                  [&](const BenchmarkResult& other) { return other.name == base.name; });
+        if (found == results.end()) {
+            std::cout << base.name << ": in the baseline but not measured by this run" << std::endl;
+        }
+    }
+
+    for (const std::string& regression : regressions) {
+        std::cout << "REGRESSION " << regression << std::endl;
+    }
+    std::cout << regressions.size() << " regressions against the baseline" << std::endl;
+    return (int) regressions.size();
+}
+
+double BenchmarkReport::get_percentile(std::vector<double>& samples, double percent) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto rank = (size_t) std::ceil(percent / 100.0 * (double) samples.size());
+    return samples[std::min(std::max(rank, (size_t) 1), samples.size()) - 1];
+}
+
+bool BenchmarkReport::reset_peak_rss() {
+#if defined(__linux__)
+    // Writing 5 to clear_refs resets the high water mark (VmHWM) to the current resident size, since Linux 4.0
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    clear_refs.close();
+    return (bool) clear_refs;
+#else
+    return false;
+#endif
+}
+
+double BenchmarkReport::get_peak_rss_mb() {
+#if defined(__linux__)
+    // VmHWM follows reset_peak_rss(), unlike getrusage()
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtod(line.c_str() + 6, nullptr) / 1024.0;
+        }
+    }
+#endif
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return (double) counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+    }
+    return 0.0;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    // In bytes on macOS, but kilobytes everywhere else
+    return (double) usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return (double) usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
@@ -0,0 +1,73 @@
+#ifndef BENCHMARK_REPORT_H
+#define BENCHMARK_REPORT_H
+
+#include <string>
+#include <vector>
+
+/// The measurements of one configuration of the benchmark sweep
+struct BenchmarkResult {
+    /// Identifies the configuration, results are matched to the baseline's by it
+    std::string name;
+    int instances = 0;
+    /// How many quads each side of the cube is split into, 0 for a mesh file
+    int subdivisions = 0;
+    size_t vertices = 0;
+    size_t triangles = 0;
+    bool ui = false;
+    int frames = 0;
+
+    /// How long draw() took on the CPU, recording and executing the frame
+    double cpu_p50_ms = 0.0;
+    double cpu_p95_ms = 0.0;
+    double cpu_p99_ms = 0.0;
+    double cpu_max_ms = 0.0;
+    /// The wall time of all the frames, including waiting for the GPU to finish them, divided by the frames
+    double wall_ms_per_frame = 0.0;
+    /// The GPU's time for the whole frame, 0 if the context has no timer queries
+    double gpu_avg_ms = 0.0;
+    double gpu_p99_ms = 0.0;
+    /// The most memory resident at once while the configuration ran, see BenchmarkReport::reset_peak_rss()
+    double peak_rss_mb = 0.0;
+    /// The heap allocations made by every thread, on average per frame, which should be 0
+    double allocations_per_frame = 0.0;
+};
+
+/// How much worse than the baseline a result can be before it counts as a regression, in percent. Differences smaller
+/// than the absolute minimums never count, so that tiny configurations don't fail on timer noise.
+struct BenchmarkThresholds {
+    double cpu_percent = 10.0;
+    double gpu_percent = 10.0;
+    double rss_percent = 10.0;
+    double min_ms = 0.05;
+    double min_rss_mb = 4.0;
+};
+
+/// The results of a benchmark run, which can be written to and read back from JSON, and compared against a baseline
+/// run to find regressions.
+struct BenchmarkReport {
+    /// What the results were measured on, as the baseline is only meaningful for the same renderer
+    std::string renderer;
+    std::string gl_version;
+    std::vector<BenchmarkResult> results;
+
+    /// Write the report as JSON. Returns false if the file can't be written.
+    bool write(const std::string& path) const;
+    /// Read a report written by write(). Returns false, leaving the report empty, if it can't be read or parsed.
+    bool read(const std::string& path);
+
+    /// Print every result next to the baseline's result of the same name, and the regressions beyond the thresholds.
+    /// The CPU time is gated on its p50 and p95 only, the p99 of a short run is too few frames to be stable. The
+    /// allocations are only printed, as the baseline is normally 0. Returns the number of regressions.
+    int compare(const BenchmarkReport& baseline, const BenchmarkThresholds& thresholds) const;
+
+    /// The value below which the given percent of the samples fall (nearest rank), sorting the samples
+    static double get_percentile(std::vector<double>& samples, double percent);
+
+    /// Start measuring the peak resident memory from what is resident now, where the OS allows it (Linux). Otherwise
+    /// the peak is the process's since it started, and only ever grows. Returns false if it couldn't be reset.
+    static bool reset_peak_rss();
+    /// The most memory that has been resident at once, since the last reset_peak_rss() where that is supported
+    static double get_peak_rss_mb();
+};
+
+#endif //BENCHMARK_REPORT_H
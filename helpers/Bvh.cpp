@@ -0,0 +1,173 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <numeric>
+
+// The number of leaves each task refits, enough to make scheduling a task cheap in comparison
+static const size_t LEAVES_PER_TASK = 256;
+
+void Bvh::build(const BoundsBatch& bounds) {
+    auto count = (uint32_t) bounds.size();
+    nodes.clear();
+    leaves.clear();
+    slot_objects.resize(count);
+    std::iota(slot_objects.begin(), slot_objects.end(), 0);
+
+    if (count > 0) {
+        nodes.push_back(BvhNode{{}, {}, 0, count, 0});
+    }
+    std::vector<uint32_t> stack{0};
+    while (!nodes.empty() && !stack.empty()) {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        BvhNode node = nodes[index];
+        if (node.count <= LEAF_SIZE) {
+            leaves.push_back(index);
+            continue;
+        }
+
+        // Split at the median of the objects' centres, along the axis they are most spread out on
+        const std::vector<float>* centres[3] = {&bounds.centre_x, &bounds.centre_y, &bounds.centre_z};
+        float spread[3];
+        for (int axis = 0; axis < 3; axis++) {
+            float low = std::numeric_limits<float>::max();
+            float high = std::numeric_limits<float>::lowest();
+            for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+                float centre = (*centres[axis])[slot_objects[slot]];
+                low = std::min(low, centre);
+                high = std::max(high, centre);
+            }
+            spread[axis] = high - low;
+        }
+        int axis = (int) (std::max_element(spread, spread + 3) - spread);
+        const std::vector<float>& first_centres = *centres[axis];
+        const std::vector<float>& second_centres = *centres[(axis + 1) % 3];
+        const std::vector<float>& third_centres = *centres[(axis + 2) % 3];
+
+        // Rounded up to a whole number of leaves, so that as many leaves as possible are full. Objects level along the
+        // axis (e.g. a column of a grid) are ordered by the other axes, or the ones on the split would be divided
+        // between the halves at random, stretching both of them.
+        uint32_t left_count = (node.count / 2 + LEAF_SIZE - 1) / LEAF_SIZE * LEAF_SIZE;
+        auto begin = slot_objects.begin() + node.first;
+        std::nth_element(begin, begin + left_count, begin + node.count, [&](uint32_t a, uint32_t b) {
+            if (first_centres[a] != first_centres[b]) {
+                return first_centres[a] < first_centres[b];
+            }
+            if (second_centres[a] != second_centres[b]) {
+                return second_centres[a] < second_centres[b];
+            }
+            return third_centres[a] < third_centres[b];
+        });
+
+        auto left = (uint32_t) nodes.size();
+        nodes[index].left = left;
+        nodes.push_back(BvhNode{{}, {}, node.first, left_count, 0});
+        nodes.push_back(BvhNode{{}, {}, node.first + left_count, node.count - left_count, 0});
+        stack.push_back(left + 1);
+        stack.push_back(left);
+    }
+
+    slot_bounds.resize(count);
+    for (uint32_t slot = 0; slot < count; slot++) {
+        uint32_t object = slot_objects[slot];
+        slot_bounds.centre_x[slot] = bounds.centre_x[object];
+        slot_bounds.centre_y[slot] = bounds.centre_y[object];
+        slot_bounds.centre_z[slot] = bounds.centre_z[object];
+        slot_bounds.extent_x[slot] = bounds.extent_x[object];
+        slot_bounds.extent_y[slot] = bounds.extent_y[object];
+        slot_bounds.extent_z[slot] = bounds.extent_z[object];
+    }
+
+    // Children always come after their parents, so going backwards fits every child before its parent
+    for (size_t i = nodes.size(); i-- > 0;) {
+        fit_node(nodes[i]);
+    }
+    node_changed.assign(nodes.size(), 0);
+}
+
+void Bvh::fit_node(BvhNode& node) const {
+    if (node.is_leaf()) {
+        for (int axis = 0; axis < 3; axis++) {
+            node.min[axis] = std::numeric_limits<float>::max();
+            node.max[axis] = std::numeric_limits<float>::lowest();
+        }
+        for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+            float centre[3] = {slot_bounds.centre_x[slot], slot_bounds.centre_y[slot], slot_bounds.centre_z[slot]};
+            float extent[3] = {slot_bounds.extent_x[slot], slot_bounds.extent_y[slot], slot_bounds.extent_z[slot]};
+            for (int axis = 0; axis < 3; axis++) {
+                node.min[axis] = std::min(node.min[axis], centre[axis] - extent[axis]);
+                node.max[axis] = std::max(node.max[axis], centre[axis] + extent[axis]);
+            }
+        }
+        return;
+    }
+
+    const BvhNode& left = nodes[node.left];
+    const BvhNode& right = nodes[node.left + 1];
+    for (int axis = 0; axis < 3; axis++) {
+        node.min[axis] = std::min(left.min[axis], right.min[axis]);
+        node.max[axis] = std::max(left.max[axis], right.max[axis]);
+    }
+}
+
+void Bvh::refit(const BoundsBatch& bounds, JobSystem& jobs) {
+    auto start = std::chrono::steady_clock::now();
+
+    // Copy the new bounds into slot order, and refit the leaves with an object whose bounds changed
+    std::atomic<size_t> objects_changed{0};
+    std::atomic<size_t> leaves_refit{0};
+    size_t task_count = (leaves.size() + LEAVES_PER_TASK - 1) / LEAVES_PER_TASK;
+    const float* sources[6] = {bounds.centre_x.data(), bounds.centre_y.data(), bounds.centre_z.data(),
+                               bounds.extent_x.data(), bounds.extent_y.data(), bounds.extent_z.data()};
+    float* destinations[6] = {slot_bounds.centre_x.data(), slot_bounds.centre_y.data(), slot_bounds.centre_z.data(),
+                              slot_bounds.extent_x.data(), slot_bounds.extent_y.data(), slot_bounds.extent_z.data()};
+    jobs.parallel_for(task_count, [&](size_t task) {
+        size_t task_objects_changed = 0;
+        size_t task_leaves_refit = 0;
+        size_t end = std::min(leaves.size(), (task + 1) * LEAVES_PER_TASK);
+        for (size_t i = task * LEAVES_PER_TASK; i < end; i++) {
+            BvhNode& leaf = nodes[leaves[i]];
+            bool changed = false;
+            for (uint32_t slot = leaf.first; slot < leaf.first + leaf.count; slot++) {
+                uint32_t object = slot_objects[slot];
+                bool object_changed = false;
+                for (int array = 0; array < 6; array++) {
+                    float value = sources[array][object];
+                    object_changed |= destinations[array][slot] != value;
+                    destinations[array][slot] = value;
+                }
+                task_objects_changed += object_changed;
+                changed |= object_changed;
+            }
+            if (changed) {
+                fit_node(leaf);
+                task_leaves_refit++;
+            }
+            node_changed[leaves[i]] = changed;
+        }
+        objects_changed += task_objects_changed;
+        leaves_refit += task_leaves_refit;
+    }, 1);
+
+    // Then the nodes above them. This visits every node, but only refits those with a child that changed.
+    size_t nodes_refit = leaves_refit;
+    for (size_t i = nodes.size(); i-- > 0;) {
+        BvhNode& node = nodes[i];
+        if (node.is_leaf()) {
+            continue;
+        }
+        bool changed = node_changed[node.left] || node_changed[node.left + 1];
+        if (changed) {
+            fit_node(node);
+            nodes_refit++;
+        }
+        node_changed[i] = changed;
+    }
+
+    refit_stats.objects_changed = objects_changed;
+    refit_stats.nodes_refit = nodes_refit;
+    refit_stats.refit_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,73 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "BatchTransform.h"
+#include "JobSystem.h"
+
+/// A node of a Bvh. Every node covers a contiguous run of the hierarchy's slots (its objects, reordered so that each
+/// subtree's are next to each other), so a node that is entirely visible is visible as one range.
+struct BvhNode {
+    float min[3];
+    float max[3];
+    /// The node's first slot, and the number of slots it covers
+    uint32_t first;
+    uint32_t count;
+    /// The index of the left child, the right one is right after it. 0 for leaves, as the root is nobody's child.
+    uint32_t left;
+
+    [[nodiscard]] bool is_leaf() const { return left == 0; }
+};
+
+/// What the last Bvh::refit() did
+struct BvhRefitStats {
+    size_t objects_changed = 0;
+    size_t nodes_refit = 0;
+    double refit_ms = 0.0;
+};
+
+/// A bounding volume hierarchy over a set of objects' axis aligned bounds, so that whole groups of objects can be
+/// accepted or rejected by testing their node.
+///
+/// It's built once for a set of objects (splitting each node at the median of its objects along its longest axis), then
+/// refit as the objects move or rotate: the tree stays the same, only the bounds of the nodes above objects whose
+/// bounds changed are recomputed. That's much cheaper than a rebuild, but the tree gets looser if objects move far
+/// from where they were when it was built, so it should be rebuilt when they are rearranged.
+///
+/// The objects' bounds are kept in slot order as a structure of arrays, so that the objects of a leaf can be tested
+/// 4 at a time.
+class Bvh {
+public:
+    /// The most objects in a leaf, a multiple of 4 for the SIMD tests
+    static const uint32_t LEAF_SIZE = 8;
+
+    /// Build the hierarchy over bounds, replacing what it had before
+    void build(const BoundsBatch& bounds);
+    /// Update the objects' bounds (which must be the same objects as the hierarchy was built with), and the bounds of
+    /// every node above one that changed. Leaves are refit as jobs, in parallel.
+    void refit(const BoundsBatch& bounds, JobSystem& jobs);
+
+    [[nodiscard]] const std::vector<BvhNode>& get_nodes() const { return nodes; }
+    /// The objects' bounds in slot order
+    [[nodiscard]] const BoundsBatch& get_slot_bounds() const { return slot_bounds; }
+    /// The index of the object in each slot
+    [[nodiscard]] const std::vector<uint32_t>& get_slot_objects() const { return slot_objects; }
+    [[nodiscard]] size_t get_object_count() const { return slot_objects.size(); }
+    [[nodiscard]] const BvhRefitStats& get_refit_stats() const { return refit_stats; }
+
+private:
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> leaves;
+    BoundsBatch slot_bounds;
+    std::vector<uint32_t> slot_objects;
+    // Set while refitting for each node whose bounds changed
+    std::vector<uint8_t> node_changed;
+    BvhRefitStats refit_stats;
+
+    void fit_node(BvhNode& node) const;
+};
+
+#endif //BVH_H
@@ -0,0 +1,423 @@
+#include "CaptureWriter.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "CpuProfiler.h"
+
+CaptureWriter::~CaptureWriter() {
+    stop();
+}
+
+CaptureFormat CaptureWriter::get_format(const std::string& path) {
+    const std::string extension = ".y4m";
+    if (path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0) {
+        return CaptureFormat::Y4m;
+    }
+    return CaptureFormat::PngSequence;
+}
+
+bool CaptureWriter::start(const std::string& output_path, CaptureFormat output_format, int frame_width, int frame_height, double frame_rate) {
+    stop();
+    path = output_path;
+    format = output_format;
+    width = frame_width;
+    height = frame_height;
+    fps = frame_rate > 0.0 ? frame_rate : 60.0;
+    frame_index = 0;
+    failed = false;
+
+    if (format == CaptureFormat::Y4m) {
+        stream.open(path, std::ios::binary);
+        if (!stream) {
+            std::cerr << "Failed to open " << path << " for the capture" << std::endl;
+            return false;
+        }
+        // The frame rate as a fraction, so that e.g. 59.94 isn't rounded. The planes are BT.601 limited range, see
+        // write_y4m().
+        char header[128];
+        int header_size = std::snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+                                        width, height, (int) (fps * 1000.0 + 0.5));
+        stream.write(header, header_size);
+    }
+
+    buffers.assign(BUFFER_COUNT, std::vector<uint8_t>(get_frame_size()));
+    for (size_t i = 0; i < BUFFER_COUNT; i++) {
+        free_buffers.push(i);
+    }
+
+    stopping = false;
+    thread = std::thread([this] {
+        CpuProfiler::set_thread_name("Capture Writer");
+        run();
+    });
+    return true;
+}
+
+void CaptureWriter::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued_condition.notify_one();
+    thread.join();
+
+    // Leave the queues empty for the next start()
+    while (free_buffers.pop()) {
+    }
+    while (queued_buffers.pop()) {
+    }
+    if (stream.is_open()) {
+        stream.close();
+    }
+    buffers.clear();
+}
+
+uint8_t* CaptureWriter::acquire_buffer() {
+    std::optional<size_t> buffer = free_buffers.pop();
+    if (!buffer) {
+        CpuProfiler::Zone wait_zone{"Wait For Capture Writer"};
+        producer_waits.fetch_add(1, std::memory_order_relaxed);
+        while (!(buffer = free_buffers.pop())) {
+            std::this_thread::yield();
+        }
+    }
+    acquired = *buffer;
+    return buffers[acquired].data();
+}
+
+void CaptureWriter::submit_buffer() {
+    // Can't fail, there are only as many buffers as the queue holds
+    queued_buffers.push(acquired);
+    std::lock_guard<std::mutex> lock(mutex);
+    queued_condition.notify_one();
+}
+
+CaptureWriterStats CaptureWriter::get_stats() const {
+    return {frames_written.load(std::memory_order_relaxed), bytes_written.load(std::memory_order_relaxed),
+            producer_waits.load(std::memory_order_relaxed), last_encode_ms.load(std::memory_order_relaxed)};
+}
+
+void CaptureWriter::run() {
+    while (true) {
+        std::optional<size_t> buffer = queued_buffers.pop();
+        if (!buffer) {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued_condition.wait(lock, [this] { return stopping || queued_buffers.size() > 0; });
+            // Only stop once everything queued has been written
+            if (stopping && queued_buffers.size() == 0) {
+                return;
+            }
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        write_frame(buffers[*buffer].data());
+        last_encode_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        free_buffers.push(*buffer);
+    }
+}
+
+void CaptureWriter::write_frame(const uint8_t* pixels) {
+    if (failed) {
+        return;
+    }
+    CpuProfiler::Zone write_zone{"Write Capture Frame"};
+    if (format == CaptureFormat::Y4m) {
+        write_y4m(pixels);
+    } else {
+        write_png(pixels);
+    }
+    frame_index++;
+    frames_written.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Planar YUV 4:2:0, BT.601 limited range with the usual 8 bit integer approximations. Each chroma sample is the average
+// of a 2x2 block of pixels, which is where C420jpeg says it's sited, and the last row or column is repeated for odd
+// sizes.
+void CaptureWriter::write_y4m(const uint8_t* pixels) {
+    size_t chroma_width = (width + 1) / 2;
+    size_t chroma_height = (height + 1) / 2;
+    size_t luma_size = (size_t) width * height;
+    size_t chroma_size = chroma_width * chroma_height;
+    scratch.resize(luma_size + 2 * chroma_size);
+    uint8_t* y_plane = scratch.data();
+    uint8_t* u_plane = y_plane + luma_size;
+    uint8_t* v_plane = u_plane + chroma_size;
+
+    // The frame is bottom up, Y4M is top down
+    auto pixel = [&](int x, int y) { return pixels + ((size_t) (height - 1 - y) * width + x) * 4; };
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const uint8_t* rgb = pixel(x, y);
+            y_plane[(size_t) y * width + x] = (uint8_t) (((66 * rgb[0] + 129 * rgb[1] + 25 * rgb[2] + 128) >> 8) + 16);
+        }
+    }
+    for (size_t chroma_y = 0; chroma_y < chroma_height; chroma_y++) {
+        int y0 = (int) chroma_y * 2;
+        int y1 = std::min(y0 + 1, height - 1);
+        for (size_t chroma_x = 0; chroma_x < chroma_width; chroma_x++) {
+            int x0 = (int) chroma_x * 2;
+            int x1 = std::min(x0 + 1, width - 1);
+            int sum[3] = {};
+            for (const uint8_t* rgb : {pixel(x0, y0), pixel(x1, y0), pixel(x0, y1), pixel(x1, y1)}) {
+                for (int channel = 0; channel < 3; channel++) {
+                    sum[channel] += rgb[channel];
+                }
+            }
+            int r = (sum[0] + 2) / 4;
+            int g = (sum[1] + 2) / 4;
+            int b = (sum[2] + 2) / 4;
+            u_plane[chroma_y * chroma_width + chroma_x] = (uint8_t) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v_plane[chroma_y * chroma_width + chroma_x] = (uint8_t) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    stream.write("FRAME\n", 6);
+    stream.write((const char*) scratch.data(), (std::streamsize) scratch.size());
+    if (!stream) {
+        std::cerr << "Failed to write to " << path << ", stopping the capture" << std::endl;
+        failed = true;
+        return;
+    }
+    bytes_written.fetch_add(6 + scratch.size(), std::memory_order_relaxed);
+}
+
+// The PNG's image data is a zlib stream, and there is no zlib in the tree, so this is a small deflate compressor of its
+// own: one block with the fixed Huffman codes, and matches found through a hash of the next 3 bytes that only remembers
+// the last position each hash was seen at. That compresses far worse than zlib, but the rendered frames are mostly
+// flat colour, which it handles well, and it's fast enough to keep up with the frame rate.
+static const size_t WINDOW_SIZE = 32768;
+static const size_t MIN_MATCH = 3;
+static const size_t MAX_MATCH = 258;
+static const int HASH_BITS = 15;
+
+static const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99,
+                                         115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025,
+                                           1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+                                           12, 12, 13, 13};
+
+// Deflate packs bits from the least significant end, except for Huffman codes, which start from their most
+// significant bit
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& output) : output(output) {}
+
+    void put_bits(uint32_t value, int count) {
+        bits |= value << bit_count;
+        bit_count += count;
+        while (bit_count >= 8) {
+            output.push_back((uint8_t) bits);
+            bits >>= 8;
+            bit_count -= 8;
+        }
+    }
+
+    void put_code(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++) {
+            reversed |= ((code >> i) & 1) << (length - 1 - i);
+        }
+        put_bits(reversed, length);
+    }
+
+    void flush() {
+        if (bit_count > 0) {
+            output.push_back((uint8_t) bits);
+        }
+        bits = 0;
+        bit_count = 0;
+    }
+
+private:
+    std::vector<uint8_t>& output;
+    uint32_t bits = 0;
+    int bit_count = 0;
+};
+
+// The fixed literal/length code of a symbol in [0, 287]
+static void put_symbol(BitWriter& writer, int symbol) {
+    if (symbol < 144) {
+        writer.put_code(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        writer.put_code(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        writer.put_code(symbol - 256, 7);
+    } else {
+        writer.put_code(0xC0 + symbol - 280, 8);
+    }
+}
+
+static void put_match(BitWriter& writer, size_t length, size_t distance) {
+    int length_code = 28;
+    while (LENGTH_BASE[length_code] > length) {
+        length_code--;
+    }
+    put_symbol(writer, 257 + length_code);
+    writer.put_bits((uint32_t) (length - LENGTH_BASE[length_code]), LENGTH_EXTRA[length_code]);
+
+    int distance_code = 29;
+    while (DISTANCE_BASE[distance_code] > distance) {
+        distance_code--;
+    }
+    writer.put_code(distance_code, 5);
+    writer.put_bits((uint32_t) (distance - DISTANCE_BASE[distance_code]), DISTANCE_EXTRA[distance_code]);
+}
+
+static uint32_t hash3(const uint8_t* data) {
+    uint32_t value = data[0] | (data[1] << 8) | (data[2] << 16);
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void append_u32(std::vector<uint8_t>& output, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        output.push_back((uint8_t) (value >> shift));
+    }
+}
+
+// Compress data into a zlib stream, appended to output
+static void zlib_compress(const std::vector<uint8_t>& data, std::vector<uint8_t>& output, std::vector<int32_t>& hash_table) {
+    // Deflate with the default 32K window, no preset dictionary, and a check value making the header a multiple of 31
+    output.push_back(0x78);
+    output.push_back(0x01);
+
+    BitWriter writer{output};
+    // A single, final block with the fixed codes
+    writer.put_bits(1, 1);
+    writer.put_bits(1, 2);
+
+    hash_table.assign((size_t) 1 << HASH_BITS, -1);
+    size_t size = data.size();
+    size_t i = 0;
+    while (i < size) {
+        size_t length = 0;
+        size_t distance = 0;
+        if (i + MIN_MATCH <= size) {
+            uint32_t hash = hash3(&data[i]);
+            int32_t candidate = hash_table[hash];
+            hash_table[hash] = (int32_t) i;
+            if (candidate >= 0 && i - candidate <= WINDOW_SIZE) {
+                size_t max_length = std::min(MAX_MATCH, size - i);
+                while (length < max_length && data[candidate + length] == data[i + length]) {
+                    length++;
+                }
+                distance = i - candidate;
+            }
+        }
+
+        if (length >= MIN_MATCH) {
+            put_match(writer, length, distance);
+            // Only the start of the match is hashed, the positions inside it are skipped for speed
+            i += length;
+        } else {
+            put_symbol(writer, data[i]);
+            i++;
+        }
+    }
+    put_symbol(writer, 256);
+    writer.flush();
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t start = 0; start < size; start += 5552) {
+        // The largest run that can't overflow before taking the modulo
+        size_t end = std::min(size, start + 5552);
+        for (size_t j = start; j < end; j++) {
+            a += data[j];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    append_u32(output, (b << 16) | a);
+}
+
+static uint32_t crc32(const uint8_t* data, size_t size) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[n] = c;
+        }
+        return entries;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Append a chunk: its length, type, data and the CRC of the type and data
+static void append_chunk(std::vector<uint8_t>& output, const char* type, const uint8_t* data, size_t size) {
+    append_u32(output, (uint32_t) size);
+    size_t type_start = output.size();
+    output.insert(output.end(), type, type + 4);
+    output.insert(output.end(), data, data + size);
+    append_u32(output, crc32(&output[type_start], 4 + size));
+}
+
+void CaptureWriter::write_png(const uint8_t* pixels) {
+    // Each row is filtered by subtracting the row above (filter type 2, "Up"), which leaves zeros wherever the image
+    // doesn't change vertically, for the compressor to turn into long matches. The alpha channel is dropped.
+    size_t row_size = 1 + (size_t) width * 3;
+    scratch.resize(row_size * height);
+    for (int y = 0; y < height; y++) {
+        // The frame is bottom up, PNG is top down
+        const uint8_t* row = pixels + (size_t) (height - 1 - y) * width * 4;
+        const uint8_t* above = y > 0 ? pixels + (size_t) (height - y) * width * 4 : nullptr;
+        uint8_t* out = &scratch[row_size * y];
+        *out++ = 2;
+        for (int x = 0; x < width; x++) {
+            for (int channel = 0; channel < 3; channel++) {
+                uint8_t value = row[x * 4 + channel];
+                *out++ = (uint8_t) (above ? value - above[x * 4 + channel] : value);
+            }
+        }
+    }
+
+    compressed.clear();
+    zlib_compress(scratch, compressed, hash_table);
+
+    encoded.clear();
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    encoded.insert(encoded.end(), signature, signature + 8);
+    uint8_t header[13];
+    for (int i = 0; i < 4; i++) {
+        header[i] = (uint8_t) (width >> (24 - 8 * i));
+        header[4 + i] = (uint8_t) (height >> (24 - 8 * i));
+    }
+    // 8 bits per channel, RGB, the standard compression and filtering, no interlacing
+    header[8] = 8;
+    header[9] = 2;
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    append_chunk(encoded, "IHDR", header, sizeof(header));
+    append_chunk(encoded, "IDAT", compressed.data(), compressed.size());
+    append_chunk(encoded, "IEND", nullptr, 0);
+
+    char file_name[32];
+    std::snprintf(file_name, sizeof(file_name), "%06llu.png", (unsigned long long) frame_index);
+    std::ofstream file(path + file_name, std::ios::binary);
+    file.write((const char*) encoded.data(), (std::streamsize) encoded.size());
+    if (!file) {
+        std::cerr << "Failed to write " << path + file_name << ", stopping the capture" << std::endl;
+        failed = true;
+        return;
+    }
+    bytes_written.fetch_add(encoded.size(), std::memory_order_relaxed);
+}
@@ -0,0 +1,114 @@
+#ifndef CAPTURE_WRITER_H
+#define CAPTURE_WRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SpscQueue.h"
+
+/// How a capture is written to disk
+enum class CaptureFormat {
+    /// A numbered PNG per frame, <path>000000.png, <path>000001.png...
+    PngSequence,
+    /// One raw YUV4MPEG2 stream of every frame, 4:2:0, which ffmpeg and most players read directly
+    Y4m,
+};
+
+/// What a CaptureWriter has done so far, safe to read from any thread
+struct CaptureWriterStats {
+    uint64_t frames_written = 0;
+    uint64_t bytes_written = 0;
+    /// How many times the frame's producer had to wait for the writer to free a buffer
+    uint64_t producer_waits = 0;
+    double last_encode_ms = 0.0;
+};
+
+/// Encodes and writes captured frames on a thread of its own, so that the thread rendering them only has to copy them
+/// into one of the writer's buffers.
+///
+/// The buffers go round between two single producer, single consumer queues: the producer takes a free one, fills it
+/// with a frame and queues it, the writer writes it and hands it back, so no frames are allocated while capturing. If
+/// every buffer is waiting to be written, the producer waits for one rather than dropping the frame, as a capture with
+/// gaps in it is no use for review.
+///
+/// Frames are RGBA8, bottom row first, as glReadPixels returns them.
+class CaptureWriter {
+public:
+    /// The frames that can be waiting to be written, a few frames' worth of the disk being slow
+    static const size_t BUFFER_COUNT = 8;
+
+    CaptureWriter() = default;
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    /// Guess the format from the path: .y4m for a stream, anything else is the prefix of a PNG sequence
+    static CaptureFormat get_format(const std::string& path);
+
+    /// Allocate the buffers and start the thread. fps is only written to the Y4M header, for players.
+    /// Returns false if the output can't be opened.
+    bool start(const std::string& path, CaptureFormat format, int width, int height, double fps);
+    /// Write every frame still queued, then stop and join the thread, also done by the destructor
+    void stop();
+
+    /// Called from the producer thread, a buffer of get_frame_size() bytes for the next frame, waiting for the writer
+    /// to free one if it has to
+    uint8_t* acquire_buffer();
+    /// Called from the producer thread, queue the buffer last acquired for writing
+    void submit_buffer();
+
+    [[nodiscard]] bool is_running() const { return thread.joinable(); }
+    [[nodiscard]] size_t get_frame_size() const { return (size_t) width * height * 4; }
+    [[nodiscard]] CaptureWriterStats get_stats() const;
+
+private:
+    std::string path;
+    CaptureFormat format = CaptureFormat::PngSequence;
+    int width = 0;
+    int height = 0;
+    double fps = 60.0;
+
+    std::vector<std::vector<uint8_t>> buffers;
+    // Indices into buffers, in each direction
+    SpscQueue<size_t, BUFFER_COUNT> free_buffers;
+    SpscQueue<size_t, BUFFER_COUNT> queued_buffers;
+    // The buffer the producer acquired last
+    size_t acquired = 0;
+
+    std::thread thread;
+    // The writer sleeps on this while there is nothing queued
+    std::mutex mutex;
+    std::condition_variable queued_condition;
+    bool stopping = false;
+
+    // Only used by the writer thread
+    std::ofstream stream;
+    uint64_t frame_index = 0;
+    // The frame converted for the format: PNG's filtered rows, or the Y4M planes. Then for PNG, the compressed rows and
+    // the whole file, and the compressor's hash table. Kept between frames, so they are only allocated once.
+    std::vector<uint8_t> scratch;
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> encoded;
+    std::vector<int32_t> hash_table;
+    bool failed = false;
+
+    std::atomic<uint64_t> frames_written{0};
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<uint64_t> producer_waits{0};
+    std::atomic<double> last_encode_ms{0.0};
+
+    void run();
+    void write_frame(const uint8_t* pixels);
+    void write_png(const uint8_t* pixels);
+    void write_y4m(const uint8_t* pixels);
+};
+
+#endif //CAPTURE_WRITER_H
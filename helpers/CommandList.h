@@ -0,0 +1,88 @@
+#ifndef COMMAND_LIST_H
+#define COMMAND_LIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+/// A compact list of commands, recorded on one thread to be executed later, e.g. on a render thread.
+/// Each command is a type followed by an optional payload of plain data, packed together in a single byte buffer
+/// that keeps its capacity when cleared, so recording a frame's commands doesn't allocate once it has warmed up.
+template<typename Type>
+class CommandList {
+    struct Header {
+        Type type;
+        uint32_t payload_size;
+    };
+
+    std::vector<unsigned char> data;
+    size_t count = 0;
+
+    void append(const void* bytes, size_t size) {
+        size_t offset = data.size();
+        data.resize(offset + size);
+        std::memcpy(data.data() + offset, bytes, size);
+    }
+
+public:
+    /// A recorded command, valid until the list is next recorded into
+    class Command {
+        Type type;
+        const unsigned char* payload;
+        uint32_t payload_size;
+    public:
+        Command(Type type, const unsigned char* payload, uint32_t payload_size) : type(type), payload(payload), payload_size(payload_size) {}
+
+        [[nodiscard]] Type get_type() const { return type; }
+
+        /// Read the payload, which must be the type it was recorded with
+        template<typename Payload>
+        [[nodiscard]] Payload get() const {
+            Payload value;
+            // Payloads aren't aligned in the buffer, so copy them out rather than casting
+            std::memcpy(&value, payload, sizeof(Payload));
+            return value;
+        }
+    };
+
+    /// Remove every command, keeping the storage
+    void clear() {
+        data.clear();
+        count = 0;
+    }
+
+    void record(Type type) {
+        Header header{type, 0};
+        append(&header, sizeof(header));
+        count++;
+    }
+
+    template<typename Payload>
+    void record(Type type, const Payload& payload) {
+        static_assert(std::is_trivially_copyable_v<Payload>, "Command payloads must be plain data");
+        Header header{type, (uint32_t) sizeof(Payload)};
+        append(&header, sizeof(header));
+        append(&payload, sizeof(Payload));
+        count++;
+    }
+
+    /// Call function with each command, in the order they were recorded
+    template<typename Function>
+    void for_each(Function&& function) const {
+        size_t offset = 0;
+        while (offset < data.size()) {
+            Header header;
+            std::memcpy(&header, data.data() + offset, sizeof(header));
+            offset += sizeof(header);
+            function(Command{header.type, data.data() + offset, header.payload_size});
+            offset += header.payload_size;
+        }
+    }
+
+    [[nodiscard]] size_t size() const { return count; }
+    [[nodiscard]] size_t byte_size() const { return data.size(); }
+};
+
+#endif //COMMAND_LIST_H
@@ -0,0 +1,201 @@
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <imgui/imgui.h>
+
+#include "imgui/ImGuiReadouts.h"
+
+namespace {
+    struct ZoneEvent {
+        const char* name;
+        uint64_t start_ns;
+        uint64_t end_ns;
+    };
+
+    /// The events of one thread, only ever written by that thread
+    struct ThreadBuffer {
+        uint32_t thread_id;
+        // Only set by the owning thread, so it is guarded by registry_mutex to be safe to read while writing a trace
+        std::string thread_name;
+        std::unique_ptr<ZoneEvent[]> events{new ZoneEvent[CpuProfiler::EVENTS_PER_THREAD]};
+        /// The total number of events written, the next one goes at write_count % EVENTS_PER_THREAD
+        std::atomic<uint64_t> write_count{0};
+    };
+}
+
+static const auto epoch = std::chrono::steady_clock::now();
+static std::atomic<bool> enabled{true};
+
+// Buffers are registered the first time a thread records something, and are kept after the thread exits
+// so that its events still make it into the trace
+static std::mutex registry_mutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> thread_buffers;
+
+static ThreadBuffer& get_thread_buffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        thread_buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = thread_buffers.back().get();
+        buffer->thread_id = (uint32_t) thread_buffers.size();
+    }
+    return *buffer;
+}
+
+CpuProfiler::Zone::Zone(const char* name) : name(is_enabled() ? name : nullptr), start_ns(this->name ? now_ns() : 0) {}
+
+CpuProfiler::Zone::~Zone() {
+    if (name) {
+        record(name, start_ns, now_ns());
+    }
+}
+
+uint64_t CpuProfiler::now_ns() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void CpuProfiler::set_enabled(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool CpuProfiler::is_enabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void CpuProfiler::set_thread_name(const std::string& name) {
+    ThreadBuffer& buffer = get_thread_buffer();
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    buffer.thread_name = name;
+}
+
+void CpuProfiler::record(const char* name, uint64_t start_ns, uint64_t end_ns) {
+    ThreadBuffer& buffer = get_thread_buffer();
+    // Only this thread writes write_count, so a relaxed load sees its own latest value
+    uint64_t index = buffer.write_count.load(std::memory_order_relaxed);
+    buffer.events[index % EVENTS_PER_THREAD] = ZoneEvent{name, start_ns, end_ns};
+    buffer.write_count.store(index + 1, std::memory_order_release);
+}
+
+// Escape the characters that can't appear as is in a JSON string
+static void write_json_string(std::ostream& out, const char* str) {
+    out << '"';
+    for (; *str; str++) {
+        char c = *str;
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if ((unsigned char) c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Chrome trace timestamps are in microseconds, but can be fractional, keep the full nanosecond precision
+static void write_microseconds(std::ostream& out, uint64_t ns) {
+    char formatted[32];
+    std::snprintf(formatted, sizeof(formatted), "%llu.%03llu", (unsigned long long) (ns / 1000), (unsigned long long) (ns % 1000));
+    out << formatted;
+}
+
+bool CpuProfiler::write_chrome_trace(const std::string& path) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open trace file: " << path << std::endl;
+        return false;
+    }
+
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    auto separator = [&] {
+        if (!first) {
+            file << ",\n";
+        }
+        first = false;
+    };
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    std::vector<ZoneEvent> events;
+    for (const auto& buffer : thread_buffers) {
+        separator();
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id << ",\"args\":{\"name\":";
+        write_json_string(file, buffer->thread_name.empty() ? ("Thread " + std::to_string(buffer->thread_id)).c_str()
+                                                            : buffer->thread_name.c_str());
+        file << "}}";
+
+        // Copy the events out while the thread may still be writing, then throw away any that it could have
+        // overwritten during the copy. That's those that are no longer within the last EVENTS_PER_THREAD written, and
+        // the oldest of those too, as its slot is the one the next event (which may be mid-write) goes in.
+        uint64_t end = buffer->write_count.load(std::memory_order_acquire);
+        uint64_t begin = end > EVENTS_PER_THREAD ? end - EVENTS_PER_THREAD : 0;
+        events.clear();
+        for (uint64_t i = begin; i < end; i++) {
+            events.push_back(buffer->events[i % EVENTS_PER_THREAD]);
+        }
+        uint64_t end_after = buffer->write_count.load(std::memory_order_acquire);
+        uint64_t valid_begin = end_after + 1 > EVENTS_PER_THREAD ? end_after + 1 - EVENTS_PER_THREAD : 0;
+        auto skip = (size_t) (std::max(valid_begin, begin) - begin);
+
+        for (size_t i = skip; i < events.size(); i++) {
+            const ZoneEvent& event = events[i];
+            separator();
+            file << "{\"name\":";
+            write_json_string(file, event.name);
+            file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_id << ",\"ts\":";
+            write_microseconds(file, event.start_ns);
+            file << ",\"dur\":";
+            write_microseconds(file, event.end_ns - event.start_ns);
+            file << "}";
+        }
+    }
+    file << "\n]}\n";
+
+    if (!file) {
+        std::cerr << "Failed to write trace file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+uint64_t CpuProfiler::get_event_count() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    uint64_t count = 0;
+    for (const auto& buffer : thread_buffers) {
+        count += buffer->write_count.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+void CpuProfiler::ui() {
+    if (ImGui::Begin("CPU Profiler", nullptr, ImGuiWindowFlags_NoFocusOnAppearing)) {
+        bool record_zones = is_enabled();
+        if (ImGui::Checkbox("Record Zones", &record_zones)) {
+            set_enabled(record_zones);
+        }
+        ImGuiReadouts::text("Events recorded: %llu", (unsigned long long) get_event_count());
+
+        // The last EVENTS_PER_THREAD zones of each thread are written, i.e. the last few seconds
+        static std::string status;
+        if (ImGui::Button("Save Trace")) {
+            const char* path = "cpu_trace.json";
+            status = write_chrome_trace(path) ? std::string("Saved to ") + path : "Failed to save trace";
+        }
+        if (!status.empty()) {
+            ImGui::SameLine();
+            ImGui::TextUnformatted(status.c_str());
+        }
+    }
+    ImGui::End();
+}
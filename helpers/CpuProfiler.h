@@ -0,0 +1,54 @@
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// Records when named zones of code start and end on each thread, with nanosecond timestamps, and writes them out
+/// in the Chrome trace event format (open it in chrome://tracing or https://ui.perfetto.dev).
+///
+/// Each thread records into its own ring buffer that only it writes to, so recording a zone takes no locks, and the
+/// oldest events are overwritten once it's full. Reading the buffers (to write a trace) can happen on any thread
+/// at any time, events that are overwritten while they're being read are left out.
+class CpuProfiler {
+public:
+    /// The number of events each thread keeps
+    static const size_t EVENTS_PER_THREAD = 1 << 16;
+
+    /// Records a zone for as long as it is in scope. The name must outlive the profiler, e.g. be a string literal.
+    class Zone {
+        const char* name;
+        uint64_t start_ns;
+    public:
+        explicit Zone(const char* name);
+        ~Zone();
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+    };
+
+    /// Nanoseconds since the profiler was first used
+    static uint64_t now_ns();
+
+    /// Recording is enabled by default, when disabled zones cost a branch
+    static void set_enabled(bool enabled);
+    static bool is_enabled();
+
+    /// Name the calling thread in the trace
+    static void set_thread_name(const std::string& name);
+
+    /// Record a zone on the calling thread
+    static void record(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+    /// Write every thread's recorded events to a Chrome trace event JSON file, returns false if it can't be written
+    static bool write_chrome_trace(const std::string& path);
+
+    /// The number of events that have been recorded across all threads, including those since overwritten
+    static uint64_t get_event_count();
+
+    /// Show the controls in an ImGui window
+    static void ui();
+};
+
+#endif //CPU_PROFILER_H
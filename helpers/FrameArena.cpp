@@ -0,0 +1,57 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+
+LinearArena::LinearArena(size_t block_size) {
+    add_block(std::max<size_t>(block_size, 1));
+}
+
+void LinearArena::reset() {
+    // Grown during the frame, so replace the blocks with one that would have fitted it all
+    if (blocks.size() > 1) {
+        size_t capacity = get_capacity();
+        blocks.clear();
+        add_block(capacity);
+    }
+    used = 0;
+    offset = 0;
+}
+
+size_t LinearArena::get_capacity() const {
+    size_t capacity = 0;
+    for (const Block& block : blocks) {
+        capacity += block.size;
+    }
+    return capacity;
+}
+
+void* LinearArena::do_allocate(size_t bytes, size_t alignment) {
+    // The block itself is only aligned for new, so it's the address that is aligned rather than the offset
+    Block& block = blocks.back();
+    auto base = (uintptr_t) block.memory.get();
+    size_t start = ((base + offset + alignment - 1) & ~(uintptr_t) (alignment - 1)) - base;
+    if (start + bytes > block.size) {
+        overflows++;
+        used += offset;
+        offset = 0;
+        // Always big enough for the allocation, however it has to be aligned
+        add_block(std::max(block.size * 2, bytes + alignment));
+        return do_allocate(bytes, alignment);
+    }
+
+    offset = start + bytes;
+    peak = std::max(peak, used + offset);
+    return block.memory.get() + start;
+}
+
+void LinearArena::add_block(size_t size) {
+    // Not make_unique, which would zero it
+    blocks.push_back(Block{std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+}
+
+FrameArena::FrameArena(size_t block_size) : arenas{LinearArena{block_size}, LinearArena{block_size}} {}
+
+void FrameArena::begin_frame() {
+    current = 1 - current;
+    arenas[current].reset();
+}
@@ -0,0 +1,85 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+/// A bump allocator: allocating is moving an offset into a block of memory, and everything allocated is freed at once
+/// by reset(). It is a std::pmr::memory_resource, so the standard containers can allocate from it, e.g.
+///     std::pmr::vector<int> values{&arena};
+/// and deallocating does nothing, the memory is only reused after the next reset().
+///
+/// When the block is full, another twice the size is allocated from the heap. At the next reset() the blocks are
+/// replaced by one big enough for all of them, so once it has seen the most that is allocated between two resets, the
+/// arena stops allocating at all.
+///
+/// Not thread safe, only one thread can use it at a time.
+class LinearArena : public std::pmr::memory_resource {
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+    explicit LinearArena(size_t block_size = DEFAULT_BLOCK_SIZE);
+
+    LinearArena(const LinearArena&) = delete;
+    LinearArena& operator=(const LinearArena&) = delete;
+
+    /// Free everything allocated since the last reset. Anything still using the memory must be gone by now.
+    void reset();
+
+    /// The bytes allocated since the last reset, including the padding for alignment
+    [[nodiscard]] size_t get_used() const { return used + offset; }
+    [[nodiscard]] size_t get_capacity() const;
+    /// The most bytes used between two resets
+    [[nodiscard]] size_t get_peak() const { return peak; }
+    /// How many times a block filled up, so another had to be allocated from the heap
+    [[nodiscard]] uint64_t get_overflows() const { return overflows; }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+private:
+    struct Block {
+        std::unique_ptr<std::byte[]> memory;
+        size_t size;
+    };
+
+    // Allocations come from the last block, the others are full
+    std::vector<Block> blocks;
+    size_t offset = 0;
+    // The bytes used in the full blocks
+    size_t used = 0;
+    size_t peak = 0;
+    uint64_t overflows = 0;
+
+    void add_block(size_t size);
+};
+
+/// Two LinearArenas, used on alternate frames, so that what is allocated during a frame stays valid until the end of
+/// the next one. That is what data recorded on the main thread needs, as the render thread executes it while the next
+/// frame is being recorded, and it's no more work than an arena that is reset every frame.
+///
+/// Only the thread recording the frames can allocate from it.
+class FrameArena {
+public:
+    explicit FrameArena(size_t block_size = LinearArena::DEFAULT_BLOCK_SIZE);
+
+    /// Switch to the other arena, freeing what was allocated in it two frames ago. Call once at the start of each
+    /// frame, once nothing from two frames ago is used any more.
+    void begin_frame();
+
+    /// The arena for this frame
+    [[nodiscard]] LinearArena& get() { return arenas[current]; }
+    [[nodiscard]] const LinearArena& get() const { return arenas[current]; }
+    [[nodiscard]] const LinearArena& get_previous() const { return arenas[1 - current]; }
+
+private:
+    LinearArena arenas[2];
+    int current = 0;
+};
+
+#endif //FRAME_ARENA_H
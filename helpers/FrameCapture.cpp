@@ -0,0 +1,147 @@
+#include "FrameCapture.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "CpuProfiler.h"
+
+// How long to wait for a fence at a time when the capture has to, before checking again
+static const GLuint64 FENCE_TIMEOUT_NS = 10'000'000;
+
+bool FrameCapture::init(int frame_width, int frame_height, CaptureWriter& frame_writer, int ring_size) {
+    width = frame_width;
+    height = frame_height;
+    writer = &frame_writer;
+
+    GLint previous_framebuffer;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_framebuffer);
+
+    glGenRenderbuffers(1, &colour_renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colour_renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depth_renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour_renderbuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_renderbuffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, (uint) previous_framebuffer);
+    if (!complete) {
+        std::cerr << "Capture framebuffer is incomplete" << std::endl;
+        cleanup();
+        return false;
+    }
+
+    // GL_STREAM_READ, as each buffer is written by the GPU once and read by us once
+    readbacks.resize(ring_size);
+    for (Readback& readback : readbacks) {
+        glGenBuffers(1, &readback.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr) writer->get_frame_size(), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    next_readback = 0;
+    frame_index = 0;
+    return true;
+}
+
+void FrameCapture::cleanup() {
+    // The frames still in flight are the last ones drawn, oldest first from the next readback
+    for (size_t i = 0; i < readbacks.size(); i++) {
+        Readback& readback = readbacks[(next_readback + i) % readbacks.size()];
+        if (readback.fence) {
+            collect(readback, true);
+        }
+        glDeleteBuffers(1, &readback.buffer);
+    }
+    readbacks.clear();
+
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colour_renderbuffer);
+    glDeleteRenderbuffers(1, &depth_renderbuffer);
+    framebuffer = 0;
+    colour_renderbuffer = 0;
+    depth_renderbuffer = 0;
+}
+
+void FrameCapture::begin_frame() {
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void FrameCapture::end_frame() {
+    CpuProfiler::Zone capture_zone{"Frame Capture"};
+
+    // The next buffer still holding a frame means the GPU is a whole ring behind, so that frame has to be waited for
+    Readback& readback = readbacks[next_readback];
+    if (readback.fence) {
+        CpuProfiler::Zone stall_zone{"Capture Fence Stall"};
+        fence_stalls.fetch_add(1, std::memory_order_relaxed);
+        collect(readback, true);
+    }
+
+    // With a buffer bound to GL_PIXEL_PACK_BUFFER, the pixels are written to it (at offset 0) on the GPU's timeline,
+    // instead of to our memory right away
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.frame = frame_index++;
+    next_readback = (next_readback + 1) % readbacks.size();
+
+    // Show the frame where it would have been drawn without the capture
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (uint) target_framebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, (uint) target_framebuffer);
+
+    // Pass on every frame the GPU has finished reading back, oldest first, stopping at the first it hasn't
+    for (size_t i = 0; i < readbacks.size(); i++) {
+        Readback& pending = readbacks[(next_readback + i) % readbacks.size()];
+        if (pending.fence && !collect(pending, false)) {
+            break;
+        }
+    }
+}
+
+bool FrameCapture::collect(Readback& readback, bool wait) {
+    // Flush so that the fence is sure to be reached eventually, even if nothing else flushes before the next check
+    GLenum result = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? FENCE_TIMEOUT_NS : 0);
+    while (wait && result == GL_TIMEOUT_EXPIRED) {
+        result = glClientWaitSync(readback.fence, 0, FENCE_TIMEOUT_NS);
+    }
+    if (result == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+    glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+    if (result == GL_WAIT_FAILED) {
+        std::cerr << "Failed to wait for capture frame " << readback.frame << ", dropping it" << std::endl;
+        return true;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr) writer->get_frame_size(), GL_MAP_READ_BIT);
+    if (pixels) {
+        std::memcpy(writer->acquire_buffer(), pixels, writer->get_frame_size());
+        writer->submit_buffer();
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        frames_read.fetch_add(1, std::memory_order_relaxed);
+        latency_frames.store(frame_index - 1 - readback.frame, std::memory_order_relaxed);
+    } else {
+        std::cerr << "Failed to map capture frame " << readback.frame << ", dropping it" << std::endl;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+FrameCaptureStats FrameCapture::get_stats() const {
+    return {frames_read.load(std::memory_order_relaxed), fence_stalls.load(std::memory_order_relaxed),
+            latency_frames.load(std::memory_order_relaxed)};
+}
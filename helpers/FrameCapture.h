@@ -0,0 +1,87 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "CaptureWriter.h"
+
+// A useful shorthand that not all compilers provide by default
+using uint = unsigned int;
+
+/// What a FrameCapture has done so far, safe to read from any thread
+struct FrameCaptureStats {
+    uint64_t frames_read = 0;
+    /// How many times every readback was still in flight, so the oldest had to be waited for
+    uint64_t fence_stalls = 0;
+    /// How many frames after it was drawn the last frame was read back
+    uint64_t latency_frames = 0;
+};
+
+/// Captures every frame drawn, without stalling the GPU to do it.
+///
+/// The frame is drawn into a framebuffer object of the capture's own, which is copied to wherever it would have been
+/// drawn otherwise at the end of the frame. Before that, glReadPixels copies it into the next of a ring of pixel buffer
+/// objects, which returns straight away as the copy is just queued on the GPU, and a fence is put after it. Each frame,
+/// the buffers whose fences have been passed are mapped and handed to a CaptureWriter, oldest first, so a frame is
+/// picked up 1 or 2 frames after it was drawn, when the GPU has long finished with it. Only when the GPU is so far
+/// behind that every buffer is still in flight does the capture wait for the oldest.
+///
+/// Everything must be called on the thread with the context current.
+class FrameCapture {
+public:
+    /// Enough for 2 frames in flight, plus the one being read
+    static const int DEFAULT_RING_SIZE = 3;
+
+    /// Create the framebuffer and the ring of buffers, frames are passed on to writer. Returns false if the
+    /// framebuffer isn't complete.
+    bool init(int width, int height, CaptureWriter& writer, int ring_size = DEFAULT_RING_SIZE);
+    /// Wait for the frames still being read back and pass them on, then delete everything
+    void cleanup();
+
+    /// Draw the frame into the capture's framebuffer, rather than the one bound now
+    void begin_frame();
+    /// Read the frame back, copy it to the framebuffer that was bound before begin_frame(), and pass on any earlier
+    /// frames that are ready
+    void end_frame();
+
+    [[nodiscard]] bool is_initialised() const { return framebuffer != 0; }
+    [[nodiscard]] FrameCaptureStats get_stats() const;
+
+private:
+    struct Readback {
+        uint buffer = 0;
+        // Null while the buffer is free
+        GLsync fence = nullptr;
+        uint64_t frame = 0;
+    };
+
+    int width = 0;
+    int height = 0;
+    CaptureWriter* writer = nullptr;
+
+    uint framebuffer = 0;
+    uint colour_renderbuffer = 0;
+    uint depth_renderbuffer = 0;
+    // The framebuffer the frame is copied to, 0 for the window
+    int target_framebuffer = 0;
+
+    std::vector<Readback> readbacks;
+    // The next readback to use, which is also the oldest in flight if there are any
+    size_t next_readback = 0;
+    uint64_t frame_index = 0;
+
+    std::atomic<uint64_t> frames_read{0};
+    std::atomic<uint64_t> fence_stalls{0};
+    std::atomic<uint64_t> latency_frames{0};
+
+    /// Pass the readback's frame on to the writer, if the GPU has finished it or wait is set. Returns false if the GPU
+    /// hasn't.
+    bool collect(Readback& readback, bool wait);
+};
+
+#endif //FRAME_CAPTURE_H
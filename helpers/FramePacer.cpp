@@ -0,0 +1,77 @@
+#include "FramePacer.h"
+
+#include <thread>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+const char* FramePacer::get_mode_name(Mode mode) {
+    switch (mode) {
+        case Mode::Idle:
+            return "Idle";
+        case Mode::Capped:
+            return "Capped";
+        case Mode::Uncapped:
+            return "Uncapped";
+    }
+    return "Unknown";
+}
+
+void FramePacer::wait_for_next_frame(bool active) {
+    if (active) {
+        wake();
+    }
+
+    was_idle = mode == Mode::Idle && frames_to_draw == 0;
+    if (was_idle) {
+        // Nothing is changing, so there's nothing to draw until an event arrives. Whatever it is, draw a few frames
+        // afterwards, the UI might react to it. If the timeout expired instead, the one frame drawn after this is
+        // enough to show any change that came without an event.
+        uint64_t events_before = event_count;
+        auto start = Clock::now();
+        glfwWaitEventsTimeout(IDLE_TIMEOUT_SECONDS);
+        next_frame_time = Clock::now();
+        idle_seconds += std::chrono::duration<double>(next_frame_time - start).count();
+        idle_count++;
+        if (event_count != events_before) {
+            wake();
+        }
+    } else {
+        // Wait first and poll afterwards, so the events are as fresh as possible when the frame is drawn
+        if (mode != Mode::Uncapped) {
+            wait_for_frame_time();
+        }
+        glfwPollEvents();
+    }
+
+    if (frames_to_draw > 0) {
+        frames_to_draw--;
+    }
+}
+
+void FramePacer::wait_for_frame_time() {
+    if (target_fps <= 0.0) {
+        return;
+    }
+
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / target_fps));
+    auto now = Clock::now();
+    next_frame_time += period;
+    if (next_frame_time < now - period) {
+        // Too far behind (e.g. after a hitch, or the first frame after idling), catching up would mean a burst of
+        // frames, so start again from now instead
+        next_frame_time = now;
+        return;
+    }
+
+    if (next_frame_time - now > SPIN_MARGIN) {
+        std::this_thread::sleep_until(next_frame_time - SPIN_MARGIN);
+    }
+    auto spin_start = Clock::now();
+    sleep_seconds += std::chrono::duration<double>(spin_start - now).count();
+
+    while (Clock::now() < next_frame_time) {
+        std::this_thread::yield();
+    }
+    spin_seconds += std::chrono::duration<double>(Clock::now() - spin_start).count();
+}
@@ -0,0 +1,79 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <chrono>
+#include <cstdint>
+
+/// Decides when the main loop starts its next frame, and processes window events meanwhile (it replaces the loop's
+/// glfwPollEvents call). There are three modes:
+///  - Idle: when nothing is changing, blocks in glfwWaitEventsTimeout until an event arrives, so a static scene costs
+///    (almost) nothing. While something is changing, frames are capped at the target rate.
+///  - Capped: always draws, at the target rate.
+///  - Uncapped: draws as fast as possible, for benchmarking.
+///
+/// The cap sleeps until just before the frame is due, then spins for the rest, since sleeping alone can overshoot by
+/// the scheduler's granularity (a millisecond or more).
+class FramePacer {
+public:
+    enum class Mode {
+        Idle,
+        Capped,
+        Uncapped,
+    };
+
+    /// The number of frames drawn after something changes or an event arrives, as ImGUI can take a couple of frames
+    /// to settle (e.g. to lay out a window that just appeared)
+    static const int WAKE_FRAMES = 3;
+    /// The longest time to idle for without drawing a frame, so that changes that don't come with an event
+    /// (such as a shader finishing compiling) still show up eventually. Only one frame is drawn when it expires.
+    static constexpr double IDLE_TIMEOUT_SECONDS = 0.5;
+
+    void set_mode(Mode new_mode) { mode = new_mode; }
+    [[nodiscard]] Mode get_mode() const { return mode; }
+    static const char* get_mode_name(Mode mode);
+
+    /// The frame rate the Idle and Capped modes limit to, 0 for no limit
+    void set_target_fps(double fps) { target_fps = fps; }
+    [[nodiscard]] double get_target_fps() const { return target_fps; }
+
+    /// Keep drawing for the next few frames, call whenever something has changed
+    void wake() { frames_to_draw = WAKE_FRAMES; }
+    /// Call from the window's input callbacks, so that idling can tell an event arriving from the timeout expiring
+    void notify_event() { event_count++; }
+
+    /// Wait until the next frame should be drawn, processing window events. active is whether something is changing
+    /// by itself (e.g. an animation), which keeps the Idle mode from idling.
+    void wait_for_next_frame(bool active);
+
+    /// The number of times the main loop has idled, and the total time it spent idling, sleeping and spinning
+    [[nodiscard]] uint64_t get_idle_count() const { return idle_count; }
+    [[nodiscard]] double get_idle_seconds() const { return idle_seconds; }
+    [[nodiscard]] double get_sleep_seconds() const { return sleep_seconds; }
+    [[nodiscard]] double get_spin_seconds() const { return spin_seconds; }
+    /// Whether the last wait idled, rather than being paced
+    [[nodiscard]] bool is_idle() const { return was_idle; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /// How long before the frame is due to stop sleeping and start spinning
+    static constexpr std::chrono::microseconds SPIN_MARGIN{1500};
+
+    Mode mode = Mode::Idle;
+    double target_fps = 60.0;
+    int frames_to_draw = WAKE_FRAMES;
+    // Counted by notify_event(), compared before and after idling
+    uint64_t event_count = 0;
+    Clock::time_point next_frame_time = Clock::now();
+
+    uint64_t idle_count = 0;
+    double idle_seconds = 0.0;
+    double sleep_seconds = 0.0;
+    double spin_seconds = 0.0;
+    bool was_idle = false;
+
+    /// Sleep, then spin, until the next frame is due at the target rate
+    void wait_for_frame_time();
+};
+
+#endif //FRAME_PACER_H
@@ -0,0 +1,238 @@
+#include "FrustumCuller.h"
+
+#include <chrono>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define FRUSTUM_CULLER_SSE
+#include <immintrin.h>
+#endif
+
+// How many subtrees to split the walk into per thread, so that a thread whose subtrees turn out to be cheap (e.g.
+// entirely outside) can take some of another's
+static const size_t TASKS_PER_THREAD = 8;
+// Deeper than a hierarchy over 2^32 objects split at their median can be
+static const int MAX_DEPTH = 64;
+
+Frustum Frustum::from_matrix(const glm::mat4& view_projection) {
+    // A point is inside the clip volume when -w <= x, y, z <= w. Each of those is a plane made of the matrix's rows,
+    // e.g. x + w >= 0 is (row 0 + row 3) . point >= 0 (Gribb and Hartmann)
+    auto row = [&](int i) {
+        return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+    };
+    glm::vec4 planes[PLANE_COUNT] = {
+            row(3) + row(0), row(3) - row(0),
+            row(3) + row(1), row(3) - row(1),
+            row(3) + row(2), row(3) - row(2),
+            glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
+    };
+
+    Frustum frustum{};
+    for (int i = 0; i < PLANE_COUNT; i++) {
+        frustum.a[i] = planes[i].x;
+        frustum.b[i] = planes[i].y;
+        frustum.c[i] = planes[i].z;
+        frustum.d[i] = planes[i].w;
+    }
+    return frustum;
+}
+
+enum class Containment {
+    Outside,
+    Intersecting,
+    Inside,
+};
+
+// A box is outside a plane if even its corner furthest along the plane's normal is behind it, and inside if its
+// nearest corner is in front. Those corners are the centre plus or minus the extent projected onto the normal.
+static Containment classify_node(const Frustum& frustum, const BvhNode& node) {
+    float centre[3];
+    float extent[3];
+    for (int axis = 0; axis < 3; axis++) {
+        centre[axis] = 0.5f * (node.min[axis] + node.max[axis]);
+        extent[axis] = 0.5f * (node.max[axis] - node.min[axis]);
+    }
+
+#ifdef FRUSTUM_CULLER_SSE
+    // 4 planes at a time
+    __m128 sign_mask = _mm_set1_ps(-0.0f);
+    __m128 zero = _mm_setzero_ps();
+    int outside = 0;
+    int straddling = 0;
+    for (int i = 0; i < Frustum::PLANE_COUNT; i += 4) {
+        __m128 a = _mm_load_ps(frustum.a + i);
+        __m128 b = _mm_load_ps(frustum.b + i);
+        __m128 c = _mm_load_ps(frustum.c + i);
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(centre[0])), _mm_mul_ps(b, _mm_set1_ps(centre[1]))),
+                                     _mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(centre[2])), _mm_load_ps(frustum.d + i)));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign_mask, a), _mm_set1_ps(extent[0])),
+                                              _mm_mul_ps(_mm_andnot_ps(sign_mask, b), _mm_set1_ps(extent[1]))),
+                                   _mm_mul_ps(_mm_andnot_ps(sign_mask, c), _mm_set1_ps(extent[2])));
+        outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        straddling |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero));
+    }
+    if (outside) {
+        return Containment::Outside;
+    }
+    return straddling ? Containment::Intersecting : Containment::Inside;
+#else
+    bool straddling = false;
+    for (int i = 0; i < Frustum::PLANE_COUNT; i++) {
+        float distance = frustum.a[i] * centre[0] + frustum.b[i] * centre[1] + frustum.c[i] * centre[2] + frustum.d[i];
+        float radius = std::abs(frustum.a[i]) * extent[0] + std::abs(frustum.b[i]) * extent[1] + std::abs(frustum.c[i]) * extent[2];
+        if (distance + radius < 0.0f) {
+            return Containment::Outside;
+        }
+        straddling |= distance - radius < 0.0f;
+    }
+    return straddling ? Containment::Intersecting : Containment::Inside;
+#endif
+}
+
+static bool is_object_visible(const Frustum& frustum, const BoundsBatch& bounds, uint32_t slot) {
+    for (int i = 0; i < 6; i++) {
+        float distance = frustum.a[i] * bounds.centre_x[slot] + frustum.b[i] * bounds.centre_y[slot]
+                         + frustum.c[i] * bounds.centre_z[slot] + frustum.d[i];
+        float radius = std::abs(frustum.a[i]) * bounds.extent_x[slot] + std::abs(frustum.b[i]) * bounds.extent_y[slot]
+                       + std::abs(frustum.c[i]) * bounds.extent_z[slot];
+        if (distance + radius < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Test the objects in a leaf the frustum straddles, adding the visible ones to visible
+static void cull_objects(const Frustum& frustum, const Bvh& bvh, const BvhNode& leaf, std::vector<uint32_t>& visible) {
+    const BoundsBatch& bounds = bvh.get_slot_bounds();
+    const std::vector<uint32_t>& objects = bvh.get_slot_objects();
+    uint32_t slot = leaf.first;
+    uint32_t end = leaf.first + leaf.count;
+
+#ifdef FRUSTUM_CULLER_SSE
+    // 4 objects at a time, against each plane in turn
+    __m128 zero = _mm_setzero_ps();
+    for (; slot + 4 <= end; slot += 4) {
+        __m128 centre_x = _mm_loadu_ps(&bounds.centre_x[slot]);
+        __m128 centre_y = _mm_loadu_ps(&bounds.centre_y[slot]);
+        __m128 centre_z = _mm_loadu_ps(&bounds.centre_z[slot]);
+        __m128 extent_x = _mm_loadu_ps(&bounds.extent_x[slot]);
+        __m128 extent_y = _mm_loadu_ps(&bounds.extent_y[slot]);
+        __m128 extent_z = _mm_loadu_ps(&bounds.extent_z[slot]);
+
+        __m128 outside = zero;
+        for (int i = 0; i < 6; i++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustum.a[i]), centre_x),
+                                                    _mm_mul_ps(_mm_set1_ps(frustum.b[i]), centre_y)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustum.c[i]), centre_z), _mm_set1_ps(frustum.d[i])));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(frustum.a[i])), extent_x),
+                                                  _mm_mul_ps(_mm_set1_ps(std::abs(frustum.b[i])), extent_y)),
+                                       _mm_mul_ps(_mm_set1_ps(std::abs(frustum.c[i])), extent_z));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        }
+
+        int visible_mask = ~_mm_movemask_ps(outside) & 15;
+        for (int lane = 0; lane < 4; lane++) {
+            if (visible_mask & (1 << lane)) {
+                visible.push_back(objects[slot + lane]);
+            }
+        }
+    }
+#endif
+
+    for (; slot < end; slot++) {
+        if (is_object_visible(frustum, bounds, slot)) {
+            visible.push_back(objects[slot]);
+        }
+    }
+}
+
+static void add_all_objects(const Bvh& bvh, const BvhNode& node, std::vector<uint32_t>& visible) {
+    const std::vector<uint32_t>& objects = bvh.get_slot_objects();
+    visible.insert(visible.end(), objects.begin() + node.first, objects.begin() + node.first + node.count);
+}
+
+void FrustumCuller::cull(const Bvh& bvh, const Frustum& frustum, JobSystem& jobs, std::vector<uint32_t>& visible) {
+    auto start = std::chrono::steady_clock::now();
+    const std::vector<BvhNode>& nodes = bvh.get_nodes();
+    visible.clear();
+    tasks.clear();
+    stats = {};
+
+    // Split the top of the tree a level at a time, until there are enough subtrees for every thread or nothing left
+    // to split. Nodes outside are dropped here already.
+    if (!nodes.empty()) {
+        Containment root = classify_node(frustum, nodes[0]);
+        stats.nodes_tested++;
+        if (root != Containment::Outside) {
+            tasks.push_back(Task{0, root == Containment::Inside});
+        }
+    }
+    size_t target_tasks = TASKS_PER_THREAD * jobs.get_thread_count();
+    bool split = true;
+    while (split && !tasks.empty() && tasks.size() < target_tasks) {
+        split = false;
+        next_tasks.clear();
+        for (Task task : tasks) {
+            const BvhNode& node = nodes[task.node];
+            if (task.inside || node.is_leaf()) {
+                next_tasks.push_back(task);
+                continue;
+            }
+            split = true;
+            for (uint32_t child = node.left; child <= node.left + 1; child++) {
+                Containment containment = classify_node(frustum, nodes[child]);
+                stats.nodes_tested++;
+                if (containment != Containment::Outside) {
+                    next_tasks.push_back(Task{child, containment == Containment::Inside});
+                }
+            }
+        }
+        std::swap(tasks, next_tasks);
+    }
+
+    // Then walk the subtrees in parallel, each as its own job (so idle threads steal single subtrees) into its own list
+    if (task_visible.size() < tasks.size()) {
+        task_visible.resize(tasks.size());
+    }
+    task_nodes_tested.assign(tasks.size(), 0);
+    jobs.parallel_for(tasks.size(), [&](size_t i) {
+        std::vector<uint32_t>& task_output = task_visible[i];
+        task_output.clear();
+        if (tasks[i].inside) {
+            add_all_objects(bvh, nodes[tasks[i].node], task_output);
+            return;
+        }
+
+        // Every node on the stack straddles the frustum
+        uint32_t stack[MAX_DEPTH];
+        int depth = 0;
+        stack[depth++] = tasks[i].node;
+        size_t nodes_tested = 0;
+        while (depth > 0) {
+            const BvhNode& node = nodes[stack[--depth]];
+            if (node.is_leaf()) {
+                cull_objects(frustum, bvh, node, task_output);
+                continue;
+            }
+            for (uint32_t child = node.left; child <= node.left + 1; child++) {
+                Containment containment = classify_node(frustum, nodes[child]);
+                nodes_tested++;
+                if (containment == Containment::Inside) {
+                    add_all_objects(bvh, nodes[child], task_output);
+                } else if (containment == Containment::Intersecting) {
+                    stack[depth++] = child;
+                }
+            }
+        }
+        task_nodes_tested[i] = nodes_tested;
+    }, 1);
+
+    for (size_t i = 0; i < tasks.size(); i++) {
+        visible.insert(visible.end(), task_visible[i].begin(), task_visible[i].end());
+        stats.nodes_tested += task_nodes_tested[i];
+    }
+    stats.visible = visible.size();
+    stats.culled = bvh.get_object_count() - visible.size();
+    stats.cull_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,64 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Bvh.h"
+#include "JobSystem.h"
+
+/// The 6 planes of a view frustum, with a*x + b*y + c*z + d >= 0 for points inside all of them. Stored as a structure
+/// of arrays, padded to 8 with planes that everything is inside of, so that a box is tested against 4 planes at once.
+struct Frustum {
+    static const int PLANE_COUNT = 8;
+
+    alignas(16) float a[PLANE_COUNT];
+    alignas(16) float b[PLANE_COUNT];
+    alignas(16) float c[PLANE_COUNT];
+    alignas(16) float d[PLANE_COUNT];
+
+    /// Extract the planes of a view projection matrix's clip volume, in the space the matrix transforms from
+    static Frustum from_matrix(const glm::mat4& view_projection);
+};
+
+/// What the last FrustumCuller::cull() did
+struct CullStats {
+    size_t visible = 0;
+    size_t culled = 0;
+    size_t nodes_tested = 0;
+    double cull_ms = 0.0;
+};
+
+/// Finds the objects of a Bvh that are at least partly inside a frustum.
+///
+/// The top of the tree is walked on the calling thread until there are enough subtrees to keep every thread busy,
+/// then the subtrees are walked in parallel. Nodes entirely outside the frustum are skipped with all their objects,
+/// nodes entirely inside have all their objects accepted without testing them, and in the leaves the frustum
+/// straddles, the objects are tested 4 at a time with SSE (where available).
+class FrustumCuller {
+public:
+    /// Write the indices of the visible objects to visible, in the hierarchy's slot order
+    void cull(const Bvh& bvh, const Frustum& frustum, JobSystem& jobs, std::vector<uint32_t>& visible);
+
+    [[nodiscard]] const CullStats& get_stats() const { return stats; }
+
+private:
+    /// A subtree to walk, and whether its root is already known to be entirely inside
+    struct Task {
+        uint32_t node;
+        bool inside;
+    };
+
+    std::vector<Task> tasks;
+    // The level below tasks while splitting the top of the tree, kept so that culling doesn't allocate once it has grown
+    std::vector<Task> next_tasks;
+    // Each task's visible objects, kept between frames so that they don't have to be allocated again
+    std::vector<std::vector<uint32_t>> task_visible;
+    std::vector<size_t> task_nodes_tested;
+    CullStats stats;
+};
+
+#endif //FRUSTUM_CULLER_H
@@ -0,0 +1,234 @@
+#include "GeometryPool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+RangeAllocator::RangeAllocator(size_t capacity) : capacity(capacity), free_units(0) {
+    reset(capacity, 0);
+}
+
+std::optional<size_t> RangeAllocator::allocate(size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    for (auto it = free_ranges.begin(); it != free_ranges.end(); ++it) {
+        if (it->second < size) {
+            continue;
+        }
+        size_t offset = it->first;
+        size_t remaining = it->second - size;
+        free_ranges.erase(it);
+        if (remaining > 0) {
+            free_ranges.emplace(offset + size, remaining);
+        }
+        free_units -= size;
+        return offset;
+    }
+    return std::nullopt;
+}
+
+void RangeAllocator::free(size_t offset, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    free_units += size;
+
+    // Merge with the free range after it, then the one before it
+    auto next = free_ranges.lower_bound(offset);
+    if (next != free_ranges.end() && next->first == offset + size) {
+        size += next->second;
+        next = free_ranges.erase(next);
+    }
+    if (next != free_ranges.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+    free_ranges.emplace(offset, size);
+}
+
+void RangeAllocator::reset(size_t new_capacity, size_t used) {
+    capacity = new_capacity;
+    free_units = capacity - used;
+    free_ranges.clear();
+    if (free_units > 0) {
+        free_ranges.emplace(used, free_units);
+    }
+}
+
+size_t RangeAllocator::get_largest_free() const {
+    size_t largest = 0;
+    for (const auto& range : free_ranges) {
+        largest = std::max(largest, range.second);
+    }
+    return largest;
+}
+
+void GeometryPool::create(size_t size_of_vertex, void (*set_vertex_attributes)(size_t), size_t vertex_capacity,
+                          size_t index_capacity) {
+    vertex_size = size_of_vertex;
+    set_attributes = set_vertex_attributes;
+
+    glGenVertexArrays(1, &vertex_array);
+    glGenBuffers(1, &vertex_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr) (vertex_size * vertex_capacity), nullptr, GL_STATIC_DRAW);
+    glGenBuffers(1, &index_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr) (sizeof(uint) * index_capacity), nullptr, GL_STATIC_DRAW);
+    vertex_ranges.reset(vertex_capacity, 0);
+    index_ranges.reset(index_capacity, 0);
+    attach_buffers();
+}
+
+void GeometryPool::cleanup() {
+    glDeleteVertexArrays(1, &vertex_array);
+    glDeleteBuffers(1, &vertex_buffer);
+    glDeleteBuffers(1, &index_buffer);
+    vertex_array = vertex_buffer = index_buffer = 0;
+    meshes.clear();
+    mesh_used.clear();
+    free_handles.clear();
+}
+
+void GeometryPool::attach_buffers() {
+    glBindVertexArray(vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    set_attributes(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+}
+
+std::optional<GeometryHandle> GeometryPool::add(const void* vertices, size_t vertex_count, const uint* indices, size_t index_count) {
+    auto allocate = [&]() -> std::optional<GeometryRange> {
+        auto first_vertex = vertex_ranges.allocate(vertex_count);
+        if (!first_vertex) {
+            return std::nullopt;
+        }
+        auto first_index = index_ranges.allocate(index_count);
+        if (!first_index) {
+            vertex_ranges.free(*first_vertex, vertex_count);
+            return std::nullopt;
+        }
+        return GeometryRange{(uint) *first_vertex, (uint) vertex_count, (uint) *first_index, (uint) index_count};
+    };
+
+    auto range = allocate();
+    if (!range && vertex_ranges.get_free() >= vertex_count && index_ranges.get_free() >= index_count) {
+        // There is room, just not in one piece
+        defragment();
+        range = allocate();
+    }
+    if (!range) {
+        // Grow by at least half again, so that adding meshes one at a time doesn't copy the whole pool every time
+        size_t vertex_capacity = vertex_ranges.get_capacity();
+        size_t index_capacity = index_ranges.get_capacity();
+        size_t vertices_needed = vertex_capacity - vertex_ranges.get_free() + vertex_count;
+        size_t indices_needed = index_capacity - index_ranges.get_free() + index_count;
+        if (vertices_needed > std::numeric_limits<uint>::max() || indices_needed > std::numeric_limits<uint>::max()) {
+            std::cerr << "Geometry pool can't fit a mesh of " << vertex_count << " vertices and " << index_count
+                      << " indices" << std::endl;
+            return std::nullopt;
+        }
+        reallocate(std::max(vertices_needed, vertex_capacity + vertex_capacity / 2),
+                   std::max(indices_needed, index_capacity + index_capacity / 2));
+        range = allocate();
+        if (!range) {
+            return std::nullopt;
+        }
+    }
+
+    // Uploaded through the copy binding, so that the bindings the vertex array or a GlStateCache know about stay
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr) (vertex_size * range->first_vertex),
+                    (GLsizeiptr) (vertex_size * vertex_count), vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr) (sizeof(uint) * range->first_index),
+                    (GLsizeiptr) (sizeof(uint) * index_count), indices);
+
+    GeometryHandle handle;
+    if (!free_handles.empty()) {
+        handle = free_handles.back();
+        free_handles.pop_back();
+        meshes[handle] = *range;
+        mesh_used[handle] = 1;
+    } else {
+        handle = (GeometryHandle) meshes.size();
+        meshes.push_back(*range);
+        mesh_used.push_back(1);
+    }
+    return handle;
+}
+
+void GeometryPool::remove(GeometryHandle handle) {
+    const GeometryRange& range = meshes[handle];
+    vertex_ranges.free(range.first_vertex, range.vertex_count);
+    index_ranges.free(range.first_index, range.index_count);
+    mesh_used[handle] = 0;
+    free_handles.push_back(handle);
+}
+
+void GeometryPool::defragment() {
+    reallocate(vertex_ranges.get_capacity(), index_ranges.get_capacity());
+    defragmentations++;
+}
+
+void GeometryPool::reallocate(size_t vertex_capacity, size_t index_capacity) {
+    std::vector<GeometryHandle> handles;
+    for (GeometryHandle handle = 0; handle < meshes.size(); handle++) {
+        if (mesh_used[handle]) {
+            handles.push_back(handle);
+        }
+    }
+
+    // The copies go to new buffers, as copies within a buffer can't overlap. Each buffer's meshes keep their order,
+    // so that meshes that were added together stay next to each other.
+    auto copy_ranges = [&](uint& buffer, size_t element_size, size_t capacity, uint GeometryRange::* first,
+                           uint GeometryRange::* count) {
+        std::sort(handles.begin(), handles.end(), [&](GeometryHandle a, GeometryHandle b) {
+            return meshes[a].*first < meshes[b].*first;
+        });
+        uint new_buffer;
+        glGenBuffers(1, &new_buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr) (element_size * capacity), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        size_t next = 0;
+        for (GeometryHandle handle : handles) {
+            GeometryRange& range = meshes[handle];
+            if (range.*count > 0) {
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr) (element_size * (range.*first)),
+                                    (GLintptr) (element_size * next), (GLsizeiptr) (element_size * (range.*count)));
+            }
+            range.*first = (uint) next;
+            next += range.*count;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = new_buffer;
+        return next;
+    };
+
+    if (vertex_capacity != vertex_ranges.get_capacity() || index_capacity != index_ranges.get_capacity()) {
+        reallocations++;
+    }
+    size_t vertices_used = copy_ranges(vertex_buffer, vertex_size, vertex_capacity, &GeometryRange::first_vertex, &GeometryRange::vertex_count);
+    size_t indices_used = copy_ranges(index_buffer, sizeof(uint), index_capacity, &GeometryRange::first_index, &GeometryRange::index_count);
+    vertex_ranges.reset(vertex_capacity, vertices_used);
+    index_ranges.reset(index_capacity, indices_used);
+    attach_buffers();
+}
+
+GeometryPoolStats GeometryPool::get_stats() const {
+    GeometryPoolStats stats;
+    stats.meshes = meshes.size() - free_handles.size();
+    stats.vertex_capacity = vertex_ranges.get_capacity();
+    stats.vertices_used = vertex_ranges.get_capacity() - vertex_ranges.get_free();
+    stats.index_capacity = index_ranges.get_capacity();
+    stats.indices_used = index_ranges.get_capacity() - index_ranges.get_free();
+    stats.free_ranges = vertex_ranges.get_free_range_count() + index_ranges.get_free_range_count();
+    stats.reallocations = reallocations;
+    stats.defragmentations = defragmentations;
+    return stats;
+}
@@ -0,0 +1,134 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include <glad/gl.h>
+
+#include "VertexFormat.h"
+
+// A useful shorthand that not all compilers provide by default
+using uint = unsigned int;
+
+/// Hands out ranges of [0, capacity) from a free list, first fit. Freed ranges are merged with the free ones on either
+/// side of them, so the list only ever has gaps between allocated ranges in it.
+class RangeAllocator {
+public:
+    explicit RangeAllocator(size_t capacity = 0);
+
+    /// Returns the start of a free range of size units, or nothing if there is no gap big enough
+    std::optional<size_t> allocate(size_t size);
+    /// Give back a range returned by allocate()
+    void free(size_t offset, size_t size);
+    /// Forget every range, and make the first used units allocated, e.g. after the ranges have been moved together
+    void reset(size_t new_capacity, size_t used);
+
+    [[nodiscard]] size_t get_capacity() const { return capacity; }
+    [[nodiscard]] size_t get_free() const { return free_units; }
+    [[nodiscard]] size_t get_largest_free() const;
+    [[nodiscard]] size_t get_free_range_count() const { return free_ranges.size(); }
+
+private:
+    size_t capacity;
+    size_t free_units;
+    // The free ranges, from their start to their size
+    std::map<size_t, size_t> free_ranges;
+};
+
+/// Refers to a mesh in a GeometryPool. It stays valid while the mesh moves around the pool, when it's defragmented.
+using GeometryHandle = uint32_t;
+
+/// Where a mesh currently is in its pool's buffers. The indices are relative to the mesh's first vertex, so the mesh is
+/// drawn with first_vertex as the base vertex.
+struct GeometryRange {
+    uint first_vertex;
+    uint vertex_count;
+    uint first_index;
+    uint index_count;
+};
+
+/// What a GeometryPool holds, safe to read on the thread that uses it
+struct GeometryPoolStats {
+    size_t meshes = 0;
+    size_t vertex_capacity = 0;
+    size_t vertices_used = 0;
+    size_t index_capacity = 0;
+    size_t indices_used = 0;
+    /// The number of gaps between meshes, more of them for the same free space means more fragmentation
+    size_t free_ranges = 0;
+    uint64_t reallocations = 0;
+    uint64_t defragmentations = 0;
+};
+
+/// The meshes of one vertex format, all in the same vertex buffer and index buffer, with one vertex array object over
+/// them. Any of the meshes can be drawn without binding anything, with the base vertex variants of the draw calls (or
+/// many of them with one multi draw), where giving each mesh its own buffers and vertex array would mean binding them
+/// for every mesh drawn.
+///
+/// Each mesh takes a range of the vertex buffer and one of the index buffer, from a RangeAllocator each. Freeing meshes
+/// leaves gaps that may be too small to reuse, so when a mesh doesn't fit, the meshes are first moved together to the
+/// start of the buffers (on the GPU, with glCopyBufferSubData), and only if it still doesn't fit are they reallocated
+/// bigger. The indices are relative to their mesh's first vertex, so moving a mesh doesn't change them.
+///
+/// Everything must be called with the context current. The vertex array and buffers are bound directly, so a
+/// GlStateCache in use has to be invalidated after anything that uploads or moves meshes.
+class GeometryPool {
+public:
+    GeometryPool() = default;
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    /// Create the buffers and vertex array for vertices of type V, with room for the given number of vertices and
+    /// indices to start with
+    template<typename V>
+    void init(size_t vertex_capacity, size_t index_capacity) {
+        create(sizeof(V), &set_vertex_attributes<V>, vertex_capacity, index_capacity);
+    }
+    /// Delete the buffers and vertex array
+    void cleanup();
+
+    /// Copy a mesh into the pool, vertices is vertex_count vertices of the pool's type, and indices are relative to
+    /// the first of them. Returns nothing if the pool can't be grown to fit it.
+    std::optional<GeometryHandle> add(const void* vertices, size_t vertex_count, const uint* indices, size_t index_count);
+    /// Free a mesh's ranges for others to use
+    void remove(GeometryHandle handle);
+    /// Move every mesh to the start of the buffers, in the order they are in now, leaving one free range at the end
+    void defragment();
+
+    [[nodiscard]] const GeometryRange& get_range(GeometryHandle handle) const { return meshes[handle]; }
+    [[nodiscard]] uint get_vertex_array() const { return vertex_array; }
+    [[nodiscard]] uint get_vertex_buffer() const { return vertex_buffer; }
+    [[nodiscard]] uint get_index_buffer() const { return index_buffer; }
+    [[nodiscard]] bool is_initialised() const { return vertex_array != 0; }
+    [[nodiscard]] GeometryPoolStats get_stats() const;
+
+private:
+    size_t vertex_size = 0;
+    void (*set_attributes)(size_t) = nullptr;
+
+    uint vertex_array = 0;
+    uint vertex_buffer = 0;
+    uint index_buffer = 0;
+    RangeAllocator vertex_ranges;
+    RangeAllocator index_ranges;
+
+    // Indexed by handle, the handles in free_handles are unused
+    std::vector<GeometryRange> meshes;
+    std::vector<uint8_t> mesh_used;
+    std::vector<GeometryHandle> free_handles;
+
+    uint64_t reallocations = 0;
+    uint64_t defragmentations = 0;
+
+    void create(size_t size_of_vertex, void (*set_vertex_attributes)(size_t), size_t vertex_capacity, size_t index_capacity);
+    /// Replace the buffers with ones of the given capacities, copying the meshes to the start of them (in order)
+    void reallocate(size_t vertex_capacity, size_t index_capacity);
+    /// Point the vertex array at the current buffers
+    void attach_buffers();
+};
+
+#endif //GEOMETRY_POOL_H
@@ -0,0 +1,235 @@
+#include "GlStateCache.h"
+
+#include <algorithm>
+
+#include "StreamBuffer.h"
+
+template<typename T>
+bool GlStateCache::update(std::optional<T>& cached, const T& value) {
+    if (cached && *cached == value) {
+        frame_stats.filtered++;
+        return false;
+    }
+    cached = value;
+    frame_stats.issued++;
+    return true;
+}
+
+void GlStateCache::use_program(uint new_program) {
+    if (update(program, new_program)) {
+        glUseProgram(new_program);
+    }
+}
+
+void GlStateCache::bind_vertex_array(uint vao) {
+    if (update(vertex_array, vao)) {
+        glBindVertexArray(vao);
+        element_buffer.reset();
+    }
+}
+
+void GlStateCache::bind_array_buffer(uint buffer) {
+    if (update(array_buffer, buffer)) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    }
+}
+
+void GlStateCache::bind_element_buffer(uint buffer) {
+    if (update(element_buffer, buffer)) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    }
+}
+
+void GlStateCache::set_depth_test(bool enabled) {
+    if (update(depth_test, enabled)) {
+        enabled ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+    }
+}
+
+void GlStateCache::set_blend(bool enabled) {
+    if (update(blend, enabled)) {
+        enabled ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+    }
+}
+
+void GlStateCache::set_blend_func(GLenum source, GLenum destination) {
+    if (update(blend_func, {source, destination})) {
+        glBlendFunc(source, destination);
+    }
+}
+
+void GlStateCache::set_viewport(int x, int y, int width, int height) {
+    if (update(viewport, {x, y, width, height})) {
+        glViewport(x, y, width, height);
+    }
+}
+
+void GlStateCache::invalidate() {
+    program.reset();
+    vertex_array.reset();
+    array_buffer.reset();
+    element_buffer.reset();
+    depth_test.reset();
+    blend.reset();
+    blend_func.reset();
+    viewport.reset();
+}
+
+void GlStateCache::end_frame() {
+    last_issued = frame_stats.issued;
+    last_filtered = frame_stats.filtered;
+    last_draws = frame_stats.draws;
+    frame_stats = {};
+}
+
+GlStateStats GlStateCache::get_last_frame_stats() const {
+    GlStateStats stats;
+    stats.issued = last_issued;
+    stats.filtered = last_filtered;
+    stats.draws = last_draws;
+    return stats;
+}
+
+uint64_t DrawItem::get_sort_key() const {
+    // 1 bit blend | 31 bits program | 31 bits vertex array | 1 bit depth test. GL names are small in practice,
+    // so truncating them only risks putting two draws in the wrong order, never drawing them wrong.
+    return ((uint64_t) blend << 63) | ((uint64_t) (program & 0x7fffffff) << 32)
+           | ((uint64_t) (vao & 0x7fffffff) << 1) | (uint64_t) !depth_test;
+}
+
+bool DrawQueue::has_indirect() {
+#ifdef GL_VERSION_4_3
+    return GLAD_GL_VERSION_4_3;
+#else
+    return false;
+#endif
+}
+
+void DrawQueue::flush(GlStateCache& state) {
+    std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) {
+        return a.get_sort_key() < b.get_sort_key();
+    });
+
+    bool indirect = indirect_enabled && has_indirect() && stream_buffer;
+    if (indirect && !items.empty()) {
+        // Every draw's parameters are written into the frame's region of the stream buffer at once, each run of draws
+        // then reads its own part of them. If they don't fit, the draws are issued directly instead.
+        auto* commands = (DrawElementsIndirectCommand*) stream_buffer->map(sizeof(DrawElementsIndirectCommand) * items.size(),
+                                                                          alignof(DrawElementsIndirectCommand), &indirect_offset);
+        if (commands) {
+            for (size_t i = 0; i < items.size(); i++) {
+                const DrawItem& item = items[i];
+                commands[i] = DrawElementsIndirectCommand{(uint) item.count, (uint) item.instance_count,
+                                                          (uint) item.first_index, item.base_vertex, (uint) item.base_instance};
+            }
+            stream_buffer->unmap();
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream_buffer->get_buffer());
+        } else {
+            indirect = false;
+        }
+    }
+
+    for (size_t begin = 0; begin < items.size();) {
+        const DrawItem& first = items[begin];
+        size_t end = begin + 1;
+        while (end < items.size() && items[end].program == first.program && items[end].vao == first.vao
+               && items[end].depth_test == first.depth_test && items[end].blend == first.blend) {
+            end++;
+        }
+
+        state.use_program(first.program);
+        state.bind_vertex_array(first.vao);
+        state.set_depth_test(first.depth_test);
+        state.set_blend(first.blend);
+        if (indirect) {
+            issue_indirect(state, begin, end);
+        } else {
+            issue_direct(state, begin, end);
+        }
+        begin = end;
+    }
+    items.clear();
+}
+
+void DrawQueue::issue_indirect(GlStateCache& state, size_t begin, size_t end) {
+#ifdef GL_VERSION_4_3
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                (const void*) (indirect_offset + sizeof(DrawElementsIndirectCommand) * begin),
+                                (GLsizei) (end - begin), 0);
+    state.count_draw();
+#else
+    issue_direct(state, begin, end);
+#endif
+}
+
+void DrawQueue::issue_direct(GlStateCache& state, size_t begin, size_t end) {
+#ifdef GL_VERSION_4_2
+    bool base_instance_supported = GLAD_GL_VERSION_4_2;
+#else
+    bool base_instance_supported = false;
+#endif
+    // The instance the attributes point at, unknown until the first draw of the run has set it
+    std::optional<int> current_base_instance;
+    if (base_instance_supported || !set_base_instance) {
+        current_base_instance = 0;
+    }
+
+    for (size_t i = begin; i < end;) {
+        const DrawItem& item = items[i];
+        if (!base_instance_supported && current_base_instance != item.base_instance && set_base_instance) {
+            set_base_instance(item.base_instance);
+            current_base_instance = item.base_instance;
+        }
+
+        // Merge the single instance draws that follow, from the same instance
+        size_t run_end = i + 1;
+        if (item.instance_count == 1) {
+            while (run_end < end && items[run_end].instance_count == 1 && items[run_end].base_instance == item.base_instance) {
+                run_end++;
+            }
+        }
+        if (run_end - i > 1) {
+            multi_draw_offsets.clear();
+            multi_draw_counts.clear();
+            multi_draw_base_vertices.clear();
+            for (size_t j = i; j < run_end; j++) {
+                multi_draw_offsets.push_back((const void*) (sizeof(uint) * (size_t) items[j].first_index));
+                multi_draw_counts.push_back(items[j].count);
+                multi_draw_base_vertices.push_back(items[j].base_vertex);
+            }
+            if (base_instance_supported && item.base_instance != 0) {
+                // There is no multi draw with a base instance before the indirect one, so these have to go one by one
+                for (size_t j = i; j < run_end; j++) {
+                    draw_base_instance(items[j]);
+                    state.count_draw();
+                }
+            } else {
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, multi_draw_counts.data(), GL_UNSIGNED_INT,
+                                              multi_draw_offsets.data(), (GLsizei) multi_draw_counts.size(),
+                                              multi_draw_base_vertices.data());
+                state.count_draw();
+            }
+        } else if (base_instance_supported && item.base_instance != 0) {
+            draw_base_instance(item);
+            state.count_draw();
+        } else if (item.instance_count == 1) {
+            glDrawElementsBaseVertex(GL_TRIANGLES, item.count, GL_UNSIGNED_INT,
+                                     (const void*) (sizeof(uint) * (size_t) item.first_index), item.base_vertex);
+            state.count_draw();
+        } else {
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.count, GL_UNSIGNED_INT,
+                                              (const void*) (sizeof(uint) * (size_t) item.first_index),
+                                              item.instance_count, item.base_vertex);
+            state.count_draw();
+        }
+        i = run_end;
+    }
+}
+
+void DrawQueue::draw_base_instance(const DrawItem& item) {
+#ifdef GL_VERSION_4_2
+    glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, item.count, GL_UNSIGNED_INT,
+                                                  (const void*) (sizeof(uint) * (size_t) item.first_index),
+                                                  item.instance_count, item.base_vertex, (uint) item.base_instance);
+#endif
+}
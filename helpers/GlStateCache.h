@@ -0,0 +1,162 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include <glad/gl.h>
+
+class StreamBuffer;
+
+// A useful shorthand that not all compilers provide by default
+using uint = unsigned int;
+
+/// The number of state changing calls made through a GlStateCache in a frame
+struct GlStateStats {
+    /// Calls passed on to GL, because they changed something
+    uint64_t issued = 0;
+    /// Calls dropped, because GL was already in that state
+    uint64_t filtered = 0;
+    uint64_t draws = 0;
+};
+
+/// A thin layer over the state changing GL calls the app makes (program, vertex array, array and element buffer,
+/// depth test, blending and viewport), that remembers what is currently set and drops calls that wouldn't change it.
+/// Each redundant call saved is a trip through the driver's validation that doesn't happen.
+///
+/// The cache starts out not knowing anything, so the first call to each setter is always issued. Anything that
+/// changes the same state behind its back has to be followed by invalidate(). The exception is ImGUI's OpenGL backend,
+/// which saves and restores all of this state around its own rendering, so the cache stays valid.
+///
+/// It must only be used on the thread the context is current on, but the statistics can be read from any thread.
+class GlStateCache {
+public:
+    void use_program(uint program);
+    /// Also forgets the element buffer, since that binding is part of the vertex array object
+    void bind_vertex_array(uint vao);
+    void bind_array_buffer(uint buffer);
+    void bind_element_buffer(uint buffer);
+    void set_depth_test(bool enabled);
+    void set_blend(bool enabled);
+    void set_blend_func(GLenum source, GLenum destination);
+    void set_viewport(int x, int y, int width, int height);
+
+    /// Forget the current state, e.g. after a buffer that may be bound was deleted (its name can be reused)
+    void invalidate();
+
+    /// Count a draw call made with the current state
+    void count_draw() { frame_stats.draws++; }
+    /// Publish the frame's counts for get_last_frame_stats(), and start counting the next frame
+    void end_frame();
+    [[nodiscard]] GlStateStats get_last_frame_stats() const;
+
+private:
+    struct Viewport {
+        int x, y, width, height;
+        bool operator==(const Viewport& other) const {
+            return x == other.x && y == other.y && width == other.width && height == other.height;
+        }
+    };
+
+    // Empty when unknown
+    std::optional<uint> program;
+    std::optional<uint> vertex_array;
+    std::optional<uint> array_buffer;
+    std::optional<uint> element_buffer;
+    std::optional<bool> depth_test;
+    std::optional<bool> blend;
+    std::optional<std::pair<GLenum, GLenum>> blend_func;
+    std::optional<Viewport> viewport;
+
+    GlStateStats frame_stats;
+    std::atomic<uint64_t> last_issued{0};
+    std::atomic<uint64_t> last_filtered{0};
+    std::atomic<uint64_t> last_draws{0};
+
+    /// Store value in cached and return true if it's different, so the call needs to be made. Counts the call either way.
+    template<typename T>
+    bool update(std::optional<T>& cached, const T& value);
+};
+
+/// The state a draw needs, besides the vertex array's own. Draws are sorted by this, so that the ones sharing state
+/// end up next to each other and the state only changes between them.
+struct DrawItem {
+    uint program;
+    uint vao;
+    bool depth_test;
+    bool blend;
+    int count;
+    /// Where the draw's indices start in the vertex array's element buffer, e.g. for a mesh's levels of detail
+    int first_index;
+    /// Added to every index, for meshes that share their buffers with others, see GeometryPool
+    int base_vertex;
+    int instance_count;
+    /// The first instance of the per-instance attributes to draw from
+    int base_instance;
+
+    /// Blended draws go last, as they have to be drawn over everything else, then they are grouped by program, the most
+    /// expensive state to change, then by vertex array, then by depth test.
+    [[nodiscard]] uint64_t get_sort_key() const;
+};
+
+/// Collects a pass's draws, then sorts and issues them through a GlStateCache.
+/// Sorting is stable, so draws with the same key are issued in the order they were submitted.
+///
+/// Each run of draws with the same state is issued with as few calls as the context allows. With GL 4.3 that's a
+/// single glMultiDrawElementsIndirect, the draws' parameters streamed through the StreamBuffer given to
+/// set_stream_buffer(), so the indirect buffer is never reallocated or synchronised with. Otherwise each draw is its
+/// own glDrawElementsInstancedBaseVertex (or glDrawElementsInstancedBaseVertexBaseInstance with GL 4.2), except runs of
+/// single instance draws from the same base instance, which are merged into a glMultiDrawElementsBaseVertex.
+///
+/// Before GL 4.2 there is no base instance, so the per-instance attributes have to be pointed at each draw's first
+/// instance instead, by the function given to set_base_instance_function(). Draws with a base instance other than 0
+/// need one there.
+class DrawQueue {
+public:
+    /// The layout glMultiDrawElementsIndirect reads each draw's parameters in
+    struct DrawElementsIndirectCommand {
+        uint count;
+        uint instance_count;
+        uint first_index;
+        int base_vertex;
+        uint base_instance;
+    };
+
+    void submit(const DrawItem& item) { items.push_back(item); }
+    /// Sort and issue the submitted draws, then clear the queue. The indirect commands are written to the stream
+    /// buffer's current frame, which needs room for a DrawElementsIndirectCommand per draw, 4 byte aligned.
+    void flush(GlStateCache& state);
+
+    /// Set the buffer the indirect commands are streamed through. Without one, the draws are issued directly.
+    void set_stream_buffer(StreamBuffer* buffer) { stream_buffer = buffer; }
+    /// Set the function that points the bound vertex array's per-instance attributes at an instance, without GL 4.2
+    void set_base_instance_function(std::function<void(int)> function) { set_base_instance = std::move(function); }
+    /// Whether to use glMultiDrawElementsIndirect when the context has it, so the two ways can be compared
+    void set_indirect_enabled(bool enabled) { indirect_enabled = enabled; }
+    /// Whether the context has glMultiDrawElementsIndirect
+    [[nodiscard]] static bool has_indirect();
+
+    [[nodiscard]] size_t size() const { return items.size(); }
+
+private:
+    std::vector<DrawItem> items;
+    std::function<void(int)> set_base_instance;
+    bool indirect_enabled = true;
+    StreamBuffer* stream_buffer = nullptr;
+    // Where this flush's indirect commands start in the stream buffer
+    size_t indirect_offset = 0;
+    // The starts of the indices and the counts of a merged run of single instance draws
+    std::vector<const void*> multi_draw_offsets;
+    std::vector<GLsizei> multi_draw_counts;
+    std::vector<GLint> multi_draw_base_vertices;
+
+    void issue_indirect(GlStateCache& state, size_t begin, size_t end);
+    void issue_direct(GlStateCache& state, size_t begin, size_t end);
+    /// Only called when the context has GL 4.2
+    static void draw_base_instance(const DrawItem& item);
+};
+
+#endif //GL_STATE_CACHE_H
@@ -0,0 +1,188 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <imgui/imgui.h>
+
+#include "imgui/ImGuiReadouts.h"
+
+void GpuProfiler::init() {
+    for (auto& frame : frames) {
+        glGenQueries(MAX_ZONES * 2, frame.queries);
+    }
+    initialised = true;
+}
+
+void GpuProfiler::cleanup() {
+    if (!initialised) {
+        return;
+    }
+    for (auto& frame : frames) {
+        glDeleteQueries(MAX_ZONES * 2, frame.queries);
+        frame = FrameQueries{};
+    }
+    initialised = false;
+    in_frame = false;
+}
+
+int GpuProfiler::get_zone_index(const char* name) {
+    std::lock_guard<std::mutex> lock(histories_mutex);
+    for (int i = 0; i < (int) zone_histories.size(); i++) {
+        if (zone_histories[i].name == name) {
+            return i;
+        }
+    }
+    zone_histories.push_back(ZoneHistory{name});
+    return (int) zone_histories.size() - 1;
+}
+
+void GpuProfiler::read_back(FrameQueries& frame) {
+    frame.in_flight = false;
+    if (frame.zone_count == 0 || frame.last_query < 0) {
+        return;
+    }
+
+    // Queries complete in the order they were issued, so if the last one issued is available so are the rest, and
+    // reading them won't wait. Never wait for it.
+    int available = 0;
+    glGetQueryObjectiv(frame.queries[frame.last_query], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        dropped_frames++;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(histories_mutex);
+    for (int zone = 0; zone < frame.zone_count; zone++) {
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(frame.queries[zone * 2], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(frame.queries[zone * 2 + 1], GL_QUERY_RESULT, &end);
+
+        ZoneHistory& history = zone_histories[frame.zone_indices[zone]];
+        history.durations_ms[history.next] = (float) ((double) (end - start) * 1e-6);
+        history.next = (history.next + 1) % HISTORY_SIZE;
+        history.count = std::min(history.count + 1, HISTORY_SIZE);
+    }
+}
+
+void GpuProfiler::begin_frame() {
+    if (!initialised) {
+        return;
+    }
+
+    FrameQueries& frame = frames[frame_index];
+    if (frame.in_flight) {
+        read_back(frame);
+    }
+    frame.zone_count = 0;
+    frame.last_query = -1;
+    open_zone_count = 0;
+    in_frame = true;
+}
+
+void GpuProfiler::end_frame() {
+    if (!in_frame) {
+        return;
+    }
+
+    // Close any zones left open, so their end timestamps exist
+    while (open_zone_count > 0) {
+        end_zone();
+    }
+    frames[frame_index].in_flight = true;
+    frame_index = (frame_index + 1) % FRAME_LATENCY;
+    in_frame = false;
+}
+
+void GpuProfiler::begin_zone(const char* name) {
+    FrameQueries& frame = frames[frame_index];
+    if (!in_frame || frame.zone_count == MAX_ZONES) {
+        return;
+    }
+
+    // Timestamps rather than GL_TIME_ELAPSED queries, as only one of those can be active at a time so they can't nest
+    int zone = frame.zone_count++;
+    frame.zone_indices[zone] = get_zone_index(name);
+    glQueryCounter(frame.queries[zone * 2], GL_TIMESTAMP);
+    open_zones[open_zone_count++] = zone;
+}
+
+void GpuProfiler::end_zone() {
+    if (!in_frame || open_zone_count == 0) {
+        return;
+    }
+
+    FrameQueries& frame = frames[frame_index];
+    int zone = open_zones[--open_zone_count];
+    frame.last_query = zone * 2 + 1;
+    glQueryCounter(frame.queries[frame.last_query], GL_TIMESTAMP);
+}
+
+void GpuProfiler::reset_stats() {
+    // The histories are kept, as the frames in flight refer to them by index
+    std::lock_guard<std::mutex> lock(histories_mutex);
+    for (auto& history : zone_histories) {
+        history.next = 0;
+        history.count = 0;
+    }
+    dropped_frames = 0;
+}
+
+std::pmr::vector<GpuZoneStats> GpuProfiler::get_zone_stats(std::pmr::memory_resource* memory) const {
+    std::pmr::vector<GpuZoneStats> stats{memory};
+    std::pmr::vector<float> sorted{memory};
+    std::lock_guard<std::mutex> lock(histories_mutex);
+    for (const auto& history : zone_histories) {
+        if (history.count == 0) {
+            continue;
+        }
+
+        sorted.assign(history.durations_ms, history.durations_ms + history.count);
+        std::sort(sorted.begin(), sorted.end());
+
+        double total = 0.0;
+        for (float duration : sorted) {
+            total += duration;
+        }
+        auto p99_index = std::min((size_t) std::ceil(0.99 * (double) sorted.size()), sorted.size()) - 1;
+        int last = (history.next + HISTORY_SIZE - 1) % HISTORY_SIZE;
+
+        stats.push_back(GpuZoneStats{history.name, history.durations_ms[last], sorted.front(),
+                                     (float) (total / (double) sorted.size()), sorted[p99_index]});
+    }
+    return stats;
+}
+
+void GpuProfiler::ui(std::pmr::memory_resource* memory) const {
+    if (ImGui::Begin("GPU Profiler", nullptr, ImGuiWindowFlags_NoFocusOnAppearing)) {
+        if (!initialised) {
+            ImGui::TextDisabled("Not initialised");
+        } else if (ImGui::BeginTable("GPU Zones", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("Zone");
+            ImGui::TableSetupColumn("Last (ms)");
+            ImGui::TableSetupColumn("Min (ms)");
+            ImGui::TableSetupColumn("Avg (ms)");
+            ImGui::TableSetupColumn("P99 (ms)");
+            ImGui::TableHeadersRow();
+
+            for (const auto& zone : get_zone_stats(memory)) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(zone.name);
+                ImGui::TableNextColumn();
+                ImGuiReadouts::text("%.3f", zone.last_ms);
+                ImGui::TableNextColumn();
+                ImGuiReadouts::text("%.3f", zone.min_ms);
+                ImGui::TableNextColumn();
+                ImGuiReadouts::text("%.3f", zone.avg_ms);
+                ImGui::TableNextColumn();
+                ImGuiReadouts::text("%.3f", zone.p99_ms);
+            }
+            ImGui::EndTable();
+        }
+        ImGui::Text("Over the last %d frames, %d frames latency", HISTORY_SIZE, FRAME_LATENCY);
+        ImGuiReadouts::text("Dropped frames: %llu", (unsigned long long) dropped_frames.load());
+    }
+    ImGui::End();
+}
@@ -0,0 +1,121 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+#include <glad/gl.h>
+
+// A useful shorthand that not all compilers provide by default
+using uint = unsigned int;
+
+/// Timing statistics of one zone over the recent history, in milliseconds
+struct GpuZoneStats {
+    const char* name;
+    float last_ms;
+    float min_ms;
+    float avg_ms;
+    float p99_ms;
+};
+
+/// Measures how long the GPU spends on named zones of each frame, using timestamp queries.
+///
+/// The results of a frame's queries aren't available until the GPU has caught up with it, and waiting for them would
+/// stall the CPU, so each frame's queries come from a ring that is several frames deep. They are read back when their
+/// slot comes round again, by which point the GPU has normally finished with them. If it hasn't, that frame's results
+/// are dropped rather than waited for.
+///
+/// Zones are timed on the thread with the GL context, but the statistics can be read from any thread.
+class GpuProfiler {
+public:
+    /// The number of frames whose queries can be in flight at once
+    static const int FRAME_LATENCY = 4;
+    /// The most zones that can be timed in one frame
+    static const int MAX_ZONES = 16;
+    /// The number of frames of results the statistics are over
+    static const int HISTORY_SIZE = 256;
+
+    /// Times a zone for as long as it is in scope
+    class Zone {
+        GpuProfiler& profiler;
+    public:
+        Zone(GpuProfiler& profiler, const char* name) : profiler(profiler) { profiler.begin_zone(name); }
+        ~Zone() { profiler.end_zone(); }
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+    };
+
+    GpuProfiler() = default;
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    /// Create the queries, must be called once the context is current
+    void init();
+    /// Delete the queries, must be called while the context is still current
+    void cleanup();
+
+    /// Read back the results of the frame that last used this frame's slot, and start the frame
+    void begin_frame();
+    void end_frame();
+
+    /// Start timing a zone, zones can be nested. The name must outlive the profiler, e.g. be a string literal,
+    /// as it's also what identifies the zone.
+    void begin_zone(const char* name);
+    void end_zone();
+
+    /// The statistics of every zone that has been timed, in the order they were first seen, allocated from memory
+    [[nodiscard]] std::pmr::vector<GpuZoneStats> get_zone_stats(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) const;
+    /// Forget every zone's durations so far, so that the statistics start over, e.g. after warming up. The frames
+    /// still in flight are counted once they are read back.
+    void reset_stats();
+    /// The number of frames whose results weren't ready in time, and so were dropped
+    [[nodiscard]] uint64_t get_dropped_frames() const { return dropped_frames; }
+
+    /// Show the statistics in an ImGui window, allocating them from memory, e.g. a FrameArena's
+    void ui(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) const;
+
+private:
+    /// The queries of one frame, each zone has a pair of timestamps
+    struct FrameQueries {
+        uint queries[MAX_ZONES * 2]{};
+        /// The zone each pair of queries is for, by index into zone_histories
+        int zone_indices[MAX_ZONES]{};
+        int zone_count = 0;
+        /// The query issued last, which completes last. Zones nest, so it's the end of the zone closed last (normally
+        /// the outermost), not the end of the zone opened last.
+        int last_query = -1;
+        /// Whether the queries have been issued and not yet read back
+        bool in_flight = false;
+    };
+
+    /// The recent durations of a zone, in a ring
+    struct ZoneHistory {
+        const char* name;
+        float durations_ms[HISTORY_SIZE]{};
+        int next = 0;
+        int count = 0;
+    };
+
+    FrameQueries frames[FRAME_LATENCY];
+    int frame_index = 0;
+    bool in_frame = false;
+    /// The zones that are open in the current frame, by index into the frame's zones
+    int open_zones[MAX_ZONES]{};
+    int open_zone_count = 0;
+
+    /// Guards zone_histories, which are read by get_zone_stats() on any thread
+    mutable std::mutex histories_mutex;
+    std::vector<ZoneHistory> zone_histories;
+    std::atomic<uint64_t> dropped_frames{0};
+    std::atomic<bool> initialised{false};
+
+    int get_zone_index(const char* name);
+    void read_back(FrameQueries& frame);
+};
+
+#endif //GPU_PROFILER_H
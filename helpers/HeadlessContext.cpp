@@ -0,0 +1,163 @@
+#include "HeadlessContext.h"
+
+#include <iostream>
+
+#ifdef __linux__
+// We only ever use EGL without a window system, so don't pull in the X11 headers
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::HeadlessContext(int width, int height) : width(width), height(height) {}
+
+HeadlessContext::~HeadlessContext() {
+    if (framebuffer) {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &colour_renderbuffer);
+        glDeleteRenderbuffers(1, &depth_renderbuffer);
+    }
+
+#ifdef __linux__
+    if (display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT) {
+            eglDestroyContext(display, context);
+        }
+        eglTerminate(display);
+    }
+#else
+    if (hidden_window) {
+        glfwDestroyWindow(hidden_window);
+        glfwTerminate();
+    }
+#endif
+}
+
+#ifdef __linux__
+// Get a display that doesn't need a window system, preferring Mesa's surfaceless platform, then the first
+// EGL device, and finally whatever the default display is.
+static EGLDisplay get_headless_display() {
+    auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display) {
+        EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY) {
+            return display;
+        }
+
+        auto query_devices = (PFNEGLQUERYDEVICESEXTPROC) eglGetProcAddress("eglQueryDevicesEXT");
+        EGLDeviceEXT device;
+        EGLint num_devices = 0;
+        if (query_devices && query_devices(1, &device, &num_devices) && num_devices > 0) {
+            display = get_platform_display(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+#endif
+
+bool HeadlessContext::init(int version_major, int version_minor) {
+#ifdef __linux__
+    display = get_headless_display();
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        std::cerr << "Failed to initialize an EGL display" << std::endl;
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL display doesn't support desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    // We never create a surface, so any config that can render OpenGL will do. Some surfaceless
+    // implementations expose no configs at all, in which case we rely on EGL_KHR_no_config_context.
+    const EGLint config_attributes[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(display, config_attributes, &config, 1, &num_configs) || num_configs == 0) {
+        config = EGL_NO_CONFIG_KHR;
+    }
+
+    const EGLint context_attributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, version_major,
+            EGL_CONTEXT_MINOR_VERSION, version_minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+    };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+    if (context == EGL_NO_CONTEXT) {
+        std::cerr << "Failed to create an EGL context for OpenGL " << version_major << "." << version_minor << std::endl;
+        return false;
+    }
+
+    // Requires EGL_KHR_surfaceless_context, all rendering goes to our framebuffer object
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cerr << "Failed to make the EGL context current without a surface" << std::endl;
+        return false;
+    }
+#else
+    if (!glfwInit()) {
+        return false;
+    }
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version_major);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version_minor);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#if __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif // __APPLE__
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    hidden_window = glfwCreateWindow(width, height, "Headless", nullptr, nullptr);
+    if (!hidden_window) {
+        std::cerr << "Failed to create a hidden window for headless rendering" << std::endl;
+        return false;
+    }
+    glfwMakeContextCurrent(hidden_window);
+    glfwSwapInterval(0);
+#endif
+
+    return true;
+}
+
+GLADloadfunc HeadlessContext::get_proc_address() {
+#ifdef __linux__
+    return (GLADloadfunc) eglGetProcAddress;
+#else
+    return (GLADloadfunc) glfwGetProcAddress;
+#endif
+}
+
+void HeadlessContext::create_framebuffer() {
+    glGenRenderbuffers(1, &colour_renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colour_renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &depth_renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour_renderbuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_renderbuffer);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Headless framebuffer is incomplete" << std::endl;
+    }
+
+    bind_framebuffer();
+}
+
+void HeadlessContext::bind_framebuffer() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+}
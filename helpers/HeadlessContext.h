@@ -0,0 +1,53 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <glad/gl.h>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+// A useful shorthand that not all compilers provide by default
+using uint = unsigned int;
+
+/// An OpenGL context that doesn't need a display, rendering into a framebuffer object instead of a window.
+/// On Linux this is a surfaceless EGL context (works with Mesa's llvmpipe on machines without a GPU),
+/// elsewhere it falls back to a hidden GLFW window.
+class HeadlessContext {
+    int width;
+    int height;
+
+#ifdef __linux__
+    // EGLDisplay and EGLContext, kept opaque so that the EGL (and X11) headers don't leak into users of this header
+    void* display = nullptr;
+    void* context = nullptr;
+#else
+    GLFWwindow* hidden_window = nullptr;
+#endif
+
+    uint framebuffer = 0;
+    uint colour_renderbuffer = 0;
+    uint depth_renderbuffer = 0;
+
+public:
+    HeadlessContext(int width, int height);
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    /// Create the context for the requested OpenGL version and make it current, returns false on failure.
+    bool init(int version_major, int version_minor);
+
+    /// The function to pass to gladLoadGL once the context is current.
+    static GLADloadfunc get_proc_address();
+
+    /// Create the framebuffer object to render into and bind it, must be called after GL has been loaded.
+    void create_framebuffer();
+    /// Bind the offscreen framebuffer and set the viewport to cover it.
+    void bind_framebuffer() const;
+
+    [[nodiscard]] int get_width() const { return width; }
+    [[nodiscard]] int get_height() const { return height; }
+};
+
+#endif //HEADLESS_CONTEXT_H
@@ -0,0 +1,249 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "CpuProfiler.h"
+
+// How many batches a parallel_for() without a batch size is split into per thread, so that a thread whose batches turn
+// out to be cheap can steal some of another's
+static const size_t BATCHES_PER_THREAD = 4;
+// How many times a worker looks for a job to steal before going to sleep
+static const int STEAL_ATTEMPTS = 64;
+
+// Which system's worker the calling thread is, if any, and the index of its queue
+static thread_local const JobSystem* current_system = nullptr;
+static thread_local size_t current_queue = 0;
+
+void JobSystem::WorkQueue::push(Job* job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ring[tail++ % JOB_CAPACITY] = job;
+}
+
+Job* JobSystem::WorkQueue::pop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (head == tail) {
+        return nullptr;
+    }
+    return ring[--tail % JOB_CAPACITY];
+}
+
+Job* JobSystem::WorkQueue::steal() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (head == tail) {
+        return nullptr;
+    }
+    return ring[head++ % JOB_CAPACITY];
+}
+
+JobSystem::JobSystem() : jobs(new Job[JOB_CAPACITY]) {
+    queues.push_back(std::make_unique<WorkQueue>());
+}
+
+JobSystem::~JobSystem() {
+    stop();
+}
+
+void JobSystem::start(int worker_count) {
+    stop();
+    stopping = false;
+    queues.resize(1);
+    for (int i = 0; i < worker_count; i++) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (int i = 0; i < worker_count; i++) {
+        threads.emplace_back([this, i] {
+            CpuProfiler::set_thread_name("Worker " + std::to_string(i + 1));
+            run_worker((size_t) i + 1);
+        });
+    }
+}
+
+void JobSystem::stop() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake_condition.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+Job* JobSystem::allocate(JobCounter* counter, Job* parent) {
+    // The slots are taken in turn, by the time one comes round again its job has normally long finished. If it hasn't,
+    // there are too many jobs in flight, so help them finish rather than wait.
+    Job* job = &jobs[next_job++ % JOB_CAPACITY];
+    bool expected = false;
+    while (!job->in_use.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
+        expected = false;
+        if (!run_one()) {
+            std::this_thread::yield();
+        }
+    }
+
+    job->parent = parent;
+    job->counter = counter;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    job->blockers.store(1, std::memory_order_relaxed);
+    job->finished = false;
+    job->continuation_count = 0;
+    if (parent) {
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (counter) {
+        counter->count.fetch_add(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+bool JobSystem::add_dependency(JobHandle job, JobHandle dependency) {
+    bool added = true;
+    while (dependency->continuation_lock.test_and_set(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    // Nothing to wait for if the dependency has already finished
+    if (!dependency->finished) {
+        if (dependency->continuation_count < Job::MAX_CONTINUATIONS) {
+            dependency->continuations[dependency->continuation_count++] = job;
+            job->blockers.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            added = false;
+        }
+    }
+    dependency->continuation_lock.clear(std::memory_order_release);
+
+    if (!added) {
+        std::cerr << "Job already has " << Job::MAX_CONTINUATIONS << " continuations" << std::endl;
+    }
+    return added;
+}
+
+void JobSystem::submit(JobHandle job) {
+    release(job);
+}
+
+void JobSystem::release(Job* job) {
+    if (job->blockers.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        push(job);
+    }
+}
+
+void JobSystem::push(Job* job) {
+    queues[get_queue_index()]->push(job);
+    queued_jobs.fetch_add(1);
+    // A worker going to sleep counts itself before checking for jobs, so either it sees this one or it's counted here
+    if (sleeping_workers.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        wake_condition.notify_one();
+    }
+}
+
+size_t JobSystem::get_queue_index() const {
+    return current_system == this ? current_queue : 0;
+}
+
+Job* JobSystem::find_job() {
+    size_t own = get_queue_index();
+    Job* job = queues[own]->pop();
+    if (!job) {
+        // Start with the queue after our own, so that the thieves spread out rather than all going for the first
+        for (size_t i = 1; i < queues.size() && !job; i++) {
+            job = queues[(own + i) % queues.size()]->steal();
+        }
+        if (job) {
+            jobs_stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (job) {
+        queued_jobs.fetch_sub(1);
+    }
+    return job;
+}
+
+bool JobSystem::run_one() {
+    Job* job = find_job();
+    if (!job) {
+        return false;
+    }
+    execute(job);
+    return true;
+}
+
+void JobSystem::execute(Job* job) {
+    job->run(*this, *job);
+    jobs_run.fetch_add(1, std::memory_order_relaxed);
+    finish(job);
+}
+
+void JobSystem::finish(Job* job) {
+    if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    job->destroy(*job);
+
+    // No more continuations can be added once it's marked as finished, so the ones there are can be released
+    while (job->continuation_lock.test_and_set(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    job->finished = true;
+    int continuation_count = job->continuation_count;
+    Job* continuations[Job::MAX_CONTINUATIONS];
+    std::copy(job->continuations, job->continuations + continuation_count, continuations);
+    job->continuation_lock.clear(std::memory_order_release);
+    for (int i = 0; i < continuation_count; i++) {
+        release(continuations[i]);
+    }
+
+    // The slot can be reused as soon as it's given up, so read what's still needed from it first. The counter is
+    // counted down last, as whoever waits for it may return (and destroy it) straight away.
+    Job* parent = job->parent;
+    JobCounter* counter = job->counter;
+    job->in_use.store(false, std::memory_order_release);
+    if (parent) {
+        finish(parent);
+    }
+    if (counter) {
+        counter->count.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    while (!counter.is_done()) {
+        if (!run_one()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+size_t JobSystem::get_batch_size(size_t count) const {
+    size_t batches = BATCHES_PER_THREAD * (size_t) get_thread_count();
+    return std::max<size_t>(1, (count + batches - 1) / batches);
+}
+
+void JobSystem::run_worker(size_t queue_index) {
+    current_system = this;
+    current_queue = queue_index;
+    while (true) {
+        bool found = false;
+        for (int attempt = 0; attempt < STEAL_ATTEMPTS && !found; attempt++) {
+            found = run_one();
+            if (!found) {
+                std::this_thread::yield();
+            }
+        }
+        if (found) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleeping_workers.fetch_add(1);
+        wake_condition.wait(lock, [this] { return stopping || queued_jobs.load() > 0; });
+        sleeping_workers.fetch_sub(1);
+        if (stopping) {
+            return;
+        }
+    }
+}
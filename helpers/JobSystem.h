@@ -0,0 +1,231 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class JobSystem;
+
+/// Counts the jobs created with it that haven't finished yet, so that a thread can wait for a whole group of them, e.g.
+/// everything started for a frame, with JobSystem::wait()
+class JobCounter {
+public:
+    [[nodiscard]] bool is_done() const { return count.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+    std::atomic<int> count{0};
+};
+
+/// A function to run on one of a JobSystem's threads, with everything needed to schedule it. The function is stored in
+/// the job itself, so creating one never allocates.
+struct Job {
+    /// The most bytes a job's function (its captures, for a lambda) may take
+    static constexpr size_t DATA_SIZE = 64;
+    /// The most jobs that can depend on one job, make them depend on an empty job in between for more
+    static constexpr int MAX_CONTINUATIONS = 8;
+
+    // Calls the function, and destroys it once the job and all its children have finished
+    void (*run)(JobSystem& system, Job& job) = nullptr;
+    void (*destroy)(Job& job) = nullptr;
+    alignas(std::max_align_t) unsigned char data[DATA_SIZE];
+
+    // The job that only finishes once this one has, and the counter counting this one
+    Job* parent = nullptr;
+    JobCounter* counter = nullptr;
+    // This job itself plus its children, until they finish
+    std::atomic<int> unfinished{0};
+    // The dependencies that haven't finished, plus one until the job is submitted
+    std::atomic<int> blockers{0};
+
+    // The jobs waiting on this one, guarded by continuation_lock so that a dependency can't be added as it finishes
+    std::atomic_flag continuation_lock = ATOMIC_FLAG_INIT;
+    bool finished = false;
+    int continuation_count = 0;
+    Job* continuations[MAX_CONTINUATIONS];
+
+    // Set while the slot is taken, from create() until the job has finished
+    std::atomic<bool> in_use{false};
+};
+
+/// Refers to a job. The jobs' storage is reused in turn, so a handle is only good until JobSystem::JOB_CAPACITY more
+/// jobs have been created after it, which is plenty for everything a frame starts.
+using JobHandle = Job*;
+
+/// How many jobs a JobSystem has run, and how many of them were taken from another thread's queue
+struct JobSystemStats {
+    uint64_t jobs_run = 0;
+    uint64_t jobs_stolen = 0;
+};
+
+/// A work stealing scheduler: a fixed set of worker threads, each with its own queue of jobs to run.
+///
+/// A thread pushes the jobs it creates onto its own queue and takes them back from the same end, newest first, so it
+/// keeps working on data that is still in its cache, and a job that splits itself ends up working depth first. A thread
+/// whose queue is empty steals from the other end of someone else's, taking the oldest job there, which for a job that
+/// splits itself in halves is the biggest piece of work left. Threads only sleep once there is nothing to steal.
+///
+/// Jobs can depend on other jobs (only starting once all of them have finished), and have children (only finishing
+/// once all of them have, so a job can split itself up and still be depended on as a whole). Threads that aren't
+/// workers, like the main thread, share one extra queue, and run jobs too while they wait for them, so with no workers
+/// everything simply runs on the thread that waits.
+///
+/// Each queue is a ring guarded by its own mutex, which is only ever contended by a thief, rather than a lock free
+/// (Chase-Lev) deque. Jobs are coarse enough (a chunk of objects, not a single object) that the locks don't show up.
+class JobSystem {
+public:
+    /// How many jobs can exist at once, the oldest slots are reused once their jobs have finished
+    static const size_t JOB_CAPACITY = 4096;
+
+    JobSystem();
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    /// Start worker_count threads, in addition to the threads that wait for jobs
+    void start(int worker_count);
+    /// Stop and join the threads, also done by the destructor. Every job submitted must have finished.
+    void stop();
+
+    /// Create a job that calls function(), without starting it, so that dependencies can be added first. It's counted
+    /// by counter, and is a child of parent, if given. It must be submitted, or it never finishes.
+    template<typename F>
+    JobHandle create(F&& function, JobCounter* counter = nullptr, JobHandle parent = nullptr) {
+        using Function = std::decay_t<F>;
+        static_assert(sizeof(Function) <= Job::DATA_SIZE, "The job's function is too big to store in the job");
+        static_assert(alignof(Function) <= alignof(std::max_align_t), "The job's function is aligned too strictly");
+
+        Job* job = allocate(counter, parent);
+        new(job->data) Function(std::forward<F>(function));
+        job->run = [](JobSystem&, Job& job) { (*std::launder(reinterpret_cast<Function*>(job.data)))(); };
+        job->destroy = [](Job& job) { std::launder(reinterpret_cast<Function*>(job.data))->~Function(); };
+        return job;
+    }
+
+    /// Create a job that calls function(i) for every i in [0, count), without starting it. The job splits the range in
+    /// halves until they are at most batch_size iterations (0 to pick a size that gives each thread a few batches),
+    /// leaving one half for other threads to steal each time, and only finishes once every iteration has returned.
+    template<typename F>
+    JobHandle create_parallel_for(size_t count, F&& function, size_t batch_size = 0, JobCounter* counter = nullptr) {
+        using Loop = ParallelFor<std::decay_t<F>>;
+        static_assert(sizeof(Loop) <= Job::DATA_SIZE, "The loop's function is too big to store in the job");
+
+        Job* job = allocate(counter, nullptr);
+        new(job->data) Loop{std::forward<F>(function), count, batch_size > 0 ? batch_size : get_batch_size(count)};
+        job->run = [](JobSystem& system, Job& job) {
+            run_range<Loop>(system, &job, 0, std::launder(reinterpret_cast<Loop*>(job.data))->count);
+        };
+        job->destroy = [](Job& job) { std::launder(reinterpret_cast<Loop*>(job.data))->~Loop(); };
+        return job;
+    }
+
+    /// Make job wait for dependency to finish before it starts. job must not have been submitted yet. Returns false if
+    /// dependency already has the most continuations it can have.
+    bool add_dependency(JobHandle job, JobHandle dependency);
+    /// Let a job start, as soon as its dependencies have finished
+    void submit(JobHandle job);
+
+    /// Run jobs on this thread until every job counted by counter has finished
+    void wait(JobCounter& counter);
+
+    /// Call function(i) for every i in [0, count), spread over the workers and the calling thread, and return once
+    /// they have all returned. Can be called from inside a job.
+    template<typename F>
+    void parallel_for(size_t count, F&& function, size_t batch_size = 0) {
+        if (count == 0) {
+            return;
+        }
+        // The function outlives the loop, so only a pointer to it is stored
+        auto* loop_function = &function;
+        JobCounter done;
+        submit(create_parallel_for(count, [loop_function](size_t i) { (*loop_function)(i); }, batch_size, &done));
+        wait(done);
+    }
+
+    /// The number of threads that run jobs, including one that waits for them
+    [[nodiscard]] int get_thread_count() const { return (int) threads.size() + 1; }
+    [[nodiscard]] JobSystemStats get_stats() const { return {jobs_run.load(), jobs_stolen.load()}; }
+
+private:
+    /// A job's queue of jobs ready to run. The owner pushes and pops at the back, thieves steal from the front.
+    struct WorkQueue {
+        std::mutex mutex;
+        // A ring of JOB_CAPACITY, which is as many jobs as can be queued at all, indexed by head and tail modulo that
+        std::vector<Job*> ring;
+        size_t head = 0;
+        size_t tail = 0;
+
+        WorkQueue() : ring(JOB_CAPACITY) {}
+        void push(Job* job);
+        Job* pop();
+        Job* steal();
+    };
+
+    template<typename Function>
+    struct ParallelFor {
+        Function function;
+        size_t count;
+        size_t batch_size;
+    };
+
+    std::unique_ptr<Job[]> jobs;
+    std::atomic<size_t> next_job{0};
+
+    // One queue per worker, after the one shared by every other thread
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> threads;
+
+    // The workers sleep on this once there are no jobs left to steal
+    std::mutex sleep_mutex;
+    std::condition_variable wake_condition;
+    std::atomic<int> sleeping_workers{0};
+    std::atomic<int> queued_jobs{0};
+    bool stopping = false;
+
+    std::atomic<uint64_t> jobs_run{0};
+    std::atomic<uint64_t> jobs_stolen{0};
+
+    Job* allocate(JobCounter* counter, Job* parent);
+    void push(Job* job);
+    /// A job from the calling thread's queue, or stolen from another
+    Job* find_job();
+    /// Run one job if there is any, returns false if there wasn't
+    bool run_one();
+    void execute(Job* job);
+    /// Count one of the job's own or its children's completions, and finish it once they all have
+    void finish(Job* job);
+    /// Count one of the job's blockers as gone, and queue it once none are left
+    void release(Job* job);
+    [[nodiscard]] size_t get_batch_size(size_t count) const;
+    /// The index of the calling thread's queue
+    [[nodiscard]] size_t get_queue_index() const;
+    void run_worker(size_t queue_index);
+
+    // Run function(i) for [begin, end) of the loop stored in root, leaving halves of it for other threads to steal
+    template<typename Loop>
+    static void run_range(JobSystem& system, Job* root, size_t begin, size_t end) {
+        Loop& loop = *std::launder(reinterpret_cast<Loop*>(root->data));
+        while (end - begin > loop.batch_size) {
+            size_t middle = begin + (end - begin) / 2;
+            system.submit(system.create([&system, root, middle, end] {
+                run_range<Loop>(system, root, middle, end);
+            }, nullptr, root));
+            end = middle;
+        }
+        for (size_t i = begin; i < end; i++) {
+            loop.function(i);
+        }
+    }
+};
+
+#endif //JOB_SYSTEM_H
@@ -0,0 +1,34 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// A useful shorthand that not all compilers provide by default
+using uint = unsigned int;
+
+/// The data of a single vertex, with the attributes interleaved.
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 colour;
+};
+
+/// The per-instance transform for instanced drawing, read by the vertex shader through attributes with a divisor of 1.
+/// It is stored as the 3 rows of a 3x4 affine matrix, so that the translation is in the w components.
+struct InstanceTransform {
+    glm::vec4 rows[3];
+};
+
+/// The per-instance colour the tinted shader variants multiply the vertex colour by, also read with a divisor of 1
+struct InstanceColour {
+    glm::vec4 colour;
+};
+
+/// An indexed triangle mesh, every 3 indices make a triangle.
+struct Mesh {
+    std::vector<Vertex> vertices;
+    std::vector<uint> indices;
+};
+
+#endif //MESH_H
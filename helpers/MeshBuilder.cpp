@@ -0,0 +1,356 @@
+#include "MeshBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Hash the bit patterns of the vertex's floats (FNV-1a over 32-bit words), treating -0.0 and 0.0 as the same value so that
+// they get welded together like operator== would.
+static inline uint64_t hash_vertex(const Vertex& vertex) {
+    const float* components = &vertex.position.x;
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < 6; i++) {
+        float value = components[i] == 0.0f ? 0.0f : components[i];
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        hash = (hash ^ bits) * 1099511628211ull;
+    }
+    // Whole words leave the low bits (which pick the table slot) poorly mixed, so finish with MurmurHash3's fmix64
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static inline bool vertices_equal(const Vertex& a, const Vertex& b) {
+    return a.position == b.position && a.colour == b.colour;
+}
+
+Mesh MeshBuilder::weld(const Vertex* vertices, size_t vertex_count) {
+    Mesh mesh;
+    mesh.indices.reserve(vertex_count);
+
+    // Open addressing table of indices into mesh.vertices, sized to a power of 2 at most half full
+    size_t table_size = 16;
+    while (table_size < vertex_count * 2) {
+        table_size *= 2;
+    }
+    const uint EMPTY = ~0u;
+    std::vector<uint> table(table_size, EMPTY);
+
+    for (size_t i = 0; i < vertex_count; i++) {
+        const Vertex& vertex = vertices[i];
+        size_t slot = hash_vertex(vertex) & (table_size - 1);
+        while (table[slot] != EMPTY && !vertices_equal(mesh.vertices[table[slot]], vertex)) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (table[slot] == EMPTY) {
+            table[slot] = (uint) mesh.vertices.size();
+            mesh.vertices.push_back(vertex);
+        }
+        mesh.indices.push_back(table[slot]);
+    }
+
+    return mesh;
+}
+
+// Scoring constants from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+static const int FORSYTH_CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+static float forsyth_vertex_score(int cache_position, uint remaining_triangles) {
+    if (remaining_triangles == 0) {
+        // No triangles left to use this vertex, so it doesn't matter
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cache_position >= 0) {
+        if (cache_position < 3) {
+            // The vertices of the triangle just emitted get a fixed score, so that we don't
+            // favour continuing in a strip direction over a fan.
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (float) (cache_position - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+
+    // Boost vertices with few triangles left, so that we finish them off rather than leaving lone triangles behind
+    score += VALENCE_BOOST_SCALE * std::pow((float) remaining_triangles, -VALENCE_BOOST_POWER);
+    return score;
+}
+
+void MeshBuilder::optimize_vertex_cache(std::vector<uint>& indices, size_t vertex_count) {
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Build the vertex -> triangle adjacency, stored compactly as one array with an offset per vertex
+    std::vector<uint> remaining(vertex_count, 0);
+    for (auto index : indices) {
+        remaining[index]++;
+    }
+    std::vector<uint> adjacency_offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; v++) {
+        adjacency_offsets[v + 1] = adjacency_offsets[v] + remaining[v];
+    }
+    std::vector<uint> adjacency(indices.size());
+    {
+        std::vector<uint> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        for (size_t t = 0; t < triangle_count; t++) {
+            for (int k = 0; k < 3; k++) {
+                adjacency[fill[indices[t * 3 + k]]++] = (uint) t;
+            }
+        }
+    }
+
+    std::vector<float> vertex_scores(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        vertex_scores[v] = forsyth_vertex_score(-1, remaining[v]);
+    }
+
+    std::vector<float> triangle_scores(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    for (size_t t = 0; t < triangle_count; t++) {
+        triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+    }
+
+    std::vector<uint> output;
+    output.reserve(indices.size());
+
+    // The cache holds up to FORSYTH_CACHE_SIZE vertices, plus room for the 3 being pushed in before the rest get evicted
+    std::vector<uint> cache;
+    std::vector<uint> new_cache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    new_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    long best_triangle = (long) (std::max_element(triangle_scores.begin(), triangle_scores.end()) - triangle_scores.begin());
+    size_t scan_cursor = 0;
+
+    for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+        if (best_triangle < 0) {
+            // Nothing adjacent to the cache is left, so just continue with the next triangle that hasn't been emitted
+            while (emitted[scan_cursor]) {
+                scan_cursor++;
+            }
+            best_triangle = (long) scan_cursor;
+        }
+
+        const uint* triangle = &indices[best_triangle * 3];
+        emitted[best_triangle] = true;
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // Remove the triangle from the adjacency of its vertices
+        for (int k = 0; k < 3; k++) {
+            uint v = triangle[k];
+            uint begin = adjacency_offsets[v];
+            uint end = begin + remaining[v];
+            for (uint i = begin; i < end; i++) {
+                if (adjacency[i] == (uint) best_triangle) {
+                    std::swap(adjacency[i], adjacency[end - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // Push the triangle's vertices to the front of the (LRU) cache
+        new_cache.assign(triangle, triangle + 3);
+        for (auto v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                new_cache.push_back(v);
+            }
+        }
+        for (size_t i = FORSYTH_CACHE_SIZE; i < new_cache.size(); i++) {
+            vertex_scores[new_cache[i]] = forsyth_vertex_score(-1, remaining[new_cache[i]]);
+        }
+        if (new_cache.size() > (size_t) FORSYTH_CACHE_SIZE) {
+            new_cache.resize(FORSYTH_CACHE_SIZE);
+        }
+        std::swap(cache, new_cache);
+
+        for (size_t i = 0; i < cache.size(); i++) {
+            vertex_scores[cache[i]] = forsyth_vertex_score((int) i, remaining[cache[i]]);
+        }
+
+        // Only triangles touching the cache can have changed score, so the next best is among them
+        best_triangle = -1;
+        float best_score = -1.0f;
+        for (auto v : cache) {
+            uint begin = adjacency_offsets[v];
+            for (uint i = begin; i < begin + remaining[v]; i++) {
+                uint t = adjacency[i];
+                float score = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+                triangle_scores[t] = score;
+                if (score > best_score) {
+                    best_score = score;
+                    best_triangle = t;
+                }
+            }
+        }
+    }
+
+    indices = std::move(output);
+}
+
+void MeshBuilder::optimize_overdraw(const std::vector<Vertex>& vertices, std::vector<uint>& indices) {
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Split the (already cache optimised) triangles into clusters wherever the cache is completely missed,
+    // since reordering at these points doesn't cost any extra vertex shader invocations.
+    std::vector<size_t> cluster_starts;
+    std::vector<uint> cache_time(vertices.size(), 0);
+    uint time = CACHE_SIZE + 1;
+    for (size_t t = 0; t < triangle_count; t++) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            uint v = indices[t * 3 + k];
+            if (time - cache_time[v] > (uint) CACHE_SIZE) {
+                cache_time[v] = time++;
+                misses++;
+            }
+        }
+        if (t == 0 || misses == 3) {
+            cluster_starts.push_back(t);
+        }
+    }
+    cluster_starts.push_back(triangle_count);
+    size_t cluster_count = cluster_starts.size() - 1;
+
+    // Area weighted centroid and normal of each cluster
+    std::vector<glm::vec3> centroids(cluster_count, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(cluster_count, glm::vec3(0.0f));
+    std::vector<float> areas(cluster_count, 0.0f);
+    glm::vec3 mesh_centroid(0.0f);
+    float mesh_area = 0.0f;
+    for (size_t c = 0; c < cluster_count; c++) {
+        for (size_t t = cluster_starts[c]; t < cluster_starts[c + 1]; t++) {
+            const auto& p0 = vertices[indices[t * 3]].position;
+            const auto& p1 = vertices[indices[t * 3 + 1]].position;
+            const auto& p2 = vertices[indices[t * 3 + 2]].position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            normals[c] += normal;
+            areas[c] += area;
+        }
+        mesh_centroid += centroids[c];
+        mesh_area += areas[c];
+        if (areas[c] > 0.0f) {
+            centroids[c] = centroids[c] / areas[c];
+        }
+    }
+    if (mesh_area > 0.0f) {
+        mesh_centroid = mesh_centroid / mesh_area;
+    }
+
+    // Clusters that face away from the centre of the mesh are on the outside, so draw them first
+    std::vector<float> sort_keys(cluster_count);
+    for (size_t c = 0; c < cluster_count; c++) {
+        float normal_length = glm::length(normals[c]);
+        sort_keys[c] = normal_length > 0.0f ? glm::dot(centroids[c] - mesh_centroid, normals[c] / normal_length) : 0.0f;
+    }
+    std::vector<size_t> order(cluster_count);
+    for (size_t c = 0; c < cluster_count; c++) {
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sort_keys[a] > sort_keys[b]; });
+
+    std::vector<uint> output;
+    output.reserve(indices.size());
+    for (auto c : order) {
+        output.insert(output.end(), indices.begin() + (long) cluster_starts[c] * 3, indices.begin() + (long) cluster_starts[c + 1] * 3);
+    }
+    indices = std::move(output);
+}
+
+void MeshBuilder::optimize_vertex_fetch(Mesh& mesh) {
+    const uint UNUSED = ~0u;
+    std::vector<uint> remap(mesh.vertices.size(), UNUSED);
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+
+    for (auto& index : mesh.indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = (uint) vertices.size();
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    mesh.vertices = std::move(vertices);
+}
+
+float MeshBuilder::compute_acmr(const std::vector<uint>& indices, size_t vertex_count, int cache_size) {
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return 0.0f;
+    }
+
+    // FIFO cache, a vertex is a hit if it was pushed less than cache_size misses ago
+    std::vector<uint> cache_time(vertex_count, 0);
+    uint time = cache_size + 1;
+    size_t misses = 0;
+    for (auto v : indices) {
+        if (time - cache_time[v] > (uint) cache_size) {
+            cache_time[v] = time++;
+            misses++;
+        }
+    }
+
+    return (float) misses / (float) triangle_count;
+}
+
+// The reordering passes shared by both build() overloads, on a mesh that has already been welded
+static void optimize(Mesh& mesh, MeshBuildStats* stats) {
+    MeshBuilder::optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+    MeshBuilder::optimize_overdraw(mesh.vertices, mesh.indices);
+    MeshBuilder::optimize_vertex_fetch(mesh);
+
+    if (stats) {
+        stats->unique_vertices = mesh.vertices.size();
+        stats->triangles = mesh.indices.size() / 3;
+        stats->acmr_after = MeshBuilder::compute_acmr(mesh.indices, mesh.vertices.size());
+    }
+}
+
+Mesh MeshBuilder::build(const Vertex* vertices, size_t vertex_count, MeshBuildStats* stats) {
+    Mesh mesh = weld(vertices, vertex_count);
+
+    if (stats) {
+        // Drawn as a non-indexed triangle list every vertex is a miss, so this is always 3
+        stats->input_vertices = vertex_count;
+        stats->acmr_before = vertex_count > 0 ? 3.0f : 0.0f;
+    }
+
+    optimize(mesh, stats);
+    return mesh;
+}
+
+Mesh MeshBuilder::build(const Mesh& input, MeshBuildStats* stats) {
+    // Weld again, imported meshes are often indexed but still contain duplicate vertices
+    std::vector<Vertex> expanded;
+    expanded.reserve(input.indices.size());
+    for (auto index : input.indices) {
+        expanded.push_back(input.vertices[index]);
+    }
+    Mesh mesh = weld(expanded.data(), expanded.size());
+
+    if (stats) {
+        stats->input_vertices = input.vertices.size();
+        stats->acmr_before = compute_acmr(input.indices, input.vertices.size());
+    }
+
+    optimize(mesh, stats);
+    return mesh;
+}
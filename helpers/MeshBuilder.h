@@ -0,0 +1,52 @@
+#ifndef MESH_BUILDER_H
+#define MESH_BUILDER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "Mesh.h"
+
+/// Statistics about what MeshBuilder::build did, for measuring the gains on a particular mesh.
+struct MeshBuildStats {
+    size_t input_vertices = 0;
+    size_t unique_vertices = 0;
+    size_t triangles = 0;
+    /// Average cache miss ratio (vertex shader invocations per triangle) of the input as given,
+    /// a non-indexed triangle list always has 3.0
+    float acmr_before = 0.0f;
+    /// Average cache miss ratio after reordering the triangles
+    float acmr_after = 0.0f;
+};
+
+/// Turns triangle soup into an indexed mesh that is friendly to the GPU's post-transform vertex cache.
+class MeshBuilder {
+public:
+    /// The size of the FIFO post-transform cache that is simulated when computing ACMR.
+    /// Real hardware varies, but ~32 entries is a reasonable middle ground.
+    static const int CACHE_SIZE = 32;
+
+    /// Run the full pipeline on a triangle list: weld, optimise for the vertex cache, then for overdraw,
+    /// then reorder the vertices to match the order they are fetched in.
+    static Mesh build(const Vertex* vertices, size_t vertex_count, MeshBuildStats* stats = nullptr);
+    /// Same as the above, for an already indexed mesh.
+    static Mesh build(const Mesh& mesh, MeshBuildStats* stats = nullptr);
+
+    /// Deduplicate identical vertices with a hash table, producing an index buffer that references them.
+    static Mesh weld(const Vertex* vertices, size_t vertex_count);
+
+    /// Reorder the triangles to maximise post-transform cache hits, using Tom Forsyth's linear-speed algorithm.
+    static void optimize_vertex_cache(std::vector<uint>& indices, size_t vertex_count);
+
+    /// Reorder clusters of triangles (without breaking up the cache friendly runs within them) so that the ones
+    /// facing outwards come first, as they are likely to occlude the rest and so reduce overdraw.
+    static void optimize_overdraw(const std::vector<Vertex>& vertices, std::vector<uint>& indices);
+
+    /// Reorder the vertices in the order they are first referenced, so that fetching them is a mostly linear walk.
+    static void optimize_vertex_fetch(Mesh& mesh);
+
+    /// Compute the average cache miss ratio, simulating a FIFO cache of the given size.
+    /// 3.0 is the worst case (no reuse), ~0.5 is the best possible for large regular meshes.
+    static float compute_acmr(const std::vector<uint>& indices, size_t vertex_count, int cache_size = CACHE_SIZE);
+};
+
+#endif //MESH_BUILDER_H
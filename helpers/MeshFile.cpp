@@ -0,0 +1,266 @@
+#include "MeshFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include "VertexFormat.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t get_vertex_size(MeshVertexFormat format) {
+    switch (format) {
+        case MeshVertexFormat::Float:
+            return sizeof(Vertex);
+        case MeshVertexFormat::Compact:
+            return sizeof(CompactVertex);
+    }
+    return 0;
+}
+
+MappedMeshFile::~MappedMeshFile() {
+    close();
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+bool MappedMeshFile::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Failed to open mesh file " << path << std::endl;
+        return false;
+    }
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0 || (size_t) file_stat.st_size < sizeof(MeshFileHeader)) {
+        std::cerr << "Mesh file " << path << " is too small to be a mesh file" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    size = (size_t) file_stat.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file open
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map mesh file " << path << std::endl;
+        size = 0;
+        return false;
+    }
+    data = static_cast<const unsigned char*>(mapping);
+    // It's read from start to end, once, when it's uploaded
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    madvise(mapping, size, MADV_WILLNEED);
+
+    const MeshFileHeader& header = get_header();
+    const char* error = nullptr;
+    if (header.magic != MeshFileHeader::MAGIC) {
+        error = "isn't a mesh file";
+    } else if (header.version != MeshFileHeader::VERSION) {
+        error = "is a different version";
+    } else if (header.vertex_size == 0 || header.vertex_size != get_vertex_size(header.vertex_format)) {
+        error = "has an unknown vertex format";
+    } else if (header.vertex_offset % MESH_FILE_ALIGNMENT != 0 || header.index_offset % MESH_FILE_ALIGNMENT != 0) {
+        error = "has misaligned blobs";
+    } else if (header.vertex_count > size / header.vertex_size || header.vertex_offset > size - get_vertex_bytes()
+               || header.index_count > size / sizeof(uint) || header.index_offset > size - get_index_bytes()) {
+        error = "is truncated";
+    } else if (header.index_count % 3 != 0) {
+        error = "has an incomplete triangle";
+    } else if (header.lod_count == 0 || header.lod_count > MESH_FILE_MAX_LODS) {
+        error = "has an invalid number of levels of detail";
+    } else if (std::any_of(header.lods, header.lods + header.lod_count, [&](const MeshFileLod& lod) {
+                   return lod.first_index > header.index_count || lod.index_count > header.index_count - lod.first_index
+                          || lod.index_count % 3 != 0;
+               })) {
+        error = "has a level of detail outside its indices";
+    } else {
+        // An index past the vertices would make the GPU read outside the vertex buffer, and the LODs read outside the
+        // mapping. Every index is uploaded anyway, so reading them once more here only costs a pass over pages that
+        // are about to be read.
+        const uint* indices = get_indices();
+        uint64_t vertex_count = header.vertex_count;
+        if (std::any_of(indices, indices + header.index_count, [=](uint index) { return index >= vertex_count; })) {
+            error = "has an index past its vertices";
+        }
+    }
+    if (error) {
+        std::cerr << "Mesh file " << path << " " << error << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedMeshFile::close() {
+    if (data) {
+        munmap(const_cast<unsigned char*>(data), size);
+        data = nullptr;
+        size = 0;
+    }
+}
+
+#else
+
+bool MappedMeshFile::open(const std::string& path) {
+    std::cerr << "Mapping mesh files is unsupported on this platform, can't load " << path << std::endl;
+    return false;
+}
+
+void MappedMeshFile::close() {}
+
+#endif
+
+glm::vec3 MappedMeshFile::get_bounds_min() const {
+    const float* bounds = get_header().bounds_min;
+    return {bounds[0], bounds[1], bounds[2]};
+}
+
+glm::vec3 MappedMeshFile::get_bounds_max() const {
+    const float* bounds = get_header().bounds_max;
+    return {bounds[0], bounds[1], bounds[2]};
+}
+
+// Pad the file with zeros up to a multiple of MESH_FILE_ALIGNMENT
+static void pad_to_alignment(std::ostream& stream, uint64_t& offset) {
+    static const char zeros[MESH_FILE_ALIGNMENT] = {};
+    uint64_t aligned = align_up(offset, MESH_FILE_ALIGNMENT);
+    stream.write(zeros, (std::streamsize) (aligned - offset));
+    offset = aligned;
+}
+
+bool MeshFileWriter::open(const std::string& output_path, MeshVertexFormat format) {
+    path = output_path;
+    index_path = output_path + ".indices.tmp";
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    index_file.open(index_path, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+    if (!file || !index_file) {
+        std::cerr << "Failed to create " << path << std::endl;
+        return false;
+    }
+
+    header = {};
+    header.magic = MeshFileHeader::MAGIC;
+    header.version = MeshFileHeader::VERSION;
+    header.vertex_format = format;
+    header.vertex_size = get_vertex_size(format);
+
+    // The header is written again at the end, once the counts are known
+    uint64_t offset = sizeof(MeshFileHeader);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad_to_alignment(file, offset);
+    header.vertex_offset = offset;
+    return true;
+}
+
+void MeshFileWriter::write_vertices(const Vertex* vertices, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (header.vertex_count == 0) {
+        bounds_min = bounds_max = vertices[0].position;
+    }
+    for (size_t i = 0; i < count; i++) {
+        bounds_min = glm::min(bounds_min, vertices[i].position);
+        bounds_max = glm::max(bounds_max, vertices[i].position);
+    }
+
+    if (header.vertex_format == MeshVertexFormat::Compact) {
+        std::vector<CompactVertex> compact(count);
+        for (size_t i = 0; i < count; i++) {
+            compact[i] = CompactVertex::from(vertices[i]);
+        }
+        file.write(reinterpret_cast<const char*>(compact.data()), (std::streamsize) (sizeof(CompactVertex) * count));
+    } else {
+        file.write(reinterpret_cast<const char*>(vertices), (std::streamsize) (sizeof(Vertex) * count));
+    }
+    header.vertex_count += count;
+}
+
+void MeshFileWriter::write_indices(const uint* indices, size_t count) {
+    index_file.write(reinterpret_cast<const char*>(indices), (std::streamsize) (sizeof(uint) * count));
+    header.index_count += count;
+}
+
+bool MeshFileWriter::finish() {
+    uint64_t offset = header.vertex_offset + header.vertex_count * header.vertex_size;
+    pad_to_alignment(file, offset);
+    header.index_offset = offset;
+
+    // Copy the indices over in blocks, rather than reading them all back in
+    index_file.seekg(0);
+    std::vector<char> block(1 << 20);
+    while (index_file) {
+        index_file.read(block.data(), (std::streamsize) block.size());
+        file.write(block.data(), index_file.gcount());
+    }
+    index_file.close();
+    std::remove(index_path.c_str());
+
+    for (int axis = 0; axis < 3; axis++) {
+        header.bounds_min[axis] = bounds_min[axis];
+        header.bounds_max[axis] = bounds_max[axis];
+    }
+    header.lod_count = 1;
+    header.lods[0] = {0, header.index_count, 0.0f, 0};
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+
+    if (!file) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool MeshFileWriter::write_lods(const std::string& path, const std::vector<uint>& indices,
+                                const std::vector<MeshFileLod>& lods) {
+    if (lods.empty() || lods.size() > MESH_FILE_MAX_LODS) {
+        std::cerr << "Can't store " << lods.size() << " levels of detail in " << path << std::endl;
+        return false;
+    }
+
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    MeshFileHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != MeshFileHeader::MAGIC || header.version != MeshFileHeader::VERSION) {
+        std::cerr << "Failed to read the header of " << path << std::endl;
+        return false;
+    }
+
+    header.index_count = indices.size();
+    header.lod_count = (uint32_t) lods.size();
+    std::copy(lods.begin(), lods.end(), header.lods);
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.seekp((std::streamoff) header.index_offset);
+    file.write(reinterpret_cast<const char*>(indices.data()), (std::streamsize) (sizeof(uint) * indices.size()));
+    file.close();
+    if (!file) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+
+    // The original mesh is always the first level, so the blob only grows, but cut off anything past it regardless
+    std::error_code error;
+    std::filesystem::resize_file(path, header.index_offset + sizeof(uint) * indices.size(), error);
+    if (error) {
+        std::cerr << "Failed to resize " << path << ": " << error.message() << std::endl;
+        return false;
+    }
+    return true;
+}
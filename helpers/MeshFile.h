@@ -0,0 +1,124 @@
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+/// The vertex types a mesh file can store its vertices as
+enum class MeshVertexFormat : uint32_t {
+    /// Vertex, 24 bytes of floats
+    Float = 0,
+    /// CompactVertex, 12 bytes with half float positions, so only for meshes close to the origin
+    Compact = 1,
+};
+
+/// The most levels of detail a mesh file stores, including the original
+const size_t MESH_FILE_MAX_LODS = 8;
+
+/// One level of detail stored in a mesh file, a range of its index blob
+struct MeshFileLod {
+    uint64_t first_index;
+    uint64_t index_count;
+    /// Roughly how far (in the mesh's own units) the simplified surface may be from the original, 0 for the original
+    float error;
+    uint32_t padding;
+};
+
+/// The start of a mesh file. It's followed by the vertex blob and then the index blob (32 bit indices, every 3 make a
+/// triangle), each starting at a multiple of MESH_FILE_ALIGNMENT, so that they can be handed to GL (or read with SIMD)
+/// straight from a mapping of the file. Everything is little endian.
+///
+/// The index blob holds the indices of every level of detail one after the other, from the original (which is always
+/// the first level) to the coarsest, so that they're built once by the converter rather than every time the file is
+/// loaded, and can be uploaded straight from the mapping like the rest of it.
+struct MeshFileHeader {
+    static const uint32_t MAGIC = 0x4853454D; // "MESH"
+    static const uint32_t VERSION = 2;
+
+    uint32_t magic;
+    uint32_t version;
+    MeshVertexFormat vertex_format;
+    uint32_t vertex_size;
+    uint64_t vertex_count;
+    uint64_t vertex_offset;
+    uint64_t index_count;
+    uint64_t index_offset;
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t lod_count;
+    uint32_t padding;
+    MeshFileLod lods[MESH_FILE_MAX_LODS];
+};
+
+/// The alignment of each blob in a mesh file, from the start of the file
+const size_t MESH_FILE_ALIGNMENT = 64;
+
+/// A mesh file mapped into memory, so that its blobs can be uploaded without reading them into a buffer first.
+/// Only the pages that are touched are read from disk, and they are shared with the OS's file cache.
+class MappedMeshFile {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+public:
+    MappedMeshFile() = default;
+    ~MappedMeshFile();
+
+    MappedMeshFile(const MappedMeshFile&) = delete;
+    MappedMeshFile& operator=(const MappedMeshFile&) = delete;
+
+    /// Map a file and check that its header is valid, the blobs and levels of detail lie within it and every index
+    /// refers to a vertex.
+    /// Returns false (after printing why) if it can't be mapped or isn't a valid mesh file.
+    bool open(const std::string& path);
+    /// Unmap the file, the pointers returned by the getters are no longer valid afterwards
+    void close();
+
+    [[nodiscard]] const MeshFileHeader& get_header() const { return *reinterpret_cast<const MeshFileHeader*>(data); }
+    [[nodiscard]] const void* get_vertices() const { return data + get_header().vertex_offset; }
+    [[nodiscard]] size_t get_vertex_bytes() const { return get_header().vertex_count * get_header().vertex_size; }
+    [[nodiscard]] const uint* get_indices() const { return reinterpret_cast<const uint*>(data + get_header().index_offset); }
+    [[nodiscard]] size_t get_index_bytes() const { return get_header().index_count * sizeof(uint); }
+    [[nodiscard]] glm::vec3 get_bounds_min() const;
+    [[nodiscard]] glm::vec3 get_bounds_max() const;
+};
+
+/// Writes a mesh file incrementally, so that a mesh never has to be held in memory whole. The vertices are written
+/// straight to the file, and the indices to a temporary file next to it, which is appended once the number of vertices
+/// (and so where the index blob starts) is known.
+class MeshFileWriter {
+    std::string path;
+    std::string index_path;
+    std::ofstream file;
+    std::fstream index_file;
+    MeshFileHeader header{};
+    glm::vec3 bounds_min{0.0f};
+    glm::vec3 bounds_max{0.0f};
+public:
+    /// Create the file, returns false if it can't be
+    bool open(const std::string& output_path, MeshVertexFormat format);
+    /// Append vertices, converting them to the file's vertex format
+    void write_vertices(const Vertex* vertices, size_t count);
+    /// Append indices, which must be less than the total number of vertices once every vertex is written
+    void write_indices(const uint* indices, size_t count);
+    /// Append the indices after the vertices and write the header, with the indices as the only level of detail.
+    /// Returns false if anything failed to be written.
+    bool finish();
+
+    /// Replace the index blob of a finished mesh file with the indices of its levels of detail, lods being their ranges
+    /// of indices, the first being the original mesh. The index blob is the end of the file, so only it and the header
+    /// are rewritten. Returns false (after printing why) if the file can't be rewritten.
+    static bool write_lods(const std::string& path, const std::vector<uint>& indices, const std::vector<MeshFileLod>& lods);
+
+    [[nodiscard]] uint64_t get_vertex_count() const { return header.vertex_count; }
+    [[nodiscard]] uint64_t get_index_count() const { return header.index_count; }
+    /// The temporary file the indices are written to until finish(), which removes it
+    [[nodiscard]] const std::string& get_index_path() const { return index_path; }
+};
+
+#endif //MESH_FILE_H
@@ -0,0 +1,785 @@
+#include "MeshImporter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// What one thread parsed out of its range of a chunk
+struct ParsedRange {
+    std::vector<Vertex> vertices;
+    // Every 3 make a triangle. OBJ's negative indices count back from the latest vertex, so they are stored relative to
+    // the first vertex of the range until the ranges before it have been counted, and listed in relative_indices.
+    std::vector<int64_t> indices;
+    std::vector<size_t> relative_indices;
+    // Reused for each polygon, so that parsing a face doesn't allocate
+    std::vector<int64_t> polygon;
+    std::vector<bool> polygon_relative;
+    // The first line that failed to parse, or -1
+    int64_t error_line = -1;
+
+    void clear() {
+        vertices.clear();
+        indices.clear();
+        relative_indices.clear();
+        error_line = -1;
+    }
+};
+
+// Parses one line (begin to end, without the newline) into range. line counts from 0 at the start of the text.
+// Returns false if the line is invalid.
+using LineParser = std::function<bool(const char* begin, const char* end, uint64_t line, ParsedRange& range)>;
+// Takes the ranges of a chunk in order, returns false to stop with an error
+using RangeConsumer = std::function<bool(std::vector<ParsedRange>& ranges)>;
+
+// Run function(0) to function(count - 1) in parallel, the calling thread runs function(0)
+void run_parallel(int count, const std::function<void(int)>& function) {
+    std::vector<std::thread> threads;
+    for (int i = 1; i < count; i++) {
+        threads.emplace_back(function, i);
+    }
+    function(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void skip_spaces(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+}
+
+// The number parsers stop at the end of the line themselves (every line in the buffer ends with a newline), but would
+// skip over it to the next line if there was nothing left on this one, hence checking for that first
+bool parse_double(const char*& p, const char* end, double& out) {
+    skip_spaces(p, end);
+    if (p >= end) {
+        return false;
+    }
+    char* next;
+    out = std::strtod(p, &next);
+    if (next == p) {
+        return false;
+    }
+    p = next;
+    return true;
+}
+
+bool parse_float(const char*& p, const char* end, float& out) {
+    double value;
+    if (!parse_double(p, end, value)) {
+        return false;
+    }
+    out = (float) value;
+    return true;
+}
+
+bool parse_int(const char*& p, const char* end, int64_t& out) {
+    skip_spaces(p, end);
+    if (p >= end) {
+        return false;
+    }
+    char* next;
+    out = std::strtoll(p, &next, 10);
+    if (next == p) {
+        return false;
+    }
+    p = next;
+    return true;
+}
+
+// Split the polygon parsed into range.polygon into a fan of triangles around its first vertex
+void add_polygon(ParsedRange& range) {
+    for (size_t i = 1; i + 1 < range.polygon.size(); i++) {
+        for (size_t corner : {(size_t) 0, i, i + 1}) {
+            if (range.polygon_relative[corner]) {
+                range.relative_indices.push_back(range.indices.size());
+            }
+            range.indices.push_back(range.polygon[corner]);
+        }
+    }
+}
+
+// Read the rest of in a chunk at a time, parse each chunk's lines with thread_count threads, and pass the parsed ranges
+// to consume. first_line_number is the number of in's first line in the file, for error messages.
+bool parse_text(std::istream& in, int thread_count, uint64_t first_line_number, const LineParser& parse_line,
+                const RangeConsumer& consume, MeshImportStats& stats) {
+    std::vector<char> buffer(MeshImporter::CHUNK_SIZE);
+    std::vector<ParsedRange> ranges(thread_count);
+    // The bytes of an incomplete line carried over from the previous chunk
+    size_t carried = 0;
+    uint64_t line = 0;
+
+    while (true) {
+        in.read(buffer.data() + carried, (std::streamsize) (buffer.size() - carried));
+        auto read = (size_t) in.gcount();
+        stats.bytes_read += read;
+        size_t available = carried + read;
+        bool end_of_file = !in;
+
+        // Parse up to the end of the last complete line, and carry the rest over. At the end of the file, the last
+        // line may not have a newline, so it's given one.
+        size_t length = available;
+        if (end_of_file) {
+            if (available == 0) {
+                break;
+            }
+            if (buffer[available - 1] != '\n') {
+                if (available == buffer.size()) {
+                    buffer.push_back('\n');
+                } else {
+                    buffer[available] = '\n';
+                }
+                length = ++available;
+            }
+        } else {
+            while (length > 0 && buffer[length - 1] != '\n') {
+                length--;
+            }
+            if (length == 0) {
+                std::cerr << "Line " << first_line_number + line << " is longer than the chunk size" << std::endl;
+                return false;
+            }
+        }
+
+        // Split the chunk into a range per thread, each starting at the beginning of a line
+        std::vector<size_t> starts(thread_count + 1);
+        starts[thread_count] = length;
+        for (int i = 1; i < thread_count; i++) {
+            size_t start = std::max(starts[i - 1], length / thread_count * i);
+            while (start > 0 && start < length && buffer[start - 1] != '\n') {
+                start++;
+            }
+            starts[i] = start;
+        }
+
+        // Count the lines in each range first, so that each knows the number of its first line
+        std::vector<uint64_t> first_lines(thread_count + 1);
+        run_parallel(thread_count, [&](int i) {
+            first_lines[i + 1] = std::count(buffer.data() + starts[i], buffer.data() + starts[i + 1], '\n');
+        });
+        first_lines[0] = line;
+        for (int i = 1; i <= thread_count; i++) {
+            first_lines[i] += first_lines[i - 1];
+        }
+
+        run_parallel(thread_count, [&](int i) {
+            ParsedRange& range = ranges[i];
+            range.clear();
+            const char* p = buffer.data() + starts[i];
+            const char* end = buffer.data() + starts[i + 1];
+            for (uint64_t range_line = first_lines[i]; p < end; range_line++) {
+                const auto* line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+                if (!parse_line(p, line_end, range_line, range)) {
+                    range.error_line = (int64_t) range_line;
+                    break;
+                }
+                p = line_end + 1;
+            }
+        });
+
+        for (const ParsedRange& range : ranges) {
+            if (range.error_line >= 0) {
+                std::cerr << "Failed to parse line " << first_line_number + range.error_line << std::endl;
+                return false;
+            }
+        }
+        if (!consume(ranges)) {
+            return false;
+        }
+
+        line = first_lines[thread_count];
+        carried = available - length;
+        std::memmove(buffer.data(), buffer.data() + length, carried);
+        if (end_of_file) {
+            break;
+        }
+    }
+    return true;
+}
+
+// Writes parsed ranges to a mesh file, resolving relative indices and checking the rest
+class RangeWriter {
+    MeshFileWriter& writer;
+    std::vector<uint> indices;
+    int64_t max_index = -1;
+public:
+    explicit RangeWriter(MeshFileWriter& writer) : writer(writer) {}
+
+    bool write(ParsedRange& range) {
+        auto first_vertex = (int64_t) writer.get_vertex_count();
+        for (size_t position : range.relative_indices) {
+            range.indices[position] += first_vertex;
+        }
+        writer.write_vertices(range.vertices.data(), range.vertices.size());
+
+        indices.resize(range.indices.size());
+        for (size_t i = 0; i < range.indices.size(); i++) {
+            int64_t index = range.indices[i];
+            if (index < 0 || index > std::numeric_limits<uint>::max()) {
+                std::cerr << "Index " << index << " is out of range" << std::endl;
+                return false;
+            }
+            max_index = std::max(max_index, index);
+            indices[i] = (uint) index;
+        }
+        writer.write_indices(indices.data(), indices.size());
+        return true;
+    }
+
+    bool write(std::vector<ParsedRange>& ranges) {
+        for (ParsedRange& range : ranges) {
+            if (!write(range)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether every index refers to a vertex, which can only be known once they have all been read
+    [[nodiscard]] bool check_indices() const {
+        if (max_index >= (int64_t) writer.get_vertex_count()) {
+            std::cerr << "Index " << max_index << " refers to a vertex that doesn't exist" << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+bool parse_obj_line(const char* p, const char* end, ParsedRange& range) {
+    skip_spaces(p, end);
+    if (end - p < 2 || (p[1] != ' ' && p[1] != '\t')) {
+        // Not a vertex or face, e.g. a comment, texture coordinate, normal or group, which are ignored
+        return true;
+    }
+
+    if (p[0] == 'v') {
+        p += 2;
+        Vertex vertex{glm::vec3(0.0f), glm::vec3(1.0f)};
+        if (!parse_float(p, end, vertex.position.x) || !parse_float(p, end, vertex.position.y)
+            || !parse_float(p, end, vertex.position.z)) {
+            return false;
+        }
+        // A common extension puts the vertex's colour after its position
+        glm::vec3 colour;
+        if (parse_float(p, end, colour.x) && parse_float(p, end, colour.y) && parse_float(p, end, colour.z)) {
+            vertex.colour = colour;
+        }
+        range.vertices.push_back(vertex);
+    } else if (p[0] == 'f') {
+        p += 2;
+        range.polygon.clear();
+        range.polygon_relative.clear();
+        int64_t index;
+        while (parse_int(p, end, index)) {
+            if (index == 0) {
+                return false;
+            }
+            // 1 based, or counting back from the latest vertex if negative
+            bool relative = index < 0;
+            range.polygon.push_back(relative ? (int64_t) range.vertices.size() + index : index - 1);
+            range.polygon_relative.push_back(relative);
+            // Skip the texture coordinate and normal indices
+            while (p < end && *p != ' ' && *p != '\t') {
+                p++;
+            }
+        }
+        if (range.polygon.size() < 3) {
+            return false;
+        }
+        add_polygon(range);
+    }
+    return true;
+}
+
+bool import_obj(std::istream& in, MeshFileWriter& writer, int thread_count, MeshImportStats& stats) {
+    RangeWriter range_writer{writer};
+    auto parse_line = [](const char* begin, const char* end, uint64_t, ParsedRange& range) {
+        return parse_obj_line(begin, end, range);
+    };
+    auto consume = [&range_writer](std::vector<ParsedRange>& ranges) { return range_writer.write(ranges); };
+    return parse_text(in, thread_count, 1, parse_line, consume, stats) && range_writer.check_indices();
+}
+
+enum class PlyType {
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Float32,
+    Float64,
+    Invalid,
+};
+
+PlyType parse_ply_type(const std::string& name) {
+    if (name == "char" || name == "int8") return PlyType::Int8;
+    if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+    if (name == "short" || name == "int16") return PlyType::Int16;
+    if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+    if (name == "int" || name == "int32") return PlyType::Int32;
+    if (name == "uint" || name == "uint32") return PlyType::UInt32;
+    if (name == "float" || name == "float32") return PlyType::Float32;
+    if (name == "double" || name == "float64") return PlyType::Float64;
+    return PlyType::Invalid;
+}
+
+size_t get_ply_type_size(PlyType type) {
+    switch (type) {
+        case PlyType::Int8:
+        case PlyType::UInt8:
+            return 1;
+        case PlyType::Int16:
+        case PlyType::UInt16:
+            return 2;
+        case PlyType::Int32:
+        case PlyType::UInt32:
+        case PlyType::Float32:
+            return 4;
+        case PlyType::Float64:
+            return 8;
+        case PlyType::Invalid:
+            break;
+    }
+    return 0;
+}
+
+// Read a little endian value, assuming the CPU is little endian too
+double read_ply_value(const unsigned char* p, PlyType type) {
+    switch (type) {
+        case PlyType::Int8: return (double) *reinterpret_cast<const int8_t*>(p);
+        case PlyType::UInt8: return (double) *p;
+        case PlyType::Int16: { int16_t value; std::memcpy(&value, p, 2); return value; }
+        case PlyType::UInt16: { uint16_t value; std::memcpy(&value, p, 2); return value; }
+        case PlyType::Int32: { int32_t value; std::memcpy(&value, p, 4); return value; }
+        case PlyType::UInt32: { uint32_t value; std::memcpy(&value, p, 4); return value; }
+        case PlyType::Float32: { float value; std::memcpy(&value, p, 4); return value; }
+        case PlyType::Float64: { double value; std::memcpy(&value, p, 8); return value; }
+        case PlyType::Invalid: break;
+    }
+    return 0.0;
+}
+
+struct PlyProperty {
+    std::string name;
+    PlyType type = PlyType::Invalid;
+    // Lists are a count of count_type followed by that many values of type
+    bool is_list = false;
+    PlyType count_type = PlyType::Invalid;
+};
+
+struct PlyElement {
+    std::string name;
+    uint64_t count = 0;
+    std::vector<PlyProperty> properties;
+
+    // The size of each record, or 0 if it has lists and so varies
+    [[nodiscard]] size_t get_record_size() const {
+        size_t size = 0;
+        for (const auto& property : properties) {
+            if (property.is_list) {
+                return 0;
+            }
+            size += get_ply_type_size(property.type);
+        }
+        return size;
+    }
+};
+
+// The most properties a PLY vertex can have, their values are decoded into an array of this size before the vertex is
+// built from the ones the app uses
+const size_t PLY_MAX_VERTEX_PROPERTIES = 64;
+
+// Where the properties the app uses are in the vertex and face elements, -1 if they are missing
+struct PlyLayout {
+    int vertex_element = -1;
+    int position[3] = {-1, -1, -1};
+    int colour[3] = {-1, -1, -1};
+    // Colours stored as integers are 0 to 255
+    double colour_scale = 1.0;
+    int face_element = -1;
+    int face_indices = -1;
+};
+
+struct PlyHeader {
+    bool binary = false;
+    std::vector<PlyElement> elements;
+    PlyLayout layout;
+    uint64_t line_count = 0;
+};
+
+bool read_ply_header(std::istream& in, PlyHeader& header) {
+    std::string line;
+    if (!std::getline(in, line) || line.rfind("ply", 0) != 0) {
+        std::cerr << "Not a PLY file" << std::endl;
+        return false;
+    }
+    header.line_count = 1;
+
+    while (std::getline(in, line)) {
+        header.line_count++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        std::istringstream words(line);
+        std::string keyword;
+        words >> keyword;
+
+        if (keyword == "format") {
+            std::string format;
+            words >> format;
+            if (format == "ascii") {
+                header.binary = false;
+            } else if (format == "binary_little_endian") {
+                header.binary = true;
+            } else {
+                std::cerr << "Unsupported PLY format " << format << std::endl;
+                return false;
+            }
+        } else if (keyword == "element") {
+            PlyElement element;
+            words >> element.name >> element.count;
+            header.elements.push_back(element);
+        } else if (keyword == "property") {
+            if (header.elements.empty()) {
+                std::cerr << "PLY property before any element" << std::endl;
+                return false;
+            }
+            PlyProperty property;
+            std::string type;
+            words >> type;
+            if (type == "list") {
+                std::string count_type;
+                words >> count_type >> type;
+                property.is_list = true;
+                property.count_type = parse_ply_type(count_type);
+            }
+            property.type = parse_ply_type(type);
+            words >> property.name;
+            if (property.type == PlyType::Invalid || (property.is_list && property.count_type == PlyType::Invalid)) {
+                std::cerr << "Unknown PLY property type in: " << line << std::endl;
+                return false;
+            }
+            header.elements.back().properties.push_back(property);
+        } else if (keyword == "end_header") {
+            break;
+        }
+    }
+
+    PlyLayout& layout = header.layout;
+    for (int e = 0; e < (int) header.elements.size(); e++) {
+        const PlyElement& element = header.elements[e];
+        if (element.name == "vertex") {
+            layout.vertex_element = e;
+            for (int p = 0; p < (int) element.properties.size(); p++) {
+                const PlyProperty& property = element.properties[p];
+                const char* position_names[] = {"x", "y", "z"};
+                const char* colour_names[] = {"red", "green", "blue"};
+                for (int axis = 0; axis < 3; axis++) {
+                    if (property.name == position_names[axis]) {
+                        layout.position[axis] = p;
+                    }
+                    if (property.name == colour_names[axis]) {
+                        layout.colour[axis] = p;
+                        bool is_float = property.type == PlyType::Float32 || property.type == PlyType::Float64;
+                        layout.colour_scale = is_float ? 1.0 : 1.0 / 255.0;
+                    }
+                }
+            }
+        } else if (element.name == "face") {
+            layout.face_element = e;
+            for (int p = 0; p < (int) element.properties.size(); p++) {
+                const PlyProperty& property = element.properties[p];
+                if (property.is_list && (property.name == "vertex_indices" || property.name == "vertex_index")) {
+                    layout.face_indices = p;
+                }
+            }
+        }
+    }
+
+    if (layout.vertex_element < 0 || layout.position[0] < 0 || layout.position[1] < 0 || layout.position[2] < 0) {
+        std::cerr << "PLY file has no vertex positions" << std::endl;
+        return false;
+    }
+    if (layout.face_element >= 0 && layout.face_indices < 0) {
+        std::cerr << "PLY file has faces without vertex indices" << std::endl;
+        return false;
+    }
+    if (header.elements[layout.vertex_element].get_record_size() == 0) {
+        std::cerr << "PLY vertices with list properties are unsupported" << std::endl;
+        return false;
+    }
+    if (header.elements[layout.vertex_element].properties.size() > PLY_MAX_VERTEX_PROPERTIES) {
+        std::cerr << "PLY vertices with more than " << PLY_MAX_VERTEX_PROPERTIES << " properties are unsupported" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Build a vertex from its properties' values, in the order the header declares them
+Vertex make_ply_vertex(const double* values, const PlyLayout& layout) {
+    Vertex vertex{glm::vec3(0.0f), glm::vec3(1.0f)};
+    for (int axis = 0; axis < 3; axis++) {
+        vertex.position[axis] = (float) values[layout.position[axis]];
+        if (layout.colour[axis] >= 0) {
+            vertex.colour[axis] = (float) (values[layout.colour[axis]] * layout.colour_scale);
+        }
+    }
+    return vertex;
+}
+
+// Parse a line of an ASCII PLY body. line counts from the first line after the header.
+bool parse_ply_line(const char* p, const char* end, uint64_t line, const PlyHeader& header, ParsedRange& range) {
+    // Find which element the line belongs to, the elements' records are one after another
+    const PlyLayout& layout = header.layout;
+    int element_index = -1;
+    for (int e = 0; e < (int) header.elements.size(); e++) {
+        if (line < header.elements[e].count) {
+            element_index = e;
+            break;
+        }
+        line -= header.elements[e].count;
+    }
+    if (element_index != layout.vertex_element && element_index != layout.face_element) {
+        // Either another element, or after them all
+        return true;
+    }
+
+    const PlyElement& element = header.elements[element_index];
+    if (element_index == layout.vertex_element) {
+        // read_ply_header() rejects vertices with more properties than this
+        double values[PLY_MAX_VERTEX_PROPERTIES];
+        for (size_t i = 0; i < element.properties.size(); i++) {
+            if (!parse_double(p, end, values[i])) {
+                return false;
+            }
+        }
+        range.vertices.push_back(make_ply_vertex(values, layout));
+        return true;
+    }
+
+    for (int i = 0; i < (int) element.properties.size(); i++) {
+        const PlyProperty& property = element.properties[i];
+        int64_t count = 1;
+        if (property.is_list && !parse_int(p, end, count)) {
+            return false;
+        }
+        if (i == layout.face_indices) {
+            range.polygon.clear();
+            range.polygon_relative.clear();
+        }
+        for (int64_t j = 0; j < count; j++) {
+            double value;
+            if (!parse_double(p, end, value)) {
+                return false;
+            }
+            if (i == layout.face_indices) {
+                range.polygon.push_back((int64_t) value);
+                range.polygon_relative.push_back(false);
+            }
+        }
+    }
+    if (range.polygon.size() < 3) {
+        return false;
+    }
+    add_polygon(range);
+    return true;
+}
+
+// Reads a binary stream through a fixed size buffer, for parsing records that may straddle two reads
+class ChunkReader {
+    std::istream& in;
+    std::vector<unsigned char> buffer;
+    size_t position = 0;
+    size_t end = 0;
+    MeshImportStats& stats;
+public:
+    ChunkReader(std::istream& in, MeshImportStats& stats) : in(in), buffer(MeshImporter::CHUNK_SIZE), stats(stats) {}
+
+    // Make sure there are at least size bytes buffered (at most the chunk size), returns false if the stream ends first
+    bool ensure(size_t size) {
+        if (end - position >= size) {
+            return true;
+        }
+        std::memmove(buffer.data(), buffer.data() + position, end - position);
+        end -= position;
+        position = 0;
+        in.read(reinterpret_cast<char*>(buffer.data() + end), (std::streamsize) (buffer.size() - end));
+        auto read = (size_t) in.gcount();
+        stats.bytes_read += read;
+        end += read;
+        return end >= size;
+    }
+
+    [[nodiscard]] const unsigned char* data() const { return buffer.data() + position; }
+    void skip(size_t size) { position += size; }
+    [[nodiscard]] size_t capacity() const { return buffer.size(); }
+};
+
+bool import_ply_binary(std::istream& in, const PlyHeader& header, MeshFileWriter& writer, int thread_count,
+                       MeshImportStats& stats) {
+    const PlyLayout& layout = header.layout;
+    ChunkReader reader{in, stats};
+    RangeWriter range_writer{writer};
+    std::vector<ParsedRange> ranges(thread_count);
+
+    for (int e = 0; e < (int) header.elements.size(); e++) {
+        const PlyElement& element = header.elements[e];
+        size_t record_size = element.get_record_size();
+
+        if (e == layout.vertex_element) {
+            // Fixed size records, so each thread can decode its share of a chunk independently
+            std::vector<size_t> offsets;
+            size_t offset = 0;
+            for (const auto& property : element.properties) {
+                offsets.push_back(offset);
+                offset += get_ply_type_size(property.type);
+            }
+
+            uint64_t records_per_chunk = reader.capacity() / record_size;
+            for (uint64_t done = 0; done < element.count;) {
+                uint64_t count = std::min(records_per_chunk, element.count - done);
+                if (!reader.ensure(count * record_size)) {
+                    std::cerr << "PLY file ends in the middle of its vertices" << std::endl;
+                    return false;
+                }
+                const unsigned char* records = reader.data();
+                run_parallel(thread_count, [&](int i) {
+                    ParsedRange& range = ranges[i];
+                    range.clear();
+                    uint64_t first = count * i / thread_count;
+                    uint64_t last = count * (i + 1) / thread_count;
+                    // read_ply_header() rejects vertices with more properties than this
+                    double values[PLY_MAX_VERTEX_PROPERTIES];
+                    for (uint64_t r = first; r < last; r++) {
+                        const unsigned char* record = records + r * record_size;
+                        for (size_t p = 0; p < element.properties.size(); p++) {
+                            values[p] = read_ply_value(record + offsets[p], element.properties[p].type);
+                        }
+                        range.vertices.push_back(make_ply_vertex(values, layout));
+                    }
+                });
+                if (!range_writer.write(ranges)) {
+                    return false;
+                }
+                reader.skip(count * record_size);
+                done += count;
+            }
+            continue;
+        }
+
+        // Faces, and any other element, are read one record at a time, as lists make their size vary
+        ParsedRange& range = ranges[0];
+        range.clear();
+        for (uint64_t r = 0; r < element.count; r++) {
+            range.polygon.clear();
+            range.polygon_relative.clear();
+            for (int p = 0; p < (int) element.properties.size(); p++) {
+                const PlyProperty& property = element.properties[p];
+                uint64_t count = 1;
+                if (property.is_list) {
+                    size_t count_size = get_ply_type_size(property.count_type);
+                    if (!reader.ensure(count_size)) {
+                        std::cerr << "PLY file ends in the middle of element " << element.name << std::endl;
+                        return false;
+                    }
+                    count = (uint64_t) read_ply_value(reader.data(), property.count_type);
+                    reader.skip(count_size);
+                }
+                size_t value_size = get_ply_type_size(property.type);
+                if (!reader.ensure(count * value_size)) {
+                    std::cerr << "PLY file ends in the middle of element " << element.name << std::endl;
+                    return false;
+                }
+                if (e == layout.face_element && p == layout.face_indices) {
+                    for (uint64_t i = 0; i < count; i++) {
+                        range.polygon.push_back((int64_t) read_ply_value(reader.data() + i * value_size, property.type));
+                        range.polygon_relative.push_back(false);
+                    }
+                }
+                reader.skip(count * value_size);
+            }
+            if (e == layout.face_element) {
+                if (range.polygon.size() < 3) {
+                    std::cerr << "PLY face " << r << " has fewer than 3 vertices" << std::endl;
+                    return false;
+                }
+                add_polygon(range);
+                // Write in batches, rather than holding every face
+                if (range.indices.size() >= (1 << 20)) {
+                    if (!range_writer.write(range)) {
+                        return false;
+                    }
+                    range.clear();
+                }
+            }
+        }
+        if (e == layout.face_element && !range_writer.write(range)) {
+            return false;
+        }
+    }
+    return range_writer.check_indices();
+}
+
+bool import_ply(std::istream& in, MeshFileWriter& writer, int thread_count, MeshImportStats& stats) {
+    PlyHeader header;
+    if (!read_ply_header(in, header)) {
+        return false;
+    }
+    if (header.binary) {
+        return import_ply_binary(in, header, writer, thread_count, stats);
+    }
+
+    RangeWriter range_writer{writer};
+    auto parse_line = [&header](const char* begin, const char* end, uint64_t line, ParsedRange& range) {
+        return parse_ply_line(begin, end, line, header, range);
+    };
+    auto consume = [&range_writer](std::vector<ParsedRange>& ranges) { return range_writer.write(ranges); };
+    return parse_text(in, thread_count, header.line_count + 1, parse_line, consume, stats) && range_writer.check_indices();
+}
+
+}
+
+bool MeshImporter::import(const std::string& path, MeshFileWriter& writer, int thread_count, MeshImportStats* stats) {
+    auto start = std::chrono::steady_clock::now();
+    thread_count = std::max(1, thread_count);
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+
+    std::string extension = path.substr(std::min(path.size(), path.rfind('.')));
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    MeshImportStats import_stats;
+    bool success;
+    if (extension == ".obj") {
+        success = import_obj(in, writer, thread_count, import_stats);
+    } else if (extension == ".ply") {
+        success = import_ply(in, writer, thread_count, import_stats);
+    } else {
+        std::cerr << "Unsupported mesh file extension: " << path << std::endl;
+        return false;
+    }
+
+    import_stats.vertices = writer.get_vertex_count();
+    import_stats.triangles = writer.get_index_count() / 3;
+    import_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (stats) {
+        *stats = import_stats;
+    }
+    return success;
+}
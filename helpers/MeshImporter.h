@@ -0,0 +1,36 @@
+#ifndef MESH_IMPORTER_H
+#define MESH_IMPORTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "MeshFile.h"
+
+/// What MeshImporter::import read, and how long it took
+struct MeshImportStats {
+    uint64_t bytes_read = 0;
+    uint64_t vertices = 0;
+    uint64_t triangles = 0;
+    double seconds = 0.0;
+};
+
+/// Converts OBJ and PLY files into mesh files, streaming them through a fixed size buffer so that files much larger
+/// than memory can be converted. Text is read a chunk at a time, each chunk is split at line boundaries into a range
+/// per thread, and the ranges are parsed in parallel then written out in order. Binary PLY vertices, which are fixed
+/// size, are decoded in parallel the same way, its faces (which are variable size) on one thread.
+///
+/// Only what the app draws is imported: positions, vertex colours (white if there are none) and the faces, with
+/// polygons split into triangle fans. In OBJ, the texture coordinate and normal indices of faces (v/vt/vn) are ignored,
+/// so that each position stays one vertex and nothing needs to be looked up across chunks.
+class MeshImporter {
+public:
+    /// The size of the buffer each chunk is read into
+    static const size_t CHUNK_SIZE = 16 << 20;
+
+    /// Import a .obj or .ply file (picked by extension) into writer, which must be open, parsing with thread_count
+    /// threads. Returns false (after printing why) if it can't be read or isn't valid. Doesn't finish the writer.
+    static bool import(const std::string& path, MeshFileWriter& writer, int thread_count, MeshImportStats* stats = nullptr);
+};
+
+#endif //MESH_IMPORTER_H
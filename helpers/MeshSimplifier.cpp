@@ -0,0 +1,342 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+#include "MeshBuilder.h"
+
+// A level that doesn't remove at least this fraction of the triangles of the one before it isn't worth having
+static const float MIN_LOD_REDUCTION = 0.1f;
+// Collapses that turn a triangle by more than about 75 degrees are rejected, to keep the surface from folding over
+static const float MIN_NORMAL_COS = 0.25f;
+
+namespace {
+
+/// The symmetric 4x4 matrix (stored as its upper triangle) of the squared distance to a sum of planes, weighted by the
+/// areas of the triangles they came from, and the total weight
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+
+    void add_plane(double a, double b, double c, double d, double w) {
+        a00 += w * a * a; a01 += w * a * b; a02 += w * a * c; a03 += w * a * d;
+        a11 += w * b * b; a12 += w * b * c; a13 += w * b * d;
+        a22 += w * c * c; a23 += w * c * d;
+        a33 += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& other) {
+        a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+        a11 += other.a11; a12 += other.a12; a13 += other.a13;
+        a22 += other.a22; a23 += other.a23;
+        a33 += other.a33;
+        weight += other.weight;
+    }
+
+    /// The weighted sum of the squared distances from p to the planes
+    [[nodiscard]] double evaluate(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        return a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+               + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+               + a22 * z * z + 2 * a23 * z
+               + a33;
+    }
+};
+
+/// Collapse from onto to
+struct Collapse {
+    float cost;
+    uint from;
+    uint to;
+};
+
+glm::vec3 triangle_normal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    return glm::cross(b - a, c - a);
+}
+
+/// The state of a mesh being simplified, so that a chain of levels can be made by simplifying it further and further.
+/// The quadrics keep accumulating, so each level's error is measured against the original, not the level before it.
+class Simplifier {
+public:
+    Simplifier(const std::vector<glm::vec3>& positions, std::vector<uint> indices)
+            : positions(positions), indices(std::move(indices)), quadrics(positions.size()), locked(positions.size(), 0) {
+        for (size_t i = 0; i < this->indices.size(); i += 3) {
+            uint v[3] = {this->indices[i], this->indices[i + 1], this->indices[i + 2]};
+            glm::vec3 normal = triangle_normal(positions[v[0]], positions[v[1]], positions[v[2]]);
+            float length = glm::length(normal);
+            if (length == 0.0f) {
+                continue;
+            }
+            // The cross product's length is twice the area
+            glm::vec3 n = normal / length;
+            float d = -glm::dot(n, positions[v[0]]);
+            for (uint vertex : v) {
+                quadrics[vertex].add_plane(n.x, n.y, n.z, d, 0.5 * length);
+            }
+        }
+        lock_boundaries();
+    }
+
+    /// Collapse edges until there are at most target_index_count indices. Returns false if it ran out of edges that
+    /// can be collapsed first.
+    bool run(size_t target_index_count, MeshSimplifyStats& stats) {
+        while (indices.size() > target_index_count) {
+            stats.passes++;
+            build_adjacency();
+
+            collapses.clear();
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                for (int edge = 0; edge < 3; edge++) {
+                    // An edge shared by two triangles comes up in both, in opposite directions, only one is kept
+                    uint a = indices[i + edge];
+                    uint b = indices[i + (edge + 1) % 3];
+                    if (a > b || (locked[a] && locked[b])) {
+                        continue;
+                    }
+                    // Moving either end onto the other costs the same quadric, evaluated at the other end
+                    Quadric quadric = quadrics[a];
+                    quadric.add(quadrics[b]);
+                    double scale = quadric.weight > 0.0 ? 1.0 / quadric.weight : 0.0;
+                    double cost_a_to_b = std::numeric_limits<double>::infinity();
+                    double cost_b_to_a = std::numeric_limits<double>::infinity();
+                    if (!locked[a]) {
+                        cost_a_to_b = std::max(0.0, quadric.evaluate(positions[b]) * scale);
+                    }
+                    if (!locked[b]) {
+                        cost_b_to_a = std::max(0.0, quadric.evaluate(positions[a]) * scale);
+                    }
+                    if (cost_a_to_b <= cost_b_to_a) {
+                        collapses.push_back(Collapse{(float) cost_a_to_b, a, b});
+                    } else {
+                        collapses.push_back(Collapse{(float) cost_b_to_a, b, a});
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+                return a.cost < b.cost;
+            });
+
+            touched.assign(positions.size(), 0);
+            remap.resize(positions.size());
+            std::iota(remap.begin(), remap.end(), 0);
+            size_t triangles_to_remove = (indices.size() - target_index_count + 2) / 3;
+            size_t triangles_removed = 0;
+            size_t pass_collapses = 0;
+            for (const Collapse& collapse : collapses) {
+                if (triangles_removed >= triangles_to_remove) {
+                    break;
+                }
+                if (touched[collapse.from] || touched[collapse.to]) {
+                    continue;
+                }
+                if (flips(collapse)) {
+                    stats.rejected_flips++;
+                    continue;
+                }
+
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to].add(quadrics[collapse.from]);
+                error = std::max(error, std::sqrt(collapse.cost));
+                triangles_removed += touch_neighbours(collapse.from, collapse.to);
+                touch_neighbours(collapse.to, collapse.to);
+                pass_collapses++;
+            }
+            if (pass_collapses == 0) {
+                return false;
+            }
+            stats.collapses += pass_collapses;
+
+            // Move the collapsed vertices, and drop the triangles that lost a vertex
+            size_t write = 0;
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                uint a = remap[indices[i]];
+                uint b = remap[indices[i + 1]];
+                uint c = remap[indices[i + 2]];
+                if (a != b && b != c && c != a) {
+                    indices[write++] = a;
+                    indices[write++] = b;
+                    indices[write++] = c;
+                }
+            }
+            indices.resize(write);
+        }
+        return true;
+    }
+
+    [[nodiscard]] const std::vector<uint>& get_indices() const { return indices; }
+    [[nodiscard]] float get_error() const { return error; }
+
+private:
+    const std::vector<glm::vec3>& positions;
+    std::vector<uint> indices;
+    std::vector<Quadric> quadrics;
+    // Vertices on an open boundary (including seams), or an edge shared by more than two triangles
+    std::vector<uint8_t> locked;
+    float error = 0.0f;
+
+    // The triangles around each vertex, rebuilt every pass: vertex v's are vertex_triangles[triangle_offsets[v]] up
+    // to vertex_triangles[triangle_offsets[v + 1]]
+    std::vector<uint> triangle_offsets;
+    std::vector<uint> vertex_triangles;
+    std::vector<Collapse> collapses;
+    // Vertices around an edge collapsed in this pass
+    std::vector<uint8_t> touched;
+    std::vector<uint> remap;
+
+    void lock_boundaries() {
+        // An edge used by exactly one triangle is on a boundary, sorting the edges puts the uses of each together
+        std::vector<std::pair<uint, uint>> edges;
+        edges.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            for (int edge = 0; edge < 3; edge++) {
+                uint a = indices[i + edge];
+                uint b = indices[i + (edge + 1) % 3];
+                edges.emplace_back(std::min(a, b), std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size();) {
+            size_t end = i + 1;
+            while (end < edges.size() && edges[end] == edges[i]) {
+                end++;
+            }
+            if (end - i != 2) {
+                locked[edges[i].first] = 1;
+                locked[edges[i].second] = 1;
+            }
+            i = end;
+        }
+    }
+
+    void build_adjacency() {
+        triangle_offsets.assign(positions.size() + 1, 0);
+        for (uint index : indices) {
+            triangle_offsets[index + 1]++;
+        }
+        for (size_t v = 0; v < positions.size(); v++) {
+            triangle_offsets[v + 1] += triangle_offsets[v];
+        }
+        vertex_triangles.resize(indices.size());
+        std::vector<uint> fill(triangle_offsets.begin(), triangle_offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            vertex_triangles[fill[indices[i]]++] = (uint) (i / 3);
+        }
+    }
+
+    /// Whether moving from onto to would turn any of from's other triangles too far
+    [[nodiscard]] bool flips(const Collapse& collapse) const {
+        for (uint i = triangle_offsets[collapse.from]; i < triangle_offsets[collapse.from + 1]; i++) {
+            const uint* triangle = &indices[3 * vertex_triangles[i]];
+            if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                continue;
+            }
+            glm::vec3 before[3];
+            glm::vec3 after[3];
+            for (int corner = 0; corner < 3; corner++) {
+                before[corner] = positions[triangle[corner]];
+                after[corner] = triangle[corner] == collapse.from ? positions[collapse.to] : before[corner];
+            }
+            glm::vec3 normal_before = triangle_normal(before[0], before[1], before[2]);
+            glm::vec3 normal_after = triangle_normal(after[0], after[1], after[2]);
+            float lengths = glm::length(normal_before) * glm::length(normal_after);
+            if (glm::dot(normal_before, normal_after) <= MIN_NORMAL_COS * lengths) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Mark the vertices of vertex's triangles as touched, and return how many of them also use other
+    size_t touch_neighbours(uint vertex, uint other) {
+        size_t shared = 0;
+        for (uint i = triangle_offsets[vertex]; i < triangle_offsets[vertex + 1]; i++) {
+            const uint* triangle = &indices[3 * vertex_triangles[i]];
+            for (int corner = 0; corner < 3; corner++) {
+                touched[triangle[corner]] = 1;
+            }
+            shared += triangle[0] == other || triangle[1] == other || triangle[2] == other;
+        }
+        return shared;
+    }
+};
+
+}
+
+std::vector<uint> MeshSimplifier::simplify(const std::vector<glm::vec3>& positions, const std::vector<uint>& indices,
+                                           size_t target_index_count, float* error) {
+    Simplifier simplifier{positions, indices};
+    MeshSimplifyStats stats;
+    simplifier.run(target_index_count, stats);
+    if (error) {
+        *error = simplifier.get_error();
+    }
+    return simplifier.get_indices();
+}
+
+MeshLodChain MeshSimplifier::build_lod_chain(const std::vector<glm::vec3>& positions, const std::vector<uint>& indices,
+                                             int lod_count, float reduction, MeshSimplifyStats* stats) {
+    auto start = std::chrono::steady_clock::now();
+    MeshSimplifyStats build_stats;
+
+    MeshLodChain chain;
+    chain.indices = indices;
+    chain.lods.push_back(MeshLod{0, (uint) indices.size(), 0.0f});
+    lod_count = std::min(lod_count, MAX_LODS);
+    if (lod_count <= 1) {
+        return chain;
+    }
+
+    Simplifier simplifier{positions, indices};
+    while ((int) chain.lods.size() < lod_count) {
+        size_t previous_count = chain.lods.back().index_count;
+        size_t target = (size_t) ((float) (previous_count / 3) * reduction) * 3;
+        bool finished = !simplifier.run(target, build_stats);
+
+        const std::vector<uint>& lod_indices = simplifier.get_indices();
+        if (lod_indices.empty() || (float) lod_indices.size() > (1.0f - MIN_LOD_REDUCTION) * (float) previous_count) {
+            break;
+        }
+        // The simplifier keeps its own order, only the copy in the chain is reordered
+        std::vector<uint> optimised = lod_indices;
+        MeshBuilder::optimize_vertex_cache(optimised, positions.size());
+        chain.lods.push_back(MeshLod{(uint) chain.indices.size(), (uint) optimised.size(), simplifier.get_error()});
+        chain.indices.insert(chain.indices.end(), optimised.begin(), optimised.end());
+        if (finished) {
+            break;
+        }
+    }
+
+    build_stats.build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (stats) {
+        *stats = build_stats;
+    }
+    return chain;
+}
+
+int MeshLodChain::select_lod(float pixels_per_unit, int current, float max_pixel_error, float hysteresis) const {
+    int last = (int) lods.size() - 1;
+    current = std::min(std::max(current, 0), last);
+
+    // The coarsest level within a tolerance, the errors only grow along the chain
+    auto coarsest_within = [&](float tolerance) {
+        int lod = 0;
+        while (lod < last && lods[lod + 1].error * pixels_per_unit <= tolerance) {
+            lod++;
+        }
+        return lod;
+    };
+
+    if (lods[current].error * pixels_per_unit > max_pixel_error * (1.0f + hysteresis)) {
+        return coarsest_within(max_pixel_error);
+    }
+    return std::max(current, coarsest_within(max_pixel_error * (1.0f - hysteresis)));
+}
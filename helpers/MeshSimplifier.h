@@ -0,0 +1,70 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+/// One level of detail of a mesh, a range of a MeshLodChain's indices
+struct MeshLod {
+    uint first_index;
+    uint index_count;
+    /// Roughly how far (in the mesh's own units) the simplified surface may be from the original, 0 for the original
+    float error;
+};
+
+/// A mesh's levels of detail, from the original to the coarsest. Every level indexes the same vertices, so they can all
+/// be drawn from one vertex buffer, with their indices one after the other in one index buffer.
+struct MeshLodChain {
+    std::vector<uint> indices;
+    std::vector<MeshLod> lods;
+
+    /// Pick the level to draw an instance at, given how many pixels one unit of the mesh covers on screen. That's the
+    /// coarsest level whose error stays under max_pixel_error pixels, but the instance only moves to a coarser level
+    /// than current once its error is under (1 - hysteresis) of that, and to a finer one once current's is over
+    /// (1 + hysteresis) of it, so that an instance right at a threshold doesn't keep popping between two levels.
+    [[nodiscard]] int select_lod(float pixels_per_unit, int current, float max_pixel_error, float hysteresis) const;
+};
+
+/// Statistics about what MeshSimplifier::build_lod_chain did
+struct MeshSimplifyStats {
+    size_t passes = 0;
+    size_t collapses = 0;
+    size_t rejected_flips = 0;
+    double build_ms = 0.0;
+};
+
+/// Reduces the triangle count of a mesh with quadric error metric edge collapses (Garland and Heckbert).
+///
+/// Every vertex has a quadric, the sum of the squared distances to the planes of the triangles around it in the
+/// original mesh. Collapsing an edge moves one of its vertices onto the other, and costs the sum of their quadrics at
+/// the position it ends up at, so the edges in flat areas go first and the silhouette and sharp features last. The
+/// vertex is always moved onto the other end of the edge rather than an optimal new position, so that the simplified
+/// mesh only uses vertices that already exist, and every level can share the original's vertex buffer.
+///
+/// The collapses are done in passes: the cost of every edge is computed, then the cheapest are collapsed in order,
+/// skipping any that touch a vertex around an edge already collapsed in the pass, so that the costs that were computed
+/// stay valid. Vertices on an open boundary or a seam (where the vertices are split, e.g. for colours) are never moved,
+/// so holes don't open up and attributes don't bleed across the seams.
+class MeshSimplifier {
+public:
+    /// The most levels a chain has, including the original
+    static constexpr int MAX_LODS = 8;
+
+    /// Simplify a mesh until it has at most target_index_count indices, or can't be simplified further.
+    /// positions are the vertices' positions, which the returned indices index like the input.
+    /// If error is given, it's set to the level's error (see MeshLod).
+    static std::vector<uint> simplify(const std::vector<glm::vec3>& positions, const std::vector<uint>& indices,
+                                      size_t target_index_count, float* error = nullptr);
+
+    /// Build a chain of up to lod_count levels, each with about reduction times the triangles of the one before it.
+    /// The chain stops early once a level can't be reduced meaningfully. Each level's triangles are reordered for the
+    /// post-transform vertex cache.
+    static MeshLodChain build_lod_chain(const std::vector<glm::vec3>& positions, const std::vector<uint>& indices,
+                                        int lod_count, float reduction = 0.5f, MeshSimplifyStats* stats = nullptr);
+};
+
+#endif //MESH_SIMPLIFIER_H
@@ -0,0 +1,107 @@
+#include "RenderThread.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "CpuProfiler.h"
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+RenderThread::~RenderThread() {
+    stop();
+}
+
+void RenderThread::start(std::function<void()> on_start, std::function<void(int slot)> execute, std::function<void()> on_stop) {
+    if (is_running()) {
+        return;
+    }
+    stopping = false;
+    thread = std::thread(&RenderThread::run, this, std::move(on_start), std::move(execute), std::move(on_stop));
+}
+
+void RenderThread::stop() {
+    if (!is_running()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    thread.join();
+}
+
+int RenderThread::acquire_slot() {
+    std::unique_lock<std::mutex> lock(mutex);
+    int slot = next_record_slot;
+    next_record_slot = (next_record_slot + 1) % FRAME_SLOTS;
+
+    if (slot_states[slot] != SlotState::Free) {
+        CpuProfiler::Zone zone{"Wait For Render Thread"};
+        auto start = std::chrono::steady_clock::now();
+        condition.wait(lock, [&] { return slot_states[slot] == SlotState::Free; });
+        metrics.record_stalls++;
+        metrics.record_stall_ms += milliseconds_since(start);
+    }
+
+    slot_states[slot] = SlotState::Recording;
+    return slot;
+}
+
+void RenderThread::submit(int slot) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slot_states[slot] = SlotState::Queued;
+        metrics.queue_depth++;
+        metrics.max_queue_depth = std::max(metrics.max_queue_depth, metrics.queue_depth);
+    }
+    condition.notify_all();
+}
+
+void RenderThread::run(const std::function<void()>& on_start, const std::function<void(int slot)>& execute,
+                       const std::function<void()>& on_stop) {
+    CpuProfiler::set_thread_name("Render");
+    on_start();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        int slot = next_execute_slot;
+        if (slot_states[slot] != SlotState::Queued) {
+            if (stopping) {
+                break;
+            }
+            auto start = std::chrono::steady_clock::now();
+            condition.wait(lock, [&] { return slot_states[slot] == SlotState::Queued || stopping; });
+            if (slot_states[slot] != SlotState::Queued) {
+                break;
+            }
+            metrics.render_stalls++;
+            metrics.render_stall_ms += milliseconds_since(start);
+        }
+
+        slot_states[slot] = SlotState::Executing;
+        next_execute_slot = (next_execute_slot + 1) % FRAME_SLOTS;
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        execute(slot);
+        double execute_ms = milliseconds_since(start);
+
+        lock.lock();
+        slot_states[slot] = SlotState::Free;
+        metrics.frames_executed++;
+        metrics.queue_depth--;
+        metrics.last_execute_ms = execute_ms;
+        condition.notify_all();
+    }
+    lock.unlock();
+
+    on_stop();
+}
+
+RenderThreadMetrics RenderThread::get_metrics() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return metrics;
+}
@@ -0,0 +1,76 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/// How well the main and render threads are keeping each other busy
+struct RenderThreadMetrics {
+    uint64_t frames_executed = 0;
+    /// Frames submitted and not yet finished executing
+    int queue_depth = 0;
+    int max_queue_depth = 0;
+    /// Times the main thread had to wait for a slot to record into, because the render thread was behind
+    uint64_t record_stalls = 0;
+    double record_stall_ms = 0.0;
+    /// Times the render thread had nothing to execute, because the main thread was behind
+    uint64_t render_stalls = 0;
+    double render_stall_ms = 0.0;
+    /// How long the render thread took to execute the last frame
+    double last_execute_ms = 0.0;
+};
+
+/// Runs the execution of frames on a dedicated thread, which owns the GL context, while the main thread records
+/// the next frame. Frames are recorded into one of two slots (the app keeps the per-slot data, e.g. a command list,
+/// indexed by slot), so the main thread can record frame N + 1 while the render thread executes frame N.
+class RenderThread {
+public:
+    static const int FRAME_SLOTS = 2;
+
+    RenderThread() = default;
+    ~RenderThread();
+
+    RenderThread(const RenderThread&) = delete;
+    RenderThread& operator=(const RenderThread&) = delete;
+
+    /// Start the thread. on_start is called on it first (e.g. to make the context current), then execute for each
+    /// submitted slot, then on_stop when stopping (e.g. to release the context so the main thread can clean up).
+    void start(std::function<void()> on_start, std::function<void(int slot)> execute, std::function<void()> on_stop);
+    /// Execute any frames still queued, then stop and join the thread
+    void stop();
+    [[nodiscard]] bool is_running() const { return thread.joinable(); }
+
+    /// Get a slot to record the next frame into, waiting for the render thread to finish with it if needed
+    int acquire_slot();
+    /// Queue a recorded slot for execution
+    void submit(int slot);
+
+    [[nodiscard]] RenderThreadMetrics get_metrics();
+
+private:
+    enum class SlotState {
+        Free,
+        Recording,
+        Queued,
+        Executing,
+    };
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+
+    SlotState slot_states[FRAME_SLOTS] = {SlotState::Free, SlotState::Free};
+    /// Slots are recorded and executed in turn
+    int next_record_slot = 0;
+    int next_execute_slot = 0;
+    bool stopping = false;
+
+    RenderThreadMetrics metrics;
+
+    void run(const std::function<void()>& on_start, const std::function<void(int slot)>& execute, const std::function<void()>& on_stop);
+};
+
+#endif //RENDER_THREAD_H
@@ -1,22 +1,507 @@
 #include "ShaderHelper.h"
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
 #include <vector>
 
 const std::string ShaderHelper::SHADER_DIR = "res/shaders";
+const std::string ShaderHelper::CACHE_DIR = "cache/shaders";
+
+bool ShaderHelper::cache_enabled = true;
+ProgramCacheStats ShaderHelper::cache_stats;
+
+std::unordered_map<ProgramHandle, ShaderHelper::PendingProgram> ShaderHelper::pending_programs;
+ProgramHandle ShaderHelper::next_program_handle = 1;
+
+std::unordered_map<uint64_t, ShaderHelper::ShaderVariant> ShaderHelper::variants;
+std::unordered_map<std::string, std::string> ShaderHelper::shader_sources;
+
+// Identifies our cache files, and the version of their layout
+static const uint32_t PROGRAM_CACHE_MAGIC = 0x42535750; // "PWSB"
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+// The header at the start of each cache file, followed by the binary itself
+struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+};
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
 uint ShaderHelper::load_shader(const std::string &vertex_path, const std::string &fragment_path) {
-    auto vertex_code = load_shader_file(SHADER_DIR + "/" + vertex_path).value(); // Will throw exception on failure
-    auto fragment_code = load_shader_file(SHADER_DIR + "/" + fragment_path).value(); // Will throw exception on failure
+    return wait_for_program(load_shader_async(vertex_path, fragment_path)).value(); // Will throw exception on failure
+}
+
+ProgramHandle ShaderHelper::load_shader_async(const std::string& vertex_path, const std::string& fragment_path) {
+    auto vertex_code = load_shader_file(SHADER_DIR + "/" + vertex_path);
+    auto fragment_code = load_shader_file(SHADER_DIR + "/" + fragment_path);
+    if (!vertex_code || !fragment_code) {
+        ProgramHandle handle = next_program_handle++;
+        pending_programs[handle].stage = PendingProgram::Stage::Failed;
+        return handle;
+    }
+
+    return compile_program_async(std::move(*vertex_code), std::move(*fragment_code));
+}
 
-    auto vertexShader = compile_shader_code(vertex_code, GL_VERTEX_SHADER).value(); // Will throw exception on failure
-    auto fragmentShader = compile_shader_code(fragment_code, GL_FRAGMENT_SHADER).value(); // Will throw exception on failure
+ProgramHandle ShaderHelper::compile_program_async(std::string vertex_code, std::string fragment_code) {
+    ProgramHandle handle = next_program_handle++;
+    PendingProgram& pending = pending_programs[handle];
+    pending.start = std::chrono::steady_clock::now();
 
-    auto program_id = link_program(vertexShader, fragmentShader).value(); // Will throw exception on failure
+    // Binaries can only be retrieved if the driver supports at least one format
+    int num_binary_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_binary_formats);
+    pending.use_cache = cache_enabled && num_binary_formats > 0;
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    if (pending.use_cache) {
+        pending.cache_key = get_program_cache_key(vertex_code, fragment_code);
+        if (auto program = load_program_binary(pending.cache_key)) {
+            pending.program = *program;
+            pending.stage = PendingProgram::Stage::Ready;
+            cache_stats.hits++;
+            cache_stats.hit_time_ms += milliseconds_since(pending.start);
+            return handle;
+        }
+    }
+
+    pending.vertex_code = std::move(vertex_code);
+    pending.fragment_code = std::move(fragment_code);
+    pending.vertex_shader = submit_shader(pending.vertex_code, GL_VERTEX_SHADER);
+    pending.fragment_shader = submit_shader(pending.fragment_code, GL_FRAGMENT_SHADER);
+    pending.stage = PendingProgram::Stage::Compiling;
+    return handle;
+}
+
+// Not in every glad configuration, the value is from the GL_KHR_parallel_shader_compile spec
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
-    return program_id;
+bool ShaderHelper::has_parallel_compile() {
+    static const bool supported = [] {
+        int num_extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+        for (int i = 0; i < num_extensions; i++) {
+            auto* extension = (const char*) glGetStringi(GL_EXTENSIONS, i);
+            if (extension && std::string(extension) == "GL_KHR_parallel_shader_compile") {
+                return true;
+            }
+        }
+        return false;
+    }();
+    return supported;
+}
+
+void ShaderHelper::advance_program(PendingProgram& pending, bool blocking) {
+    bool can_poll = !blocking && has_parallel_compile();
+
+    if (pending.stage == PendingProgram::Stage::Compiling) {
+        if (can_poll) {
+            int vertex_done, fragment_done;
+            glGetShaderiv(pending.vertex_shader, GL_COMPLETION_STATUS_KHR, &vertex_done);
+            glGetShaderiv(pending.fragment_shader, GL_COMPLETION_STATUS_KHR, &fragment_done);
+            if (!vertex_done || !fragment_done) {
+                return;
+            }
+        }
+
+        // Check both, so that the errors of both are printed
+        bool vertex_ok = check_shader(pending.vertex_shader, pending.vertex_code, GL_VERTEX_SHADER);
+        bool fragment_ok = check_shader(pending.fragment_shader, pending.fragment_code, GL_FRAGMENT_SHADER);
+        if (!vertex_ok || !fragment_ok) {
+            glDeleteShader(pending.vertex_shader);
+            glDeleteShader(pending.fragment_shader);
+            pending.stage = PendingProgram::Stage::Failed;
+            return;
+        }
+
+        pending.program = submit_link(pending.vertex_shader, pending.fragment_shader);
+        pending.stage = PendingProgram::Stage::Linking;
+    }
+
+    if (pending.stage == PendingProgram::Stage::Linking) {
+        if (can_poll) {
+            int done;
+            glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done) {
+                return;
+            }
+        }
+
+        glDeleteShader(pending.vertex_shader);
+        glDeleteShader(pending.fragment_shader);
+
+        if (!check_link(pending.program)) {
+            glDeleteProgram(pending.program);
+            pending.program = 0;
+            pending.stage = PendingProgram::Stage::Failed;
+            return;
+        }
+
+        if (pending.use_cache) {
+            save_program_binary(pending.program, pending.cache_key);
+        }
+        cache_stats.misses++;
+        cache_stats.miss_time_ms += milliseconds_since(pending.start);
+
+        // The sources are only needed for error messages
+        pending.vertex_code.clear();
+        pending.vertex_code.shrink_to_fit();
+        pending.fragment_code.clear();
+        pending.fragment_code.shrink_to_fit();
+        pending.stage = PendingProgram::Stage::Ready;
+    }
+}
+
+void ShaderHelper::poll_programs(double budget_ms) {
+    auto start = std::chrono::steady_clock::now();
+    bool parallel = has_parallel_compile();
+
+    for (auto& [handle, pending] : pending_programs) {
+        if (pending.stage == PendingProgram::Stage::Ready || pending.stage == PendingProgram::Stage::Failed) {
+            continue;
+        }
+
+        if (parallel) {
+            // Never blocks, so just check on all of them
+            advance_program(pending, false);
+        } else {
+            advance_program(pending, true);
+            if (milliseconds_since(start) >= budget_ms) {
+                break;
+            }
+        }
+    }
+}
+
+ProgramStatus ShaderHelper::get_program_status(ProgramHandle handle) {
+    auto it = pending_programs.find(handle);
+    if (it == pending_programs.end() || it->second.stage == PendingProgram::Stage::Failed) {
+        return ProgramStatus::Failed;
+    }
+    return it->second.stage == PendingProgram::Stage::Ready ? ProgramStatus::Ready : ProgramStatus::Pending;
+}
+
+std::optional<uint> ShaderHelper::take_program(ProgramHandle handle) {
+    auto it = pending_programs.find(handle);
+    if (it == pending_programs.end()) {
+        return {};
+    }
+
+    std::optional<uint> program;
+    switch (it->second.stage) {
+        case PendingProgram::Stage::Ready:
+            program = it->second.program;
+            break;
+        case PendingProgram::Stage::Failed:
+            break;
+        default:
+            // Still pending, keep it around
+            return {};
+    }
+    pending_programs.erase(it);
+    return program;
+}
+
+std::optional<uint> ShaderHelper::wait_for_program(ProgramHandle handle) {
+    auto it = pending_programs.find(handle);
+    if (it != pending_programs.end()) {
+        advance_program(it->second, true);
+    }
+    return take_program(handle);
+}
+
+size_t ShaderHelper::get_pending_program_count() {
+    return pending_programs.size();
+}
+
+void ShaderHelper::set_program_cache_enabled(bool enabled) {
+    cache_enabled = enabled;
+}
+
+const ProgramCacheStats& ShaderHelper::get_program_cache_stats() {
+    return cache_stats;
+}
+
+// FNV-1a, including the terminating null so that e.g. "ab" + "c" and "a" + "bc" hash differently
+static uint64_t hash_string(uint64_t hash, const char* str) {
+    do {
+        hash = (hash ^ (unsigned char) *str) * 1099511628211ull;
+    } while (*str++);
+    return hash;
+}
+
+uint64_t ShaderHelper::get_program_cache_key(const std::string& vertex_code, const std::string& fragment_code) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = hash_string(hash, vertex_code.c_str());
+    hash = hash_string(hash, fragment_code.c_str());
+    // The stages the sources are for, so that the same source used for different stages can't collide
+    hash = hash_string(hash, "vertex+fragment");
+    // A binary is only valid for the driver that produced it
+    hash = hash_string(hash, (const char*) glGetString(GL_VENDOR));
+    hash = hash_string(hash, (const char*) glGetString(GL_RENDERER));
+    hash = hash_string(hash, (const char*) glGetString(GL_VERSION));
+    return hash;
+}
+
+static std::string get_cache_file_name(uint64_t key) {
+    std::stringstream name;
+    name << std::hex << key << ".bin";
+    return name.str();
+}
+
+std::optional<uint> ShaderHelper::load_program_binary(uint64_t key) {
+    auto path = std::filesystem::path(CACHE_DIR) / get_cache_file_name(key);
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return {};
+    }
+
+    ProgramCacheHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION || header.key != key) {
+        return {};
+    }
+
+    std::vector<char> binary(header.length);
+    file.read(binary.data(), header.length);
+    if (!file) {
+        return {};
+    }
+
+    uint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), (int) header.length);
+
+    // The driver may reject binaries even for the same version string, e.g. after a driver update that
+    // kept the version, in which case we fall back to compiling from source and overwrite the cache file.
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        cache_stats.rejected++;
+        return {};
+    }
+
+    return program;
+}
+
+void ShaderHelper::save_program_binary(uint program, uint64_t key) {
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    ProgramCacheHeader header{PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, format, (uint32_t) length};
+
+    // Write to a temporary file and rename it into place, so a crash or another instance can never see half a file
+    std::error_code error;
+    std::filesystem::create_directories(CACHE_DIR, error);
+    auto path = std::filesystem::path(CACHE_DIR) / get_cache_file_name(key);
+    auto temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+        if (!file) {
+            std::cout << "Failed to write program cache file: " << temp_path.string() << std::endl;
+            return;
+        }
+    }
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        std::cout << "Failed to write program cache file: " << path.string() << std::endl;
+    }
+}
+
+const std::string& ShaderHelper::get_shader_dir() {
+    return SHADER_DIR;
+}
+
+void ShaderHelper::update_shader_source(const std::string& shader_path, std::string source) {
+    shader_sources[shader_path] = std::move(source);
+
+    // We don't track which files each variant includes, so rebuild all of them. Only the ones that are used again
+    // are actually rebuilt, as that happens lazily in get_variant.
+    for (auto& [key, variant] : variants) {
+        variant.stale = true;
+    }
+}
+
+const std::string* ShaderHelper::get_shader_source(const std::string& shader_path) {
+    auto it = shader_sources.find(shader_path);
+    if (it == shader_sources.end()) {
+        auto source = load_shader_file(SHADER_DIR + "/" + shader_path);
+        if (!source) {
+            return nullptr;
+        }
+        it = shader_sources.emplace(shader_path, std::move(*source)).first;
+    }
+    return &it->second;
+}
+
+// If line is an #include "file" directive, returns the file, allowing whitespace around the #
+static std::optional<std::string> parse_include(const std::string& line) {
+    auto pos = line.find_first_not_of(" \t");
+    if (pos == std::string::npos || line[pos] != '#') {
+        return {};
+    }
+    pos = line.find_first_not_of(" \t", pos + 1);
+    if (pos == std::string::npos || line.compare(pos, 7, "include") != 0) {
+        return {};
+    }
+
+    auto open = line.find('"', pos + 7);
+    auto close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+    if (close == std::string::npos) {
+        return {};
+    }
+    return line.substr(open + 1, close - open - 1);
+}
+
+static bool is_version_directive(const std::string& line) {
+    auto pos = line.find_first_not_of(" \t");
+    return pos != std::string::npos && line.compare(pos, 8, "#version") == 0;
+}
+
+bool ShaderHelper::append_preprocessed(const std::string& shader_path, const ShaderDefines* defines,
+                                       std::unordered_set<std::string>& included, std::string& output) {
+    // Every file is included at most once, like with #pragma once, which also stops includes from recursing forever
+    if (!included.insert(shader_path).second) {
+        return true;
+    }
+
+    const std::string* source = get_shader_source(shader_path);
+    if (!source) {
+        return false;
+    }
+
+    // No #line directives are added, so the line numbers in the info log match the preprocessed source,
+    // which is what format_info_log shows the lines of
+    std::istringstream reader(*source);
+    for (std::string line; std::getline(reader, line);) {
+        if (auto include = parse_include(line)) {
+            if (!append_preprocessed(*include, nullptr, included, output)) {
+                std::cout << "Included from: " << shader_path << std::endl;
+                return false;
+            }
+            continue;
+        }
+
+        output += line;
+        output += '\n';
+
+        // The defines have to come after #version, which must be the first thing in the shader
+        if (defines && is_version_directive(line)) {
+            for (const auto& [name, value] : *defines) {
+                output += "#define " + name + (value.empty() ? "" : " " + value) + '\n';
+            }
+            defines = nullptr;
+        }
+    }
+
+    return true;
+}
+
+std::optional<std::string> ShaderHelper::preprocess(const std::string& shader_path, const ShaderDefines& defines) {
+    std::unordered_set<std::string> included;
+    std::string output;
+    if (!append_preprocessed(shader_path, &defines, included, output)) {
+        return {};
+    }
+    return output;
+}
+
+static uint64_t get_variant_key(const std::string& vertex_path, const std::string& fragment_path, const ShaderDefines& defines) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = hash_string(hash, vertex_path.c_str());
+    hash = hash_string(hash, fragment_path.c_str());
+    for (const auto& [name, value] : defines) {
+        hash = hash_string(hash, name.c_str());
+        hash = hash_string(hash, value.c_str());
+    }
+    return hash;
+}
+
+void ShaderHelper::update_variant(ShaderVariant& variant, const std::string& vertex_path, const std::string& fragment_path,
+                                  const ShaderDefines& defines, bool blocking) {
+    // Only one build is in flight at a time, sources updated during it are picked up by the next one
+    if (variant.stale && variant.pending == 0) {
+        variant.stale = false;
+
+        auto vertex_code = preprocess(vertex_path, defines);
+        auto fragment_code = preprocess(fragment_path, defines);
+        if (!vertex_code || !fragment_code) {
+            return;
+        }
+        variant.pending = compile_program_async(std::move(*vertex_code), std::move(*fragment_code));
+    }
+
+    if (variant.pending == 0) {
+        return;
+    }
+
+    std::optional<uint> program;
+    if (blocking) {
+        program = wait_for_program(variant.pending);
+    } else if (get_program_status(variant.pending) != ProgramStatus::Pending) {
+        program = take_program(variant.pending);
+    } else {
+        return;
+    }
+    variant.pending = 0;
+
+    if (!program) {
+        if (variant.program) {
+            std::cerr << "Failed to rebuild " << vertex_path << " + " << fragment_path << ", keeping the previous program" << std::endl;
+        }
+        return;
+    }
+
+    // Deleting a program that is in use is fine, the driver only deletes it once it no longer is
+    if (variant.program) {
+        glDeleteProgram(variant.program);
+        std::cout << "Rebuilt " << vertex_path << " + " << fragment_path << std::endl;
+    }
+    variant.program = *program;
+}
+
+std::optional<uint> ShaderHelper::get_variant(const std::string& vertex_path, const std::string& fragment_path, const ShaderDefines& defines) {
+    ShaderVariant& variant = variants[get_variant_key(vertex_path, fragment_path, defines)];
+    update_variant(variant, vertex_path, fragment_path, defines, false);
+    if (!variant.program) {
+        return {};
+    }
+    return variant.program;
+}
+
+uint ShaderHelper::load_shader_variant(const std::string& vertex_path, const std::string& fragment_path, const ShaderDefines& defines) {
+    ShaderVariant& variant = variants[get_variant_key(vertex_path, fragment_path, defines)];
+    update_variant(variant, vertex_path, fragment_path, defines, true);
+    if (!variant.program) {
+        throw std::runtime_error("Failed to build shader variant of " + vertex_path + " + " + fragment_path);
+    }
+    return variant.program;
+}
+
+size_t ShaderHelper::get_variant_count() {
+    return variants.size();
 }
 
 std::optional<std::string> ShaderHelper::load_shader_file(const std::string& shader_path) {
@@ -41,47 +526,64 @@ std::optional<std::string> ShaderHelper::load_shader_file(const std::string& sha
     return shader_code;
 }
 
+// The line of text at index (from 0), or empty if there aren't that many lines. A view of it, rather than a copy.
+static std::optional<std::string_view> get_line(std::string_view text, int index) {
+    size_t start = 0;
+    for (int i = 0; i < index && start < text.size(); i++) {
+        start = text.find('\n', start);
+        start = start == std::string_view::npos ? text.size() : start + 1;
+    }
+    if (index < 0 || start >= text.size()) {
+        return {};
+    }
+    size_t end = text.find('\n', start);
+    return text.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+}
+
+// Follow each line of the info log that refers to a line of the code, as in "0(12) : error ...", with that line and
+// the ones either side of it. The lines are found in place, rather than splitting the code into strings.
 static inline std::string format_info_log(const std::string& shader_code, const std::string& info_log) {
-    std::vector<std::string> lines;
-    std::istringstream code_line_reader(shader_code);
-    for (std::string line; std::getline(code_line_reader, line);) {
-        lines.push_back(line);
-    }
-
-    std::stringstream formatted_info_log;
-    std::istringstream info_log_reader(info_log);
-    for (std::string line; std::getline(info_log_reader, line);) {
-        formatted_info_log << line << '\n';
-        if (line.substr(0, 2) == "0(") {
-            auto end = line.find(')');
-            if (end != std::string::npos) {
-                auto num = line.substr(2, end - 2);
-                try {
-                    auto i = std::stoi(num) - 1;
-                    if (i >= 0 && i < (int) lines.size()) {
-                        if (i - 1 >= 0) {
-                            formatted_info_log << "\t[ ]: " << lines[i - 1] << '\n';
-                        }
-                        formatted_info_log << "\t[>]: " << lines[i] << '\n';
-                        if (i + 1 < (int) lines.size()) {
-                            formatted_info_log << "\t[ ]: " << lines[i + 1] << '\n';
-                        }
-                    }
-                } catch (const std::exception&) {}
+    std::string formatted_info_log;
+    std::string_view log = info_log;
+    for (size_t start = 0; start < log.size();) {
+        size_t end = std::min(log.find('\n', start), log.size());
+        std::string_view line = log.substr(start, end - start);
+        start = end + 1;
+
+        formatted_info_log.append(line).append("\n");
+        auto close = line.find(')');
+        if (line.substr(0, 2) != "0(" || close == std::string_view::npos) {
+            continue;
+        }
+        int number = 0;
+        if (std::from_chars(line.data() + 2, line.data() + close, number).ec != std::errc()) {
+            continue;
+        }
+        int i = number - 1;
+        if (auto code_line = get_line(shader_code, i)) {
+            if (auto previous = get_line(shader_code, i - 1)) {
+                formatted_info_log.append("\t[ ]: ").append(*previous).append("\n");
+            }
+            formatted_info_log.append("\t[>]: ").append(*code_line).append("\n");
+            if (auto next = get_line(shader_code, i + 1)) {
+                formatted_info_log.append("\t[ ]: ").append(*next).append("\n");
             }
         }
     }
-
-    return formatted_info_log.str();
+    return formatted_info_log;
 }
 
-std::optional<uint>ShaderHelper::compile_shader_code(const std::string& shader_code, uint shader_type) {
+uint ShaderHelper::submit_shader(const std::string& shader_code, uint shader_type) {
     uint shader = glCreateShader(shader_type);
 
     const char* source_c_str = shader_code.c_str();
     glShaderSource(shader, 1, &source_c_str, nullptr);
     glCompileShader(shader);
 
+    return shader;
+}
+
+bool ShaderHelper::check_shader(uint shader, const std::string& shader_code, uint shader_type) {
     int success;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success) {
@@ -93,19 +595,25 @@ std::optional<uint>ShaderHelper::compile_shader_code(const std::string& shader_c
         glGetShaderInfoLog(shader, msg_len, nullptr, info_log.data());
         std::cerr << "Failed to compile " << (shader_type == GL_VERTEX_SHADER ? "Vertex" : "Fragment") << " shader\n"
                   << format_info_log(shader_code, info_log) << std::endl;
-        return {};
+        return false;
     }
 
-    return shader;
+    return true;
 }
 
-std::optional<uint> ShaderHelper::link_program(uint vertex_shader, uint fragment_shader) {
+uint ShaderHelper::submit_link(uint vertex_shader, uint fragment_shader) {
     uint program = glCreateProgram();
 
     glAttachShader(program, vertex_shader);
     glAttachShader(program, fragment_shader);
+    // Let the driver know we'll want the binary for the program cache
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
 
+    return program;
+}
+
+bool ShaderHelper::check_link(uint program) {
     // print linking errors if any
     int success;
     glGetProgramiv(program, GL_LINK_STATUS, &success);
@@ -118,8 +626,8 @@ std::optional<uint> ShaderHelper::link_program(uint vertex_shader, uint fragment
 
         glGetProgramInfoLog(program, msg_len, nullptr, info_log.data());
         std::cerr << "Failed to link shader program" << "\n" << format_info_log("", info_log) << std::endl;
-        return {};
+        return false;
     }
 
-    return program;
+    return true;
 }
@@ -2,6 +2,8 @@
 #define SHADER_HELPER_H
 
 #include <string>
+#include <chrono>
+#include <cstdint>
 #include <optional>
 #include <filesystem>
 #include <unordered_map>
@@ -10,24 +12,180 @@
 #include <sstream>
 #include <utility>
 #include <functional>
+#include <map>
+#include <unordered_set>
 
 #include <glad/gl.h>
 
 // A useful shorthand that not all compilers provide by default
 using uint = unsigned int;
 
+/// Counts and timings for the program binary cache, to compare cold and warm startup.
+struct ProgramCacheStats {
+    /// Programs restored from a cached binary
+    uint hits = 0;
+    /// Programs compiled from source, because there was no cached binary
+    uint misses = 0;
+    /// Programs compiled from source because the cached binary was rejected by the driver (also counted as misses)
+    uint rejected = 0;
+    /// Total time spent in load_shader for hits and misses, including reading the files, in milliseconds
+    double hit_time_ms = 0.0;
+    double miss_time_ms = 0.0;
+};
+
+/// Identifies a program submitted with ShaderHelper::load_shader_async or ShaderHelper::compile_program_async
+using ProgramHandle = uint;
+
+enum class ProgramStatus {
+    /// Still compiling or linking
+    Pending,
+    /// Linked successfully, take it with ShaderHelper::take_program
+    Ready,
+    /// Failed to load, compile or link, the errors have already been printed
+    Failed,
+};
+
+/// The macros to #define when preprocessing a shader variant, by name. An empty value defines the macro without one.
+/// Being ordered means the same set always gives the same source, and so the same variant, whatever order it was built in.
+using ShaderDefines = std::map<std::string, std::string>;
+
 /// A shader helper that loads files, compiles and links for you. Also prints any errors.
+/// Linked programs are cached on disk as driver specific binaries, so later runs can skip compiling them.
+///
+/// Programs can also be compiled asynchronously: submit as many as needed up front, call poll_programs() once a
+/// frame, and take each one when it's ready. With GL_KHR_parallel_shader_compile the driver compiles them on its own
+/// threads and polling never blocks, otherwise each poll does as much of the work as fits in its time budget.
+///
+/// Specialised variants of a program are built by preprocessing its shaders: #include "file" lines are replaced by the
+/// file (relative to the shader directory), and a set of #defines is inserted after the #version line. Each variant is
+/// compiled once and kept, and rebuilt when one of the shader sources is updated.
 class ShaderHelper {
     static const std::string SHADER_DIR;
+    static const std::string CACHE_DIR;
+
+    static bool cache_enabled;
+    static ProgramCacheStats cache_stats;
+
+    /// The state of a program submitted asynchronously
+    struct PendingProgram {
+        enum class Stage {
+            Compiling,
+            Linking,
+            Ready,
+            Failed,
+        };
+
+        Stage stage = Stage::Compiling;
+        // Kept for formatting the info log, should compiling fail
+        std::string vertex_code;
+        std::string fragment_code;
+        uint vertex_shader = 0;
+        uint fragment_shader = 0;
+        uint program = 0;
+        bool use_cache = false;
+        uint64_t cache_key = 0;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    static std::unordered_map<ProgramHandle, PendingProgram> pending_programs;
+    static ProgramHandle next_program_handle;
+
+    /// A program built from preprocessed shaders with a particular set of defines
+    struct ShaderVariant {
+        /// The latest program that linked, 0 until the first one has
+        uint program = 0;
+        /// The program being built to replace it, 0 when there isn't one
+        ProgramHandle pending = 0;
+        /// Set when the sources have changed since the variant was last built
+        bool stale = true;
+    };
+
+    /// Keyed by a hash of the shader paths and defines
+    static std::unordered_map<uint64_t, ShaderVariant> variants;
+    /// The sources of the shader files that have been read, by path relative to the shader directory
+    static std::unordered_map<std::string, std::string> shader_sources;
 
 public:
+    /// Load, compile and link a program, blocking until it's done. Throws if any of that fails.
     static uint load_shader(const std::string& vertex_path, const std::string& fragment_path);
+
+    /// Start loading, compiling and linking a program, without waiting for the driver.
+    static ProgramHandle load_shader_async(const std::string& vertex_path, const std::string& fragment_path);
+    /// Start compiling and linking a program from source, without waiting for the driver.
+    static ProgramHandle compile_program_async(std::string vertex_code, std::string fragment_code);
+
+    /// Advance the programs that are pending, should be called once a frame. Without GL_KHR_parallel_shader_compile,
+    /// checking on a program blocks until the driver is done with it, so this stops after budget_ms
+    /// (but always advances at least one program).
+    static void poll_programs(double budget_ms = 2.0);
+    static ProgramStatus get_program_status(ProgramHandle handle);
+    /// Take a program that is no longer pending, releasing the handle. Returns empty if it failed.
+    static std::optional<uint> take_program(ProgramHandle handle);
+    /// Block until a program is no longer pending, then take it.
+    static std::optional<uint> wait_for_program(ProgramHandle handle);
+    /// The number of programs that have been submitted but not yet taken
+    static size_t get_pending_program_count();
+    /// Whether the driver supports GL_KHR_parallel_shader_compile
+    static bool has_parallel_compile();
+
+    /// Get a variant of a program, built from the shaders preprocessed with the given defines, without blocking.
+    /// The first call for a variant starts building it, and it's returned once it's ready (poll_programs() needs to
+    /// be called meanwhile). After the sources are updated, the previous program keeps being returned until the
+    /// rebuilt one is ready, and if the rebuild fails the previous one is kept.
+    static std::optional<uint> get_variant(const std::string& vertex_path, const std::string& fragment_path, const ShaderDefines& defines);
+    /// Like get_variant, but blocks until the variant is ready. Throws if it fails to build.
+    static uint load_shader_variant(const std::string& vertex_path, const std::string& fragment_path, const ShaderDefines& defines);
+    /// The number of distinct variants that have been requested
+    static size_t get_variant_count();
+
+    /// Read a shader file and resolve its includes, inserting the defines after the #version line.
+    /// Returns empty (after printing the error) if it or one of its includes can't be read.
+    static std::optional<std::string> preprocess(const std::string& shader_path, const ShaderDefines& defines);
+
+    /// The directory shader paths are relative to
+    static const std::string& get_shader_dir();
+    /// Replace the source of a shader file (e.g. after it was edited) and mark every variant to be rebuilt.
+    /// Otherwise, each file is only read from disk the first time it's used.
+    static void update_shader_source(const std::string& shader_path, std::string source);
+
+    /// Enable or disable the program binary cache (enabled by default).
+    static void set_program_cache_enabled(bool enabled);
+    static const ProgramCacheStats& get_program_cache_stats();
 private:
     static std::optional<std::string> load_shader_file(const std::string& shader_path);
 
-    static std::optional<uint> compile_shader_code(const std::string& shader_code, uint shader_type);
+    /// The source of a shader file, from shader_sources, reading it from disk the first time
+    static const std::string* get_shader_source(const std::string& shader_path);
+    /// Append a shader file to output with its includes resolved, skipping files that were already included
+    static bool append_preprocessed(const std::string& shader_path, const ShaderDefines* defines,
+                                    std::unordered_set<std::string>& included, std::string& output);
+
+    /// Start rebuilding a variant if it's stale, and swap in the rebuilt program if it's done
+    static void update_variant(ShaderVariant& variant, const std::string& vertex_path, const std::string& fragment_path,
+                               const ShaderDefines& defines, bool blocking);
+
+    /// Submit a shader for compilation, without checking the result
+    static uint submit_shader(const std::string& shader_code, uint shader_type);
+    /// Check whether a shader compiled, printing the formatted info log if it didn't
+    static bool check_shader(uint shader, const std::string& shader_code, uint shader_type);
+
+    /// Submit a program for linking, without checking the result
+    static uint submit_link(uint vertex_shader, uint fragment_shader);
+    /// Check whether a program linked, printing the info log if it didn't
+    static bool check_link(uint program);
+
+    /// Move a pending program on to its next stage if the driver is done with the current one. When blocking is false
+    /// and the driver supports parallel compilation, this returns immediately if it isn't done.
+    static void advance_program(PendingProgram& pending, bool blocking);
+
+    /// The key a program is cached under, a hash of everything that affects the binary: the sources,
+    /// the stages they are for, and the driver.
+    static uint64_t get_program_cache_key(const std::string& vertex_code, const std::string& fragment_code);
+
+    /// Create a program from the cached binary, if there is one and the driver accepts it.
+    static std::optional<uint> load_program_binary(uint64_t key);
 
-    static std::optional<uint> link_program(uint vertex_shader, uint fragment_shader);
+    static void save_program_binary(uint program, uint64_t key);
 };
 
 #endif //SHADER_HELPER_H
@@ -0,0 +1,139 @@
+#include "ShaderWatcher.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstdint>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ShaderWatcher::~ShaderWatcher() {
+    stop();
+}
+
+#ifdef __linux__
+
+// How often the thread checks whether it's been stopped, when nothing wakes it up. stop() normally wakes it straight
+// away through stop_fd, so this only bounds how long stop() waits if that fails.
+const int STOP_CHECK_INTERVAL_MS = 100;
+
+bool ShaderWatcher::start(const std::string& watch_directory) {
+    directory = watch_directory;
+    stopping = false;
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        std::cerr << "Failed to initialise inotify, shader hot reload is disabled" << std::endl;
+        return false;
+    }
+
+    // Editors either write the file in place (IN_CLOSE_WRITE) or write a temporary file and rename it over the
+    // original (IN_MOVED_TO), so watch for both.
+    if (inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cerr << "Failed to watch " << directory << ", shader hot reload is disabled" << std::endl;
+        close(inotify_fd);
+        inotify_fd = -1;
+        return false;
+    }
+
+    stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    thread = std::thread(&ShaderWatcher::run, this);
+    return true;
+}
+
+void ShaderWatcher::stop() {
+    if (thread.joinable()) {
+        // The thread is always joined, never detached, as it uses the fds closed below and the queue. If the write
+        // fails, it still sees stopping within STOP_CHECK_INTERVAL_MS.
+        stopping = true;
+        uint64_t value = 1;
+        if (write(stop_fd, &value, sizeof(value)) != sizeof(value)) {
+            std::cerr << "Failed to wake the shader watcher thread, waiting for it to notice it's stopped" << std::endl;
+        }
+        thread.join();
+    }
+
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+    if (stop_fd >= 0) {
+        close(stop_fd);
+        stop_fd = -1;
+    }
+}
+
+static bool is_shader_file(const std::string& name) {
+    const std::string extension = ".glsl";
+    return name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+void ShaderWatcher::run() {
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = {
+            {inotify_fd, POLLIN, 0},
+            {stop_fd, POLLIN, 0},
+    };
+
+    while (!stopping) {
+        int ready = ::poll(fds, 2, STOP_CHECK_INTERVAL_MS);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (ready == 0 || fds[1].revents) {
+            continue;
+        }
+
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            continue;
+        }
+
+        for (char* event_ptr = buffer; event_ptr < buffer + length;) {
+            auto* event = reinterpret_cast<inotify_event*>(event_ptr);
+            event_ptr += sizeof(inotify_event) + event->len;
+
+            if (event->len == 0 || (event->mask & IN_ISDIR) || !is_shader_file(event->name)) {
+                continue;
+            }
+
+            // Read the file here, so that the main thread never touches the disk
+            std::ifstream file(directory + "/" + event->name);
+            if (!file) {
+                continue;
+            }
+            std::stringstream source;
+            source << file.rdbuf();
+
+            if (!changes.push(ShaderChange{event->name, source.str()})) {
+                std::cerr << "Shader change queue is full, dropped change to " << event->name << std::endl;
+            }
+        }
+    }
+}
+
+#else
+
+bool ShaderWatcher::start(const std::string& /*watch_directory*/) {
+    std::cout << "Shader hot reload is only supported on Linux" << std::endl;
+    return false;
+}
+
+void ShaderWatcher::stop() {}
+
+void ShaderWatcher::run() {}
+
+#endif
+
+std::optional<ShaderChange> ShaderWatcher::poll() {
+    return changes.pop();
+}
@@ -0,0 +1,49 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <optional>
+
+#include "SpscQueue.h"
+
+/// A shader file that has been written to, along with its new source.
+struct ShaderChange {
+    /// The name of the file within the watched directory, e.g. "vert.glsl"
+    std::string file_name;
+    std::string source;
+};
+
+/// Watches a directory of shaders on a background thread (with inotify, so only on Linux), reading any .glsl file that
+/// is written to and handing its new source to the main thread through a lock-free queue.
+class ShaderWatcher {
+    std::thread thread;
+    int inotify_fd = -1;
+    // Written to by stop() to wake the thread up so that it exits
+    int stop_fd = -1;
+    // Set by stop(), the thread also checks it every so often in case writing to stop_fd fails
+    std::atomic<bool> stopping{false};
+    std::string directory;
+
+    SpscQueue<ShaderChange, 64> changes;
+
+    void run();
+
+public:
+    ShaderWatcher() = default;
+    ~ShaderWatcher();
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    /// Start watching the directory, returns false if watching isn't possible (or supported on this platform).
+    bool start(const std::string& directory);
+    /// Stop watching and join the thread, also done by the destructor.
+    void stop();
+
+    /// Take the next change, if there is one. Only call this from one thread.
+    std::optional<ShaderChange> poll();
+};
+
+#endif //SHADER_WATCHER_H
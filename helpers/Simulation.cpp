@@ -0,0 +1,145 @@
+#include "Simulation.h"
+
+#include <algorithm>
+#include <random>
+
+#include "CpuProfiler.h"
+
+static const float TWO_PI = 6.28318530717958647692f;
+
+Simulation::Simulation(double tick_rate) : tick_duration(1.0 / tick_rate), epoch(std::chrono::steady_clock::now()) {}
+
+Simulation::~Simulation() {
+    stop();
+}
+
+double Simulation::now() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Simulation::start() {
+    if (running.exchange(true)) {
+        return;
+    }
+
+    tick(now());
+    thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void Simulation::set_instance_count(size_t count) {
+    std::lock_guard<std::mutex> lock(controls_mutex);
+    controls.instance_count = count;
+}
+
+void Simulation::set_animate(bool animate) {
+    std::lock_guard<std::mutex> lock(controls_mutex);
+    controls.animate = animate;
+}
+
+void Simulation::set_rotation_speed(glm::vec3 speed) {
+    std::lock_guard<std::mutex> lock(controls_mutex);
+    controls.rotation_speed = speed;
+}
+
+void Simulation::set_angles(float angle_x, float angle_y) {
+    std::lock_guard<std::mutex> lock(controls_mutex);
+    controls.set_angles = true;
+    controls.angle_x = angle_x;
+    controls.angle_y = angle_y;
+}
+
+void Simulation::tick(double time) {
+    CpuProfiler::Zone zone{"Simulation Tick"};
+
+    Controls current_controls;
+    {
+        std::lock_guard<std::mutex> lock(controls_mutex);
+        current_controls = controls;
+        controls.set_angles = false;
+    }
+
+    // Existing instances keep their state, the first one starts like the original single cube did
+    static std::mt19937 random;
+    std::uniform_real_distribution<float> angle_distribution(0.0f, TWO_PI);
+    std::uniform_real_distribution<float> speed_distribution(0.5f, 1.5f);
+
+    auto old_count = state.size();
+    if (current_controls.instance_count != old_count) {
+        state.resize(current_controls.instance_count);
+        for (auto i = old_count; i < state.size(); i++) {
+            bool first = i == 0;
+            state.angle_x[i] = first ? 0.0f : angle_distribution(random);
+            state.angle_y[i] = first ? 0.0f : angle_distribution(random);
+            state.speed_x[i] = first ? 1.0f : speed_distribution(random);
+            state.speed_y[i] = first ? 1.0f : speed_distribution(random);
+        }
+    }
+
+    if (current_controls.set_angles) {
+        std::fill(state.angle_x.begin(), state.angle_x.end(), current_controls.angle_x);
+        std::fill(state.angle_y.begin(), state.angle_y.end(), current_controls.angle_y);
+    }
+
+    // The snapshot being written still holds whatever tick it was last used for, so is overwritten completely.
+    // assign() reuses the vectors' storage, so this doesn't allocate once the instance count settles.
+    SimulationSnapshot& snapshot = snapshots.get_write_buffer();
+    snapshot.previous_angle_x.assign(state.angle_x.begin(), state.angle_x.end());
+    snapshot.previous_angle_y.assign(state.angle_y.begin(), state.angle_y.end());
+
+    if (current_controls.animate) {
+        BatchTransform::advance(state, (float) tick_duration, current_controls.rotation_speed);
+    }
+
+    snapshot.angle_x.assign(state.angle_x.begin(), state.angle_x.end());
+    snapshot.angle_y.assign(state.angle_y.begin(), state.angle_y.end());
+    snapshot.tick = tick_index++;
+    snapshot.time = time;
+    snapshots.publish();
+
+    tick_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Simulation::run() {
+    CpuProfiler::set_thread_name("Simulation");
+
+    // Each tick is due a fixed duration after the last, regardless of how long the tick itself took
+    double next_tick = now() + tick_duration;
+    while (running.load(std::memory_order_relaxed)) {
+        double time = now();
+        if (time < next_tick) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(next_tick - time));
+            continue;
+        }
+
+        if (time - next_tick > MAX_CATCH_UP_SECONDS) {
+            auto skipped = (uint64_t) ((time - next_tick) / tick_duration);
+            skipped_tick_count.fetch_add(skipped, std::memory_order_relaxed);
+            next_tick += (double) skipped * tick_duration;
+        }
+
+        tick(next_tick);
+        next_tick += tick_duration;
+    }
+}
+
+bool Simulation::update_snapshot() {
+    return snapshots.update();
+}
+
+const SimulationSnapshot& Simulation::get_snapshot() const {
+    return snapshots.get_read_buffer();
+}
+
+float Simulation::get_interpolation_alpha() const {
+    // The snapshot's current state is for its tick time, so drawing its previous state then and reaching the
+    // current state a tick later keeps the motion smooth, at the cost of a tick of latency
+    auto alpha = (float) ((now() - get_snapshot().time) / tick_duration);
+    return std::clamp(alpha, 0.0f, 1.0f);
+}
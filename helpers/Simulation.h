@@ -0,0 +1,109 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "BatchTransform.h"
+#include "TripleBuffer.h"
+
+/// The state of the simulation after a tick, along with the state after the tick before, so that the renderer can
+/// interpolate between them. Only the angles are simulated, the layout of the instances is up to the renderer.
+struct SimulationSnapshot {
+    uint64_t tick = 0;
+    /// When the tick was due, on the simulation's clock
+    double time = 0.0;
+    std::vector<float> previous_angle_x;
+    std::vector<float> previous_angle_y;
+    std::vector<float> angle_x;
+    std::vector<float> angle_y;
+};
+
+/// Advances the rotation of every instance on its own thread at a fixed tick rate, so that the results don't depend on
+/// the frame rate, and simulating and rendering don't hold each other up.
+///
+/// Each tick is published as a snapshot through a lock-free triple buffer, the renderer picks up the latest one each
+/// frame and interpolates between its two states. So what is drawn is up to one tick behind the simulation.
+/// Changes from the UI are passed the other way through a small set of controls, read once per tick.
+class Simulation {
+public:
+    static constexpr double DEFAULT_TICK_RATE = 60.0;
+    /// If the simulation falls further behind than this, e.g. after being paused in a debugger, it skips the ticks
+    /// it missed instead of trying to catch up
+    static constexpr double MAX_CATCH_UP_SECONDS = 0.25;
+
+    explicit Simulation(double tick_rate = DEFAULT_TICK_RATE);
+    ~Simulation();
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    /// Run the first tick immediately, so there is a snapshot to draw, then start the thread
+    void start();
+    /// Stop and join the thread, also done by the destructor
+    void stop();
+
+    // Controls, called from the main thread and applied at the start of the next tick
+
+    /// Resize the simulation, keeping existing instances and giving new ones a random angle and speed
+    void set_instance_count(size_t count);
+    void set_animate(bool animate);
+    /// Multiplies every instance's own rotation speed
+    void set_rotation_speed(glm::vec3 speed);
+    /// Set every instance to the same angles
+    void set_angles(float angle_x, float angle_y);
+
+    // Rendering, called from the render thread
+
+    /// Pick up the latest snapshot, if there's a new one. Returns whether there was.
+    bool update_snapshot();
+    /// The snapshot as of the last update_snapshot()
+    [[nodiscard]] const SimulationSnapshot& get_snapshot() const;
+    /// How far from the snapshot's previous state to its current state the renderer should be now, in [0, 1]
+    [[nodiscard]] float get_interpolation_alpha() const;
+
+    [[nodiscard]] double get_tick_rate() const { return 1.0 / tick_duration; }
+    /// The number of ticks run so far, and the number skipped for falling too far behind
+    [[nodiscard]] uint64_t get_tick_count() const { return tick_count.load(std::memory_order_relaxed); }
+    [[nodiscard]] uint64_t get_skipped_tick_count() const { return skipped_tick_count.load(std::memory_order_relaxed); }
+
+private:
+    struct Controls {
+        size_t instance_count = 1;
+        bool animate = true;
+        glm::vec3 rotation_speed{1.0f};
+        bool set_angles = false;
+        float angle_x = 0.0f;
+        float angle_y = 0.0f;
+    };
+
+    double tick_duration;
+    std::chrono::steady_clock::time_point epoch;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    // Only held while copying the controls in or out, so never for long
+    std::mutex controls_mutex;
+    Controls controls;
+
+    /// The simulation's own state, only the angles and speeds are used
+    TransformBatch state;
+    uint64_t tick_index = 0;
+    TripleBuffer<SimulationSnapshot> snapshots;
+
+    std::atomic<uint64_t> tick_count{0};
+    std::atomic<uint64_t> skipped_tick_count{0};
+
+    [[nodiscard]] double now() const;
+    void tick(double time);
+    void run();
+};
+
+#endif //SIMULATION_H
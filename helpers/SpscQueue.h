@@ -0,0 +1,52 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+/// A bounded, lock-free queue for passing values from exactly one producer thread to exactly one consumer thread.
+/// Neither side ever blocks: push fails when the queue is full, and pop returns empty when there is nothing to take.
+template<typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+
+    T slots[Capacity];
+    // The indices only ever increase, and are wrapped when indexing. Each is written by one side only, and they are
+    // kept on separate cache lines so that the two threads don't fight over the same line.
+    /// The next slot to pop from, written by the consumer
+    alignas(64) std::atomic<size_t> head{0};
+    /// The next slot to push to, written by the producer
+    alignas(64) std::atomic<size_t> tail{0};
+
+public:
+    /// Called from the producer thread. Returns false, without taking the value, if the queue is full.
+    bool push(T value) {
+        size_t current_tail = tail.load(std::memory_order_relaxed);
+        if (current_tail - head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        slots[current_tail & (Capacity - 1)] = std::move(value);
+        tail.store(current_tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Called from the consumer thread.
+    std::optional<T> pop() {
+        size_t current_head = head.load(std::memory_order_relaxed);
+        if (current_head == tail.load(std::memory_order_acquire)) {
+            return {};
+        }
+        T value = std::move(slots[current_head & (Capacity - 1)]);
+        head.store(current_head + 1, std::memory_order_release);
+        return value;
+    }
+
+    /// Approximate when called while the other thread is active.
+    [[nodiscard]] size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+};
+
+#endif //SPSC_QUEUE_H
@@ -0,0 +1,163 @@
+#include "StreamBuffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// The buffer is mapped through this target, so as not to disturb the bindings the app uses
+static const GLenum MAP_TARGET = GL_COPY_WRITE_BUFFER;
+
+// Regions are kept aligned to this, which covers every alignment that is asked for in practice
+// (GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT is at most 256 on current hardware)
+static const size_t REGION_ALIGNMENT = 256;
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void StreamBuffer::init(size_t initial_region_size) {
+    // Not every glad configuration has the 4.4 functions, and the context may not support them even if it does
+#ifdef GL_VERSION_4_4
+    persistent = GLAD_GL_VERSION_4_4;
+#else
+    persistent = false;
+#endif
+    create(initial_region_size);
+}
+
+void StreamBuffer::create(size_t new_region_size) {
+    region_size = align_up(new_region_size, REGION_ALIGNMENT);
+    size_t size = region_size * REGION_COUNT;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(MAP_TARGET, buffer);
+#ifdef GL_VERSION_4_4
+    if (persistent) {
+        // Coherent, so writes are visible to the GPU without flushing
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(MAP_TARGET, (GLsizeiptr) size, nullptr, flags);
+        persistent_data = (unsigned char*) glMapBufferRange(MAP_TARGET, 0, (GLsizeiptr) size, flags);
+    }
+#endif
+    if (!persistent) {
+        glBufferData(MAP_TARGET, (GLsizeiptr) size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(MAP_TARGET, 0);
+
+    buffer_size = size;
+}
+
+void StreamBuffer::destroy() {
+    for (auto& fence : fences) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (buffer) {
+        // Deleting the buffer while the GPU is still reading it is fine, the driver keeps it until it's done
+        if (persistent_data) {
+            glBindBuffer(MAP_TARGET, buffer);
+            glUnmapBuffer(MAP_TARGET);
+            glBindBuffer(MAP_TARGET, 0);
+            persistent_data = nullptr;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+}
+
+void StreamBuffer::cleanup() {
+    destroy();
+    region_size = 0;
+    buffer_size = 0;
+}
+
+bool StreamBuffer::begin_frame(size_t required_size) {
+    bool reallocated = required_size > region_size;
+    if (reallocated) {
+        // Grow by at least double, so that a slowly growing scene doesn't reallocate every frame
+        destroy();
+        create(std::max(required_size, region_size * 2));
+        reallocations++;
+        region = 0;
+    } else {
+        region = (region + 1) % REGION_COUNT;
+    }
+    region_used = 0;
+
+    GLsync& fence = fences[region];
+    if (!fence) {
+        return reallocated;
+    }
+
+    // Normally the GPU finished with the region a frame or two ago, so check without waiting first
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        auto start = std::chrono::steady_clock::now();
+        // Flush, so the fence is guaranteed to be signalled eventually, and keep waiting in 100ms steps
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100'000'000);
+        } while (result == GL_TIMEOUT_EXPIRED);
+
+        fence_waits++;
+        double waited = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        fence_wait_ms.store(fence_wait_ms.load(std::memory_order_relaxed) + waited, std::memory_order_relaxed);
+    }
+    if (result == GL_WAIT_FAILED) {
+        std::cerr << "Failed to wait for stream buffer fence" << std::endl;
+    }
+
+    glDeleteSync(fence);
+    fence = nullptr;
+    return reallocated;
+}
+
+void StreamBuffer::end_frame() {
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame_bytes = region_used;
+}
+
+void* StreamBuffer::map(size_t size, size_t alignment, size_t* offset) {
+    size_t start = align_up(region_used, alignment);
+    if (start + size > region_size) {
+        std::cerr << "Stream buffer region is full, " << size << " bytes didn't fit" << std::endl;
+        return nullptr;
+    }
+    region_used = start + size;
+    bytes_streamed += size;
+
+    *offset = (size_t) region * region_size + start;
+    if (persistent_data) {
+        return persistent_data + *offset;
+    }
+
+    // The fences guarantee the GPU isn't reading this range, so the driver doesn't need to check,
+    // and the previous contents don't matter
+    glBindBuffer(MAP_TARGET, buffer);
+    mapped = true;
+    return glMapBufferRange(MAP_TARGET, (GLintptr) *offset, (GLsizeiptr) size,
+                            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+void StreamBuffer::unmap() {
+    if (!mapped) {
+        return;
+    }
+    glBindBuffer(MAP_TARGET, buffer);
+    glUnmapBuffer(MAP_TARGET);
+    glBindBuffer(MAP_TARGET, 0);
+    mapped = false;
+}
+
+StreamBufferStats StreamBuffer::get_stats() const {
+    StreamBufferStats stats;
+    stats.bytes_streamed = bytes_streamed;
+    stats.frame_bytes = frame_bytes;
+    stats.fence_waits = fence_waits;
+    stats.fence_wait_ms = fence_wait_ms;
+    stats.reallocations = reallocations;
+    stats.buffer_size = buffer_size;
+    stats.persistent = persistent;
+    return stats;
+}
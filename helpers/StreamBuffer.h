@@ -0,0 +1,84 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <glad/gl.h>
+
+// A useful shorthand that not all compilers provide by default
+using uint = unsigned int;
+
+/// Counters for a StreamBuffer, safe to read from any thread
+struct StreamBufferStats {
+    uint64_t bytes_streamed = 0;
+    /// The bytes written in the last completed frame
+    uint64_t frame_bytes = 0;
+    /// Times a region was still in use by the GPU when it came round again, and had to be waited for
+    uint64_t fence_waits = 0;
+    double fence_wait_ms = 0.0;
+    /// Times the buffer had to grow to fit a frame
+    uint64_t reallocations = 0;
+    size_t buffer_size = 0;
+    bool persistent = false;
+};
+
+/// A single buffer that per-frame data (vertex attributes, uniform blocks, ...) is streamed through, as a ring of
+/// regions, one per frame in flight. Each frame writes only to its own region, and a fence placed at the end of the
+/// frame tells us when the GPU has finished reading it, so that the region can be reused without the driver having to
+/// synchronise (or hand out fresh memory) for every map.
+///
+/// With GL 4.4 the buffer is mapped once, persistently, and written to directly. Otherwise each write maps its range
+/// with GL_MAP_UNSYNCHRONIZED_BIT, which is safe because of the fences.
+class StreamBuffer {
+public:
+    /// The number of frames that can be in flight, the CPU waits rather than overwrite a region older than this
+    static const int REGION_COUNT = 3;
+
+    /// Create the buffer with room for region_size bytes per frame, must be called with the context current
+    void init(size_t region_size);
+    /// Delete the buffer and fences, must be called with the context current
+    void cleanup();
+
+    /// Move on to the next region, waiting for the GPU to be done with it if necessary. The region must fit
+    /// required_size bytes of writes (including alignment), the buffer is reallocated bigger if it doesn't.
+    /// Returns true if it was reallocated, in which case the old buffer was deleted and its name may be reused.
+    bool begin_frame(size_t required_size);
+    /// Place a fence after the frame's commands, so that the region isn't reused until the GPU has read it
+    void end_frame();
+
+    /// Reserve size bytes in the frame's region, aligned to alignment (a power of 2), and map them for writing.
+    /// offset is set to where they are in the buffer. Every map must be followed by unmap() before drawing.
+    /// Returns null if the region is full.
+    void* map(size_t size, size_t alignment, size_t* offset);
+    /// Finish writing the last mapped range, a no-op when persistently mapped
+    void unmap();
+
+    [[nodiscard]] uint get_buffer() const { return buffer; }
+    [[nodiscard]] bool is_persistent() const { return persistent; }
+    [[nodiscard]] StreamBufferStats get_stats() const;
+
+private:
+    uint buffer = 0;
+    size_t region_size = 0;
+    int region = 0;
+    size_t region_used = 0;
+    GLsync fences[REGION_COUNT]{};
+
+    bool persistent = false;
+    unsigned char* persistent_data = nullptr;
+    bool mapped = false;
+
+    std::atomic<uint64_t> bytes_streamed{0};
+    std::atomic<uint64_t> frame_bytes{0};
+    std::atomic<uint64_t> fence_waits{0};
+    std::atomic<double> fence_wait_ms{0.0};
+    std::atomic<uint64_t> reallocations{0};
+    std::atomic<size_t> buffer_size{0};
+
+    void create(size_t new_region_size);
+    void destroy();
+};
+
+#endif //STREAM_BUFFER_H
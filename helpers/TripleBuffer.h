@@ -0,0 +1,50 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/// Passes the latest version of a value from one writer thread to one reader thread without locks or copies.
+///
+/// The writer fills in the write buffer and publishes it, the reader picks up the latest published buffer whenever it
+/// wants. Each side always owns a buffer of its own, and the third sits in the middle holding the latest published
+/// value, so neither side ever waits for the other. Versions the reader doesn't pick up before the next is published
+/// are skipped.
+template<typename T>
+class TripleBuffer {
+    static const uint8_t INDEX_MASK = 3;
+    /// Set in middle when it holds a buffer the reader hasn't picked up yet
+    static const uint8_t NEW_BIT = 4;
+
+    T buffers[3];
+    std::atomic<uint8_t> middle{1};
+    /// Only touched by the writer
+    uint8_t write_index = 0;
+    /// Only touched by the reader
+    uint8_t read_index = 2;
+
+public:
+    /// The buffer the writer fills in. It still holds whatever it did when it was last swapped out, not the latest value.
+    T& get_write_buffer() { return buffers[write_index]; }
+
+    /// Make the write buffer the latest value, and swap it for the middle buffer
+    void publish() {
+        uint8_t previous = middle.exchange(write_index | NEW_BIT, std::memory_order_acq_rel);
+        write_index = previous & INDEX_MASK;
+    }
+
+    /// Swap the read buffer for the latest published value, if there's a new one. Returns whether there was.
+    bool update() {
+        if (!(middle.load(std::memory_order_acquire) & NEW_BIT)) {
+            return false;
+        }
+        uint8_t previous = middle.exchange(read_index, std::memory_order_acq_rel);
+        read_index = previous & INDEX_MASK;
+        return true;
+    }
+
+    /// The buffer the reader owns, the latest value as of the last update()
+    const T& get_read_buffer() const { return buffers[read_index]; }
+};
+
+#endif //TRIPLE_BUFFER_H
@@ -0,0 +1,237 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "Mesh.h"
+
+/// One attribute of a vertex (or instance) type, as passed to glVertexAttribPointer
+struct VertexAttribute {
+    uint location;
+    int components;
+    GLenum type;
+    /// Whether integer types are mapped to [0, 1] (unsigned) or [-1, 1] (signed), rather than converted as they are
+    bool normalized;
+    size_t offset;
+    /// 0 to advance per vertex, 1 to advance per instance
+    uint divisor = 0;
+};
+
+/// The size in bytes of an attribute with the given type and number of components
+constexpr size_t get_attribute_size(GLenum type, int components) {
+    switch (type) {
+        case GL_FLOAT:
+            return 4 * components;
+        case GL_HALF_FLOAT:
+            return 2 * components;
+        case GL_UNSIGNED_BYTE:
+        case GL_BYTE:
+            return components;
+        case GL_UNSIGNED_SHORT:
+        case GL_SHORT:
+            return 2 * components;
+        // Every component in one 32 bit word
+        case GL_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_2_10_10_10_REV:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+/// The layout of a vertex type, specialised for each type with its attributes:
+///
+///     template<> struct VertexLayout<MyVertex> {
+///         static constexpr VertexAttribute attributes[] = {{0, 3, GL_FLOAT, false, offsetof(MyVertex, position)}, ...};
+///     };
+///
+/// set_vertex_attributes() uses it to set up the attribute pointers, so they are never written out by hand.
+template<typename V>
+struct VertexLayout;
+
+/// Check at compile time that every attribute of a layout is a known type, and lies within the vertex
+template<typename V>
+constexpr bool is_valid_layout() {
+    for (const VertexAttribute& attribute : VertexLayout<V>::attributes) {
+        size_t size = get_attribute_size(attribute.type, attribute.components);
+        if (size == 0 || attribute.offset + size > sizeof(V)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Enable the attributes of V in the bound vertex array object, and set their divisors
+template<typename V>
+void enable_vertex_attributes() {
+    for (const VertexAttribute& attribute : VertexLayout<V>::attributes) {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribDivisor(attribute.location, attribute.divisor);
+    }
+}
+
+/// Point the attributes of V at the buffer bound to GL_ARRAY_BUFFER, starting at base_offset bytes into it.
+/// The attribute pointers are stored in the bound vertex array object.
+template<typename V>
+void set_vertex_attribute_pointers(size_t base_offset = 0) {
+    static_assert(is_valid_layout<V>(), "An attribute of the vertex layout has an unknown type or lies outside the vertex");
+
+    for (const VertexAttribute& attribute : VertexLayout<V>::attributes) {
+        glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                              sizeof(V), (void *) (base_offset + attribute.offset));
+    }
+}
+
+/// Disable the attributes of V in the bound vertex array object, so the shader reads their default values
+template<typename V>
+void disable_vertex_attributes() {
+    for (const VertexAttribute& attribute : VertexLayout<V>::attributes) {
+        glDisableVertexAttribArray(attribute.location);
+    }
+}
+
+/// Enable the attributes of V and point them at the buffer bound to GL_ARRAY_BUFFER
+template<typename V>
+void set_vertex_attributes(size_t base_offset = 0) {
+    enable_vertex_attributes<V>();
+    set_vertex_attribute_pointers<V>(base_offset);
+}
+
+template<>
+struct VertexLayout<Vertex> {
+    static constexpr VertexAttribute attributes[] = {
+            {0, 3, GL_FLOAT, false, offsetof(Vertex, position)},
+            {1, 3, GL_FLOAT, false, offsetof(Vertex, colour)},
+    };
+};
+
+/// The rows of the 3x4 transform, advancing once per instance
+template<>
+struct VertexLayout<InstanceTransform> {
+    static constexpr VertexAttribute attributes[] = {
+            {2, 4, GL_FLOAT, false, offsetof(InstanceTransform, rows) + 0 * sizeof(glm::vec4), 1},
+            {3, 4, GL_FLOAT, false, offsetof(InstanceTransform, rows) + 1 * sizeof(glm::vec4), 1},
+            {4, 4, GL_FLOAT, false, offsetof(InstanceTransform, rows) + 2 * sizeof(glm::vec4), 1},
+    };
+};
+
+/// The tint of each instance, advancing once per instance
+template<>
+struct VertexLayout<InstanceColour> {
+    static constexpr VertexAttribute attributes[] = {
+            {5, 4, GL_FLOAT, false, offsetof(InstanceColour, colour), 1},
+    };
+};
+
+/// Vertex with the same attributes as Vertex, packed into 12 bytes instead of 24. The shaders read it the same way,
+/// GL converts the attributes back to floats as it fetches them.
+///
+/// Half floats have 11 bits of precision, so positions should be in the mesh's own space, close to the origin
+/// (the error is under 0.0005 within [-1, 1]). The colour is 8 bits per channel, as it would be on screen anyway.
+struct CompactVertex {
+    /// x, y and z as half floats, the 4th is padding to keep the colour 4 byte aligned
+    uint16_t position[4];
+    /// RGBA, 8 bits per channel, normalised to [0, 1]
+    uint8_t colour[4];
+
+    static CompactVertex from(const Vertex& vertex);
+};
+
+/// A vertex with a normal as well, packed into 16 bytes instead of 36, for meshes with lighting data
+struct CompactLitVertex {
+    uint16_t position[4];
+    /// x, y and z as 10 bit signed normalised integers, packed into one word (with 2 unused bits), see pack_normal()
+    uint32_t normal;
+    uint8_t colour[4];
+
+    static CompactLitVertex from(const Vertex& vertex, glm::vec3 normal);
+};
+
+template<>
+struct VertexLayout<CompactVertex> {
+    static constexpr VertexAttribute attributes[] = {
+            {0, 3, GL_HALF_FLOAT, false, offsetof(CompactVertex, position)},
+            {1, 4, GL_UNSIGNED_BYTE, true, offsetof(CompactVertex, colour)},
+    };
+};
+
+/// The normal is at location 6, after the per-instance attributes
+template<>
+struct VertexLayout<CompactLitVertex> {
+    static constexpr VertexAttribute attributes[] = {
+            {0, 3, GL_HALF_FLOAT, false, offsetof(CompactLitVertex, position)},
+            {1, 4, GL_UNSIGNED_BYTE, true, offsetof(CompactLitVertex, colour)},
+            {6, 4, GL_INT_2_10_10_10_REV, true, offsetof(CompactLitVertex, normal)},
+    };
+};
+
+static_assert(sizeof(CompactVertex) == 12, "CompactVertex should be packed into 12 bytes");
+static_assert(sizeof(CompactLitVertex) == 16, "CompactLitVertex should be packed into 16 bytes");
+
+// The packing functions put the first component in the lowest bits, which on a little endian CPU is the first byte
+// in memory, the order GL reads them in.
+inline void pack_position(glm::vec3 position, uint16_t* out) {
+    uint64_t packed = glm::packHalf4x16(glm::vec4(position, 1.0f));
+    std::memcpy(out, &packed, sizeof(packed));
+}
+
+/// The inverse of pack_position(), for code that needs the positions back on the CPU
+inline glm::vec3 unpack_position(const uint16_t* packed) {
+    uint64_t bits;
+    std::memcpy(&bits, packed, sizeof(bits));
+    return glm::vec3(glm::unpackHalf4x16(bits));
+}
+
+inline void pack_colour(glm::vec3 colour, uint8_t* out) {
+    uint32_t packed = glm::packUnorm4x8(glm::clamp(glm::vec4(colour, 1.0f), 0.0f, 1.0f));
+    std::memcpy(out, &packed, sizeof(packed));
+}
+
+/// Pack a normal into the layout GL_INT_2_10_10_10_REV reads: x, y and z as 10 bit signed normalised integers from the
+/// lowest bits up, and 0 in the top 2. It's normalised first, and each component is then within 1/1022 of the unit
+/// normal's. GL before 4.2 maps the integers back with (2c + 1) / 1023 rather than c / 511, which is up to 2/1023 further
+/// off (at -1), still well under what lighting would show.
+inline uint32_t pack_normal(glm::vec3 normal) {
+    float length = glm::length(normal);
+    glm::vec3 unit = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    return glm::packSnorm3x10_1x2(glm::vec4(unit, 0.0f));
+}
+
+/// The inverse of pack_normal(), as GL 4.2 and later decode it
+inline glm::vec3 unpack_normal(uint32_t packed) {
+    return glm::vec3(glm::unpackSnorm3x10_1x2(packed));
+}
+
+inline CompactVertex CompactVertex::from(const Vertex& vertex) {
+    CompactVertex compact{};
+    pack_position(vertex.position, compact.position);
+    pack_colour(vertex.colour, compact.colour);
+    return compact;
+}
+
+inline CompactLitVertex CompactLitVertex::from(const Vertex& vertex, glm::vec3 normal) {
+    CompactLitVertex compact{};
+    pack_position(vertex.position, compact.position);
+    pack_colour(vertex.colour, compact.colour);
+    compact.normal = pack_normal(normal);
+    return compact;
+}
+
+/// Convert vertices from the float layout to a compact one, which needs a static Target::from(const Vertex&)
+template<typename Target>
+std::vector<Target> convert_vertices(const std::vector<Vertex>& vertices) {
+    std::vector<Target> converted(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        converted[i] = Target::from(vertices[i]);
+    }
+    return converted;
+}
+
+#endif //VERTEX_FORMAT_H
@@ -1,14 +1,40 @@
 #include "ImGuiManager.h"
 
-ImGuiManager::ImGuiManager(GLFWwindow* window) : window(window) {
+#include <cstring>
+
+#include "../AllocationCounter.h"
+#include "../ShaderHelper.h"
+
+ImGuiManager::ImGuiManager(int width, int height) : window(nullptr) {
     IMGUI_CHECKVERSION();
+    ImGui::SetAllocatorFunctions(AllocationCounter::allocate, AllocationCounter::deallocate);
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.IniFilename = nullptr; // Don't let headless runs overwrite the layout of the windowed app
+    io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;           // Enable Docking
+    // Without a platform backend we are responsible for the display size (DeltaTime keeps its 1/60 default)
+    io.DisplaySize = ImVec2((float) width, (float) height);
+
+    ImGui::StyleColorsDark();
+
+    // Only the renderer binding, since there is no window to get input from
+    ImGui_ImplOpenGL3_Init("#version 410");
+}
+
+ImGuiManager::ImGuiManager(GLFWwindow* window, bool enable_viewports) : window(window) {
+    IMGUI_CHECKVERSION();
+    // ImGUI allocates with malloc() rather than new, so it is pointed at the counter to show up in the allocations
+    // per frame
+    ImGui::SetAllocatorFunctions(AllocationCounter::allocate, AllocationCounter::deallocate);
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO();
     io.IniFilename = "config/imgui.ini";
 //    io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;       // Enable Keyboard Controls
     //io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
     io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;           // Enable Docking
-    io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;         // Enable Multi-Viewport / Platform Windows
+    if (enable_viewports) {
+        io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;     // Enable Multi-Viewport / Platform Windows
+    }
     //io.ConfigViewportsNoAutoMerge = true;
     //io.ConfigViewportsNoTaskBarIcon = true;
 
@@ -45,19 +71,36 @@ ImGuiManager::ImGuiManager(GLFWwindow* window) : window(window) {
 
 void ImGuiManager::new_frame() {
     ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
+    if (window) {
+        ImGui_ImplGlfw_NewFrame();
+    }
     ImGui::NewFrame();
 }
 
 void ImGuiManager::render() {
+    render_draw_data(end_frame());
+    render_platform_windows();
+}
+
+ImDrawData* ImGuiManager::end_frame() {
+    // With a window, the GLFW backend sets the display size and framebuffer scale in new_frame()
     ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    return ImGui::GetDrawData();
+}
 
-    ImGuiIO& io = ImGui::GetIO();
+void ImGuiManager::render_draw_data(ImDrawData* draw_data) {
+    ImGui_ImplOpenGL3_RenderDrawData(draw_data);
+}
 
-    auto width = 0, height = 0;
-    glfwGetFramebufferSize(window, &width, &height);
-    io.DisplaySize = ImVec2((float) width, (float) height);
+void ImGuiManager::create_device_objects() {
+    ImGui_ImplOpenGL3_CreateDeviceObjects();
+}
+
+void ImGuiManager::render_platform_windows() {
+    ImGuiIO& io = ImGui::GetIO();
+    if (!window) {
+        return;
+    }
 
     // Update and Render additional Platform Windows
     // (Platform functions may change the current OpenGL context, so we save/restore it to make it easier to paste this code elsewhere.
@@ -65,14 +108,277 @@ void ImGuiManager::render() {
     if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
         GLFWwindow* backup_current_context = glfwGetCurrentContext();
         ImGui::UpdatePlatformWindows();
-        ImGui::RenderPlatformWindowsDefault();
+
+        // Like ImGui::RenderPlatformWindowsDefault(), but skipping the windows whose draw data is the same as when they
+        // were last rendered. The platform handle is part of the hash, as a recreated window starts out blank.
+        // The hashes are updated in place and the list of changed windows is kept, so that this only allocates when
+        // a window is opened
+        ImGuiPlatformIO& platform_io = ImGui::GetPlatformIO();
+        std::vector<ImGuiViewport*>& changed = changed_platform_windows;
+        changed.clear();
+        // The first viewport is the main window, which is rendered by render_draw_data()
+        for (int i = 1; i < platform_io.Viewports.Size; i++) {
+            ImGuiViewport* viewport = platform_io.Viewports[i];
+            uint64_t hash = ImGuiOverlayCache::hash_draw_data(viewport->DrawData) ^ (uint64_t) (uintptr_t) viewport->PlatformHandle;
+
+            auto [previous, inserted] = platform_window_hashes.try_emplace(viewport->ID, hash);
+            if (!inserted && previous->second == hash) {
+                platform_windows_skipped++;
+            } else {
+                changed.push_back(viewport);
+            }
+            previous->second = hash;
+        }
+        // Forget the windows that have closed
+        for (auto it = platform_window_hashes.begin(); it != platform_window_hashes.end();) {
+            bool open = false;
+            for (int i = 1; i < platform_io.Viewports.Size && !open; i++) {
+                open = platform_io.Viewports[i]->ID == it->first;
+            }
+            it = open ? std::next(it) : platform_window_hashes.erase(it);
+        }
+
+        for (ImGuiViewport* viewport : changed) {
+            if (platform_io.Platform_RenderWindow) {
+                platform_io.Platform_RenderWindow(viewport, nullptr);
+            }
+            if (platform_io.Renderer_RenderWindow) {
+                platform_io.Renderer_RenderWindow(viewport, nullptr);
+            }
+        }
+        for (ImGuiViewport* viewport : changed) {
+            if (platform_io.Platform_SwapBuffers) {
+                platform_io.Platform_SwapBuffers(viewport, nullptr);
+            }
+            if (platform_io.Renderer_SwapBuffers) {
+                platform_io.Renderer_SwapBuffers(viewport, nullptr);
+            }
+        }
+        platform_windows_rendered += changed.size();
+
         glfwMakeContextCurrent(backup_current_context);
     }
 }
 
+// Mix size bytes into hash, a word at a time. Only needs to tell frames apart, not resist attacks.
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    auto mix = [&hash](uint64_t word) {
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 32;
+    };
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        mix(word);
+    }
+    uint64_t tail = 0;
+    if (i < size) {
+        std::memcpy(&tail, bytes + i, size - i);
+    }
+    mix(tail ^ ((uint64_t) size << 56));
+    return hash;
+}
+
+uint64_t ImGuiOverlayCache::hash_draw_data(const ImDrawData* draw_data) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    if (!draw_data) {
+        return hash;
+    }
+
+    hash = hash_bytes(hash, &draw_data->DisplayPos, sizeof(draw_data->DisplayPos));
+    hash = hash_bytes(hash, &draw_data->DisplaySize, sizeof(draw_data->DisplaySize));
+    hash = hash_bytes(hash, &draw_data->FramebufferScale, sizeof(draw_data->FramebufferScale));
+    for (int i = 0; i < draw_data->CmdListsCount; i++) {
+        const ImDrawList* list = draw_data->CmdLists[i];
+        hash = hash_bytes(hash, list->VtxBuffer.Data, list->VtxBuffer.Size * sizeof(ImDrawVert));
+        hash = hash_bytes(hash, list->IdxBuffer.Data, list->IdxBuffer.Size * sizeof(ImDrawIdx));
+        for (const ImDrawCmd& command : list->CmdBuffer) {
+            // Field by field, as the commands have padding (and in some versions members only used while building)
+            hash = hash_bytes(hash, &command.ClipRect, sizeof(command.ClipRect));
+            hash = hash_bytes(hash, &command.TextureId, sizeof(command.TextureId));
+            hash = hash_bytes(hash, &command.VtxOffset, sizeof(command.VtxOffset));
+            hash = hash_bytes(hash, &command.IdxOffset, sizeof(command.IdxOffset));
+            hash = hash_bytes(hash, &command.ElemCount, sizeof(command.ElemCount));
+            // A callback may draw something different every time, but this is the best that can be done
+            hash = hash_bytes(hash, &command.UserCallback, sizeof(command.UserCallback));
+            hash = hash_bytes(hash, &command.UserCallbackData, sizeof(command.UserCallbackData));
+        }
+    }
+    return hash ? hash : 1;
+}
+
+bool ImGuiOverlayCache::init() {
+    // A triangle covering the screen, copying the overlay texel for texel
+    auto handle = ShaderHelper::compile_program_async(
+            "#version 410 core\n"
+            "void main() {\n"
+            "    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+            "    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);\n"
+            "}\n",
+            "#version 410 core\n"
+            "uniform sampler2D overlay;\n"
+            "out vec4 fragColor;\n"
+            "void main() {\n"
+            "    fragColor = texelFetch(overlay, ivec2(gl_FragCoord.xy), 0);\n"
+            "}\n");
+    auto linked = ShaderHelper::wait_for_program(handle);
+    if (!linked) {
+        std::cerr << "Failed to build the ImGUI overlay program, the overlay won't be cached" << std::endl;
+        return false;
+    }
+    program = *linked;
+    // The sampler uses texture unit 0, the default, so there is no uniform to set
+
+    glGenVertexArrays(1, &empty_vao);
+    glGenFramebuffers(1, &framebuffer);
+    return true;
+}
+
+void ImGuiOverlayCache::cleanup() {
+    if (program) {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &empty_vao);
+        glDeleteFramebuffers(1, &framebuffer);
+        program = 0;
+    }
+    if (texture) {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+    cached_hash = 0;
+}
+
+void ImGuiOverlayCache::resize(int new_width, int new_height) {
+    if (texture && new_width == width && new_height == height) {
+        return;
+    }
+    width = new_width;
+    height = new_height;
+
+    if (!texture) {
+        glGenTextures(1, &texture);
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    // Only read with texelFetch, but a texture without mipmaps isn't complete with the default filter
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    GLint previous_framebuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer);
+}
+
+void ImGuiOverlayCache::render(ImDrawData* draw_data, uint64_t hash) {
+    if (hash != cached_hash && draw_data) {
+        resize((int) (draw_data->DisplaySize.x * draw_data->FramebufferScale.x),
+               (int) (draw_data->DisplaySize.y * draw_data->FramebufferScale.y));
+
+        GLint previous_framebuffer;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous_framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        const float transparent[] = {0.0f, 0.0f, 0.0f, 0.0f};
+        glClearBufferfv(GL_COLOR, 0, transparent);
+        ImGui_ImplOpenGL3_RenderDrawData(draw_data);
+        glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer);
+
+        cached_hash = hash;
+        misses++;
+    } else {
+        hits++;
+    }
+    if (!texture) {
+        return;
+    }
+
+    glViewport(0, 0, width, height);
+    glUseProgram(program);
+    glBindVertexArray(empty_vao);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+ImGuiDrawDataCopy::~ImGuiDrawDataCopy() {
+    clear();
+}
+
+// Copy an ImVector into another, reusing its buffer if it's big enough. Assigning one frees the buffer first.
+template<typename T>
+static void copy_buffer(ImVector<T>& target, const ImVector<T>& source) {
+    target.resize(source.Size);
+    if (source.Size > 0) {
+        std::memcpy(target.Data, source.Data, source.size_in_bytes());
+    }
+}
+
+// Copy the draw data, pointing the copy at the copied lists. Older versions of ImGUI keep the lists as a plain array,
+// which is copied as a pointer, newer ones as an ImVector, overloading on the target's and source's lists handles both.
+static void copy_draw_data(ImDrawData& target, const ImDrawData& source, ImDrawList**& target_lists, ImDrawList** const&,
+                           std::vector<ImDrawList*>& lists) {
+    target = source;
+    target_lists = lists.data();
+}
+
+[[maybe_unused]] static void copy_draw_data(ImDrawData& target, const ImDrawData& source, ImVector<ImDrawList*>& target_lists,
+                                            const ImVector<ImDrawList*>& const_source_lists, std::vector<ImDrawList*>& lists) {
+    // Assigning the draw data would reallocate its ImVector, so the source's is swapped out for the assignment, then
+    // back. It's ImGUI's own draw data, which isn't used by anything else until the next frame.
+    auto& source_lists = const_cast<ImVector<ImDrawList*>&>(const_source_lists);
+    ImVector<ImDrawList*> kept_lists;
+    ImVector<ImDrawList*> moved_lists;
+    kept_lists.swap(target_lists);
+    moved_lists.swap(source_lists);
+    target = source;
+    source_lists.swap(moved_lists);
+
+    kept_lists.resize(source_lists.Size);
+    for (int i = 0; i < kept_lists.Size; i++) {
+        kept_lists[i] = lists[i];
+    }
+    target_lists.swap(kept_lists);
+}
+
+ImDrawData* ImGuiDrawDataCopy::copy(const ImDrawData* source) {
+    // The lists are reused from frame to frame, so only have to be allocated when there are more of them or they grow.
+    // Only the parts CloneOutput() copies are.
+    while (draw_lists.size() < (size_t) source->CmdListsCount) {
+        draw_lists.push_back(IM_NEW(ImDrawList)(source->CmdLists[draw_lists.size()]->_Data));
+    }
+    for (int i = 0; i < source->CmdListsCount; i++) {
+        const ImDrawList* list = source->CmdLists[i];
+        ImDrawList* list_copy = draw_lists[i];
+        copy_buffer(list_copy->CmdBuffer, list->CmdBuffer);
+        copy_buffer(list_copy->IdxBuffer, list->IdxBuffer);
+        copy_buffer(list_copy->VtxBuffer, list->VtxBuffer);
+        list_copy->Flags = list->Flags;
+    }
+    copy_draw_data(draw_data, *source, draw_data.CmdLists, source->CmdLists, draw_lists);
+    return &draw_data;
+}
+
+void ImGuiDrawDataCopy::clear() {
+    for (ImDrawList* list : draw_lists) {
+        IM_DELETE(list);
+    }
+    draw_lists.clear();
+    draw_data.CmdListsCount = 0;
+}
+
 void ImGuiManager::cleanup() {
     ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
+    // The platform backend is only initialised when there is a window
+    if (ImGui::GetIO().BackendPlatformName) {
+        ImGui_ImplGlfw_Shutdown();
+    }
     ImGui::DestroyContext();
 }
 
@@ -1,20 +1,119 @@
 #ifndef IMGUI_MANAGER_H
 #define IMGUI_MANAGER_H
 
+#include <atomic>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include "ImGuiImpl.h"
 
+/// A copy of a frame's ImGUI draw data, that stays valid after the next frame has started, so that it can be
+/// rendered on another thread while the next frame is being built. The copied lists are kept and copied into again by
+/// the next copy(), so once they have grown to fit the UI, copying it doesn't allocate.
+class ImGuiDrawDataCopy {
+    ImDrawData draw_data{};
+    std::vector<ImDrawList*> draw_lists;
+public:
+    ImGuiDrawDataCopy() = default;
+    ~ImGuiDrawDataCopy();
+
+    ImGuiDrawDataCopy(const ImGuiDrawDataCopy&) = delete;
+    ImGuiDrawDataCopy& operator=(const ImGuiDrawDataCopy&) = delete;
+
+    /// Replace the copy with a copy of source, returns the copy
+    ImDrawData* copy(const ImDrawData* source);
+    /// Free the copied draw lists, the draw data mustn't be used after this
+    void clear();
+    ImDrawData* get() { return &draw_data; }
+};
+
+/// Keeps the rendered ImGUI overlay in a texture, so that frames whose UI is unchanged composite the texture over the
+/// framebuffer (one full screen triangle) instead of drawing every window again. Whether the UI changed is decided by
+/// hashing the draw data, which is normally done on the thread building the UI so that unchanged draw data doesn't
+/// even need to be copied for the render thread.
+///
+/// ImGUI's OpenGL backend blends the colour with the source alpha but the alpha with one, so rendering into a texture
+/// cleared to transparent leaves it premultiplied, which composited with (one, one - source alpha) gives the same
+/// result as drawing the overlay directly.
+class ImGuiOverlayCache {
+    GLuint framebuffer = 0;
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+    GLuint program = 0;
+    // Core profile needs a vertex array bound to draw, even though the triangle is made from gl_VertexID
+    GLuint empty_vao = 0;
+    // The hash of the draw data in the texture, 0 when it's empty
+    uint64_t cached_hash = 0;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+    /// (Re)create the texture and framebuffer if the overlay's size has changed
+    void resize(int new_width, int new_height);
+public:
+    ImGuiOverlayCache() = default;
+
+    ImGuiOverlayCache(const ImGuiOverlayCache&) = delete;
+    ImGuiOverlayCache& operator=(const ImGuiOverlayCache&) = delete;
+
+    /// Build the compositing program, must be called with the context current. Returns false if it failed to build,
+    /// in which case the cache can't be used.
+    bool init();
+    /// Delete the GL objects, must be called while the context is still current
+    void cleanup();
+
+    /// A hash of everything that affects how draw data looks: the size, the vertices and indices, and the commands.
+    /// Never 0, so that can be used to mean no hash.
+    static uint64_t hash_draw_data(const ImDrawData* draw_data);
+
+    /// Draw the overlay over the current framebuffer. If hash differs from the cached overlay's, draw_data is rendered
+    /// into the texture first, otherwise draw_data is unused and can be null. Changes the program, vertex array, texture
+    /// binding, blending, depth test and viewport, without restoring them.
+    void render(ImDrawData* draw_data, uint64_t hash);
+
+    /// The number of frames the cached overlay was reused, and re-rendered
+    [[nodiscard]] uint64_t get_hits() const { return hits; }
+    [[nodiscard]] uint64_t get_misses() const { return misses; }
+};
+
 /// A helper class to make using ImGUI a bit easier
 class ImGuiManager {
     GLFWwindow* window;
+
+    /// The hash of the draw data each platform window was last rendered with, by viewport ID
+    std::unordered_map<ImGuiID, uint64_t> platform_window_hashes;
+    /// The platform windows to render this frame, kept between frames so as not to allocate it every frame
+    std::vector<ImGuiViewport*> changed_platform_windows;
+    uint64_t platform_windows_rendered = 0;
+    uint64_t platform_windows_skipped = 0;
 public:
-    /// Construct the manager, targeting a main window.
-    explicit ImGuiManager(GLFWwindow* window);
+    /// Construct the manager, targeting a main window. Multi-viewports (ImGUI windows dragged out of the main window)
+    /// need the platform windows to be rendered on the thread that owns them, so have to be disabled when rendering
+    /// on a different thread to the main one.
+    explicit ImGuiManager(GLFWwindow* window, bool enable_viewports = true);
+    /// Construct the manager without a platform window, for rendering into an offscreen framebuffer
+    /// of the given size. Input, docking into other windows and multi-viewports are unavailable.
+    ImGuiManager(int width, int height);
 
     /// Start a new ImGUI frame
     void new_frame();
-    /// Render the last ImGUI frame
+    /// Render the last ImGUI frame, i.e. end_frame(), render_draw_data() and render_platform_windows()
     void render();
+    /// End the ImGUI frame, returning what to draw. This doesn't touch GL, so can be done on a thread without the context.
+    ImDrawData* end_frame();
+    /// Draw the ImGUI frame into the current framebuffer
+    static void render_draw_data(ImDrawData* draw_data);
+    /// Update the windows of any ImGUI windows that have been dragged out of the main one, and render the ones whose
+    /// contents have changed. The others aren't swapped either, so keep showing what they did.
+    void render_platform_windows();
+    /// The number of times platform windows were rendered, and skipped because they hadn't changed
+    [[nodiscard]] uint64_t get_platform_windows_rendered() const { return platform_windows_rendered; }
+    [[nodiscard]] uint64_t get_platform_windows_skipped() const { return platform_windows_skipped; }
+    /// Create the renderer's GL objects (including the font texture) now, rather than in the first new_frame(),
+    /// so that new_frame() never needs the GL context. Must be called with the context current.
+    static void create_device_objects();
     /// Cleanup the manager
     static void cleanup();
     /// Enable and configure the docking feature, needs to be called every ImGUI frame
@@ -0,0 +1,46 @@
+#include "ImGuiReadouts.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// The text each readout showed, in the order they were shown. The strings keep their capacity, so once every readout
+// has been shown, reformatting them doesn't allocate.
+struct Readout {
+    const char* format = nullptr;
+    std::string text;
+};
+static std::vector<Readout> readouts;
+static size_t next_readout = 0;
+static double last_refresh_time = 0.0;
+static bool refreshing = true;
+
+void ImGuiReadouts::begin_frame(double time) {
+    next_readout = 0;
+    refreshing = time - last_refresh_time >= REFRESH_SECONDS || time < last_refresh_time;
+    if (refreshing) {
+        last_refresh_time = time;
+    }
+}
+
+bool ImGuiReadouts::is_refreshing() {
+    return refreshing;
+}
+
+void ImGuiReadouts::text(const char* format, ...) {
+    if (next_readout == readouts.size()) {
+        readouts.emplace_back();
+    }
+    Readout& readout = readouts[next_readout++];
+    if (refreshing || readout.format != format) {
+        char buffer[512];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        readout.format = format;
+        readout.text.assign(buffer);
+    }
+    ImGui::TextUnformatted(readout.text.data(), readout.text.data() + readout.text.size());
+}
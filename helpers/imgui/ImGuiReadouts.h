@@ -0,0 +1,26 @@
+#ifndef IMGUI_READOUTS_H
+#define IMGUI_READOUTS_H
+
+#include <imgui/imgui.h>
+
+/// Text that changes every frame, like timings and counters, makes every frame's draw data different, so the
+/// ImGuiOverlayCache would never get to reuse the overlay. Readouts are formatted like ImGui::Text(), but only every
+/// REFRESH_SECONDS, and show the text formatted last time in between, which is also easier to read than numbers
+/// changing every frame.
+///
+/// The readouts are told apart by the order they are shown in, so a readout whose format differs from the one shown in
+/// its place last time (e.g. because a window was collapsed) is formatted straight away. Only used on the thread
+/// building the UI.
+class ImGuiReadouts {
+public:
+    static constexpr double REFRESH_SECONDS = 0.25;
+
+    /// Call each frame before building the UI, with the time in seconds
+    static void begin_frame(double time);
+    /// Whether the readouts are reformatted this frame, for widgets that show a value that changes every frame
+    static bool is_refreshing();
+    /// Show a readout, formatted like ImGui::Text()
+    static void text(const char* format, ...) IM_FMTARGS(1);
+};
+
+#endif //IMGUI_READOUTS_H
@@ -1,4 +1,17 @@
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 
 // A useful shorthand that not all compilers provide by default
 using uint = unsigned int;
@@ -36,6 +49,65 @@ using uint = unsigned int;
 
 // Include some code that helps with using ImGui
 #include "helpers/imgui/ImGuiManager.h"
+#include "helpers/imgui/ImGuiReadouts.h"
+
+// Include the mesh building stage that turns the vertex list below into an optimised indexed mesh
+#include "helpers/MeshBuilder.h"
+
+// Include the vertex layouts, which set up the attributes of each vertex type, and the compact vertex formats
+#include "helpers/VertexFormat.h"
+#include "helpers/MeshFile.h"
+
+// Include the quadric simplification that builds the mesh's levels of detail
+#include "helpers/MeshSimplifier.h"
+
+// Include the shared buffers the meshes are suballocated from
+#include "helpers/GeometryPool.h"
+
+// Include the vectorised per-instance animation and transform building
+#include "helpers/BatchTransform.h"
+
+// Include the offscreen context used when running without a display
+#include "helpers/HeadlessContext.h"
+
+// Include the bounding volume hierarchy the instances are culled against
+#include "helpers/Bvh.h"
+#include "helpers/FrustumCuller.h"
+
+// Include the work stealing scheduler the frame's CPU work runs on
+#include "helpers/JobSystem.h"
+
+// Include the asynchronous readback that captures the frames, and the thread that writes them to disk
+#include "helpers/FrameCapture.h"
+#include "helpers/CaptureWriter.h"
+
+// Include the watcher that reloads shaders when they are edited
+#include "helpers/ShaderWatcher.h"
+
+// Include the fixed timestep simulation thread that animates the instances
+#include "helpers/Simulation.h"
+
+// Include the render thread, and the command lists frames are recorded into for it
+#include "helpers/RenderThread.h"
+#include "helpers/CommandList.h"
+
+// Include the ring buffer per-frame data is streamed through, and the cache that filters redundant state changes
+#include "helpers/StreamBuffer.h"
+#include "helpers/GlStateCache.h"
+
+// Include the frame pacing that decides when the main loop draws
+#include "helpers/FramePacer.h"
+
+// Include the GPU timer query profiler, and the CPU one
+#include "helpers/GpuProfiler.h"
+#include "helpers/CpuProfiler.h"
+
+// Include the results of --benchmark, and the baseline they are compared against
+#include "helpers/BenchmarkReport.h"
+
+// Include the per-frame memory arena, and the counting of heap allocations
+#include "helpers/FrameArena.h"
+#include "helpers/AllocationCounter.h"
 
 // Some constant window properties we define here for now, since we currently don't handle
 // window resizing.
@@ -46,17 +118,20 @@ using uint = unsigned int;
 // A flag to enable or disable vsync (aka frame limiting)
 #define V_SYNC false
 
+// The number of frames rendered by --headless when --frames isn't given
+#define HEADLESS_FRAMES 1000
+// The number of frames measured per configuration by --benchmark when --frames isn't given, after some frames to warm
+// up (grow the buffers, settle the levels of detail, fill the GPU profiler's queries)
+#define BENCHMARK_FRAMES 60
+#define BENCHMARK_WARMUP_FRAMES 10
+
 const int NUM_SIDES = 6;
 const int NUM_TRIANGLES = 2 * NUM_SIDES;
 const int NUM_VERTICES = 3 * NUM_TRIANGLES;
 
-// This time create a struct representing the data of a single vertex, because we will be
-// interleaving the vertex attributes instead of laying it out with each attribute together like before.
-struct Vertex {
-    glm::vec3 position;
-    glm::vec3 colour;
-};
-
+// The vertices are described as a plain triangle list, with the shared corners duplicated, since that is easy
+// to write out by hand. init() runs it through MeshBuilder to weld the duplicates and produce an index buffer.
+// (Vertex is a struct of the interleaved attributes, see helpers/Mesh.h)
 Vertex vertices[NUM_VERTICES] = {
         Vertex{glm::vec3(-0.5, -0.5, 0.5), glm::vec3(1.0, 0.0, 0.0)},
         Vertex{glm::vec3(0.5, -0.5, 0.5), glm::vec3(0.0, 0.0, 1.0)},
@@ -101,133 +176,1196 @@ Vertex vertices[NUM_VERTICES] = {
         Vertex{glm::vec3(-0.5, -0.5, 0.5), glm::vec3(0.0, 0.0, 1.0)}
 };
 
-int xyz_multipliers_location;
+// The same cube, with each side split into subdivisions x subdivisions quads, so that the vertex count can be scaled
+// without changing what is drawn. Each side is a grid of its own, coloured like the sides above with the colours
+// blended across it, laid out in the same order, so that 1 subdivision gives exactly the triangles above.
+Mesh make_subdivided_cube(int subdivisions) {
+    // Each side's first corner, and the edges from it to the next two, in the order the sides above are in
+    const glm::vec3 corners[NUM_SIDES] = {{-0.5, -0.5, 0.5}, {-0.5, -0.5, -0.5}, {0.5, -0.5, -0.5},
+                                          {-0.5, -0.5, -0.5}, {-0.5, 0.5, -0.5}, {-0.5, -0.5, -0.5}};
+    const glm::vec3 u_edges[NUM_SIDES] = {{1, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 1, 0}, {0, 0, 1}, {0, 0, 1}};
+    const glm::vec3 v_edges[NUM_SIDES] = {{0, 1, 0}, {0, 1, 0}, {0, 0, 1}, {0, 0, 1}, {1, 0, 0}, {1, 0, 0}};
+
+    Mesh mesh;
+    uint row = (uint) subdivisions + 1;
+    mesh.vertices.reserve((size_t) NUM_SIDES * row * row);
+    mesh.indices.reserve((size_t) NUM_SIDES * subdivisions * subdivisions * 6);
+    for (int side = 0; side < NUM_SIDES; side++) {
+        uint first = (uint) mesh.vertices.size();
+        for (int y = 0; y <= subdivisions; y++) {
+            for (int x = 0; x <= subdivisions; x++) {
+                float u = (float) x / (float) subdivisions;
+                float v = (float) y / (float) subdivisions;
+                // Red, blue, green and cyan in the corners, as above
+                glm::vec3 colour = glm::mix(glm::mix(glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), u),
+                                            glm::mix(glm::vec3(0, 1, 0), glm::vec3(0, 1, 1), u), v);
+                mesh.vertices.push_back(Vertex{corners[side] + u * u_edges[side] + v * v_edges[side], colour});
+            }
+        }
+        for (int y = 0; y < subdivisions; y++) {
+            for (int x = 0; x < subdivisions; x++) {
+                uint corner = first + (uint) y * row + (uint) x;
+                mesh.indices.insert(mesh.indices.end(), {corner, corner + 1, corner + row,
+                                                         corner + row + 1, corner + row, corner + 1});
+            }
+        }
+    }
+    return mesh;
+}
+
+// The program currently used for drawing, replaced whenever the shaders are edited and recompile successfully
+uint program;
+// The meshes, in a pool per vertex format, each with one vertex array for all of its meshes. Only used on the thread
+// executing the frames.
+GeometryPool float_geometry;
+GeometryPool compact_geometry;
+// The pool the mesh is in, and its handle there. Its vertices are followed by the indices of all its levels of detail.
+GeometryPool* mesh_pool = nullptr;
+GeometryHandle mesh_handle = 0;
+// A copy of the mesh's pool's statistics, for the UI, updated whenever they change on the thread executing the frames.
+// It's too big for a lock free atomic, so it's guarded by a mutex instead.
+std::mutex geometry_stats_mutex;
+GeometryPoolStats geometry_stats;
+
+void set_geometry_stats(const GeometryPoolStats& stats) {
+    std::lock_guard<std::mutex> lock(geometry_stats_mutex);
+    geometry_stats = stats;
+}
+
+GeometryPoolStats get_geometry_stats() {
+    std::lock_guard<std::mutex> lock(geometry_stats_mutex);
+    return geometry_stats;
+}
+// Whether to issue the draws with glMultiDrawElementsIndirect when the context has it (GL 4.3)
+bool use_indirect_draws = true;
+// Set by the UI to defragment the mesh's pool on the thread executing the next frame
+bool defragment_geometry = false;
+// Whether to upload the vertices as CompactVertex (12 bytes) rather than Vertex (24 bytes of floats)
+bool compact_vertices = true;
+// The most levels of detail to draw the mesh with, including itself, 1 for none
+int lod_count = 4;
+// The mesh's levels of detail, only their ranges of the mesh's indices, the indices themselves aren't kept
+MeshLodChain mesh_lods;
+// A mesh file (see tools/mesh_converter.cpp) to draw instead of the cube, if set
+std::string mesh_path;
+// How many quads each side of the cube is split into, see make_subdivided_cube()
+int cube_subdivisions = 1;
+// The most the benchmark will split the cube's sides into, 6 x 256 x 256 x 2 triangles
+const int MAX_CUBE_SUBDIVISIONS = 256;
+// Fits the mesh into the same space as the cube, centred on the origin, applied before the scene wide transform
+float mesh_scale = 1.0f;
+glm::vec3 mesh_offset{0.0f};
+
+// The largest number of instances the UI allows
+const int MAX_INSTANCES = 1000000;
+
+// The number of copies of the cube drawn with a single instanced draw call, laid out in a grid
+int instance_count = 1;
+// Whether to give each instance its own colour, to make them easier to tell apart
+bool tint_instances = false;
+// Set when the instances need to be laid out again and their buffers resized before the next draw
+bool instances_dirty = true;
+
+// The layout of every instance with their angles filled in for the frame being recorded (see record_frame()), and
+// their colours. Only the visible instances' transforms and colours are copied into the frame, and streamed through
+// stream_buffer when it is executed.
+TransformBatch instance_layout;
+std::vector<InstanceColour> instance_colours;
+// The angles of the first instance as last drawn, shown in the UI
+glm::vec2 first_instance_angles{0.0f};
+
+// Advances the instances' angles on its own thread, at a fixed rate
+Simulation simulation;
+
+// The UI's copies of the simulation controls, changes are passed on to the simulation
+bool animate_rotation = true;
+// Multiplies every instance's own rotation speed
+glm::vec3 rotation_speed{1.0f};
+
+// The 2D camera, zooming in towards camera_centre so that the instances outside the view can be culled
+float camera_zoom = 1.0f;
+glm::vec2 camera_centre{0.0f};
+
+// Whether to only draw the instances inside the view frustum
+bool frustum_culling = true;
+// The world space bounds of every instance, recomputed each frame as they rotate
+BoundsBatch instance_bounds;
+// The hierarchy over instance_bounds, rebuilt when the instances are laid out again, and refit every frame otherwise
+Bvh instance_bvh;
+// Set when the instances have been laid out again, so the hierarchy has to be rebuilt rather than refit
+bool bvh_dirty = true;
+FrustumCuller frustum_culler;
+// The indices of the instances that passed the last cull
+std::vector<uint32_t> visible_instances;
+// How long computing the instances' bounds took in the last frame, shown in the UI
+double instance_bounds_ms = 0.0;
+// Runs the frame's CPU work (the animation, culling, gathering and preparing the UI's draw data) on every core, the
+// main thread included, see record_frame()
+JobSystem job_system;
+// Counts the jobs started for the frame being recorded, all of which have finished before its draws are recorded
+JobCounter frame_jobs;
+// How many jobs the last frame ran, and how many of those were stolen from another thread, shown in the UI
+JobSystemStats frame_job_stats;
+
+// Whether to draw instances that are small on screen with one of the mesh's coarser levels of detail
+bool use_lods = true;
+// The most error (in pixels on screen) a level of detail may have to be used, and how far past that (as a fraction of
+// it) an instance has to get before it changes level, so that one near a threshold doesn't keep popping between two
+float lod_pixel_error = 1.0f;
+float lod_hysteresis = 0.25f;
+// The level each instance was last drawn at, which the hysteresis is relative to
+std::vector<uint8_t> instance_lods;
+// How many instances were drawn at each level in the last frame, shown in the UI
+size_t lod_instance_counts[MeshSimplifier::MAX_LODS] = {};
+// Where each chunk of the gathered instances writes its instances of each level, see gather_instances()
+std::vector<size_t> chunk_lod_offsets;
+
+// Lay out the instances in a square grid covering the viewport. The simulation gives any new ones a random starting
+// angle and speed, and the instance buffers are resized by the next frame.
+void update_instances() {
+    auto side = (int) std::ceil(std::sqrt((float) instance_count));
+    float cell_size = 2.0f / (float) side;
+    // The cube is 1 unit wide, so with a single instance this keeps it at its original size
+    float scale = 0.5f * cell_size;
+
+    instance_layout.resize(instance_count);
+    instance_colours.resize(instance_count);
+    instance_lods.resize(instance_count, 0);
+    simulation.set_instance_count(instance_count);
+
+    for (int i = 0; i < instance_count; i++) {
+        int column = i % side;
+        int row = i / side;
+        instance_layout.scale[i] = scale;
+        instance_layout.position_x[i] = -1.0f + cell_size * ((float) column + 0.5f);
+        instance_layout.position_y[i] = 1.0f - cell_size * ((float) row + 0.5f);
+        instance_layout.position_z[i] = 0.0f;
+
+        if (tint_instances) {
+            instance_colours[i].colour = {0.5f + 0.5f * (float) column / (float) side, 0.5f + 0.5f * (float) row / (float) side, 1.0f, 1.0f};
+        } else {
+            instance_colours[i].colour = glm::vec4(1.0f);
+        }
+    }
+
+    bvh_dirty = true;
+}
+
+// Times the zones of each frame on the GPU
+GpuProfiler gpu_profiler;
+
+// Memory for what only has to last until the end of the next frame, only allocated from by the thread recording frames
+FrameArena frame_arena;
+// The heap allocations made by every thread during each frame, which should be none once the frames are steady
+FrameAllocationTracker frame_allocations;
+
+// Watches the shader directory for edits, started in main() when there is a window
+ShaderWatcher shader_watcher;
+
+// Whether to use the per vertex colours, or colour every vertex the same
+bool vertex_colours = true;
+
+// The options that pick the shader variant, passed to the thread executing the frame
+struct ShaderOptions {
+    bool vertex_colours;
+    bool instance_tint;
+};
+
+ShaderDefines get_shader_defines(bool use_vertex_colours, bool use_instance_tint) {
+    ShaderDefines defines{{"INSTANCED", ""}};
+    if (use_vertex_colours) {
+        defines["VERTEX_COLOUR"] = "";
+    }
+    if (use_instance_tint) {
+        defines["INSTANCE_TINT"] = "";
+    }
+    return defines;
+}
+
+// The defines of every combination of ShaderOptions, built once so that picking a variant each frame doesn't allocate.
+// See res/shaders/vert.glsl for what they do.
+const ShaderDefines& get_shader_defines(ShaderOptions options) {
+    static const ShaderDefines all_defines[4] = {
+            get_shader_defines(false, false),
+            get_shader_defines(false, true),
+            get_shader_defines(true, false),
+            get_shader_defines(true, true),
+    };
+    return all_defines[(options.vertex_colours ? 2 : 0) + (options.instance_tint ? 1 : 0)];
+}
+
+// ShaderHelper isn't thread safe, so the UI shows a count kept up to date by whichever thread executes the frames
+std::atomic<size_t> shader_variant_count{0};
+
+// Every state change made while executing frames goes through this, so that redundant ones are dropped
+GlStateCache gl_state;
+// The scene's draws, sorted by the state they need before they are issued
+DrawQueue scene_draws;
+
+// The size of the window's framebuffer in pixels, which may differ from its size in screen coordinates
+glm::ivec2 framebuffer_size{WINDOW_WIDTH, WINDOW_HEIGHT};
+
+// Everything streamed through one buffer each frame: the instance transforms and the frame's uniform block
+StreamBuffer stream_buffer;
+
+// Where the frame's instance transforms and colours (if it has any) were streamed to, only used on the thread
+// executing the frames
+size_t instance_transforms_offset = 0;
+std::optional<size_t> instance_colours_offset;
+
+// Point the bound vertex array's per-instance attributes at the frame's instances, from first_instance on
+void point_instance_attributes(int first_instance) {
+    gl_state.bind_array_buffer(stream_buffer.get_buffer());
+    set_vertex_attribute_pointers<InstanceTransform>(instance_transforms_offset + sizeof(InstanceTransform) * first_instance);
+    // Only the tinted variants read the colours, the others leave the attribute disabled
+    if (instance_colours_offset) {
+        set_vertex_attributes<InstanceColour>(*instance_colours_offset + sizeof(InstanceColour) * first_instance);
+    } else {
+        disable_vertex_attributes<InstanceColour>();
+    }
+}
+
+// The uniform buffer binding point the FrameUniforms block is read from
+const uint FRAME_UNIFORMS_BINDING = 0;
+// The offset of a uniform block in a buffer has to be a multiple of this, queried in init()
+int uniform_buffer_alignment = 256;
+
+// Matches the std140 layout of the FrameUniforms block in res/shaders/frame_uniforms.glsl,
+// where each column of the mat3 and the vec3 are padded to a vec4
+struct FrameUniforms {
+    glm::vec4 xyz_multipliers[3];
+    glm::vec4 flat_colour;
+    glm::vec4 mesh_offset;
+    glm::mat4 view_projection;
+};
+
+// Make a program current, and point its uniform block at the binding the frame's uniforms are streamed to.
+// Block bindings belong to the program, so this has to be redone whenever it is replaced.
+void use_program(uint new_program) {
+    program = new_program;
+    gl_state.use_program(program);
+
+    uint block_index = glGetUniformBlockIndex(program, "FrameUniforms");
+    if (block_index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, block_index, FRAME_UNIFORMS_BINDING);
+    }
+}
+
+// Pass any shader edits from the watcher on to ShaderHelper, which rebuilds the variants that use them.
+void reload_shaders() {
+    while (auto change = shader_watcher.poll()) {
+        std::cout << "Shader changed: " << change->file_name << std::endl;
+        ShaderHelper::update_shader_source(change->file_name, std::move(change->source));
+    }
+}
+
+// Switch to the variant for the options once it's ready. It may still be building after the options were changed, or
+// after an edit, in which case the previous program keeps being used so that the frame never waits for the driver.
+void update_program(ShaderOptions options) {
+    auto variant = ShaderHelper::get_variant("vert.glsl", "frag.glsl", get_shader_defines(options));
+    if (variant && *variant != program) {
+        use_program(*variant);
+    }
+    shader_variant_count = ShaderHelper::get_variant_count();
+}
+
+// Print how many triangles each of the mesh's levels of detail has
+void print_lods(const std::vector<MeshLod>& lods) {
+    for (size_t lod = 0; lod < lods.size(); lod++) {
+        std::cout << "  LOD " << lod << ": " << lods[lod].index_count / 3 << " triangles, error " << lods[lod].error << std::endl;
+    }
+}
+
+// Add a mesh's vertices and the indices of every level of detail to the geometry pool for its format, creating the pool
+// if it's the first mesh of the format. lods are the levels' ranges of the indices. Returns false if the mesh doesn't fit.
+bool add_mesh(MeshVertexFormat format, const void* mesh_vertices, size_t vertex_count, const uint* lod_indices,
+              size_t lod_index_count, const std::vector<MeshLod>& lods) {
+    // The pool starts out with room for just this mesh, it grows if more are added
+    GeometryPool& pool = format == MeshVertexFormat::Compact ? compact_geometry : float_geometry;
+    if (!pool.is_initialised()) {
+        if (format == MeshVertexFormat::Compact) {
+            pool.init<CompactVertex>(vertex_count, lod_index_count);
+        } else {
+            pool.init<Vertex>(vertex_count, lod_index_count);
+        }
+
+        // The per-instance attributes use a divisor of 1 so that they advance once per instance instead of once per
+        // vertex. Only the visible instances' transforms and colours are streamed, at a different offset in the stream
+        // buffer each frame, so their pointers are set when they are written, see execute_frame().
+        glBindVertexArray(pool.get_vertex_array());
+        enable_vertex_attributes<InstanceTransform>();
+        enable_vertex_attributes<InstanceColour>();
+    }
+    auto handle = pool.add(mesh_vertices, vertex_count, lod_indices, lod_index_count);
+    if (!handle) {
+        return false;
+    }
+    mesh_lods.lods = lods;
+    mesh_pool = &pool;
+    mesh_handle = *handle;
+    set_geometry_stats(pool.get_stats());
+    return true;
+}
+
+// Build the cube and add it to the geometry pool for the vertex format
+void upload_cube() {
+    // Weld the duplicated vertices and reorder the triangles for the post-transform vertex cache
+    MeshBuildStats mesh_stats;
+    Mesh mesh = cube_subdivisions > 1 ? MeshBuilder::build(make_subdivided_cube(cube_subdivisions), &mesh_stats)
+                                      : MeshBuilder::build(vertices, NUM_VERTICES, &mesh_stats);
+
+    std::cout << "Mesh: " << mesh_stats.input_vertices << " vertices -> " << mesh_stats.unique_vertices
+              << " unique vertices, " << mesh_stats.triangles << " triangles" << std::endl;
+    std::cout << "Mesh ACMR: " << mesh_stats.acmr_before << " -> " << mesh_stats.acmr_after
+              << " (simulated " << MeshBuilder::CACHE_SIZE << " entry cache)" << std::endl;
+
+    // The cube is built at startup anyway, so its levels of detail are too, from its positions
+    MeshLodChain lod_chain;
+    if (lod_count > 1) {
+        std::vector<glm::vec3> positions(mesh.vertices.size());
+        for (size_t i = 0; i < mesh.vertices.size(); i++) {
+            positions[i] = mesh.vertices[i].position;
+        }
+        MeshSimplifyStats stats;
+        lod_chain = MeshSimplifier::build_lod_chain(positions, mesh.indices, lod_count, 0.5f, &stats);
+        std::cout << "Mesh LODs: " << lod_chain.lods.size() << " levels in " << stats.build_ms << " ms (" << stats.passes
+                  << " passes, " << stats.collapses << " collapses, " << stats.rejected_flips << " rejected flips)" << std::endl;
+        print_lods(lod_chain.lods);
+    } else {
+        lod_chain.indices = mesh.indices;
+        lod_chain.lods = {MeshLod{0, (uint) mesh.indices.size(), 0.0f}};
+    }
+
+    // Since the data is laid out contiguously already, can just directly upload instead of needing to do it in two
+    // steps. The attribute pointers come from the vertex type's VertexLayout, set up by the pool.
+    size_t vertex_size;
+    if (compact_vertices) {
+        std::vector<CompactVertex> compact = convert_vertices<CompactVertex>(mesh.vertices);
+        vertex_size = sizeof(CompactVertex);
+        add_mesh(MeshVertexFormat::Compact, compact.data(), compact.size(), lod_chain.indices.data(),
+                 lod_chain.indices.size(), lod_chain.lods);
+    } else {
+        vertex_size = sizeof(Vertex);
+        add_mesh(MeshVertexFormat::Float, mesh.vertices.data(), mesh.vertices.size(), lod_chain.indices.data(),
+                 lod_chain.indices.size(), lod_chain.lods);
+    }
+    std::cout << "Vertex format: " << vertex_size << " bytes per vertex (" << sizeof(Vertex) << " as floats), "
+              << vertex_size * mesh.vertices.size() << " bytes" << std::endl;
+}
+
+// Add a mesh file to the geometry pool for its vertex format, straight from a mapping of it, so that nothing is parsed
+// and the vertices are never copied into memory of our own first. Returns false if it can't be.
+bool upload_mesh_file(const std::string& path) {
+    MappedMeshFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+    // The levels of detail were built by the converter and stored in the file, so they're uploaded straight from the
+    // mapping with the rest of it. Only the first lod_count are kept, and as they're stored in order, only the indices
+    // up to the end of the last one kept are uploaded.
+    const MeshFileHeader& header = file.get_header();
+    std::vector<MeshLod> lods;
+    uint64_t index_count = 0;
+    for (uint32_t lod = 0; lod < header.lod_count && lod < (uint32_t) lod_count; lod++) {
+        const MeshFileLod& file_lod = header.lods[lod];
+        lods.push_back(MeshLod{(uint) file_lod.first_index, (uint) file_lod.index_count, file_lod.error});
+        index_count = std::max(index_count, file_lod.first_index + file_lod.index_count);
+    }
+    if (index_count > (uint64_t) std::numeric_limits<int>::max()) {
+        std::cerr << "Mesh file " << path << " has too many indices to draw at once" << std::endl;
+        return false;
+    }
+    if (!add_mesh(header.vertex_format, file.get_vertices(), header.vertex_count, file.get_indices(), index_count, lods)) {
+        return false;
+    }
+
+    // Scale the largest side of the bounds to the size of the cube, and move their centre to the origin
+    glm::vec3 bounds_min = file.get_bounds_min();
+    glm::vec3 bounds_max = file.get_bounds_max();
+    glm::vec3 size = bounds_max - bounds_min;
+    float largest_side = std::max(size.x, std::max(size.y, size.z));
+    mesh_scale = largest_side > 0.0f ? 1.0f / largest_side : 1.0f;
+    mesh_offset = -mesh_scale * 0.5f * (bounds_min + bounds_max);
+
+    std::cout << "Mesh file " << path << ": " << header.vertex_count << " vertices, " << lods[0].index_count / 3
+              << " triangles, " << header.vertex_size << " bytes per vertex" << std::endl;
+    if (lods.size() > 1) {
+        std::cout << "Mesh LODs: " << lods.size() << " of the file's " << header.lod_count << " levels" << std::endl;
+        print_lods(lods);
+    }
+    return true;
+}
 
 void init() {
-    // Create a vertex array object
-    uint vao;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    // The mesh goes into a shared pool of buffers with one vertex array, rather than buffers and a vertex array of its own
+    if (mesh_path.empty() || !upload_mesh_file(mesh_path)) {
+        // Cleared so that it only says what is drawn
+        mesh_path.clear();
+        upload_cube();
+    }
 
-    // Create and initialize a buffer object for vertex data
-    uint vertex_buffer;
-    glGenBuffers(1, &vertex_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    // Before GL 4.2 the draws can't start from a base instance, so the per-instance attributes are moved instead
+    scene_draws.set_base_instance_function(point_instance_attributes);
+    // The indirect draws' parameters are streamed with the rest of the frame's data
+    scene_draws.set_stream_buffer(&stream_buffer);
 
-    // Since the data is laid out contiguously already,
-    // can just directly upload instead of needing to do it in two steps
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * NUM_VERTICES, vertices, GL_STATIC_DRAW);
+    // Start building every variant the UI can switch between, so they are likely ready by the time they're needed,
+    // then wait for the one that is used first
+    for (bool use_vertex_colours : {false, true}) {
+        for (bool use_instance_tint : {false, true}) {
+            ShaderHelper::get_variant("vert.glsl", "frag.glsl", get_shader_defines({use_vertex_colours, use_instance_tint}));
+        }
+    }
+    use_program(ShaderHelper::load_shader_variant("vert.glsl", "frag.glsl", get_shader_defines({vertex_colours, tint_instances})));
+    shader_variant_count = ShaderHelper::get_variant_count();
 
-    // Load shaders and use the resulting shader program
-    uint program = ShaderHelper::load_shader("vert.glsl", "frag.glsl");
-    glUseProgram(program);
+    const auto& cache_stats = ShaderHelper::get_program_cache_stats();
+    std::cout << "Program cache: " << cache_stats.hits << " hits (" << cache_stats.hit_time_ms << " ms), "
+              << cache_stats.misses << " misses (" << cache_stats.miss_time_ms << " ms), "
+              << cache_stats.rejected << " rejected" << std::endl;
+    std::cout << "Parallel shader compile: " << (ShaderHelper::has_parallel_compile() ? "yes" : "no") << std::endl;
 
-    // Initialize the vertex position attribute from the vertex shader.
-    // Note: that this time in the shader we use a layout qualifier to specify the attribute location,
-    // so there is no need to fetch it.
-    glEnableVertexAttribArray(0);
-    // Also note: now that we are interleaving data, the stride and offset are different
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, position));
+    // One less than the hardware threads, as the main thread runs jobs too while it waits for them
+    job_system.start((int) std::max(1u, std::thread::hardware_concurrency()) - 1);
 
-    // Likewise, initialize the vertex color attribute. And likewise location is specified in the shader.
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, colour));
+    simulation.set_instance_count(instance_count);
+    simulation.set_animate(animate_rotation);
+    simulation.set_rotation_speed(rotation_speed);
+    simulation.start();
 
-    xyz_multipliers_location = glGetUniformLocation(program, "xyzMultipliers");
+    gpu_profiler.init();
 
-    // We need to enable the depth test to discard fragments that are behind
-    // previously drawn fragments for the same pixel.
-    glEnable(GL_DEPTH_TEST);
+    // Start small, the stream buffer grows to fit the instances on the first frame
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_buffer_alignment);
+    stream_buffer.init(64 * 1024);
+    std::cout << "Stream buffer: " << (stream_buffer.is_persistent() ? "persistently mapped" : "unsynchronized maps") << std::endl;
 
     glClearColor(1.0, 1.0, 1.0, 1.0); /* white background */
 }
 
-bool animate_rotation = true;
-glm::vec3 rotation_angles{0.0f};
-glm::vec3 rotation_speed{1.0f};
+// Executes the frames recorded on the main thread, when running with a separate render thread
+RenderThread render_thread;
+
+// Limits the frame rate, and stops drawing altogether while nothing is changing
+FramePacer frame_pacer;
+
+// Where to capture every frame drawn to, a .y4m file or the prefix of a PNG sequence, empty to not capture
+std::string capture_path;
+// Reads the frames back a couple of frames late, so as not to stall the GPU, and hands them to capture_writer. Only
+// used on the thread executing the frames.
+FrameCapture frame_capture;
+// Encodes and writes the captured frames on a thread of its own
+CaptureWriter capture_writer;
+
+// Start capturing the frames to capture_path, if set, called once the context is current
+void start_capture() {
+    if (capture_path.empty()) {
+        return;
+    }
+    // The target frame rate is only a hint for players, the frames are captured as they are drawn
+    CaptureFormat format = CaptureWriter::get_format(capture_path);
+    if (!capture_writer.start(capture_path, format, framebuffer_size.x, framebuffer_size.y, frame_pacer.get_target_fps())) {
+        return;
+    }
+    if (!frame_capture.init(framebuffer_size.x, framebuffer_size.y, capture_writer)) {
+        capture_writer.stop();
+        return;
+    }
+    std::cout << "Capturing to " << capture_path << (format == CaptureFormat::Y4m ? " (Y4M)" : " (PNG sequence)") << std::endl;
+}
 
-void ui() {
+// Pass on the frames still being read back, and wait for them all to be written
+void stop_capture() {
+    if (!frame_capture.is_initialised()) {
+        return;
+    }
+    frame_capture.cleanup();
+    capture_writer.stop();
+    CaptureWriterStats stats = capture_writer.get_stats();
+    std::cout << "Captured " << stats.frames_written << " frames, " << stats.bytes_written / (1024 * 1024) << " MB, the writer held up "
+              << stats.producer_waits << " frames" << std::endl;
+}
+
+// Whether to reuse the rendered UI while it hasn't changed, turned off if the overlay cache fails to initialise
+bool cache_imgui_overlay = true;
+// The rendered UI, only used on the thread executing the frames
+ImGuiOverlayCache imgui_overlay;
+// The hash of the UI recorded in the last frame, to know whether the next one changed
+uint64_t last_overlay_hash = 0;
+
+void ui(const ImGuiManager& imgui_manager) {
     // Create an ImGUI window, the function returns true if the window is expanded and false if collapsed,
     // so we use an if to only add things to the window it is open
     if (ImGui::Begin("ImGUI Window", nullptr, ImGuiWindowFlags_NoFocusOnAppearing)) {
         // Add a checkbox to control whether to animate the rotation
-        ImGui::Checkbox("Animate Rotation", &animate_rotation);
+        if (ImGui::Checkbox("Animate Rotation", &animate_rotation)) {
+            simulation.set_animate(animate_rotation);
+        }
 
         // Add a drag to edit the 3 components of the rotation_speed vector, setting the drag speed
         // to 0.1f and don't clamp the range.
-        ImGui::DragFloat3("Rotation Speeds", &rotation_speed[0], 0.1f);
+        if (ImGui::DragFloat3("Rotation Speeds", &rotation_speed[0], 0.1f)) {
+            simulation.set_rotation_speed(rotation_speed);
+        }
 
-        // Add a slider to edit the 3 components of the rotation_angle vector, setting the rang to be [0, 2pi]
-        ImGui::SliderFloat3("Rotation Angle", &rotation_angles[0], 0.0f, 2.0f * (float) M_PI);
+        // Add a slider to edit the x and y rotation angles, setting the range to be [0, 2pi]. It shows the angles of the
+        // first instance as drawn, updated as often as the readouts so an animating scene doesn't change the UI every
+        // frame, and setting it sets every instance to the same angles from the next tick.
+        static glm::vec2 rotation_angles = first_instance_angles;
+        if (ImGuiReadouts::is_refreshing()) {
+            rotation_angles = first_instance_angles;
+        }
+        if (ImGui::SliderFloat2("Rotation Angle", &rotation_angles[0], 0.0f, 2.0f * (float) M_PI)) {
+            simulation.set_angles(rotation_angles.x, rotation_angles.y);
+        }
 
+        // All the instances are drawn with one draw call, a logarithmic slider makes it easy to go from 1 to 1M
+        // Clamped, as ctrl+clicking the slider lets a value be typed in, and the instance buffers only hold MAX_INSTANCES
+        if (ImGui::SliderInt("Instance Count", &instance_count, 1, MAX_INSTANCES, "%d",
+                             ImGuiSliderFlags_Logarithmic | ImGuiSliderFlags_AlwaysClamp)) {
+            instances_dirty = true;
+        }
+        // These switch between specialised variants of the shaders, rather than branching in them
+        if (ImGui::Checkbox("Tint Instances", &tint_instances)) {
+            instances_dirty = true;
+        }
+        ImGui::Checkbox("Vertex Colours", &vertex_colours);
+
+        // Zooming in moves most of the instances out of view, for the culling to remove
+        ImGui::SliderFloat("Camera Zoom", &camera_zoom, 1.0f, 1000.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+        ImGui::DragFloat2("Camera Centre", &camera_centre[0], 0.01f / camera_zoom, -1.0f, 1.0f);
+        ImGui::Checkbox("Frustum Culling", &frustum_culling);
+        if (frustum_culling) {
+            const CullStats& cull_stats = frustum_culler.get_stats();
+            const BvhRefitStats& refit_stats = instance_bvh.get_refit_stats();
+            ImGuiReadouts::text("Culling: %zu visible, %zu culled, %zu nodes tested, %d threads", cull_stats.visible,
+                        cull_stats.culled, cull_stats.nodes_tested, job_system.get_thread_count());
+            ImGuiReadouts::text("Bounds %.3f ms, refit %.3f ms (%zu nodes), cull %.3f ms", instance_bounds_ms,
+                        refit_stats.refit_ms, refit_stats.nodes_refit, cull_stats.cull_ms);
+        } else {
+            ImGui::Text("Culling: off");
+        }
+
+        // The triangle counts are there to tune the budget against, the error is in the mesh's own units
+        ImGui::Checkbox("Levels of Detail", &use_lods);
+        ImGui::SliderFloat("LOD Pixel Error", &lod_pixel_error, 0.1f, 16.0f, "%.1f px", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderFloat("LOD Hysteresis", &lod_hysteresis, 0.0f, 0.9f, "%.2f");
+        size_t triangles_drawn = 0;
+        for (size_t lod = 0; lod < mesh_lods.lods.size(); lod++) {
+            const MeshLod& mesh_lod = mesh_lods.lods[lod];
+            ImGuiReadouts::text("LOD %zu: %u triangles, error %.5f, %zu instances", lod, mesh_lod.index_count / 3, mesh_lod.error,
+                        lod_instance_counts[lod]);
+            triangles_drawn += (size_t) (mesh_lod.index_count / 3) * lod_instance_counts[lod];
+        }
+        ImGuiReadouts::text("Triangles drawn: %zu", triangles_drawn);
+        ImGuiReadouts::text("Jobs: %llu run, %llu stolen last frame, on %d threads", (unsigned long long) frame_job_stats.jobs_run,
+                    (unsigned long long) frame_job_stats.jobs_stolen, job_system.get_thread_count());
+
+        // Any fence stalls or writer waits mean the capture is holding up the frame rate
+        if (frame_capture.is_initialised()) {
+            FrameCaptureStats capture_stats = frame_capture.get_stats();
+            CaptureWriterStats writer_stats = capture_writer.get_stats();
+            ImGuiReadouts::text("Capture: %llu frames read back %llu frames late, %llu fence stalls",
+                        (unsigned long long) capture_stats.frames_read, (unsigned long long) capture_stats.latency_frames,
+                        (unsigned long long) capture_stats.fence_stalls);
+            ImGuiReadouts::text("Capture: %llu frames written (%.1f MB), %.2f ms to encode, %llu writer waits",
+                        (unsigned long long) writer_stats.frames_written, (double) writer_stats.bytes_written / (1024.0 * 1024.0),
+                        writer_stats.last_encode_ms, (unsigned long long) writer_stats.producer_waits);
+        }
+
+        // Every level of detail is drawn from the same pool, so they only need one multi draw
+        GeometryPoolStats pool_stats = get_geometry_stats();
+        ImGui::Text("Geometry pool: %zu meshes, %zu/%zu vertices, %zu/%zu indices, %zu free ranges", pool_stats.meshes,
+                    pool_stats.vertices_used, pool_stats.vertex_capacity, pool_stats.indices_used, pool_stats.index_capacity,
+                    pool_stats.free_ranges);
+        ImGui::Text("Geometry pool: %llu reallocations, %llu defragmentations", (unsigned long long) pool_stats.reallocations,
+                    (unsigned long long) pool_stats.defragmentations);
+        if (ImGui::Button("Defragment Geometry")) {
+            defragment_geometry = true;
+        }
+        if (DrawQueue::has_indirect()) {
+            ImGui::Checkbox("Multi Draw Indirect", &use_indirect_draws);
+        } else {
+            ImGui::Text("Multi draw indirect: needs GL 4.3");
+        }
+
+        ImGuiReadouts::text("%.1f fps (%.3f ms/frame)", ImGui::GetIO().Framerate, 1000.0f / ImGui::GetIO().Framerate);
+
+        // Idle only draws while something changes, which includes interacting with this window
+        static const char* pacing_modes[] = {"Idle", "Capped", "Uncapped"};
+        int pacing_mode = (int) frame_pacer.get_mode();
+        if (ImGui::Combo("Frame Pacing", &pacing_mode, pacing_modes, 3)) {
+            frame_pacer.set_mode((FramePacer::Mode) pacing_mode);
+        }
+        auto target_fps = (float) frame_pacer.get_target_fps();
+        if (ImGui::SliderFloat("Target FPS", &target_fps, 0.0f, 240.0f, "%.0f")) {
+            frame_pacer.set_target_fps(target_fps);
+        }
+        ImGuiReadouts::text("Idled %llu times (%.1f s), slept %.1f s, spun %.2f s", (unsigned long long) frame_pacer.get_idle_count(),
+                    frame_pacer.get_idle_seconds(), frame_pacer.get_sleep_seconds(), frame_pacer.get_spin_seconds());
+        ImGui::Text("Transform path: %s", BatchTransform::get_path_name(BatchTransform::get_path()));
+        ImGui::Text("Shader variants: %zu", shader_variant_count.load());
+        ImGuiReadouts::text("Simulation: %.0f Hz, %llu ticks (%llu skipped)", simulation.get_tick_rate(),
+                    (unsigned long long) simulation.get_tick_count(), (unsigned long long) simulation.get_skipped_tick_count());
+
+        if (render_thread.is_running()) {
+            auto metrics = render_thread.get_metrics();
+            ImGuiReadouts::text("Render thread: queue depth %d (max %d), last frame %.3f ms", metrics.queue_depth,
+                        metrics.max_queue_depth, metrics.last_execute_ms);
+            ImGuiReadouts::text("Main thread stalls: %llu (%.1f ms)", (unsigned long long) metrics.record_stalls, metrics.record_stall_ms);
+            ImGuiReadouts::text("Render thread stalls: %llu (%.1f ms)", (unsigned long long) metrics.render_stalls, metrics.render_stall_ms);
+        } else {
+            ImGui::Text("Render thread: off");
+        }
+
+        auto state_stats = gl_state.get_last_frame_stats();
+        ImGuiReadouts::text("GL state calls: %llu issued, %llu filtered, %llu draws", (unsigned long long) state_stats.issued,
+                    (unsigned long long) state_stats.filtered, (unsigned long long) state_stats.draws);
+
+        auto stream_stats = stream_buffer.get_stats();
+        ImGuiReadouts::text("Stream buffer: %.1f KiB/frame, %.1f MiB total (%s, %.1f MiB)", (double) stream_stats.frame_bytes / 1024.0,
+                    (double) stream_stats.bytes_streamed / (1024.0 * 1024.0), stream_stats.persistent ? "persistent" : "unsynchronized",
+                    (double) stream_stats.buffer_size / (1024.0 * 1024.0));
+        ImGuiReadouts::text("Stream buffer fence waits: %llu (%.1f ms), reallocations: %llu", (unsigned long long) stream_stats.fence_waits,
+                    stream_stats.fence_wait_ms, (unsigned long long) stream_stats.reallocations);
+
+        // Anything but 0 in a frame where nothing was changed is an allocation to get rid of. The arena's overflows
+        // should stop once it has grown to fit a frame.
+        const AllocationCounts& allocations = frame_allocations.get_last_frame();
+        ImGuiReadouts::text("Heap allocations: %llu last frame (%.1f KiB, %llu on the main thread), at most %llu in the last %d frames",
+                    (unsigned long long) allocations.allocations, (double) allocations.bytes / 1024.0,
+                    (unsigned long long) frame_allocations.get_last_frame_thread_allocations(),
+                    (unsigned long long) frame_allocations.get_peak_allocations(), FrameAllocationTracker::HISTORY_SIZE);
+        ImGuiReadouts::text("Frames without heap allocations: %llu", (unsigned long long) frame_allocations.get_frames_without_allocations());
+        const LinearArena& last_arena = frame_arena.get_previous();
+        ImGuiReadouts::text("Frame arena: %.1f KiB used last frame, %.1f KiB capacity, %llu overflows", (double) last_arena.get_used() / 1024.0,
+                    (double) last_arena.get_capacity() / 1024.0, (unsigned long long) last_arena.get_overflows());
     }
     // Since ImGUI is an immediate mode UI with hidden internal state, we need to explicitly tell it that
     // we are done talking about the current window, to do that we call End();
     ImGui::End();
+
+    if (ImGui::Begin("UI Overlay")) {
+        ImGui::Checkbox("Cache Overlay", &cache_imgui_overlay);
+        // The readouts only change a few times a second, so while nothing else changes most frames should reuse it
+        uint64_t overlay_hits = imgui_overlay.get_hits();
+        uint64_t overlay_misses = imgui_overlay.get_misses();
+        ImGuiReadouts::text("Overlay: %llu reused, %llu redrawn (%.1f%% reused)", (unsigned long long) overlay_hits,
+                            (unsigned long long) overlay_misses,
+                            overlay_hits + overlay_misses > 0 ? 100.0 * (double) overlay_hits / (double) (overlay_hits + overlay_misses) : 0.0);
+        ImGuiReadouts::text("Platform windows: %llu redrawn, %llu skipped", (unsigned long long) imgui_manager.get_platform_windows_rendered(),
+                    (unsigned long long) imgui_manager.get_platform_windows_skipped());
+    }
+    ImGui::End();
+
+    gpu_profiler.ui(&frame_arena.get());
+    CpuProfiler::ui();
 }
 
-void draw(GLFWwindow *window, ImGuiManager& imgui_manager) {
-    // Tell ImGUI we are starting a new frame
-    imgui_manager.new_frame();
-    ImGuiManager::enable_main_window_docking();
-
-    // Here we add the UI elements, this can be called any time between imgui_manager.new_frame() and imgui_manager.render().
-    // However, values update by the UI are updated when calling the function like DragFloat3, that means that processing the UI
-    // before using the values like this will minimise the latency between changing something, and it's showing up. As otherwise
-    // it wouldn't have a visual effect until the next frame.
-    ui();
-
-    static auto last_time = glfwGetTime();
-    auto time = glfwGetTime();
-    auto delta = (float) (time - last_time);
-    last_time = time;
-
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    if (animate_rotation) {
-        rotation_angles += delta * rotation_speed;
-        rotation_angles = glm::mod(rotation_angles, 2.0f * (float) M_PI);
-    }
-
-    // Note that the glm matrix constructor takes column vectors,
-    // so it visually appears to be the transpose of the actual matrix.
-    auto x_angle = rotation_angles.x;
-    glm::mat3 x_rotation = glm::mat3(
-            {1.0f, 0.0f, 0.0f},
-            {0.0f, std::cos(x_angle), std::sin(x_angle)},
-            {0.0f, -std::sin(x_angle), std::cos(x_angle)}
-    );
-    auto y_angle = rotation_angles.y;
-    glm::mat3 y_rotation = glm::mat3(
-            {std::cos(y_angle), 0.0, -std::sin(y_angle)},
-            {0.0f, 1.0f, 0.0f},
-            {std::sin(y_angle), 0.0, std::cos(y_angle)}
-    );
-
-    // Scale the x by 0.25
-    glm::mat3 shrink_x = glm::mat3(
-            {0.25f, 0.0f, 0.0f},
-            {0.0f, 1.0f, 0.0f},
-            {0.0f, 0.0f, 1.0f}
-    );
-
-    // Since we want the shrink to handle in model space we put in on the right,
-    // because matrices are "applied" right to left in the conventions most commonly used with OpenGL
-    glm::mat3 combined_matrix = y_rotation * x_rotation * shrink_x;
-
-    // NOTE: Since glm was designed with OpenGL in mind, it stores matrices in column major, so
-    // the is no need to transpose, hence using GL_FALSE
-    glUniformMatrix3fv(xyz_multipliers_location, 1, GL_FALSE, &combined_matrix[0][0]);
-
-    glDrawArrays(GL_TRIANGLES, 0, NUM_VERTICES);
+// Seconds since the first call. We don't use glfwGetTime() here since GLFW isn't initialised when running headless.
+double get_time() {
+    static auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The commands a frame is recorded as, executed in order by execute_frame(). The comments give their payloads.
+enum class FrameCommand : uint8_t {
+    // ShaderOptions, picks the program
+    UseShaderVariant,
+    // glm::ivec4, x, y, width and height
+    SetViewport,
+    // GLbitfield
+    Clear,
+    // const char*, the zone's name
+    BeginGpuZone,
+    EndGpuZone,
+    // None, builds the transforms from FrameData::transforms and copies FrameData::colours into the stream buffer, and
+    // points the mesh's vertex array's instance attributes at them
+    WriteInstanceTransforms,
+    // FrameUniforms, streamed and bound to FRAME_UNIFORMS_BINDING
+    SetFrameUniforms,
+    // DrawArgs, queues a draw with the current program
+    SubmitDraw,
+    // bool, whether to use multi draw indirect if available, sorts and issues the queued draws
+    FlushDraws,
+    // None, moves the meshes in the mesh's geometry pool together
+    DefragmentGeometry,
+    // RenderImGuiArgs, draws FrameData::imgui_draw_data
+    RenderImGui,
+};
+
+struct RenderImGuiArgs {
+    // Whether to go through the overlay cache, and the draw data's hash if so
+    bool cached;
+    uint64_t hash;
+};
+
+// A draw of part of a mesh's indices, which are relative to where the mesh is in its pool. The pool's meshes may move
+// when it's defragmented, so where it is is only looked up when the draw is executed.
+struct DrawArgs {
+    GeometryPool* pool;
+    GeometryHandle mesh;
+    int first_index;
+    int count;
+    int instance_count;
+    int base_instance;
+    bool depth_test;
+    bool blend;
+};
+
+// Everything a recorded frame needs when it is executed. There is one per RenderThread slot, so that the main thread
+// can record into one while the render thread executes the other.
+struct FrameData {
+    CommandList<FrameCommand> commands;
+    // The visible instances' layout and interpolated angles
+    TransformBatch transforms;
+    // The visible instances' colours, left empty when the instances aren't tinted
+    std::vector<InstanceColour> colours;
+    // Null when the overlay is cached and hasn't changed
+    ImDrawData* imgui_draw_data = nullptr;
+    // When executing on the render thread, the draw data is copied, as ImGUI reuses its own for the next frame
+    ImGuiDrawDataCopy imgui_draw_data_copy;
+    // Only when executing on the main thread, as platform windows can only be handled there
+    bool render_platform_windows = false;
+};
+
+FrameData frames[RenderThread::FRAME_SLOTS];
+
+// The instances are split into chunks of this many to spread their animation, bounds and gathering over the job system
+const size_t INSTANCE_CHUNK_SIZE = 16384;
+
+size_t get_chunk_count(size_t count) {
+    return (count + INSTANCE_CHUNK_SIZE - 1) / INSTANCE_CHUNK_SIZE;
+}
+
+// Find the instances inside the view frustum, from their transforms in instance_layout. Their bounds are recomputed
+// every frame, which only changes the hierarchy's nodes above instances that actually moved.
+void cull_instances(const glm::mat4& view_projection) {
+    CpuProfiler::Zone cull_zone{"Cull"};
+    size_t count = instance_layout.size();
+    size_t chunk_count = get_chunk_count(count);
+
+    auto start = std::chrono::steady_clock::now();
+    instance_bounds.resize(count);
+    job_system.parallel_for(chunk_count, [&](size_t chunk) {
+        size_t begin = chunk * INSTANCE_CHUNK_SIZE;
+        BatchTransform::write_bounds(instance_layout, instance_bounds, begin, std::min(count, begin + INSTANCE_CHUNK_SIZE));
+    }, 1);
+    instance_bounds_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (bvh_dirty) {
+        instance_bvh.build(instance_bounds);
+        bvh_dirty = false;
+    } else {
+        instance_bvh.refit(instance_bounds, job_system);
+    }
+    frustum_culler.cull(instance_bvh, Frustum::from_matrix(view_projection), job_system, visible_instances);
+}
+
+// Copy the visible instances' transforms and colours (or every instance's, when culling is off) into the frame,
+// grouped by the level of detail each is drawn at
+void gather_instances(FrameData& frame) {
+    CpuProfiler::Zone gather_zone{"Gather Instances"};
+    if (!frustum_culling) {
+        visible_instances.resize(instance_layout.size());
+        std::iota(visible_instances.begin(), visible_instances.end(), 0);
+    }
+    size_t count = visible_instances.size();
+    size_t chunk_count = get_chunk_count(count);
+    bool colours = tint_instances;
+    bool select_lods = use_lods && mesh_lods.lods.size() > 1;
+    const int max_lods = MeshSimplifier::MAX_LODS;
+
+    // Pick each instance's level from how many pixels a unit of the mesh covers on screen, which only depends on the
+    // instance's scale, as the camera has no perspective. Each chunk counts its instances of each level.
+    float pixels_per_unit = mesh_scale * camera_zoom * 0.5f * (float) framebuffer_size.y;
+    chunk_lod_offsets.assign(chunk_count * max_lods, 0);
+    job_system.parallel_for(chunk_count, [&](size_t chunk) {
+        size_t* lod_counts = &chunk_lod_offsets[chunk * max_lods];
+        size_t end = std::min(count, (chunk + 1) * INSTANCE_CHUNK_SIZE);
+        for (size_t i = chunk * INSTANCE_CHUNK_SIZE; i < end; i++) {
+            uint32_t instance = visible_instances[i];
+            int lod = 0;
+            if (select_lods) {
+                lod = mesh_lods.select_lod(pixels_per_unit * instance_layout.scale[instance], instance_lods[instance],
+                                           lod_pixel_error, lod_hysteresis);
+                instance_lods[instance] = (uint8_t) lod;
+            }
+            lod_counts[lod]++;
+        }
+    }, 1);
+
+    // Lay the levels out one after the other, and each level's instances in chunk order, so that every chunk knows
+    // where to write its instances without waiting for the others
+    size_t next = 0;
+    for (int lod = 0; lod < max_lods; lod++) {
+        lod_instance_counts[lod] = 0;
+        for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+            size_t chunk_lod_count = chunk_lod_offsets[chunk * max_lods + lod];
+            chunk_lod_offsets[chunk * max_lods + lod] = next;
+            next += chunk_lod_count;
+            lod_instance_counts[lod] += chunk_lod_count;
+        }
+    }
+
+    frame.transforms.resize(count);
+    frame.colours.resize(colours ? count : 0);
+    job_system.parallel_for(chunk_count, [&](size_t chunk) {
+        size_t* lod_offsets = &chunk_lod_offsets[chunk * max_lods];
+        size_t end = std::min(count, (chunk + 1) * INSTANCE_CHUNK_SIZE);
+        for (size_t i = chunk * INSTANCE_CHUNK_SIZE; i < end; i++) {
+            uint32_t instance = visible_instances[i];
+            size_t out = lod_offsets[select_lods ? instance_lods[instance] : 0]++;
+            frame.transforms.angle_x[out] = instance_layout.angle_x[instance];
+            frame.transforms.angle_y[out] = instance_layout.angle_y[instance];
+            frame.transforms.scale[out] = instance_layout.scale[instance];
+            frame.transforms.position_x[out] = instance_layout.position_x[instance];
+            frame.transforms.position_y[out] = instance_layout.position_y[instance];
+            frame.transforms.position_z[out] = instance_layout.position_z[instance];
+            if (colours) {
+                frame.colours[out] = instance_colours[instance];
+            }
+        }
+    }, 1);
+}
+
+// Pick the draw data to render the UI with: none when the overlay is cached and looks the same as last frame, otherwise
+// ImGui's own, or a copy of it when the frame is executed on the render thread
+void prepare_imgui_draw_data(FrameData& frame, ImDrawData* imgui_draw_data, bool threaded, RenderImGuiArgs& args) {
+    bool changed = true;
+    if (cache_imgui_overlay) {
+        CpuProfiler::Zone hash_zone{"Hash ImGui Draw Data"};
+        args.hash = ImGuiOverlayCache::hash_draw_data(imgui_draw_data);
+        changed = args.hash != last_overlay_hash;
+    }
+    last_overlay_hash = args.hash;
+
+    if (changed) {
+        CpuProfiler::Zone copy_zone{"Copy ImGui Draw Data"};
+        frame.imgui_draw_data = threaded ? frame.imgui_draw_data_copy.copy(imgui_draw_data) : imgui_draw_data;
+    } else {
+        frame.imgui_draw_data = nullptr;
+    }
+    frame.render_platform_windows = !threaded;
+}
+
+// What the scene's jobs need from record_frame(), which waits for them before returning
+struct SceneJobInputs {
+    const SimulationSnapshot* snapshot;
+    float alpha;
+    size_t simulated_count;
+    glm::mat4 view_projection;
+};
+
+// Start the scene's CPU work for the frame, as jobs counted by frame_jobs: interpolating the instances' angles, then
+// culling them (if enabled), then gathering the visible ones into the frame. Each step is split into jobs of its own.
+void start_scene_jobs(FrameData& frame, const SceneJobInputs& inputs) {
+    // Draw the angles part way between the latest snapshot's two ticks, depending on how long ago it was due.
+    // Right after the instance count changes, the snapshot may not have caught up, in which case the instances it
+    // doesn't cover yet keep the angles they had last frame (zero for new ones) for the tick or so until it does.
+    JobHandle interpolate = job_system.create_parallel_for(get_chunk_count(inputs.simulated_count), [&inputs](size_t chunk) {
+        size_t begin = chunk * INSTANCE_CHUNK_SIZE;
+        size_t count = std::min(inputs.simulated_count - begin, INSTANCE_CHUNK_SIZE);
+        const SimulationSnapshot& snapshot = *inputs.snapshot;
+        BatchTransform::interpolate_angles(snapshot.previous_angle_x.data() + begin, snapshot.angle_x.data() + begin,
+                                           inputs.alpha, instance_layout.angle_x.data() + begin, count);
+        BatchTransform::interpolate_angles(snapshot.previous_angle_y.data() + begin, snapshot.angle_y.data() + begin,
+                                           inputs.alpha, instance_layout.angle_y.data() + begin, count);
+    }, 1, &frame_jobs);
+
+    // Culling spreads its own loops over the job system, waiting for them by running jobs itself
+    JobHandle gather_after = interpolate;
+    if (frustum_culling) {
+        JobHandle cull = job_system.create([&inputs] { cull_instances(inputs.view_projection); }, &frame_jobs);
+        job_system.add_dependency(cull, interpolate);
+        job_system.submit(cull);
+        gather_after = cull;
+    }
+    JobHandle gather = job_system.create([&frame] { gather_instances(frame); }, &frame_jobs);
+    job_system.add_dependency(gather, gather_after);
+    job_system.submit(gather);
+    job_system.submit(interpolate);
+}
+
+// Build the UI and record the frame's commands, without touching GL. imgui_manager is null when the UI is disabled.
+void record_frame(FrameData& frame, ImGuiManager* imgui_manager, bool threaded) {
+    CpuProfiler::Zone record_zone{"record_frame"};
+    frame.commands.clear();
+
+    ImDrawData* imgui_draw_data = nullptr;
+    if (imgui_manager) {
+        // Tell ImGUI we are starting a new frame
+        imgui_manager->new_frame();
+        ImGuiManager::enable_main_window_docking();
+
+        // Here we add the UI elements, this can be called any time between imgui_manager.new_frame() and imgui_manager.end_frame().
+        // However, values update by the UI are updated when calling the function like DragFloat3, that means that processing the UI
+        // before using the values like this will minimise the latency between changing something, and it's showing up. As otherwise
+        // it wouldn't have a visual effect until the next frame.
+        {
+            CpuProfiler::Zone ui_zone{"ui"};
+            ImGuiReadouts::begin_frame(get_time());
+            ui(*imgui_manager);
+        }
+        // Dragging a slider may not send any events (e.g. while holding the mouse still), but the values still change
+        if (ImGui::IsAnyItemActive()) {
+            frame_pacer.wake();
+        }
+
+        imgui_draw_data = imgui_manager->end_frame();
+    }
+
+    // When the UI looks the same as last frame, the cached overlay is drawn again, so the draw data isn't needed. That's
+    // worked out by a job, see prepare_imgui_draw_data().
+    RenderImGuiArgs imgui_args{cache_imgui_overlay, 0};
+
+    frame.commands.record(FrameCommand::UseShaderVariant, ShaderOptions{vertex_colours, tint_instances});
+
+    if (defragment_geometry) {
+        frame.commands.record(FrameCommand::DefragmentGeometry);
+        defragment_geometry = false;
+    }
+    frame.commands.record(FrameCommand::SetViewport, glm::ivec4{0, 0, framebuffer_size.x, framebuffer_size.y});
+    frame.commands.record<const char*>(FrameCommand::BeginGpuZone, "Clear");
+    frame.commands.record(FrameCommand::Clear, (GLbitfield) (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    frame.commands.record(FrameCommand::EndGpuZone);
+
+    {
+        CpuProfiler::Zone scene_zone{"Scene"};
+        frame.commands.record<const char*>(FrameCommand::BeginGpuZone, "Scene");
+
+        if (instances_dirty) {
+            frame_pacer.wake();
+            update_instances();
+            instances_dirty = false;
+        }
+
+        simulation.update_snapshot();
+        const SimulationSnapshot& snapshot = simulation.get_snapshot();
+        // The camera only zooms and pans, the depth range stays the same
+        glm::mat4 view_projection = glm::scale(glm::vec3(camera_zoom, camera_zoom, 1.0f))
+                                    * glm::translate(glm::vec3(-camera_centre, 0.0f));
+        SceneJobInputs scene_inputs{&snapshot, simulation.get_interpolation_alpha(),
+                                    std::min(instance_layout.size(), snapshot.angle_x.size()), view_projection};
+
+        // The UI's draw data doesn't depend on the scene, so it's prepared alongside it
+        JobSystemStats stats_before = job_system.get_stats();
+        start_scene_jobs(frame, scene_inputs);
+        if (imgui_draw_data) {
+            job_system.submit(job_system.create([&frame, &imgui_args, imgui_draw_data, threaded] {
+                prepare_imgui_draw_data(frame, imgui_draw_data, threaded, imgui_args);
+            }, &frame_jobs));
+        }
+        {
+            // Rather than idling, the main thread runs jobs too until the frame's are done
+            CpuProfiler::Zone wait_zone{"Wait For Frame Jobs"};
+            job_system.wait(frame_jobs);
+        }
+        JobSystemStats stats_after = job_system.get_stats();
+        frame_job_stats = {stats_after.jobs_run - stats_before.jobs_run, stats_after.jobs_stolen - stats_before.jobs_stolen};
+        first_instance_angles = {instance_layout.angle_x[0], instance_layout.angle_y[0]};
+
+        // Each instance's rotation is part of its own transform now, so the scene wide transform that is applied before
+        // it only fits a loaded mesh to the cube's size. It is kept as a uniform so the whole scene can be transformed at once.
+        FrameUniforms uniforms{};
+        for (int column = 0; column < 3; column++) {
+            uniforms.xyz_multipliers[column] = glm::vec4(glm::mat3{mesh_scale}[column], 0.0f);
+        }
+        uniforms.mesh_offset = glm::vec4(mesh_offset, 0.0f);
+        // Only used by the variants without vertex colours
+        uniforms.flat_colour = {0.2f, 0.4f, 0.8f, 1.0f};
+        uniforms.view_projection = view_projection;
+        frame.commands.record(FrameCommand::SetFrameUniforms, uniforms);
+
+        // One draw per level of detail, with the instances drawn at it, all from the same buffers so they can be issued
+        // with a single multi draw. When everything is culled there is nothing to draw at all.
+        if (mesh_pool && frame.transforms.size() > 0) {
+            frame.commands.record(FrameCommand::WriteInstanceTransforms);
+            int first_instance = 0;
+            for (size_t lod = 0; lod < mesh_lods.lods.size(); lod++) {
+                auto lod_instances = (int) lod_instance_counts[lod];
+                if (lod_instances == 0) {
+                    continue;
+                }
+                const MeshLod& mesh_lod = mesh_lods.lods[lod];
+                // We need to enable the depth test to discard fragments that are behind
+                // previously drawn fragments for the same pixel.
+                frame.commands.record(FrameCommand::SubmitDraw, DrawArgs{mesh_pool, mesh_handle, (int) mesh_lod.first_index,
+                                                                         (int) mesh_lod.index_count, lod_instances,
+                                                                         first_instance, true, false});
+                first_instance += lod_instances;
+            }
+        }
+        frame.commands.record(FrameCommand::FlushDraws, use_indirect_draws);
+        frame.commands.record(FrameCommand::EndGpuZone);
+    }
 
     // Tell ImGUI to now render itself, this is done after drawing the scene so that it appears on top.
-    imgui_manager.render();
+    if (imgui_draw_data) {
+        frame.commands.record<const char*>(FrameCommand::BeginGpuZone, "ImGui");
+        frame.commands.record(FrameCommand::RenderImGui, imgui_args);
+        frame.commands.record(FrameCommand::EndGpuZone);
+    }
+}
+
+// Execute a recorded frame, on whichever thread has the GL context. window is null when rendering headless.
+void execute_frame(FrameData& frame, GLFWwindow* window, ImGuiManager* imgui_manager) {
+    CpuProfiler::Zone execute_zone{"execute_frame"};
+
+    // Let any shader programs compiling in the background make progress, without blocking the frame
+    reload_shaders();
+    ShaderHelper::poll_programs();
+
+    // Draw into the capture's framebuffer, which is copied to where the frame would have gone once it's read back
+    if (frame_capture.is_initialised()) {
+        frame_capture.begin_frame();
+    }
+
+    // The zones' GPU times are read back a few frames later, see GpuProfiler
+    gpu_profiler.begin_frame();
+    gpu_profiler.begin_zone("Frame");
+
+    // Make sure this frame's region of the stream buffer is free, and big enough for everything streamed below
+    // (with room for aligning each part), including the indirect draws' parameters, one per level of detail at most.
+    // If it had to grow, the old buffer's name may now belong to the new one.
+    if (stream_buffer.begin_frame(sizeof(InstanceTransform) * frame.transforms.size() + sizeof(InstanceColour) * frame.colours.size()
+                                  + sizeof(FrameUniforms) + 16 + 2 * (size_t) uniform_buffer_alignment
+                                  + sizeof(DrawQueue::DrawElementsIndirectCommand) * MeshSimplifier::MAX_LODS + 4)) {
+        gl_state.invalidate();
+    }
+
+    frame.commands.for_each([&](const CommandList<FrameCommand>::Command& command) {
+        switch (command.get_type()) {
+            case FrameCommand::UseShaderVariant:
+                update_program(command.get<ShaderOptions>());
+                break;
+            case FrameCommand::SetViewport: {
+                auto viewport = command.get<glm::ivec4>();
+                gl_state.set_viewport(viewport.x, viewport.y, viewport.z, viewport.w);
+                break;
+            }
+            case FrameCommand::Clear:
+                glClear(command.get<GLbitfield>());
+                break;
+            case FrameCommand::BeginGpuZone:
+                gpu_profiler.begin_zone(command.get<const char*>());
+                break;
+            case FrameCommand::EndGpuZone:
+                gpu_profiler.end_zone();
+                break;
+            case FrameCommand::WriteInstanceTransforms: {
+                // Build every instance's y_rotation * x_rotation * shrink_x transform straight into this frame's region of
+                // the stream buffer. 16 byte alignment lets write_transforms use streaming stores.
+                auto* transforms = (InstanceTransform *) stream_buffer.map(sizeof(InstanceTransform) * frame.transforms.size(), 16,
+                                                                           &instance_transforms_offset);
+                if (!transforms) {
+                    break;
+                }
+                BatchTransform::write_transforms(frame.transforms, transforms);
+                stream_buffer.unmap();
+
+                instance_colours_offset.reset();
+                if (!frame.colours.empty()) {
+                    size_t offset;
+                    void* colours = stream_buffer.map(sizeof(InstanceColour) * frame.colours.size(), 16, &offset);
+                    if (colours) {
+                        std::memcpy(colours, frame.colours.data(), sizeof(InstanceColour) * frame.colours.size());
+                        stream_buffer.unmap();
+                        instance_colours_offset = offset;
+                    }
+                }
+
+                // Each level of detail's draw starts from its own base instance
+                gl_state.bind_vertex_array(mesh_pool->get_vertex_array());
+                point_instance_attributes(0);
+                break;
+            }
+            case FrameCommand::SetFrameUniforms: {
+                size_t offset;
+                void* uniforms = stream_buffer.map(sizeof(FrameUniforms), uniform_buffer_alignment, &offset);
+                if (!uniforms) {
+                    break;
+                }
+                auto frame_uniforms = command.get<FrameUniforms>();
+                std::memcpy(uniforms, &frame_uniforms, sizeof(FrameUniforms));
+                stream_buffer.unmap();
+                glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, stream_buffer.get_buffer(), (GLintptr) offset, sizeof(FrameUniforms));
+                break;
+            }
+            case FrameCommand::SubmitDraw: {
+                auto args = command.get<DrawArgs>();
+                const GeometryRange& range = args.pool->get_range(args.mesh);
+                scene_draws.submit(DrawItem{program, args.pool->get_vertex_array(), args.depth_test, args.blend, args.count,
+                                            (int) range.first_index + args.first_index, (int) range.first_vertex,
+                                            args.instance_count, args.base_instance});
+                break;
+            }
+            case FrameCommand::FlushDraws:
+                scene_draws.set_indirect_enabled(command.get<bool>());
+                scene_draws.flush(gl_state);
+                break;
+            case FrameCommand::DefragmentGeometry:
+                if (mesh_pool) {
+                    mesh_pool->defragment();
+                    set_geometry_stats(mesh_pool->get_stats());
+                    // The pool binds its vertex array and buffers directly
+                    gl_state.invalidate();
+                }
+                break;
+            case FrameCommand::RenderImGui: {
+                CpuProfiler::Zone imgui_zone{"ImGui Render"};
+                auto args = command.get<RenderImGuiArgs>();
+                if (args.cached) {
+                    imgui_overlay.render(frame.imgui_draw_data, args.hash);
+                    // Unlike ImGUI's own rendering, compositing the overlay doesn't restore the state it changes
+                    gl_state.invalidate();
+                } else {
+                    ImGuiManager::render_draw_data(frame.imgui_draw_data);
+                }
+                if (frame.render_platform_windows && imgui_manager) {
+                    imgui_manager->render_platform_windows();
+                }
+                break;
+            }
+        }
+    });
+
+    gpu_profiler.end_zone();
+    gpu_profiler.end_frame();
+
+    // The region can be reused once the GPU has passed this point
+    stream_buffer.end_frame();
+    gl_state.end_frame();
+
+    if (frame_capture.is_initialised()) {
+        frame_capture.end_frame();
+    }
+
+    if (window) {
+        CpuProfiler::Zone swap_zone{"glfwSwapBuffers"};
+        glfwSwapBuffers(window);
+    }
+}
 
-    glfwSwapBuffers(window);
+// Draw a frame, window is null when rendering headless, and imgui_manager is null when the UI is disabled.
+// With the render thread running, the frame is recorded here and executed there, while the next frame is recorded.
+void draw(GLFWwindow *window, ImGuiManager* imgui_manager) {
+    if (render_thread.is_running()) {
+        // The arenas alternate like the slots, so once the slot is free, so is what was allocated for its last frame
+        int slot = render_thread.acquire_slot();
+        frame_arena.begin_frame();
+        record_frame(frames[slot], imgui_manager, true);
+        render_thread.submit(slot);
+    } else {
+        frame_arena.begin_frame();
+        record_frame(frames[0], imgui_manager, false);
+        execute_frame(frames[0], window, imgui_manager);
+    }
+    frame_allocations.end_frame();
 }
 
 void key_callback(GLFWwindow *window, int key, int /*scancode*/, int /*action*/, int /*mods*/) {
+    frame_pacer.notify_event();
     switch (key) {
         case GLFW_KEY_ESCAPE: {
             // Don't directly close this time, instead tell GLFW to mark the window as "Should close",
@@ -240,7 +1378,7 @@ void key_callback(GLFWwindow *window, int key, int /*scancode*/, int /*action*/,
 
 void refresh_callback(GLFWwindow *window) {
     auto* imgui_manager = static_cast<ImGuiManager *>(glfwGetWindowUserPointer(window));
-    draw(window, *imgui_manager);
+    draw(window, imgui_manager);
 }
 
 // A callback function that we give GLFW to report errors with.
@@ -248,7 +1386,346 @@ void glfwErrorCallback(int code, const char *msg) {
     std::cout << "GLFW Error (" << code << ")\n\t" << "msg: " << msg << std::endl;
 }
 
-int main() {
+void print_gl_info() {
+    // Print some info about the OpenGL context
+    std::cout << "" << "OpenGL Vendor: " << glGetString(GL_VENDOR) << std::endl;
+    std::cout << "" << "OpenGL Renderer: " << glGetString(GL_RENDERER) << std::endl;
+    std::cout << "" << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
+    std::cout << "" << "OpenGL Shading Language Version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
+    std::cout << "" << "------------------------------------------------------------" << std::endl;
+    std::cout << "" << std::endl;
+}
+
+// Command line options, see main() for how they are parsed.
+struct Options {
+    bool headless = false;
+    bool ui = true;
+    // Defaults to HEADLESS_FRAMES, or BENCHMARK_FRAMES per configuration with --benchmark
+    std::optional<int> frames;
+    // Where to write a Chrome trace of the CPU zones when exiting, empty for none
+    std::string trace_path;
+    // Whether to execute frames on a separate render thread, only when there is a window
+    bool render_thread = true;
+
+    // Where to write the results of --benchmark, empty to render a fixed number of frames instead
+    std::string benchmark_path;
+    // The results of an earlier run to compare against, empty for none
+    std::string baseline_path;
+    BenchmarkThresholds thresholds;
+    // The configurations swept, every combination of these and the overlay on and off
+    std::vector<int> benchmark_instances{1, 10, 100, 1000, 10000, 100000, MAX_INSTANCES};
+    std::vector<int> benchmark_subdivisions{1, 4, 16};
+    // Configurations of more instances x triangles than this are skipped, as a software renderer would take minutes
+    // a frame to draw a million of the most subdivided cubes
+    double benchmark_triangle_budget = 2e7;
+};
+
+// Parse a comma separated list of counts, e.g. 1,100,10000, clamped to [1, max]
+std::vector<int> parse_count_list(const char* list, int max) {
+    std::vector<int> counts;
+    const char* next = list;
+    while (*next) {
+        char* end;
+        long count = std::strtol(next, &end, 10);
+        if (end == next) {
+            std::cerr << "Invalid count list: " << list << std::endl;
+            break;
+        }
+        counts.push_back((int) std::clamp(count, 1L, (long) max));
+        next = *end == ',' ? end + 1 : end;
+    }
+    return counts;
+}
+
+// Parse a --pacing argument, returning empty if it isn't one of the modes
+std::optional<FramePacer::Mode> parse_pacing_mode(const char* name) {
+    for (auto mode : {FramePacer::Mode::Idle, FramePacer::Mode::Capped, FramePacer::Mode::Uncapped}) {
+        std::string mode_name = FramePacer::get_mode_name(mode);
+        std::transform(mode_name.begin(), mode_name.end(), mode_name.begin(), ::tolower);
+        if (mode_name == name) {
+            return mode;
+        }
+    }
+    return std::nullopt;
+}
+
+// Measure every combination of the instance counts, the cube's subdivisions, and the overlay on and off (when there is
+// one), then write the results to options.benchmark_path, and compare them against options.baseline_path if there is
+// one. Each configuration is drawn for some frames to warm up first. Returns a failure if anything regressed.
+int run_benchmark(const Options& options, ImGuiManager* imgui_manager) {
+    int frame_count = options.frames.value_or(BENCHMARK_FRAMES);
+    // A mesh file can't be subdivided, so only its own vertex count is measured
+    std::vector<int> subdivision_counts = options.benchmark_subdivisions;
+    if (!mesh_path.empty()) {
+        subdivision_counts = {0};
+    }
+    std::vector<bool> ui_modes{false};
+    if (imgui_manager) {
+        ui_modes.push_back(true);
+    }
+
+    BenchmarkReport report;
+    report.renderer = (const char*) glGetString(GL_RENDERER);
+    report.gl_version = (const char*) glGetString(GL_VERSION);
+    if (!BenchmarkReport::reset_peak_rss()) {
+        std::cout << "The peak RSS can't be reset here, so it is the peak of the whole run so far" << std::endl;
+    }
+
+    std::vector<double> frame_times_ms((size_t) frame_count);
+    for (int subdivisions : subdivision_counts) {
+        if (subdivisions > 0 && subdivisions != cube_subdivisions) {
+            // Swap the cube for one with more or fewer vertices, in the same pool. Adding it may grow the pool, which
+            // binds its buffers behind the state cache's back.
+            cube_subdivisions = subdivisions;
+            mesh_pool->remove(mesh_handle);
+            upload_cube();
+            gl_state.invalidate();
+        }
+        size_t vertex_count = mesh_pool->get_range(mesh_handle).vertex_count;
+        size_t triangle_count = mesh_lods.lods[0].index_count / 3;
+
+        for (int instances : options.benchmark_instances) {
+            if ((double) instances * (double) triangle_count > options.benchmark_triangle_budget) {
+                std::cout << "Skipping " << instances << " instances of " << triangle_count
+                          << " triangles, over the budget of " << options.benchmark_triangle_budget << " triangles" << std::endl;
+                continue;
+            }
+            instance_count = instances;
+            instances_dirty = true;
+
+            for (bool ui : ui_modes) {
+                ImGuiManager* manager = ui ? imgui_manager : nullptr;
+                BenchmarkResult result;
+                result.name = "instances=" + std::to_string(instances) + " subdivisions=" + std::to_string(subdivisions)
+                              + " ui=" + (ui ? "on" : "off");
+                result.instances = instances;
+                result.subdivisions = subdivisions;
+                result.vertices = vertex_count;
+                result.triangles = triangle_count;
+                result.ui = ui;
+                result.frames = frame_count;
+
+                // Also keep warming up until the simulation has caught up with a new instance count, otherwise the
+                // first frames would only draw the instances it had before
+                double warmup_start = get_time();
+                int warmup_frames = 0;
+                while (warmup_frames < BENCHMARK_WARMUP_FRAMES
+                       || (simulation.get_snapshot().angle_x.size() < (size_t) instances && get_time() - warmup_start < 10.0)) {
+                    draw(nullptr, manager);
+                    warmup_frames++;
+                }
+                glFinish();
+                gpu_profiler.reset_stats();
+                BenchmarkReport::reset_peak_rss();
+
+                AllocationCounts allocations_before = AllocationCounter::get_counts();
+                double start = get_time();
+                for (int frame = 0; frame < frame_count; frame++) {
+                    double frame_start = get_time();
+                    draw(nullptr, manager);
+                    frame_times_ms[frame] = 1000.0 * (get_time() - frame_start);
+                }
+                // The wall time includes the GPU finishing the last frames, the CPU times only what draw() took
+                glFinish();
+                result.wall_ms_per_frame = 1000.0 * (get_time() - start) / frame_count;
+                result.allocations_per_frame = (double) (AllocationCounter::get_counts().allocations - allocations_before.allocations) / frame_count;
+
+                result.cpu_p50_ms = BenchmarkReport::get_percentile(frame_times_ms, 50.0);
+                result.cpu_p95_ms = BenchmarkReport::get_percentile(frame_times_ms, 95.0);
+                result.cpu_p99_ms = BenchmarkReport::get_percentile(frame_times_ms, 99.0);
+                // Sorted by get_percentile()
+                result.cpu_max_ms = frame_times_ms.back();
+                // The last few frames' GPU times are never read back, the rest are plenty
+                for (const auto& zone : gpu_profiler.get_zone_stats()) {
+                    if (std::strcmp(zone.name, "Frame") == 0) {
+                        result.gpu_avg_ms = zone.avg_ms;
+                        result.gpu_p99_ms = zone.p99_ms;
+                    }
+                }
+                result.peak_rss_mb = BenchmarkReport::get_peak_rss_mb();
+
+                std::cout << result.name << ": cpu p50 " << result.cpu_p50_ms << " ms, p95 " << result.cpu_p95_ms
+                          << " ms, p99 " << result.cpu_p99_ms << " ms, gpu " << result.gpu_avg_ms << " ms, "
+                          << result.wall_ms_per_frame << " ms/frame, peak rss " << result.peak_rss_mb << " MB, "
+                          << result.allocations_per_frame << " allocations/frame" << std::endl;
+                report.results.push_back(std::move(result));
+            }
+        }
+    }
+
+    if (!report.write(options.benchmark_path)) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "Wrote " << report.results.size() << " results to " << options.benchmark_path << std::endl;
+
+    if (options.baseline_path.empty()) {
+        return EXIT_SUCCESS;
+    }
+    BenchmarkReport baseline;
+    if (!baseline.read(options.baseline_path)) {
+        return EXIT_FAILURE;
+    }
+    return report.compare(baseline, options.thresholds) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Render a fixed number of frames into an offscreen framebuffer, without opening a window, and report the throughput,
+// or run the benchmark with --benchmark.
+int run_headless(const Options& options) {
+    HeadlessContext context{WINDOW_WIDTH, WINDOW_HEIGHT};
+    if (!context.init(OPENGL_VERSION_MAJOR, OPENGL_VERSION_MINOR)) {
+        exit(EXIT_FAILURE);
+    }
+
+    int status = gladLoadGL(HeadlessContext::get_proc_address());
+    if (!status) {
+        std::cerr << "Failed to Load OpenGL functions, via GLAD" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    print_gl_info();
+
+    context.create_framebuffer();
+
+    // The overlay is optional, so that it can be left out of measurements of the scene
+    std::optional<ImGuiManager> imgui_manager;
+    if (options.ui) {
+        imgui_manager.emplace(WINDOW_WIDTH, WINDOW_HEIGHT);
+    }
+
+    init();
+    if (imgui_manager && !imgui_overlay.init()) {
+        cache_imgui_overlay = false;
+    }
+    start_capture();
+
+    int exit_status = EXIT_SUCCESS;
+    if (!options.benchmark_path.empty()) {
+        exit_status = run_benchmark(options, imgui_manager ? &*imgui_manager : nullptr);
+    } else {
+        int frame_count = options.frames.value_or(HEADLESS_FRAMES);
+        auto start = get_time();
+        for (int frame = 0; frame < frame_count; frame++) {
+            draw(nullptr, imgui_manager ? &*imgui_manager : nullptr);
+        }
+        // Wait for the GPU to actually finish, otherwise we would only be timing command submission
+        glFinish();
+        auto elapsed = get_time() - start;
+
+        std::cout << "Rendered " << frame_count << " frames of " << instance_count << " instances in " << elapsed << "s ("
+                  << frame_count / elapsed << " fps, " << 1000.0 * elapsed / frame_count << " ms/frame)" << std::endl;
+
+        // The last few frames' GPU times are never read back, as there are no later frames to read them in
+        for (const auto& zone : gpu_profiler.get_zone_stats()) {
+            std::cout << "GPU " << zone.name << ": avg " << zone.avg_ms << " ms, min " << zone.min_ms << " ms, p99 "
+                      << zone.p99_ms << " ms" << std::endl;
+        }
+    }
+    simulation.stop();
+    job_system.stop();
+    stop_capture();
+    gpu_profiler.cleanup();
+    stream_buffer.cleanup();
+    float_geometry.cleanup();
+    compact_geometry.cleanup();
+
+    if (!options.trace_path.empty()) {
+        CpuProfiler::write_chrome_trace(options.trace_path);
+    }
+
+    if (imgui_manager) {
+        imgui_overlay.cleanup();
+        ImGuiManager::cleanup();
+    }
+
+    return exit_status;
+}
+
+int main(int argc, char **argv) {
+    // --headless          Render offscreen without a window, for a fixed number of frames then exit
+    // --frames <count>    The number of frames to render when headless
+    // --no-ui             Don't render the ImGUI overlay
+    // --instances <count> The initial number of instances to draw
+    // --no-shader-cache   Always compile shaders from source, ignoring the program binary cache
+    // --trace <file>      Write a Chrome trace of the CPU zones to the file when exiting
+    // --no-render-thread  Render on the main thread, which also allows ImGUI windows to be dragged out of the main one
+    // --float-vertices    Upload the vertices as floats, rather than in the compact format
+    // --mesh <file>       Draw a mesh file converted by tools/mesh_converter instead of the cube
+    // --lods <count>      The most levels of detail to draw the mesh with, 1 for none. The cube's are built at startup,
+    //                     a mesh file's are built by tools/mesh_converter and only read from the file
+    // --pacing <mode>     idle (the default) only draws while something changes, capped always draws at the target
+    //                     fps, uncapped draws as fast as possible
+    // --fps <rate>        The target fps of the idle and capped modes, 0 for no limit
+    // --capture <path>    Capture every frame drawn, to a Y4M stream if the path ends in .y4m, otherwise to a PNG
+    //                     sequence named <path>000000.png, <path>000001.png...
+    // --benchmark <file>  Headless, sweep the instance count, the cube's subdivisions and the overlay on and off,
+    //                     measuring --frames frames of each, and write the results to the file as JSON
+    // --baseline <file>   Compare the benchmark's results against an earlier run's, failing if any regressed
+    // --cpu-threshold <percent>, --gpu-threshold <percent>, --rss-threshold <percent>
+    //                     How much worse than the baseline the CPU frame time, GPU time or peak RSS can get
+    // --benchmark-instances <list>, --benchmark-subdivisions <list>
+    //                     The comma separated instance counts and subdivisions to sweep
+    // --benchmark-budget <triangles>
+    //                     Skip the configurations drawing more triangles a frame than this
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--headless") == 0) {
+            options.headless = true;
+        } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            options.frames = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            options.headless = true;
+            options.benchmark_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            options.baseline_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--cpu-threshold") == 0 && i + 1 < argc) {
+            options.thresholds.cpu_percent = std::max(0.0, std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--gpu-threshold") == 0 && i + 1 < argc) {
+            options.thresholds.gpu_percent = std::max(0.0, std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--rss-threshold") == 0 && i + 1 < argc) {
+            options.thresholds.rss_percent = std::max(0.0, std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--benchmark-instances") == 0 && i + 1 < argc) {
+            options.benchmark_instances = parse_count_list(argv[++i], MAX_INSTANCES);
+        } else if (std::strcmp(argv[i], "--benchmark-subdivisions") == 0 && i + 1 < argc) {
+            options.benchmark_subdivisions = parse_count_list(argv[++i], MAX_CUBE_SUBDIVISIONS);
+        } else if (std::strcmp(argv[i], "--benchmark-budget") == 0 && i + 1 < argc) {
+            options.benchmark_triangle_budget = std::max(1.0, std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--no-ui") == 0) {
+            options.ui = false;
+        } else if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            instance_count = std::clamp(std::atoi(argv[++i]), 1, MAX_INSTANCES);
+        } else if (std::strcmp(argv[i], "--no-shader-cache") == 0) {
+            ShaderHelper::set_program_cache_enabled(false);
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            options.trace_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--no-render-thread") == 0) {
+            options.render_thread = false;
+        } else if (std::strcmp(argv[i], "--float-vertices") == 0) {
+            compact_vertices = false;
+        } else if (std::strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+            mesh_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--lods") == 0 && i + 1 < argc) {
+            lod_count = std::clamp(std::atoi(argv[++i]), 1, MeshSimplifier::MAX_LODS);
+        } else if (std::strcmp(argv[i], "--pacing") == 0 && i + 1 < argc) {
+            if (auto mode = parse_pacing_mode(argv[++i])) {
+                frame_pacer.set_mode(*mode);
+            } else {
+                std::cerr << "Unknown pacing mode: " << argv[i] << std::endl;
+            }
+        } else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            frame_pacer.set_target_fps(std::max(0.0, std::atof(argv[++i])));
+        } else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << argv[i] << std::endl;
+        }
+    }
+
+    CpuProfiler::set_thread_name("Main");
+
+    if (options.headless) {
+        return run_headless(options);
+    }
+
     glfwSetErrorCallback(glfwErrorCallback);
     glfwInit();
 
@@ -268,31 +1745,42 @@ int main() {
 
     glfwSwapInterval(V_SYNC ? 1 : 0);
 
+    // The window can't be resized, so this only needs getting once
+    glfwGetFramebufferSize(window, &framebuffer_size.x, &framebuffer_size.y);
+
     int status = gladLoadGL((GLADloadfunc) glfwGetProcAddress);
     if (!status) {
         std::cerr << "Failed to Load OpenGL functions, via GLAD" << std::endl;
         exit(EXIT_FAILURE);
     }
 
-    // Print some info about the OpenGL context
-    std::cout << "" << "OpenGL Vendor: " << glGetString(GL_VENDOR) << std::endl;
-    std::cout << "" << "OpenGL Renderer: " << glGetString(GL_RENDERER) << std::endl;
-    std::cout << "" << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
-    std::cout << "" << "OpenGL Shading Language Version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
-    std::cout << "" << "------------------------------------------------------------" << std::endl;
-    std::cout << "" << std::endl;
+    print_gl_info();
 
     // Set most callbacks before creating ImGuiManager, as ImGUI will hook into
     // the same glfw callbacks and chain call the ones previous set.
     // We could do the same if we set out callbacks afterwards, but this is less work.
     glfwSetKeyCallback(window, key_callback);
-
-    ImGuiManager imgui_manager{window};
-
-    // Store a pointer to ImGuiManager with the window, so that we can access it in refresh_callback
-    glfwSetWindowUserPointer(window, &imgui_manager);
+    // The rest of the input only has to stop the frame pacer idling, ImGUI handles it. Windows dragged out of the main
+    // one get ImGUI's callbacks alone, so they are only woken by dragging, and by the idle timeout.
+    glfwSetCharCallback(window, [](GLFWwindow*, unsigned int) { frame_pacer.notify_event(); });
+    glfwSetCursorPosCallback(window, [](GLFWwindow*, double, double) { frame_pacer.notify_event(); });
+    glfwSetCursorEnterCallback(window, [](GLFWwindow*, int) { frame_pacer.notify_event(); });
+    glfwSetMouseButtonCallback(window, [](GLFWwindow*, int, int, int) { frame_pacer.notify_event(); });
+    glfwSetScrollCallback(window, [](GLFWwindow*, double, double) { frame_pacer.notify_event(); });
+    glfwSetWindowFocusCallback(window, [](GLFWwindow*, int) { frame_pacer.notify_event(); });
+
+    ImGuiManager imgui_manager{window, !options.render_thread};
+
+    // Store a pointer to ImGuiManager with the window, so that we can access it in refresh_callback.
+    // With --no-ui this is null so that draw() skips the overlay.
+    ImGuiManager* ui_manager = options.ui ? &imgui_manager : nullptr;
+    glfwSetWindowUserPointer(window, ui_manager);
 
     init();
+    if (options.ui && !imgui_overlay.init()) {
+        cache_imgui_overlay = false;
+    }
+    start_capture();
 
     // This callback may only end up being called very rarely if at all, hence why we use a main loop.
     // Also, ImGuiManager doesn't override this callback, so it can be called afterwards.
@@ -300,15 +1788,60 @@ int main() {
     // will be invalid.
     glfwSetWindowRefreshCallback(window, refresh_callback);
 
+    // Rebuild the program whenever a shader is saved, so they can be edited while the program is running
+    shader_watcher.start(ShaderHelper::get_shader_dir());
+
+    // Hand the context over to the render thread. A context can only be current on one thread at a time, so the main
+    // thread releases it first, and takes it back once the render thread has stopped.
+    if (options.render_thread) {
+        // Otherwise the first new_frame() would create them, on the main thread
+        ImGuiManager::create_device_objects();
+        glfwMakeContextCurrent(nullptr);
+
+        render_thread.start(
+                [window] {
+                    glfwMakeContextCurrent(window);
+                    glfwSwapInterval(V_SYNC ? 1 : 0);
+                },
+                [window](int slot) { execute_frame(frames[slot], window, nullptr); },
+                [] { glfwMakeContextCurrent(nullptr); });
+    }
+
     // GLFW works a bit differently than GLUT, we have to write the main loop ourselves, though this gives more control.
     // This does have the downside though that the loop may block when resizing or moving the window on some systems,
     // see docs of glfwPollEvents call for more info, this is why we also use glfwSetWindowRefreshCallback.
     while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents(); // Tell glfw to check for new events that have arrived from the OS since the last call.
+        {
+            // Check for new events that have arrived from the OS since the last call, waiting for the next frame to be
+            // due first, or for an event to arrive if the scene is static
+            CpuProfiler::Zone pacing_zone{"Frame Pacing"};
+            frame_pacer.wait_for_next_frame(animate_rotation);
+        }
+
+        draw(window, ui_manager); // Just call draw
+    }
+
+    render_thread.stop();
+    glfwMakeContextCurrent(window);
 
-        draw(window, imgui_manager); // Just call draw
+    shader_watcher.stop();
+    simulation.stop();
+    job_system.stop();
+    stop_capture();
+    gpu_profiler.cleanup();
+    stream_buffer.cleanup();
+    float_geometry.cleanup();
+    compact_geometry.cleanup();
+
+    if (!options.trace_path.empty()) {
+        CpuProfiler::write_chrome_trace(options.trace_path);
     }
 
+    // The copies of the draw lists have to be freed while ImGUI is still around
+    for (auto& frame : frames) {
+        frame.imgui_draw_data_copy.clear();
+    }
+    imgui_overlay.cleanup();
     ImGuiManager::cleanup();
 
     glfwDestroyWindow(window);
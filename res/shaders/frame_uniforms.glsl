@@ -0,0 +1,11 @@
+// The uniforms shared by every draw in a frame, streamed once per frame into a uniform buffer.
+// The std140 layout has to match FrameUniforms in main.cpp, a mat3 is padded to three vec4 columns.
+layout(std140) uniform FrameUniforms
+{
+    mat3 xyzMultipliers;
+    vec3 flatColor;
+    // Added after xyzMultipliers, to centre a loaded mesh
+    vec3 meshOffset;
+    // The camera, applied after each instance's own transform
+    mat4 viewProjection;
+};
@@ -0,0 +1,10 @@
+// Per instance attributes, the rows of the instance's 3x4 transform and a colour to tint by
+layout(location = 2) in vec4 iTransformRow0;
+layout(location = 3) in vec4 iTransformRow1;
+layout(location = 4) in vec4 iTransformRow2;
+layout(location = 5) in vec4 iColor;
+
+vec4 transform_instance(vec4 position)
+{
+    return vec4(dot(iTransformRow0, position), dot(iTransformRow1, position), dot(iTransformRow2, position), 1.0);
+}
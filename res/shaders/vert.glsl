@@ -1,15 +1,39 @@
 #version 410 core
 
+// Variants of this shader are built by ShaderHelper with these defines:
+//   INSTANCED      Transform each instance by its own per instance transform
+//   INSTANCE_TINT  Tint each instance by its own colour (requires INSTANCED)
+//   VERTEX_COLOUR  Use the per vertex colours, otherwise every vertex is flatColor
+
 layout(location = 0) in vec3 vPosition;
+
+#ifdef VERTEX_COLOUR
 layout(location = 1) in vec3 vColor;
+#endif
 
-out vec4 color;
+#include "frame_uniforms.glsl"
 
-uniform mat3 xyzMultipliers;
+#ifdef INSTANCED
+#include "instancing.glsl"
+#endif
+
+out vec4 color;
 
 void main()
 {
-    gl_Position = vec4(xyzMultipliers * vPosition, 1.0);
+    vec4 position = vec4(xyzMultipliers * vPosition + meshOffset, 1.0);
+#ifdef INSTANCED
+    gl_Position = viewProjection * transform_instance(position);
+#else
+    gl_Position = viewProjection * position;
+#endif
 
+#ifdef VERTEX_COLOUR
     color = vec4( vColor, 1.0 );
+#else
+    color = vec4( flatColor, 1.0 );
+#endif
+#ifdef INSTANCE_TINT
+    color *= iColor;
+#endif
 }
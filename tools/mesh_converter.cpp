@@ -0,0 +1,131 @@
+// Converts OBJ and PLY meshes into the binary mesh files that the app maps and uploads with --mesh, so that no text is
+// parsed at startup.
+//
+// There is no build target for this, compile it alongside the helpers, with optimisations, e.g.
+//     g++ -O2 -std=c++17 -pthread -I. -I<glm include dir> -I<glad include dir> tools/mesh_converter.cpp helpers/MeshFile.cpp helpers/MeshImporter.cpp helpers/MeshSimplifier.cpp helpers/MeshBuilder.cpp -o mesh_converter
+// and run it as
+//     mesh_converter <input .obj or .ply> <output file> [--compact] [--threads <count>] [--lods <count>]
+// --compact stores the vertices as CompactVertex, which is only accurate for meshes within a few units of the origin.
+// --lods is the most levels of detail to build and store in the file, including the original (default 4, 1 for none).
+// They're built here rather than when the file is loaded, so that loading it stays a straight copy from a mapping.
+// Building them holds the positions and indices in memory, unlike the rest of the conversion.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../helpers/MeshFile.h"
+#include "../helpers/MeshImporter.h"
+#include "../helpers/MeshSimplifier.h"
+#include "../helpers/VertexFormat.h"
+
+static_assert(MeshSimplifier::MAX_LODS <= (int) MESH_FILE_MAX_LODS, "A mesh file can't store every level of detail");
+
+// Build the levels of detail of a converted mesh file, from the positions and indices in it, and store them in it
+static bool build_lods(const std::string& path, int lod_count) {
+    std::vector<glm::vec3> positions;
+    std::vector<uint> indices;
+    {
+        MappedMeshFile file;
+        if (!file.open(path)) {
+            return false;
+        }
+        const MeshFileHeader& header = file.get_header();
+        positions.resize(header.vertex_count);
+        for (size_t i = 0; i < positions.size(); i++) {
+            if (header.vertex_format == MeshVertexFormat::Compact) {
+                positions[i] = unpack_position(static_cast<const CompactVertex*>(file.get_vertices())[i].position);
+            } else {
+                positions[i] = static_cast<const Vertex*>(file.get_vertices())[i].position;
+            }
+        }
+        indices.assign(file.get_indices(), file.get_indices() + header.index_count);
+    }
+
+    MeshSimplifyStats stats;
+    MeshLodChain chain = MeshSimplifier::build_lod_chain(positions, indices, lod_count, 0.5f, &stats);
+    std::cout << "LODs: " << chain.lods.size() << " levels in " << stats.build_ms << " ms (" << stats.passes
+              << " passes, " << stats.collapses << " collapses, " << stats.rejected_flips << " rejected flips)" << std::endl;
+    std::vector<MeshFileLod> lods;
+    for (size_t lod = 0; lod < chain.lods.size(); lod++) {
+        const MeshLod& mesh_lod = chain.lods[lod];
+        std::cout << "  LOD " << lod << ": " << mesh_lod.index_count / 3 << " triangles, error " << mesh_lod.error << std::endl;
+        lods.push_back({mesh_lod.first_index, mesh_lod.index_count, mesh_lod.error, 0});
+    }
+    return MeshFileWriter::write_lods(path, chain.indices, lods);
+}
+
+// Removes the output file and the writer's temporary index file when it goes out of scope, unless the conversion
+// finished, so that a failed conversion never leaves a truncated mesh file behind
+struct OutputCleanup {
+    std::string output;
+    std::string index_path;
+    bool keep = false;
+
+    ~OutputCleanup() {
+        if (!keep) {
+            std::remove(output.c_str());
+            std::remove(index_path.c_str());
+        }
+    }
+};
+
+int main(int argc, char** argv) {
+    std::string input;
+    std::string output;
+    MeshVertexFormat format = MeshVertexFormat::Float;
+    int thread_count = (int) std::max(1u, std::thread::hardware_concurrency());
+    int lod_count = 4;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--compact") == 0) {
+            format = MeshVertexFormat::Compact;
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--lods") == 0 && i + 1 < argc) {
+            lod_count = std::clamp(std::atoi(argv[++i]), 1, MeshSimplifier::MAX_LODS);
+        } else if (input.empty()) {
+            input = argv[i];
+        } else if (output.empty()) {
+            output = argv[i];
+        } else {
+            input.clear();
+            break;
+        }
+    }
+    if (input.empty() || output.empty() || thread_count < 1) {
+        std::cerr << "Usage: " << argv[0] << " <input .obj or .ply> <output file> [--compact] [--threads <count>]"
+                  << " [--lods <count>]" << std::endl;
+        return 1;
+    }
+
+    // Declared before the writer, so that the writer's files are closed by the time they're removed
+    OutputCleanup cleanup;
+    cleanup.output = output;
+    MeshFileWriter writer;
+    bool opened = writer.open(output, format);
+    // open() names the index file even if it fails to create it
+    cleanup.index_path = writer.get_index_path();
+    if (!opened) {
+        return 1;
+    }
+    MeshImportStats stats;
+    if (!MeshImporter::import(input, writer, thread_count, &stats) || !writer.finish()
+        || (lod_count > 1 && !build_lods(output, lod_count))) {
+        std::cerr << "Failed to convert " << input << std::endl;
+        return 1;
+    }
+    cleanup.keep = true;
+
+    double megabytes = (double) stats.bytes_read / (1024.0 * 1024.0);
+    std::cout << "Converted " << input << " to " << output << " with " << thread_count << " threads" << std::endl;
+    std::cout << "Vertices: " << stats.vertices << ", triangles: " << stats.triangles << std::endl;
+    std::cout << "Read " << megabytes << " MiB in " << stats.seconds << " s (" << megabytes / stats.seconds << " MiB/s)"
+              << std::endl;
+    return 0;
+}